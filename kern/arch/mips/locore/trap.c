@@ -148,6 +148,11 @@ mips_trap(struct trapframe *tf)
 						+ STACK_SIZE));
 	}
 
+	/* Stop charging user time to the current thread. */
+	if (!iskern) {
+		thread_acct_enterkernel();
+	}
+
 	/* Interrupt? Call the interrupt handler and return. */
 	if (code == EX_IRQ) {
 		int old_in;
@@ -321,6 +326,11 @@ mips_trap(struct trapframe *tf)
 	cpu_irqoff();
  done2:
 
+	/* Going back to user mode; charge the time here as system time. */
+	if (!iskern) {
+		thread_acct_exitkernel();
+	}
+
 	/*
 	 * The boot thread can get here (e.g. on interrupt return) but
 	 * since it doesn't go to userlevel, it can't be returning to
@@ -396,6 +406,8 @@ mips_usermode(struct trapframe *tf)
 	 */
 	KASSERT(SAME_STACK(cpustacks[curcpu->c_number]-1, (vaddr_t)tf));
 
+	thread_acct_exitkernel();
+
 	/*
 	 * This actually does it. See exception.S.
 	 */
@@ -35,6 +35,8 @@
 #include <thread.h>
 #include <current.h>
 #include <syscall.h>
+#include <copyinout.h>
+#include <endian.h>
 
 #include "opt-A2.h" /* required for A2 */
 
@@ -82,6 +84,13 @@ syscall(struct trapframe *tf)
 	int callno;
 	int32_t retval;
 	int err;
+#if OPT_A2
+	uint64_t pos;
+	int whence;
+	userptr_t timeout;
+	off_t retval64;
+	bool is64 = false;
+#endif /* OPT_A2 */
 
 	KASSERT(curthread != NULL);
 	KASSERT(curthread->t_curspl == 0);
@@ -109,6 +118,20 @@ syscall(struct trapframe *tf)
 		err = sys___time((userptr_t)tf->tf_a0,
 				 (userptr_t)tf->tf_a1);
 		break;
+
+	    case SYS_nanosleep:
+		err = sys_nanosleep((userptr_t)tf->tf_a0,
+				    (userptr_t)tf->tf_a1);
+		break;
+
+	    case SYS_futex:
+		err = sys_futex((userptr_t)tf->tf_a0, tf->tf_a1, tf->tf_a2,
+				&retval);
+		break;
+
+	    case SYS_getrusage:
+		err = sys_getrusage(tf->tf_a0, (userptr_t)tf->tf_a1);
+		break;
 #ifdef UW
 	case SYS_write:
 	  err = sys_write((int)tf->tf_a0,
@@ -137,10 +160,110 @@ syscall(struct trapframe *tf)
 	case SYS_fork:
 		err = sys_fork(tf, (pid_t *)&retval);
 		break;
+	case SYS_vfork:
+		err = sys_vfork(tf, (pid_t *)&retval);
+		break;
+	case SYS___spawn:
+		err = sys___spawn((userptr_t)tf->tf_a0,
+				  (userptr_t)tf->tf_a1,
+				  (pid_t *)&retval);
+		break;
 	case SYS_execv:
 		err = sys_execv((userptr_t)tf->tf_a0,
 				(userptr_t)tf->tf_a1);
 		break;
+
+	case SYS_open:
+		err = sys_open((userptr_t)tf->tf_a0, tf->tf_a1, tf->tf_a2,
+			       &retval);
+		break;
+	case SYS_read:
+		err = sys_read(tf->tf_a0, (userptr_t)tf->tf_a1, tf->tf_a2,
+			       &retval);
+		break;
+	case SYS_pread:
+	case SYS_pwrite:
+	case SYS_preadv:
+	case SYS_pwritev:
+		/* pos is on the stack, since a3 can't start a pair */
+		err = copyin((userptr_t)(tf->tf_sp + 16), &pos, sizeof(pos));
+		if (err) {
+			break;
+		}
+		switch (callno) {
+		    case SYS_pread:
+			err = sys_pread(tf->tf_a0, (userptr_t)tf->tf_a1,
+					tf->tf_a2, pos, &retval);
+			break;
+		    case SYS_pwrite:
+			err = sys_pwrite(tf->tf_a0, (userptr_t)tf->tf_a1,
+					 tf->tf_a2, pos, &retval);
+			break;
+		    case SYS_preadv:
+			err = sys_preadv(tf->tf_a0, (userptr_t)tf->tf_a1,
+					 tf->tf_a2, pos, &retval);
+			break;
+		    case SYS_pwritev:
+			err = sys_pwritev(tf->tf_a0, (userptr_t)tf->tf_a1,
+					  tf->tf_a2, pos, &retval);
+			break;
+		}
+		break;
+	case SYS_readv:
+		err = sys_readv(tf->tf_a0, (userptr_t)tf->tf_a1, tf->tf_a2,
+				&retval);
+		break;
+	case SYS_writev:
+		err = sys_writev(tf->tf_a0, (userptr_t)tf->tf_a1, tf->tf_a2,
+				 &retval);
+		break;
+	case SYS_close:
+		err = sys_close(tf->tf_a0);
+		break;
+	case SYS_lseek:
+		/* fd in a0, pos in a2/a3, whence on the stack */
+		join32to64(tf->tf_a2, tf->tf_a3, &pos);
+		err = copyin((userptr_t)(tf->tf_sp + 16), &whence,
+			     sizeof(whence));
+		if (err) {
+			break;
+		}
+		err = sys_lseek(tf->tf_a0, pos, whence, &retval64);
+		is64 = true;
+		break;
+	case SYS_dup2:
+		err = sys_dup2(tf->tf_a0, tf->tf_a1, &retval);
+		break;
+	case SYS_fsync:
+		err = sys_fsync(tf->tf_a0);
+		break;
+	case SYS_ioctl:
+		err = sys_ioctl(tf->tf_a0, tf->tf_a1, (userptr_t)tf->tf_a2);
+		break;
+	case SYS_pipe:
+		err = sys_pipe((userptr_t)tf->tf_a0);
+		break;
+	case SYS_poll:
+		err = sys_poll((userptr_t)tf->tf_a0, tf->tf_a1, tf->tf_a2,
+			       &retval);
+		break;
+	case SYS_select:
+		/* the timeout is the fifth argument, on the stack */
+		err = copyin((userptr_t)(tf->tf_sp + 16), &timeout,
+			     sizeof(timeout));
+		if (err) {
+			break;
+		}
+		err = sys_select(tf->tf_a0, (userptr_t)tf->tf_a1,
+				 (userptr_t)tf->tf_a2, (userptr_t)tf->tf_a3,
+				 timeout, &retval);
+		break;
+	case SYS_ring_setup:
+		err = sys_ring_setup((userptr_t)tf->tf_a0, tf->tf_a1);
+		break;
+	case SYS_ring_enter:
+		err = sys_ring_enter(tf->tf_a0, &retval);
+		break;
 #endif /* OPT_A2 */
  
 	default:
@@ -159,6 +282,13 @@ syscall(struct trapframe *tf)
 		tf->tf_v0 = err;
 		tf->tf_a3 = 1;      /* signal an error */
 	}
+#if OPT_A2
+	else if (is64) {
+		/* Success, with a 64-bit value in v0/v1. */
+		split64to32(retval64, &tf->tf_v0, &tf->tf_v1);
+		tf->tf_a3 = 0;      /* signal no error */
+	}
+#endif /* OPT_A2 */
 	else {
 		/* Success. */
 		tf->tf_v0 = retval;
@@ -199,14 +329,14 @@ enter_forked_process(void *tf, unsigned long stub)
 	tf_c.tf_a3 = 0;      /* no error */
 	tf_c.tf_epc += 4;    /* increase the program counter */
 
-	/* return to user mode */
-	mips_usermode(&tf_c);
-
-	/* delete the trapframe copy on OS heap after we've done */
+	/* delete the trapframe copy on OS heap; mips_usermode doesn't return */
 	kfree(tf);
 
 	/* dummy to avoid warning */
 	(void)stub;
+
+	/* return to user mode */
+	mips_usermode(&tf_c);
 }
 #else
 void
@@ -52,20 +52,21 @@
  */
 
 /* under dumbvm, always have 48k of user stack */
-#define DUMBVM_STACKPAGES    12
+#define DUMBVM_STACKPAGES    VM_STACKPAGES
 
 #if OPT_A3
 unsigned long numpages;           				/* total number of pages in core-map */
 paddr_t page_start;								/* start address of pages */
 paddr_t coremap;           						/* core-map that stores the page segments */
 bool core_created = false;                      /* indicate if core-map has been created */
-static struct spinlock core_lock = SPINLOCK_INITIALIZER;        /* core-map lock */
+/* core-map lock */
+static struct spinlock core_lock = SPINLOCK_NAMED_INITIALIZER("coremap");
 #endif /* OPT_A3 */
 
 /*
  * Wrap rma_stealmem in a spinlock.
  */
-static struct spinlock stealmem_lock = SPINLOCK_INITIALIZER;
+static struct spinlock stealmem_lock = SPINLOCK_NAMED_INITIALIZER("stealmem");
 
 
 #if OPT_A3
@@ -571,6 +572,45 @@ as_define_stack(struct addrspace *as, vaddr_t *stackptr)
 	return 0;
 }
 
+int
+as_translate(struct addrspace *as, vaddr_t va, bool write, paddr_t *ret)
+{
+	vaddr_t vbase1, vtop1, vbase2, vtop2, stackbase, stacktop;
+
+	if (as == NULL || as->as_stackpbase == 0) {
+		return EFAULT;
+	}
+
+	vbase1 = as->as_vbase1;
+	vtop1 = vbase1 + as->as_npages1 * PAGE_SIZE;
+	vbase2 = as->as_vbase2;
+	vtop2 = vbase2 + as->as_npages2 * PAGE_SIZE;
+	stackbase = USERSTACK - DUMBVM_STACKPAGES * PAGE_SIZE;
+	stacktop = USERSTACK;
+
+	if (va >= vbase1 && va < vtop1) {
+		#if OPT_A3
+		/* same rule vm_fault applies: code is read-only once loaded */
+		if (write && as->hasLoaded) {
+			return EFAULT;
+		}
+		#else
+		(void)write;
+		#endif /* OPT_A3 */
+		*ret = (va - vbase1) + as->as_pbase1;
+	}
+	else if (va >= vbase2 && va < vtop2) {
+		*ret = (va - vbase2) + as->as_pbase2;
+	}
+	else if (va >= stackbase && va < stacktop) {
+		*ret = (va - stackbase) + as->as_stackpbase;
+	}
+	else {
+		return EFAULT;
+	}
+	return 0;
+}
+
 int
 as_copy(struct addrspace *old, struct addrspace **ret)
 {
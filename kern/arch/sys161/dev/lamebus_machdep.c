@@ -38,6 +38,7 @@
 #include <current.h>
 #include <synch.h>
 #include <mainbus.h>
+#include <platform/maxcpus.h>
 #include <sys161/bus.h>
 #include <lamebus/lamebus.h>
 #include "autoconf.h"
@@ -73,6 +74,64 @@ mips_timer_set(uint32_t count)
 		:: "r" (count));
 }
 
+/*
+ * Reset the cycle counter. $9 == c0_count.
+ */
+static
+void
+mips_timer_setcount(uint32_t count)
+{
+	__asm volatile(
+		".set push;"		/* save assembler mode */
+		".set mips32;"		/* allow MIPS32 registers */
+		"mtc0 %0, $9;"		/* do it */
+		".set pop"		/* restore assembler mode */
+		:: "r" (count));
+}
+
+/*
+ * Read the cycle counter. $9 == c0_count.
+ */
+static
+uint32_t
+mips_timer_getcount(void)
+{
+	uint32_t count;
+
+	__asm volatile(
+		".set push;"		/* save assembler mode */
+		".set mips32;"		/* allow MIPS32 registers */
+		"mfc0 %0, $9;"		/* do it */
+		".set pop"		/* restore assembler mode */
+		: "=r" (count));
+	return count;
+}
+
+/*
+ * c0_count goes back to zero whenever it reaches c0_compare (and when
+ * we reset it for idling), so to get a running cycle count per cpu we
+ * add up what it had reached each time that happens. timerperiod is
+ * the compare value currently loaded; 0 means the usual CPU_FREQUENCY
+ * / HZ. Both are only touched by their own cpu with interrupts off.
+ */
+static uint64_t cyclebase[MAXCPUS];
+static uint32_t timerperiod[MAXCPUS];
+
+/*
+ * Fold the cycles counted so far into cyclebase and load a new period.
+ */
+static
+void
+mips_timer_restart(uint32_t period)
+{
+	unsigned n = curcpu->c_number;
+
+	cyclebase[n] += mips_timer_getcount();
+	mips_timer_setcount(0);
+	timerperiod[n] = period;
+	mips_timer_set(period);
+}
+
 /*
  * LAMEbus data for the system. (We have only one LAMEbus per system.)
  * This does not need to be locked, because it's constant once
@@ -233,6 +292,51 @@ mainbus_ramsize(void)
 	return lamebus_ramsize();
 }
 
+/*
+ * Stop the periodic clock interrupt for an idle cpu. Restart the
+ * count so the compare register measures from now.
+ */
+void
+mainbus_timer_idle(uint32_t usecs)
+{
+	uint64_t cycles;
+
+	cycles = (uint64_t)usecs * (CPU_FREQUENCY / 1000000);
+	if (cycles == 0) {
+		cycles = 1;
+	}
+	else if (cycles > 0xffffffff) {
+		cycles = 0xffffffff;
+	}
+	mips_timer_restart(cycles);
+}
+
+/*
+ * Restart the periodic clock interrupt after idling.
+ */
+void
+mainbus_timer_resume(void)
+{
+	mips_timer_restart(CPU_FREQUENCY / HZ);
+}
+
+/*
+ * Cycles run by the current cpu since it started. Interrupts must be
+ * off so a timer interrupt can't fold the count in between the two
+ * reads.
+ */
+uint64_t
+mainbus_cycles(void)
+{
+	return cyclebase[curcpu->c_number] + mips_timer_getcount();
+}
+
+uint32_t
+mainbus_cyclehz(void)
+{
+	return CPU_FREQUENCY;
+}
+
 /*
  * Send IPI.
  */
@@ -268,7 +372,15 @@ mainbus_interrupt(struct trapframe *tf)
 		lamebus_clear_ipi(lamebus, curcpu);
 	}
 	else if (cause & MIPS_TIMER_BIT) {
-		/* Reset the timer (this clears the interrupt) */
+		/*
+		 * The count went back to zero on reaching the compare
+		 * value; account for the cycles, then reset the timer
+		 * (this clears the interrupt).
+		 */
+		cyclebase[curcpu->c_number] +=
+			timerperiod[curcpu->c_number] != 0 ?
+			timerperiod[curcpu->c_number] : CPU_FREQUENCY / HZ;
+		timerperiod[curcpu->c_number] = CPU_FREQUENCY / HZ;
 		mips_timer_set(CPU_FREQUENCY / HZ);
 		/* and call hardclock */
 		hardclock();
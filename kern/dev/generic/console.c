@@ -52,6 +52,7 @@
 
 #include <types.h>
 #include <kern/errno.h>
+#include <kern/poll.h>
 #include <lib.h>
 #include <uio.h>
 #include <thread.h>
@@ -194,6 +195,7 @@ con_input(void *vcs, int ch)
 	cs->cs_gotchars_head = nexthead;
 		
 	V(cs->cs_rsem);
+	pollwakeup(&cs->cs_pollhead, POLLIN | POLLRDNORM);
 }
 
 /*
@@ -360,6 +362,31 @@ con_ioctl(struct device *dev, int op, userptr_t data)
 	return EINVAL;
 }
 
+/*
+ * Input is ready if there's a character in the buffer. The pollent
+ * is registered before looking, and con_input calls pollwakeup after
+ * adding a character, so a character can't slip in between unseen.
+ * Output is always ready.
+ */
+static
+int
+con_poll(struct device *dev, int events, struct pollent *pe, int *revents)
+{
+	struct con_softc *cs = dev->d_data;
+	int ready;
+
+	if (pe != NULL) {
+		pollhead_add(&cs->cs_pollhead, pe);
+	}
+
+	ready = POLLOUT | POLLWRNORM;
+	if (cs->cs_gotchars_head != cs->cs_gotchars_tail) {
+		ready |= POLLIN | POLLRDNORM;
+	}
+	*revents = events & ready;
+	return 0;
+}
+
 static
 int
 attach_console_to_vfs(struct con_softc *cs)
@@ -376,6 +403,7 @@ attach_console_to_vfs(struct con_softc *cs)
 	dev->d_close = con_close;
 	dev->d_io = con_io;
 	dev->d_ioctl = con_ioctl;
+	dev->d_poll = con_poll;
 	dev->d_blocks = 0;
 	dev->d_blocksize = 1;
 	dev->d_data = cs;
@@ -441,6 +469,7 @@ config_con(struct con_softc *cs, int unit)
 	cs->cs_wsem = wsem; 
 	cs->cs_gotchars_head = 0;
 	cs->cs_gotchars_tail = 0;
+	pollhead_init(&cs->cs_pollhead);
 
 	the_console = cs;
 	con_userlock_read = rlk;
@@ -43,6 +43,7 @@
 #include <types.h>
 #include <kern/errno.h>
 #include <kern/fcntl.h>
+#include <kern/poll.h>
 #include <stat.h>
 #include <lib.h>
 #include <array.h>
@@ -472,24 +473,28 @@ emufs_reclaim(struct vnode *v)
 	int result;
 
 	/*
-	 * Need both of these locks, e_lock to protect the device
-	 * and vfs_biglock to protect the fs-related material.
+	 * e_lock protects both the device and the vnode pool. Once we
+	 * hold it, emufs_loadvnode can't hand out another reference,
+	 * so if the count is still 1 the vnode is ours to destroy.
+	 * Otherwise someone found it again; drop the reference we
+	 * were passed.
 	 */
 
-	vfs_biglock_acquire();
 	lock_acquire(ef->ef_emu->e_lock);
 
-	if (ev->ev_v.vn_refcount != 1) {
+	spinlock_acquire(&v->vn_countlock);
+	if (v->vn_refcount != 1) {
+		v->vn_refcount--;
+		spinlock_release(&v->vn_countlock);
 		lock_release(ef->ef_emu->e_lock);
-		vfs_biglock_release();
 		return EBUSY;
 	}
+	spinlock_release(&v->vn_countlock);
 
 	/* emu_close retries on I/O error */
 	result = emu_close(ev->ev_emu, ev->ev_handle);
 	if (result) {
 		lock_release(ef->ef_emu->e_lock);
-		vfs_biglock_release();
 		return result;
 	}
 
@@ -513,7 +518,6 @@ emufs_reclaim(struct vnode *v)
 	VOP_CLEANUP(&ev->ev_v);
 
 	lock_release(ef->ef_emu->e_lock);
-	vfs_biglock_release();
 
 	kfree(ev);
 	return 0;
@@ -629,6 +633,22 @@ emufs_ioctl(struct vnode *v, int op, userptr_t data)
 	return EINVAL;
 }
 
+/*
+ * VOP_POLL
+ *
+ * Nothing here blocks for long, so everything is always ready.
+ */
+static
+int
+emufs_poll(struct vnode *v, int events, struct pollent *pe, int *revents)
+{
+	(void)v;
+	(void)pe;
+
+	*revents = events & (POLLIN | POLLRDNORM | POLLOUT | POLLWRNORM);
+	return 0;
+}
+
 /*
  * VOP_STAT
  */
@@ -1085,6 +1105,7 @@ static const struct vnode_ops emufs_fileops = {
 	emufs_uio_op_notdir, /* getdirentry */
 	emufs_write,
 	emufs_ioctl,
+	emufs_poll,
 	emufs_stat,
 	emufs_file_gettype,
 	emufs_tryseek,
@@ -1120,6 +1141,7 @@ static const struct vnode_ops emufs_dirops = {
 	emufs_getdirentry,
 	emufs_uio_op_isdir,   /* write */
 	emufs_ioctl,
+	emufs_poll,
 	emufs_stat,
 	emufs_dir_gettype,
 	emufs_dir_tryseek,
@@ -1153,7 +1175,6 @@ emufs_loadvnode(struct emufs_fs *ef, uint32_t handle, int isdir,
 	unsigned i, num;
 	int result;
 
-	vfs_biglock_acquire();
 	lock_acquire(ef->ef_emu->e_lock);
 
 	num = vnodearray_num(ef->ef_vnodes);
@@ -1166,7 +1187,6 @@ emufs_loadvnode(struct emufs_fs *ef, uint32_t handle, int isdir,
 			VOP_INCREF(&ev->ev_v);
 
 			lock_release(ef->ef_emu->e_lock);
-			vfs_biglock_release();
 			*ret = ev;
 			return 0;
 		}
@@ -1187,7 +1207,6 @@ emufs_loadvnode(struct emufs_fs *ef, uint32_t handle, int isdir,
 			   &ef->ef_fs, ev);
 	if (result) {
 		lock_release(ef->ef_emu->e_lock);
-		vfs_biglock_release();
 		kfree(ev);
 		return result;
 	}
@@ -1197,13 +1216,11 @@ emufs_loadvnode(struct emufs_fs *ef, uint32_t handle, int isdir,
 		/* note: VOP_CLEANUP undoes VOP_INIT - it does not kfree */
 		VOP_CLEANUP(&ev->ev_v);
 		lock_release(ef->ef_emu->e_lock);
-		vfs_biglock_release();
 		kfree(ev);
 		return result;
 	}
 
 	lock_release(ef->ef_emu->e_lock);
-	vfs_biglock_release();
 
 	*ret = ev;
 	return 0;
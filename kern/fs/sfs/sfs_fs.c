@@ -38,9 +38,11 @@
 #include <lib.h>
 #include <array.h>
 #include <bitmap.h>
+#include <synch.h>
 #include <uio.h>
 #include <vfs.h>
 #include <device.h>
+#include <buf.h>
 #include <sfs.h>
 
 /* Shortcuts for the size macros in kern/sfs.h */
@@ -101,6 +103,37 @@ sfs_mapio(struct sfs_fs *sfs, enum uio_rw rw)
 	return 0;
 }
 
+/*
+ * Write the free block bitmap, if it's changed, and make sure it's
+ * on disk and not just in the buffer cache. For fsync.
+ */
+int
+sfs_sync_freemap(struct sfs_fs *sfs)
+{
+	uint32_t j;
+	int result;
+
+	lock_acquire(sfs->sfs_freemaplock);
+	if (sfs->sfs_freemapdirty) {
+		result = sfs_mapio(sfs, UIO_WRITE);
+		if (result) {
+			lock_release(sfs->sfs_freemaplock);
+			return result;
+		}
+		sfs->sfs_freemapdirty = false;
+	}
+	lock_release(sfs->sfs_freemaplock);
+
+	for (j=0; j<SFS_FS_BITBLOCKS(sfs); j++) {
+		result = buffer_syncblock(sfs->sfs_device,
+					  SFS_MAP_LOCATION+j);
+		if (result) {
+			return result;
+		}
+	}
+	return 0;
+}
+
 /*
  * Sync routine. This is what gets invoked if you do FS_SYNC on the
  * sfs filesystem structure.
@@ -111,11 +144,10 @@ int
 sfs_sync(struct fs *fs)
 {
 	struct sfs_fs *sfs; 
+	struct vnode **vs;
 	unsigned i, num;
 	int result;
 
-	vfs_biglock_acquire();
-
 	/*
 	 * Get the sfs_fs from the generic abstract fs.
 	 *
@@ -148,18 +180,60 @@ sfs_sync(struct fs *fs)
 
 	sfs = fs->fs_data;
 
-	/* Go over the array of loaded vnodes, syncing as we go. */
-	num = vnodearray_num(sfs->sfs_vnodes);
+	/*
+	 * Go over the table of loaded vnodes, writing their inodes to
+	 * the buffer cache as we go. (Not VOP_FSYNC, which would push
+	 * each file's blocks out one at a time; buffer_syncdev below
+	 * writes everything, sorted.)
+	 *
+	 * Vnode locks come before sfs_vnlock, so take a reference to
+	 * each vnode under sfs_vnlock, which keeps it from being
+	 * reclaimed, and lock them one at a time afterwards.
+	 */
+	lock_acquire(sfs->sfs_vnlock);
+	vs = NULL;
+	num = 0;
+	if (sfs->sfs_nvnodes > sfs->sfs_ncached) {
+		vs = kmalloc((sfs->sfs_nvnodes - sfs->sfs_ncached) *
+			     sizeof(*vs));
+		if (vs == NULL) {
+			lock_release(sfs->sfs_vnlock);
+			return ENOMEM;
+		}
+	}
+	for (i=0; i<SFS_VNHASHSIZE; i++) {
+		struct sfs_vnode *sv;
+
+		for (sv = sfs->sfs_vnhash[i]; sv; sv = sv->sv_hashnext) {
+			/* Cached ones were synced when they were released */
+			if (!sv->sv_cached) {
+				vs[num++] = &sv->sv_v;
+				VOP_INCREF(&sv->sv_v);
+			}
+		}
+	}
+	KASSERT(num == sfs->sfs_nvnodes - sfs->sfs_ncached);
+	lock_release(sfs->sfs_vnlock);
+
 	for (i=0; i<num; i++) {
-		struct vnode *v = vnodearray_get(sfs->sfs_vnodes, i);
-		VOP_FSYNC(v);
+		struct sfs_vnode *sv = vs[i]->vn_data;
+
+		lock_acquire(sv->sv_lock);
+		sfs_sync_inode(sv);
+		lock_release(sv->sv_lock);
+		VOP_DECREF(vs[i]);
+	}
+	if (vs != NULL) {
+		kfree(vs);
 	}
 
+	lock_acquire(sfs->sfs_freemaplock);
+
 	/* If the free block map needs to be written, write it. */
 	if (sfs->sfs_freemapdirty) {
 		result = sfs_mapio(sfs, UIO_WRITE);
 		if (result) {
-			vfs_biglock_release();
+			lock_release(sfs->sfs_freemaplock);
 			return result;
 		}
 		sfs->sfs_freemapdirty = false;
@@ -169,14 +243,16 @@ sfs_sync(struct fs *fs)
 	if (sfs->sfs_superdirty) {
 		result = sfs_wblock(sfs, &sfs->sfs_super, SFS_SB_LOCATION);
 		if (result) {
-			vfs_biglock_release();
+			lock_release(sfs->sfs_freemaplock);
 			return result;
 		}
 		sfs->sfs_superdirty = false;
 	}
 
-	vfs_biglock_release();
-	return 0;
+	lock_release(sfs->sfs_freemaplock);
+
+	/* Write out anything still dirty in the buffer cache. */
+	return buffer_syncdev(sfs->sfs_device);
 }
 
 /*
@@ -189,13 +265,9 @@ const char *
 sfs_getvolname(struct fs *fs)
 {
 	struct sfs_fs *sfs = fs->fs_data;
-	const char *ret;
-
-	vfs_biglock_acquire();
-	ret = sfs->sfs_super.sp_volname;
-	vfs_biglock_release();
 
-	return ret;
+	/* Set at mount and never changed; no lock needed. */
+	return sfs->sfs_super.sp_volname;
 }
 
 /*
@@ -208,22 +280,33 @@ int
 sfs_unmount(struct fs *fs)
 {
 	struct sfs_fs *sfs = fs->fs_data;
+	int result;
 
-	vfs_biglock_acquire();
-	
-	/* Do we have any files open? If so, can't unmount. */
-	if (vnodearray_num(sfs->sfs_vnodes) > 0) {
-		vfs_biglock_release();
-		return EBUSY;
+	/*
+	 * Do we have any files open? If so, can't unmount. Otherwise
+	 * free the vnodes that are only cached. VFS holds
+	 * knowndevs_lock, so once there are none nobody can get to
+	 * the filesystem to load another.
+	 */
+	result = sfs_dropvnodes(sfs);
+	if (result) {
+		return result;
 	}
 
 	/* We should have just had sfs_sync called. */
 	KASSERT(sfs->sfs_superdirty == false);
 	KASSERT(sfs->sfs_freemapdirty == false);
 
+	/* Drop our blocks from the buffer cache. */
+	result = buffer_dropdev(sfs->sfs_device);
+	if (result) {
+		return result;
+	}
+
 	/* Once we start nuking stuff we can't fail. */
-	vnodearray_destroy(sfs->sfs_vnodes);
 	bitmap_destroy(sfs->sfs_freemap);
+	lock_destroy(sfs->sfs_freemaplock);
+	lock_destroy(sfs->sfs_vnlock);
 	
 	/* The vfs layer takes care of the device for us */
 	(void)sfs->sfs_device;
@@ -232,7 +315,6 @@ sfs_unmount(struct fs *fs)
 	kfree(sfs);
 
 	/* nothing else to do */
-	vfs_biglock_release();
 	return 0;
 }
 
@@ -255,10 +337,9 @@ int
 sfs_domount(void *options, struct device *dev, struct fs **ret)
 {
 	int result;
+	unsigned i;
 	struct sfs_fs *sfs;
 
-	vfs_biglock_acquire();
-
 	/* We don't pass any options through mount */
 	(void)options;
 
@@ -268,6 +349,7 @@ sfs_domount(void *options, struct device *dev, struct fs **ret)
 	KASSERT(sizeof(struct sfs_super)==SFS_BLOCKSIZE);
 	KASSERT(sizeof(struct sfs_inode)==SFS_BLOCKSIZE);
 	KASSERT(SFS_BLOCKSIZE % sizeof(struct sfs_dir) == 0);
+	KASSERT(SFS_BLOCKSIZE == BUF_SIZE);
 
 	/*
 	 * We can't mount on devices with the wrong sector size.
@@ -278,22 +360,32 @@ sfs_domount(void *options, struct device *dev, struct fs **ret)
 	 * don't do that in sfs.)
 	 */
 	if (dev->d_blocksize != SFS_BLOCKSIZE) {
-		vfs_biglock_release();
 		return ENXIO;
 	}
 
 	/* Allocate object */
 	sfs = kmalloc(sizeof(struct sfs_fs));
 	if (sfs==NULL) {
-		vfs_biglock_release();
 		return ENOMEM;
 	}
 
-	/* Allocate array */
-	sfs->sfs_vnodes = vnodearray_create();
-	if (sfs->sfs_vnodes == NULL) {
+	/* Set up the vnode table, and allocate locks */
+	for (i=0; i<SFS_VNHASHSIZE; i++) {
+		sfs->sfs_vnhash[i] = NULL;
+	}
+	sfs->sfs_nvnodes = 0;
+	sfs->sfs_ncached = 0;
+	sfs->sfs_lruhead = sfs->sfs_lrutail = NULL;
+
+	sfs->sfs_vnlock = lock_create("sfs vnodes");
+	if (sfs->sfs_vnlock == NULL) {
+		kfree(sfs);
+		return ENOMEM;
+	}
+	sfs->sfs_freemaplock = lock_create("sfs freemap");
+	if (sfs->sfs_freemaplock == NULL) {
+		lock_destroy(sfs->sfs_vnlock);
 		kfree(sfs);
-		vfs_biglock_release();
 		return ENOMEM;
 	}
 
@@ -303,9 +395,9 @@ sfs_domount(void *options, struct device *dev, struct fs **ret)
 	/* Load superblock */
 	result = sfs_rblock(sfs, &sfs->sfs_super, SFS_SB_LOCATION);
 	if (result) {
-		vnodearray_destroy(sfs->sfs_vnodes);
+		lock_destroy(sfs->sfs_freemaplock);
+		lock_destroy(sfs->sfs_vnlock);
 		kfree(sfs);
-		vfs_biglock_release();
 		return result;
 	}
 
@@ -316,9 +408,10 @@ sfs_domount(void *options, struct device *dev, struct fs **ret)
 			"(0x%x, should be 0x%x)\n", 
 			sfs->sfs_super.sp_magic,
 			SFS_MAGIC);
-		vnodearray_destroy(sfs->sfs_vnodes);
+		buffer_dropdev(dev);
+		lock_destroy(sfs->sfs_freemaplock);
+		lock_destroy(sfs->sfs_vnlock);
 		kfree(sfs);
-		vfs_biglock_release();
 		return EINVAL;
 	}
 	
@@ -333,17 +426,19 @@ sfs_domount(void *options, struct device *dev, struct fs **ret)
 	/* Load free space bitmap */
 	sfs->sfs_freemap = bitmap_create(SFS_FS_BITMAPSIZE(sfs));
 	if (sfs->sfs_freemap == NULL) {
-		vnodearray_destroy(sfs->sfs_vnodes);
+		buffer_dropdev(dev);
+		lock_destroy(sfs->sfs_freemaplock);
+		lock_destroy(sfs->sfs_vnlock);
 		kfree(sfs);
-		vfs_biglock_release();
 		return ENOMEM;
 	}
 	result = sfs_mapio(sfs, UIO_READ);
 	if (result) {
+		buffer_dropdev(dev);
 		bitmap_destroy(sfs->sfs_freemap);
-		vnodearray_destroy(sfs->sfs_vnodes);
+		lock_destroy(sfs->sfs_freemaplock);
+		lock_destroy(sfs->sfs_vnlock);
 		kfree(sfs);
-		vfs_biglock_release();
 		return result;
 	}
 
@@ -361,7 +456,6 @@ sfs_domount(void *options, struct device *dev, struct fs **ret)
 	/* Hand back the abstract fs */
 	*ret = &sfs->sfs_absfs;
 
-	vfs_biglock_release();
 	return 0;
 }
 
@@ -35,6 +35,7 @@
 #include <types.h>
 #include <kern/errno.h>
 #include <kern/fcntl.h>
+#include <kern/poll.h>
 #include <stat.h>
 #include <lib.h>
 #include <array.h>
@@ -43,11 +44,169 @@
 #include <synch.h>
 #include <vfs.h>
 #include <device.h>
+#include <buf.h>
+#include <namecache.h>
 #include <sfs.h>
 
 /* At bottom of file */
 static int sfs_loadvnode(struct sfs_fs *sfs, uint32_t ino, int type,
 			 struct sfs_vnode **ret);
+/* Further down */
+static int sfs_dotruncate(struct sfs_vnode *sv, off_t len);
+
+////////////////////////////////////////////////////////////
+//
+// Vnode table
+
+static
+unsigned
+sfs_vnhashfunc(uint32_t ino)
+{
+	return ino & (SFS_VNHASHSIZE - 1);
+}
+
+/*
+ * Find a loaded vnode by inode number.
+ */
+static
+struct sfs_vnode *
+sfs_vnfind(struct sfs_fs *sfs, uint32_t ino)
+{
+	struct sfs_vnode *sv;
+
+	KASSERT(lock_do_i_hold(sfs->sfs_vnlock));
+
+	sv = sfs->sfs_vnhash[sfs_vnhashfunc(ino)];
+	for (; sv != NULL; sv = sv->sv_hashnext) {
+		if (sv->sv_ino == ino) {
+			return sv;
+		}
+	}
+	return NULL;
+}
+
+static
+void
+sfs_vninsert(struct sfs_fs *sfs, struct sfs_vnode *sv)
+{
+	unsigned h = sfs_vnhashfunc(sv->sv_ino);
+
+	KASSERT(lock_do_i_hold(sfs->sfs_vnlock));
+
+	sv->sv_hashnext = sfs->sfs_vnhash[h];
+	sfs->sfs_vnhash[h] = sv;
+	sfs->sfs_nvnodes++;
+}
+
+static
+void
+sfs_vnremove(struct sfs_fs *sfs, struct sfs_vnode *sv)
+{
+	struct sfs_vnode **pp;
+
+	KASSERT(lock_do_i_hold(sfs->sfs_vnlock));
+
+	pp = &sfs->sfs_vnhash[sfs_vnhashfunc(sv->sv_ino)];
+	while (*pp != sv) {
+		if (*pp == NULL) {
+			panic("sfs: vnode %u not in vnode table\n",
+			      sv->sv_ino);
+		}
+		pp = &(*pp)->sv_hashnext;
+	}
+	*pp = sv->sv_hashnext;
+	sv->sv_hashnext = NULL;
+	sfs->sfs_nvnodes--;
+}
+
+/*
+ * Put a newly unreferenced vnode at the head of the LRU list.
+ */
+static
+void
+sfs_lruinsert(struct sfs_fs *sfs, struct sfs_vnode *sv)
+{
+	KASSERT(lock_do_i_hold(sfs->sfs_vnlock));
+	KASSERT(!sv->sv_cached);
+
+	sv->sv_lruprev = NULL;
+	sv->sv_lrunext = sfs->sfs_lruhead;
+	if (sfs->sfs_lruhead != NULL) {
+		sfs->sfs_lruhead->sv_lruprev = sv;
+	}
+	else {
+		sfs->sfs_lrutail = sv;
+	}
+	sfs->sfs_lruhead = sv;
+	sv->sv_cached = true;
+	sfs->sfs_ncached++;
+}
+
+static
+void
+sfs_lruremove(struct sfs_fs *sfs, struct sfs_vnode *sv)
+{
+	KASSERT(lock_do_i_hold(sfs->sfs_vnlock));
+	KASSERT(sv->sv_cached);
+
+	if (sv->sv_lruprev != NULL) {
+		sv->sv_lruprev->sv_lrunext = sv->sv_lrunext;
+	}
+	else {
+		KASSERT(sfs->sfs_lruhead == sv);
+		sfs->sfs_lruhead = sv->sv_lrunext;
+	}
+	if (sv->sv_lrunext != NULL) {
+		sv->sv_lrunext->sv_lruprev = sv->sv_lruprev;
+	}
+	else {
+		KASSERT(sfs->sfs_lrutail == sv);
+		sfs->sfs_lrutail = sv->sv_lruprev;
+	}
+	sv->sv_lruprev = sv->sv_lrunext = NULL;
+	sv->sv_cached = false;
+	sfs->sfs_ncached--;
+}
+
+/*
+ * Free a vnode that has been taken out of the table.
+ */
+static
+void
+sfs_vndestroy(struct sfs_vnode *sv)
+{
+	if (sv->sv_i.sfi_type == SFS_TYPE_DIR) {
+		namecache_purgedir(&sv->sv_v);
+	}
+	lock_destroy(sv->sv_lock);
+	VOP_CLEANUP(&sv->sv_v);
+	kfree(sv);
+}
+
+/*
+ * Free all the cached unreferenced vnodes, for unmount. If any
+ * vnodes are still in use, do nothing and return EBUSY.
+ */
+int
+sfs_dropvnodes(struct sfs_fs *sfs)
+{
+	struct sfs_vnode *sv;
+
+	lock_acquire(sfs->sfs_vnlock);
+	if (sfs->sfs_nvnodes > sfs->sfs_ncached) {
+		lock_release(sfs->sfs_vnlock);
+		return EBUSY;
+	}
+	while ((sv = sfs->sfs_lrutail) != NULL) {
+		KASSERT(!sv->sv_dirty);
+		sfs_lruremove(sfs, sv);
+		sfs_vnremove(sfs, sv);
+		sfs_vndestroy(sv);
+	}
+	KASSERT(sfs->sfs_nvnodes == 0);
+	lock_release(sfs->sfs_vnlock);
+	return 0;
+}
 
 ////////////////////////////////////////////////////////////
 //
@@ -58,16 +217,29 @@ static
 int
 sfs_clearblock(struct sfs_fs *sfs, uint32_t block)
 {
-	/* static -> automatically initialized to zero */
-	static char zeros[SFS_BLOCKSIZE];
-	return sfs_wblock(sfs, zeros, block);
+	struct buf *b;
+	int result;
+
+	result = buffer_get(sfs->sfs_device, block, &b);
+	if (result) {
+		return result;
+	}
+	bzero(buffer_map(b), SFS_BLOCKSIZE);
+	result = sfs_writebuf(b);
+	buffer_release(b);
+	return result;
 }
 
-/* Write an on-disk inode structure back out to disk. */
-static
+/*
+ * Write an on-disk inode structure back out to disk. (That is, into
+ * the buffer cache; sfs_fsync and sfs_sync push it the rest of the
+ * way.)
+ */
 int
 sfs_sync_inode(struct sfs_vnode *sv)
 {
+	KASSERT(lock_do_i_hold(sv->sv_lock));
+
 	if (sv->sv_dirty) {
 		struct sfs_fs *sfs = sv->sv_v.vn_fs->fs_data;
 		int result = sfs_wblock(sfs, &sv->sv_i, sv->sv_ino);
@@ -92,11 +264,14 @@ sfs_balloc(struct sfs_fs *sfs, uint32_t *diskblock)
 {
 	int result;
 
+	lock_acquire(sfs->sfs_freemaplock);
 	result = bitmap_alloc(sfs->sfs_freemap, diskblock);
 	if (result) {
+		lock_release(sfs->sfs_freemaplock);
 		return result;
 	}
 	sfs->sfs_freemapdirty = true;
+	lock_release(sfs->sfs_freemaplock);
 
 	if (*diskblock >= sfs->sfs_super.sp_nblocks) {
 		panic("sfs: balloc: invalid block %u\n", *diskblock);
@@ -107,14 +282,19 @@ sfs_balloc(struct sfs_fs *sfs, uint32_t *diskblock)
 }
 
 /*
- * Free a block.
+ * Free a block. Its buffer is dropped first: once the bit is clear
+ * someone else can allocate the block and fill it in.
  */
 static
 void
 sfs_bfree(struct sfs_fs *sfs, uint32_t diskblock)
 {
+	buffer_forget(sfs->sfs_device, diskblock);
+
+	lock_acquire(sfs->sfs_freemaplock);
 	bitmap_unmark(sfs->sfs_freemap, diskblock);
 	sfs->sfs_freemapdirty = true;
+	lock_release(sfs->sfs_freemaplock);
 }
 
 /*
@@ -124,11 +304,16 @@ static
 int
 sfs_bused(struct sfs_fs *sfs, uint32_t diskblock)
 {
+	int ret;
+
 	if (diskblock >= sfs->sfs_super.sp_nblocks) {
 		panic("sfs: sfs_bused called on out of range block %u\n", 
 		      diskblock);
 	}
-	return bitmap_isset(sfs->sfs_freemap, diskblock);
+	lock_acquire(sfs->sfs_freemaplock);
+	ret = bitmap_isset(sfs->sfs_freemap, diskblock);
+	lock_release(sfs->sfs_freemaplock);
+	return ret;
 }
 
 ////////////////////////////////////////////////////////////
@@ -146,22 +331,15 @@ int
 sfs_bmap(struct sfs_vnode *sv, uint32_t fileblock, int doalloc,
 	 uint32_t *diskblock)
 {
-	/*
-	 * I/O buffer for handling indirect blocks.
-	 *
-	 * Note: in real life (and when you've done the fs assignment)
-	 * you would get space from the disk buffer cache for this,
-	 * not use a static area.
-	 */
-	static uint32_t idbuf[SFS_DBPERIDB];
-
 	struct sfs_fs *sfs = sv->sv_v.vn_fs->fs_data;
+	struct buf *idbuf;
+	uint32_t *idptrs;
 	uint32_t block;
 	uint32_t idblock;
 	uint32_t idnum, idoff;
 	int result;
 
-	KASSERT(sizeof(idbuf)==SFS_BLOCKSIZE);
+	KASSERT(lock_do_i_hold(sv->sv_lock));
 
 	/*
 	 * If the block we want is one of the direct blocks...
@@ -234,7 +412,7 @@ sfs_bmap(struct sfs_vnode *sv, uint32_t fileblock, int doalloc,
 		 * There's no indirect block allocated, but we need to
 		 * allocate a block whose number needs to be stored in
 		 * the indirect block. Thus, we need to allocate an
-		 * indirect block.
+		 * indirect block. (sfs_balloc clears it.)
 		 */
 		result = sfs_balloc(sfs, &idblock);
 		if (result) {
@@ -246,39 +424,40 @@ sfs_bmap(struct sfs_vnode *sv, uint32_t fileblock, int doalloc,
 
 		/* Mark the inode dirty */
 		sv->sv_dirty = true;
-
-		/* Clear the indirect block buffer */
-		bzero(idbuf, sizeof(idbuf));
 	}
-	else {
-		/*
-		 * We already have an indirect block allocated; load it.
-		 */
-		result = sfs_rblock(sfs, idbuf, idblock);
-		if (result) {
-			return result;
-		}
+
+	/*
+	 * Get the indirect block from the buffer cache. Repeated
+	 * lookups in the same file find it there.
+	 */
+	result = buffer_read(sfs->sfs_device, idblock, &idbuf);
+	if (result) {
+		return result;
 	}
+	idptrs = buffer_map(idbuf);
 
 	/* Get the block out of the indirect block buffer */
-	block = idbuf[idoff];
+	block = idptrs[idoff];
 
 	/* If there's no block there, allocate one */
 	if (block==0 && doalloc) {
 		result = sfs_balloc(sfs, &block);
 		if (result) {
+			buffer_release(idbuf);
 			return result;
 		}
 
 		/* Remember the block we allocated */
-		idbuf[idoff] = block;
+		idptrs[idoff] = block;
 
 		/* The indirect block is now dirty; write it back */
-		result = sfs_wblock(sfs, idbuf, idblock);
+		result = sfs_writebuf(idbuf);
 		if (result) {
+			buffer_release(idbuf);
 			return result;
 		}
 	}
+	buffer_release(idbuf);
 
 	/* Hand back the result and return. */
 	if (block != 0 && !sfs_bused(sfs, block)) {
@@ -289,15 +468,64 @@ sfs_bmap(struct sfs_vnode *sv, uint32_t fileblock, int doalloc,
 	return 0;
 }
 
+/*
+ * Write out the file's data blocks, and then its indirect block, if
+ * they're dirty in the buffer cache.
+ */
+static
+int
+sfs_sync_fileblocks(struct sfs_vnode *sv)
+{
+	struct sfs_fs *sfs = sv->sv_v.vn_fs->fs_data;
+	struct buf *idbuf;
+	uint32_t *idptrs;
+	uint32_t i;
+	int result;
+
+	for (i=0; i<SFS_NDIRECT; i++) {
+		if (sv->sv_i.sfi_direct[i] == 0) {
+			continue;
+		}
+		result = buffer_syncblock(sfs->sfs_device,
+					  sv->sv_i.sfi_direct[i]);
+		if (result) {
+			return result;
+		}
+	}
+
+	if (sv->sv_i.sfi_indirect == 0) {
+		return 0;
+	}
+
+	result = buffer_read(sfs->sfs_device, sv->sv_i.sfi_indirect, &idbuf);
+	if (result) {
+		return result;
+	}
+	idptrs = buffer_map(idbuf);
+	for (i=0; i<SFS_DBPERIDB; i++) {
+		if (idptrs[i] == 0) {
+			continue;
+		}
+		result = buffer_syncblock(sfs->sfs_device, idptrs[i]);
+		if (result) {
+			buffer_release(idbuf);
+			return result;
+		}
+	}
+	result = buffer_sync(idbuf);
+	buffer_release(idbuf);
+	return result;
+}
+
 ////////////////////////////////////////////////////////////
 //
 // File-level I/O
 
 /*
  * Do I/O to a block of a file that doesn't cover the whole block.  We
- * need to read in the original block first, even if we're writing, so
- * we don't clobber the portion of the block we're not intending to
- * write over.
+ * need the original block in the buffer cache first, even if we're
+ * writing, so we don't clobber the portion of the block we're not
+ * intending to write over.
  *
  * skipstart is the number of bytes to skip past at the beginning of
  * the sector; len is the number of bytes to actually read or write.
@@ -308,16 +536,8 @@ int
 sfs_partialio(struct sfs_vnode *sv, struct uio *uio,
 	      uint32_t skipstart, uint32_t len)
 {
-	/*
-	 * I/O buffer for handling partial sectors.
-	 *
-	 * Note: in real life (and when you've done the fs assignment)
-	 * you would get space from the disk buffer cache for this,
-	 * not use a static area.
-	 */
-	static char iobuf[SFS_BLOCKSIZE];
-
 	struct sfs_fs *sfs = sv->sv_v.vn_fs->fs_data;
+	struct buf *iobuf;
 	uint32_t diskblock;
 	uint32_t fileblock;
 	int result;
@@ -339,40 +559,39 @@ sfs_partialio(struct sfs_vnode *sv, struct uio *uio,
 	if (diskblock == 0) {
 		/*
 		 * There was no block mapped at this point in the file.
-		 * Zero the buffer.
+		 * Read zeros.
 		 */
 		KASSERT(uio->uio_rw == UIO_READ);
-		bzero(iobuf, sizeof(iobuf));
-	}
-	else {
-		/*
-		 * Read the block.
-		 */
-		result = sfs_rblock(sfs, iobuf, diskblock);
-		if (result) {
-			return result;
-		}
+		return uiomovezeros(len, uio);
 	}
 
 	/*
-	 * Now perform the requested operation into/out of the buffer.
+	 * Get the block.
 	 */
-	result = uiomove(iobuf+skipstart, len, uio);
+	result = buffer_read(sfs->sfs_device, diskblock, &iobuf);
 	if (result) {
 		return result;
 	}
 
+	/*
+	 * Now perform the requested operation into/out of the buffer.
+	 * If uiomove fails partway through a write, whatever it did
+	 * copy in has still been written.
+	 */
+	result = uiomove((char *)buffer_map(iobuf) + skipstart, len, uio);
+
 	/*
 	 * If it was a write, write back the modified block.
 	 */
 	if (uio->uio_rw == UIO_WRITE) {
-		result = sfs_wblock(sfs, iobuf, diskblock);
-		if (result) {
-			return result;
+		int result2 = sfs_writebuf(iobuf);
+		if (result == 0) {
+			result = result2;
 		}
 	}
 
-	return 0;
+	buffer_release(iobuf);
+	return result;
 }
 
 /*
@@ -383,14 +602,11 @@ int
 sfs_blockio(struct sfs_vnode *sv, struct uio *uio)
 {
 	struct sfs_fs *sfs = sv->sv_v.vn_fs->fs_data;
+	struct buf *iobuf;
 	uint32_t diskblock;
 	uint32_t fileblock;
 	int result;
 	int doalloc = (uio->uio_rw==UIO_WRITE);
-	off_t saveoff;
-	off_t diskoff;
-	off_t saveres;
-	off_t diskres;
 
 	/* Get the block number within the file */
 	fileblock = uio->uio_offset / SFS_BLOCKSIZE;
@@ -412,34 +628,126 @@ sfs_blockio(struct sfs_vnode *sv, struct uio *uio)
 		return uiomovezeros(SFS_BLOCKSIZE, uio);
 	}
 
-	/*
-	 * Do the I/O directly to the uio region. Save the uio_offset,
-	 * and substitute one that makes sense to the device.
-	 */
-	saveoff = uio->uio_offset;
-	diskoff = diskblock * SFS_BLOCKSIZE;
-	uio->uio_offset = diskoff;
-
-	/*
-	 * Temporarily set the residue to be one block size.
-	 */
 	KASSERT(uio->uio_resid >= SFS_BLOCKSIZE);
-	saveres = uio->uio_resid;
-	diskres = SFS_BLOCKSIZE;
-	uio->uio_resid = diskres;
-	
-	result = sfs_rwblock(sfs, uio);
+
+	if (uio->uio_rw == UIO_READ) {
+		result = buffer_read(sfs->sfs_device, diskblock, &iobuf);
+		if (result) {
+			return result;
+		}
+		result = uiomove(buffer_map(iobuf), SFS_BLOCKSIZE, uio);
+		buffer_release(iobuf);
+		return result;
+	}
 
 	/*
-	 * Now, restore the original uio_offset and uio_resid and update 
-	 * them by the amount of I/O done.
+	 * Writing the whole block; no need to read it first.
 	 */
-	uio->uio_offset = (uio->uio_offset - diskoff) + saveoff;
-	uio->uio_resid = (uio->uio_resid - diskres) + saveres;
-
+	result = buffer_get(sfs->sfs_device, diskblock, &iobuf);
+	if (result) {
+		return result;
+	}
+	result = uiomove(buffer_map(iobuf), SFS_BLOCKSIZE, uio);
+	if (result && !buffer_isvalid(iobuf)) {
+		/*
+		 * Only part of the block got copied in, and we don't
+		 * have the rest; the buffer is garbage. (If the
+		 * buffer was valid, what did get copied has been
+		 * written, as in sfs_partialio.)
+		 */
+		buffer_invalidate(iobuf);
+	}
+	else {
+		int result2 = sfs_writebuf(iobuf);
+		if (result == 0) {
+			result = result2;
+		}
+	}
+	buffer_release(iobuf);
 	return result;
 }
 
+/*
+ * Sequential readahead. A read that starts where one of the vnode's
+ * streams stopped continues that stream; each such read doubles its
+ * window, from SFS_RAMIN up to SFS_RAMAX blocks. Any other read starts
+ * a new stream with the window closed, replacing the least recently
+ * used one. With the window open, the blocks up to that far past the
+ * end of the read are handed to the buffer cache's readahead thread,
+ * so they're read while the caller is busy with what it just got.
+ */
+#define SFS_RAMIN	4
+#define SFS_RAMAX	32
+
+/*
+ * Called after a read of bytes [START, END) of the file.
+ */
+static
+void
+sfs_readahead(struct sfs_vnode *sv, off_t start, off_t end)
+{
+	struct sfs_fs *sfs = sv->sv_v.vn_fs->fs_data;
+	struct sfs_rastream ra;
+	uint32_t fileblocks, fileblock, lastblock, diskblock;
+	unsigned i;
+
+	for (i=0; i<SFS_RASTREAMS-1; i++) {
+		if (sv->sv_ra[i].ra_off == start) {
+			break;
+		}
+	}
+	ra = sv->sv_ra[i];
+
+	/* Move it (or the oldest, to be replaced) to the front. */
+	for (; i>0; i--) {
+		sv->sv_ra[i] = sv->sv_ra[i-1];
+	}
+
+	if (ra.ra_off != start) {
+		/* Not sequential; start a new stream. */
+		sv->sv_ra[0].ra_off = end;
+		sv->sv_ra[0].ra_window = 0;
+		sv->sv_ra[0].ra_end = 0;
+		return;
+	}
+	ra.ra_off = end;
+
+	if (ra.ra_window == 0) {
+		ra.ra_window = SFS_RAMIN;
+	}
+	else if (ra.ra_window < SFS_RAMAX) {
+		ra.ra_window *= 2;
+	}
+
+	/* Read ahead from the block after the read... */
+	fileblock = DIVROUNDUP(end, SFS_BLOCKSIZE);
+	lastblock = fileblock + ra.ra_window;
+
+	/* ...up to the end of the window or the file... */
+	fileblocks = DIVROUNDUP(sv->sv_i.sfi_size, SFS_BLOCKSIZE);
+	if (lastblock > fileblocks) {
+		lastblock = fileblocks;
+	}
+
+	/* ...skipping any we already asked for. */
+	if (fileblock < ra.ra_end) {
+		fileblock = ra.ra_end;
+	}
+
+	for (; fileblock < lastblock; fileblock++) {
+		if (sfs_bmap(sv, fileblock, 0, &diskblock)) {
+			break;
+		}
+		if (diskblock != 0) {
+			buffer_readahead(sfs->sfs_device, diskblock);
+		}
+	}
+	if (fileblock > ra.ra_end) {
+		ra.ra_end = fileblock;
+	}
+	sv->sv_ra[0] = ra;
+}
+
 /*
  * Do I/O of a whole region of data, whether or not it's block-aligned.
  */
@@ -451,6 +759,9 @@ sfs_io(struct sfs_vnode *sv, struct uio *uio)
 	uint32_t nblocks, i;
 	int result = 0;
 	uint32_t extraresid = 0;
+	off_t startpos = uio->uio_offset;
+
+	KASSERT(lock_do_i_hold(sv->sv_lock));
 
 	/*
 	 * If reading, check for EOF. If we can read a partial area,
@@ -537,6 +848,11 @@ sfs_io(struct sfs_vnode *sv, struct uio *uio)
 	/* Add in any extra amount we couldn't read because of EOF */
 	uio->uio_resid += extraresid;
 
+	/* If reading, get the following blocks coming */
+	if (uio->uio_rw == UIO_READ && result == 0) {
+		sfs_readahead(sv, startpos, uio->uio_offset);
+	}
+
 	/* Done */
 	return result;
 }
@@ -890,73 +1206,85 @@ sfs_reclaim(struct vnode *v)
 {
 	struct sfs_vnode *sv = v->vn_data;
 	struct sfs_fs *sfs = v->vn_fs->fs_data;
-	unsigned ix, i, num;
+	struct sfs_vnode *victim;
 	int result;
 
-	vfs_biglock_acquire();
+	lock_acquire(sfs->sfs_vnlock);
 
 	/*
 	 * Make sure someone else hasn't picked up the vnode since the
-	 * decision was made to reclaim it. (You must also synchronize
-	 * this with sfs_loadvnode.)
+	 * decision was made to reclaim it. sfs_loadvnode only hands
+	 * out references under sfs_vnlock, so if the count is 1 now
+	 * it stays that way.
 	 */
+	spinlock_acquire(&v->vn_countlock);
 	if (v->vn_refcount != 1) {
 
 		/* consume the reference VOP_DECREF gave us */
 		KASSERT(v->vn_refcount>1);
 		v->vn_refcount--;
 
-		vfs_biglock_release();
+		spinlock_release(&v->vn_countlock);
+		lock_release(sfs->sfs_vnlock);
 		return EBUSY;
 	}
+	spinlock_release(&v->vn_countlock);
 
-	/* If there are no on-disk references to the file either, erase it. */
-	if (sv->sv_i.sfi_linkcount==0) {
-		result = VOP_TRUNCATE(&sv->sv_v, 0);
+	/*
+	 * Nobody else has a reference, so nobody else can be holding
+	 * or waiting for sv_lock, and taking it out of order here
+	 * can't block.
+	 */
+	lock_acquire(sv->sv_lock);
+
+	/*
+	 * If the file still has a name, sync the inode and keep the
+	 * vnode in the table, on the LRU list, in case it's wanted
+	 * again soon. If that pushes out the least recently used one,
+	 * free that instead. Anything that reloads it reads the inode
+	 * we just synced.
+	 */
+	if (sv->sv_i.sfi_linkcount > 0) {
+		result = sfs_sync_inode(sv);
+		lock_release(sv->sv_lock);
 		if (result) {
-			vfs_biglock_release();
+			lock_release(sfs->sfs_vnlock);
 			return result;
 		}
-	}
-
-	/* Sync the inode to disk */
-	result = sfs_sync_inode(sv);
-	if (result) {
-		vfs_biglock_release();
-		return result;
-	}
 
-	/* If there are no on-disk references, discard the inode */
-	if (sv->sv_i.sfi_linkcount==0) {
-		sfs_bfree(sfs, sv->sv_ino);
-	}
+		sfs_lruinsert(sfs, sv);
+		victim = NULL;
+		if (sfs->sfs_ncached > SFS_VNCACHE) {
+			victim = sfs->sfs_lrutail;
+			sfs_lruremove(sfs, victim);
+			sfs_vnremove(sfs, victim);
+		}
+		lock_release(sfs->sfs_vnlock);
 
-	/* Remove the vnode structure from the table in the struct sfs_fs. */
-	num = vnodearray_num(sfs->sfs_vnodes);
-	ix = num;
-	for (i=0; i<num; i++) {
-		struct vnode *v2 = vnodearray_get(sfs->sfs_vnodes, i);
-		struct sfs_vnode *sv2 = v2->vn_data;
-		if (sv2 == sv) {
-			ix = i;
-			break;
+		if (victim != NULL) {
+			sfs_vndestroy(victim);
 		}
+		return 0;
 	}
-	if (ix == num) {
-		panic("sfs: reclaim vnode %u not in vnode pool\n",
-		      sv->sv_ino);
-	}
-	vnodearray_remove(sfs->sfs_vnodes, ix);
 
-	VOP_CLEANUP(&sv->sv_v);
+	/*
+	 * There are no on-disk references to the file either, so
+	 * erase it and discard the inode. With no name and no vnode,
+	 * nobody can get to it any more, so this needn't hold up the
+	 * table. If the truncate fails the blocks it didn't get to are
+	 * lost, but the inode is freed regardless.
+	 */
+	sfs_vnremove(sfs, sv);
+	lock_release(sfs->sfs_vnlock);
 
-	vfs_biglock_release();
+	result = sfs_dotruncate(sv, 0);
+	sfs_bfree(sfs, sv->sv_ino);
+	lock_release(sv->sv_lock);
 
-	/* Release the storage for the vnode structure itself. */
-	kfree(sv);
+	sfs_vndestroy(sv);
 
 	/* Done */
-	return 0;
+	return result;
 }
 
 /*
@@ -971,9 +1299,9 @@ sfs_read(struct vnode *v, struct uio *uio)
 
 	KASSERT(uio->uio_rw==UIO_READ);
 
-	vfs_biglock_acquire();
+	lock_acquire(sv->sv_lock);
 	result = sfs_io(sv, uio);
-	vfs_biglock_release();
+	lock_release(sv->sv_lock);
 
 	return result;
 }
@@ -990,9 +1318,9 @@ sfs_write(struct vnode *v, struct uio *uio)
 
 	KASSERT(uio->uio_rw==UIO_WRITE);
 
-	vfs_biglock_acquire();
+	lock_acquire(sv->sv_lock);
 	result = sfs_io(sv, uio);
-	vfs_biglock_release();
+	lock_release(sv->sv_lock);
 
 	return result;
 }
@@ -1015,6 +1343,21 @@ sfs_ioctl(struct vnode *v, int op, userptr_t data)
 	return EINVAL;
 }
 
+/*
+ * Called for poll() and select(). Disk I/O doesn't count as
+ * blocking, so files and directories are always ready.
+ */
+static
+int
+sfs_poll(struct vnode *v, int events, struct pollent *pe, int *revents)
+{
+	(void)v;
+	(void)pe;
+
+	*revents = events & (POLLIN | POLLRDNORM | POLLOUT | POLLWRNORM);
+	return 0;
+}
+
 /*
  * Called for stat/fstat/lstat.
  */
@@ -1033,7 +1376,9 @@ sfs_stat(struct vnode *v, struct stat *statbuf)
 		return result;
 	}
 
+	lock_acquire(sv->sv_lock);
 	statbuf->st_size = sv->sv_i.sfi_size;
+	lock_release(sv->sv_lock);
 
 	/* We don't support these yet; you get to implement them */
 	statbuf->st_nlink = 0;
@@ -1053,16 +1398,13 @@ sfs_gettype(struct vnode *v, uint32_t *ret)
 {
 	struct sfs_vnode *sv = v->vn_data;
 
-	vfs_biglock_acquire();
-
+	/* The type is set when the inode is created; no lock needed. */
 	switch (sv->sv_i.sfi_type) {
 	case SFS_TYPE_FILE:
 		*ret = S_IFREG;
-		vfs_biglock_release();
 		return 0;
 	case SFS_TYPE_DIR:
 		*ret = S_IFDIR;
-		vfs_biglock_release();
 		return 0;
 	}
 	panic("sfs: gettype: Invalid inode type (inode %u, type %u)\n",
@@ -1100,11 +1442,28 @@ int
 sfs_fsync(struct vnode *v)
 {
 	struct sfs_vnode *sv = v->vn_data;
+	struct sfs_fs *sfs = sv->sv_v.vn_fs->fs_data;
 	int result;
 
-	vfs_biglock_acquire();
-	result = sfs_sync_inode(sv);
-	vfs_biglock_release();
+	lock_acquire(sv->sv_lock);
+
+	/*
+	 * Write the file's blocks, then the free map, then the inode,
+	 * so that the inode on disk never points at blocks that haven't
+	 * been written yet or that the disk still has as free.
+	 */
+	result = sfs_sync_fileblocks(sv);
+	if (result == 0) {
+		result = sfs_sync_freemap(sfs);
+	}
+	if (result == 0) {
+		result = sfs_sync_inode(sv);
+	}
+	if (result == 0) {
+		result = buffer_syncblock(sfs->sfs_device, sv->sv_ino);
+	}
+
+	lock_release(sv->sv_lock);
 
 	return result;
 }
@@ -1121,35 +1480,26 @@ sfs_mmap(struct vnode *v   /* add stuff as needed */)
 }
 
 /*
- * Called for ftruncate() and from sfs_reclaim.
+ * Truncate a file; for sfs_truncate and sfs_reclaim. The caller
+ * holds sv_lock.
  */
 static
 int
-sfs_truncate(struct vnode *v, off_t len)
+sfs_dotruncate(struct sfs_vnode *sv, off_t len)
 {
-	/*
-	 * I/O buffer for handling the indirect block.
-	 *
-	 * Note: in real life (and when you've done the fs assignment)
-	 * you would get space from the disk buffer cache for this,
-	 * not use a static area.
-	 */
-	static uint32_t idbuf[SFS_DBPERIDB];
-
-	struct sfs_vnode *sv = v->vn_data;
 	struct sfs_fs *sfs = sv->sv_v.vn_fs->fs_data;
 
 	/* Length in blocks (divide rounding up) */
 	uint32_t blocklen = DIVROUNDUP(len, SFS_BLOCKSIZE);
 
+	struct buf *idbuf;
+	uint32_t *idptrs;
 	uint32_t i, j, block;
 	uint32_t idblock, baseblock, highblock;
 	int result;
 	int hasnonzero, iddirty;
 
-	KASSERT(sizeof(idbuf)==SFS_BLOCKSIZE);
-
-	vfs_biglock_acquire();
+	KASSERT(lock_do_i_hold(sv->sv_lock));
 
 	/*
 	 * Go through the direct blocks. Discard any that are
@@ -1177,41 +1527,46 @@ sfs_truncate(struct vnode *v, off_t len)
 		/* We're past the proposed EOF; may need to free stuff */
 
 		/* Read the indirect block */
-		result = sfs_rblock(sfs, idbuf, idblock);
+		result = buffer_read(sfs->sfs_device, idblock, &idbuf);
 		if (result) {
-			vfs_biglock_release();
 			return result;
 		}
+		idptrs = buffer_map(idbuf);
 		
 		hasnonzero = 0;
 		iddirty = 0;
 		for (j=0; j<SFS_DBPERIDB; j++) {
 			/* Discard any blocks that are past the new EOF */
-			if (blocklen < baseblock+j && idbuf[j] != 0) {
-				sfs_bfree(sfs, idbuf[j]);
-				idbuf[j] = 0;
+			if (blocklen < baseblock+j && idptrs[j] != 0) {
+				sfs_bfree(sfs, idptrs[j]);
+				idptrs[j] = 0;
 				iddirty = 1;
 			}
 			/* Remember if we see any nonzero blocks in here */
-			if (idbuf[j]!=0) {
+			if (idptrs[j]!=0) {
 				hasnonzero=1;
 			}
 		}
 
 		if (!hasnonzero) {
 			/* The whole indirect block is empty now; free it */
+			buffer_invalidate(idbuf);
+			buffer_release(idbuf);
 			sfs_bfree(sfs, idblock);
 			sv->sv_i.sfi_indirect = 0;
 			sv->sv_dirty = true;
 		}
 		else if (iddirty) {
 			/* The indirect block is dirty; write it back */
-			result = sfs_wblock(sfs, idbuf, idblock);
+			result = sfs_writebuf(idbuf);
+			buffer_release(idbuf);
 			if (result) {
-				vfs_biglock_release();
-				return result;
+					return result;
 			}
 		}
+		else {
+			buffer_release(idbuf);
+		}
 	}
 
 	/* Set the file size */
@@ -1220,10 +1575,26 @@ sfs_truncate(struct vnode *v, off_t len)
 	/* Mark the inode dirty */
 	sv->sv_dirty = true;
 
-	vfs_biglock_release();
 	return 0;
 }
 
+/*
+ * Called for ftruncate().
+ */
+static
+int
+sfs_truncate(struct vnode *v, off_t len)
+{
+	struct sfs_vnode *sv = v->vn_data;
+	int result;
+
+	lock_acquire(sv->sv_lock);
+	result = sfs_dotruncate(sv, len);
+	lock_release(sv->sv_lock);
+
+	return result;
+}
+
 /*
  * Get the full pathname for a file. This only needs to work on directories.
  * Since we don't support subdirectories, assume it's the root directory
@@ -1259,18 +1630,18 @@ sfs_creat(struct vnode *v, const char *name, bool excl, mode_t mode,
 	uint32_t ino;
 	int result;
 
-	vfs_biglock_acquire();
+	lock_acquire(sv->sv_lock);
 
 	/* Look up the name */
 	result = sfs_dir_findname(sv, name, &ino, NULL, NULL);
 	if (result!=0 && result!=ENOENT) {
-		vfs_biglock_release();
+		lock_release(sv->sv_lock);
 		return result;
 	}
 
 	/* If it exists and we didn't want it to, fail */
 	if (result==0 && excl) {
-		vfs_biglock_release();
+		lock_release(sv->sv_lock);
 		return EEXIST;
 	}
 
@@ -1278,18 +1649,18 @@ sfs_creat(struct vnode *v, const char *name, bool excl, mode_t mode,
 		/* We got a file; load its vnode and return */
 		result = sfs_loadvnode(sfs, ino, SFS_TYPE_INVAL, &newguy);
 		if (result) {
-			vfs_biglock_release();
+			lock_release(sv->sv_lock);
 			return result;
 		}
 		*ret = &newguy->sv_v;
-		vfs_biglock_release();
+		lock_release(sv->sv_lock);
 		return 0;
 	}
 
 	/* Didn't exist - create it */
 	result = sfs_makeobj(sfs, SFS_TYPE_FILE, &newguy);
 	if (result) {
-		vfs_biglock_release();
+		lock_release(sv->sv_lock);
 		return result;
 	}
 
@@ -1299,20 +1670,25 @@ sfs_creat(struct vnode *v, const char *name, bool excl, mode_t mode,
 	/* Link it into the directory */
 	result = sfs_dir_link(sv, name, newguy->sv_ino, NULL);
 	if (result) {
+		lock_release(sv->sv_lock);
 		VOP_DECREF(&newguy->sv_v);
-		vfs_biglock_release();
 		return result;
 	}
 
+	/* The name cache may say the name doesn't exist */
+	namecache_purge(v, name);
+
 	/* Update the linkcount of the new file */
+	lock_acquire(newguy->sv_lock);
 	newguy->sv_i.sfi_linkcount++;
 
 	/* and consequently mark it dirty. */
 	newguy->sv_dirty = true;
+	lock_release(newguy->sv_lock);
 
 	*ret = &newguy->sv_v;
 	
-	vfs_biglock_release();
+	lock_release(sv->sv_lock);
 	return 0;
 }
 
@@ -1331,20 +1707,31 @@ sfs_link(struct vnode *dir, const char *name, struct vnode *file)
 
 	KASSERT(file->vn_fs == dir->vn_fs);
 
-	vfs_biglock_acquire();
+	/*
+	 * There are no subdirectories, so the only directory is the
+	 * root, and it can't get another name.
+	 */
+	if (f->sv_i.sfi_type == SFS_TYPE_DIR) {
+		return EPERM;
+	}
+
+	lock_acquire(sv->sv_lock);
 
 	/* Just create a link */
 	result = sfs_dir_link(sv, name, f->sv_ino, NULL);
 	if (result) {
-		vfs_biglock_release();
+		lock_release(sv->sv_lock);
 		return result;
 	}
+	namecache_purge(dir, name);
 
 	/* and update the link count, marking the inode dirty */
+	lock_acquire(f->sv_lock);
 	f->sv_i.sfi_linkcount++;
 	f->sv_dirty = true;
+	lock_release(f->sv_lock);
 
-	vfs_biglock_release();
+	lock_release(sv->sv_lock);
 	return 0;
 }
 
@@ -1360,28 +1747,37 @@ sfs_remove(struct vnode *dir, const char *name)
 	int slot;
 	int result;
 
-	vfs_biglock_acquire();
+	lock_acquire(sv->sv_lock);
 
 	/* Look for the file and fetch a vnode for it. */
 	result = sfs_lookonce(sv, name, &victim, &slot);
 	if (result) {
-		vfs_biglock_release();
+		lock_release(sv->sv_lock);
 		return result;
 	}
 
 	/* Erase its directory entry. */
 	result = sfs_dir_unlink(sv, slot);
 	if (result==0) {
+		namecache_purge(dir, name);
+
 		/* If we succeeded, decrement the link count. */
+		lock_acquire(victim->sv_lock);
 		KASSERT(victim->sv_i.sfi_linkcount > 0);
 		victim->sv_i.sfi_linkcount--;
 		victim->sv_dirty = true;
+		lock_release(victim->sv_lock);
 	}
 
-	/* Discard the reference that sfs_lookonce got us */
+	lock_release(sv->sv_lock);
+
+	/*
+	 * Discard the reference that sfs_lookonce got us. If that was
+	 * the last one, this erases the file, which needn't hold up
+	 * the directory.
+	 */
 	VOP_DECREF(&victim->sv_v);
 
-	vfs_biglock_release();
 	return result;
 }
 
@@ -1401,21 +1797,23 @@ sfs_rename(struct vnode *d1, const char *n1,
 	int slot1, slot2;
 	int result, result2;
 
-	vfs_biglock_acquire();
-
 	KASSERT(d1==d2);
 	KASSERT(sv->sv_ino == SFS_ROOT_LOCATION);
 
+	lock_acquire(sv->sv_lock);
+
 	/* Look up the old name of the file and get its inode and slot number*/
 	result = sfs_lookonce(sv, n1, &g1, &slot1);
 	if (result) {
-		vfs_biglock_release();
+		lock_release(sv->sv_lock);
 		return result;
 	}
 
 	/* We don't support subdirectories */
 	KASSERT(g1->sv_i.sfi_type == SFS_TYPE_FILE);
 
+	lock_acquire(g1->sv_lock);
+
 	/*
 	 * Link it under the new name.
 	 *
@@ -1447,10 +1845,15 @@ sfs_rename(struct vnode *d1, const char *n1,
 	g1->sv_i.sfi_linkcount--;
 	g1->sv_dirty = true;
 
+	namecache_purge(d1, n1);
+	namecache_purge(d1, n2);
+
+	lock_release(g1->sv_lock);
+	lock_release(sv->sv_lock);
+
 	/* Let go of the reference to g1 */
 	VOP_DECREF(&g1->sv_v);
 
-	vfs_biglock_release();
 	return 0;
 
  puke_harder:
@@ -1466,9 +1869,10 @@ sfs_rename(struct vnode *d1, const char *n1,
 	}
 	g1->sv_i.sfi_linkcount--;
  puke:
+	lock_release(g1->sv_lock);
+	lock_release(sv->sv_lock);
 	/* Let go of the reference to g1 */
 	VOP_DECREF(&g1->sv_v);
-	vfs_biglock_release();
 	return result;
 }
 
@@ -1486,15 +1890,12 @@ sfs_lookparent(struct vnode *v, char *path, struct vnode **ret,
 {
 	struct sfs_vnode *sv = v->vn_data;
 
-	vfs_biglock_acquire();
-
+	/* The type never changes, so this needs no lock. */
 	if (sv->sv_i.sfi_type != SFS_TYPE_DIR) {
-		vfs_biglock_release();
 		return ENOTDIR;
 	}
 
 	if (strlen(path)+1 > buflen) {
-		vfs_biglock_release();
 		return ENAMETOOLONG;
 	}
 	strcpy(buf, path);
@@ -1502,7 +1903,6 @@ sfs_lookparent(struct vnode *v, char *path, struct vnode **ret,
 	VOP_INCREF(&sv->sv_v);
 	*ret = &sv->sv_v;
 
-	vfs_biglock_release();
 	return 0;
 }
 
@@ -1517,25 +1917,47 @@ int
 sfs_lookup(struct vnode *v, char *path, struct vnode **ret)
 {
 	struct sfs_vnode *sv = v->vn_data;
+	struct sfs_fs *sfs = v->vn_fs->fs_data;
 	struct sfs_vnode *final;
+	ino_t ino;
 	int result;
 
-	vfs_biglock_acquire();
-
 	if (sv->sv_i.sfi_type != SFS_TYPE_DIR) {
-		vfs_biglock_release();
 		return ENOTDIR;
 	}
-	
-	result = sfs_lookonce(sv, path, &final, NULL);
+
+	lock_acquire(sv->sv_lock);
+
+	/*
+	 * Try the name cache first, to skip searching the directory.
+	 * Holding the directory lock keeps the name, and so the inode,
+	 * from going away before it's loaded.
+	 */
+	if (namecache_lookup(v, path, &ino)) {
+		if (ino == NAMECACHE_NOINO) {
+			result = ENOENT;
+		}
+		else {
+			result = sfs_loadvnode(sfs, ino, SFS_TYPE_INVAL,
+					       &final);
+		}
+	}
+	else {
+		result = sfs_lookonce(sv, path, &final, NULL);
+		if (result == 0) {
+			namecache_enter(v, path, final->sv_ino);
+		}
+		else if (result == ENOENT) {
+			namecache_enter(v, path, NAMECACHE_NOINO);
+		}
+	}
+	lock_release(sv->sv_lock);
 	if (result) {
-		vfs_biglock_release();
 		return result;
 	}
 
 	*ret = &final->sv_v;
 
-	vfs_biglock_release();
 	return 0;
 }
 
@@ -1587,6 +2009,7 @@ static const struct vnode_ops sfs_fileops = {
 	NOTDIR,  /* getdirentry */
 	sfs_write,
 	sfs_ioctl,
+	sfs_poll,
 	sfs_stat,
 	sfs_gettype,
 	sfs_tryseek,
@@ -1622,6 +2045,7 @@ static const struct vnode_ops sfs_dirops = {
 	UNIMP,   /* getdirentry */
 	ISDIR,   /* write */
 	sfs_ioctl,
+	sfs_poll,
 	sfs_stat,
 	sfs_gettype,
 	UNIMP,   /* tryseek */
@@ -1651,42 +2075,47 @@ int
 sfs_loadvnode(struct sfs_fs *sfs, uint32_t ino, int forcetype,
 		 struct sfs_vnode **ret)
 {
-	struct vnode *v;
 	struct sfs_vnode *sv;
 	const struct vnode_ops *ops = NULL;
-	unsigned i, num;
 	int result;
 
-	/* Look in the vnodes table */
-	num = vnodearray_num(sfs->sfs_vnodes);
-
-	/* Linear search. Is this too slow? You decide. */
-	for (i=0; i<num; i++) {
-		v = vnodearray_get(sfs->sfs_vnodes, i);
-		sv = v->vn_data;
+	/*
+	 * Hold the table lock across the whole thing, including the
+	 * read of the inode, so two threads can't both load the same
+	 * inode and so sfs_reclaim can't free a vnode we're handing
+	 * out.
+	 */
+	lock_acquire(sfs->sfs_vnlock);
 
+	/* Look in the vnodes table */
+	sv = sfs_vnfind(sfs, ino);
+	if (sv != NULL) {
 		/* Every inode in memory must be in an allocated block */
 		if (!sfs_bused(sfs, sv->sv_ino)) {
 			panic("sfs: Found inode %u in unallocated block\n",
 			      sv->sv_ino);
 		}
 
-		if (sv->sv_ino==ino) {
-			/* Found */
-
-			/* May only be set when creating new objects */
-			KASSERT(forcetype==SFS_TYPE_INVAL);
+		/* May only be set when creating new objects */
+		KASSERT(forcetype==SFS_TYPE_INVAL);
 
+		if (sv->sv_cached) {
+			/* Take over the reference the cache was holding */
+			sfs_lruremove(sfs, sv);
+		}
+		else {
 			VOP_INCREF(&sv->sv_v);
-			*ret = sv;
-			return 0;
 		}
+		lock_release(sfs->sfs_vnlock);
+		*ret = sv;
+		return 0;
 	}
 
 	/* Didn't have it loaded; load it */
 
 	sv = kmalloc(sizeof(struct sfs_vnode));
 	if (sv==NULL) {
+		lock_release(sfs->sfs_vnlock);
 		return ENOMEM;
 	}
 
@@ -1696,16 +2125,28 @@ sfs_loadvnode(struct sfs_fs *sfs, uint32_t ino, int forcetype,
 		      ino);
 	}
 
+	sv->sv_lock = lock_create("sfs vnode");
+	if (sv->sv_lock == NULL) {
+		kfree(sv);
+		lock_release(sfs->sfs_vnlock);
+		return ENOMEM;
+	}
+
 	/* Read the block the inode is in */
 	result = sfs_rblock(sfs, &sv->sv_i, ino);
 	if (result) {
+		lock_destroy(sv->sv_lock);
 		kfree(sv);
+		lock_release(sfs->sfs_vnlock);
 		return result;
 	}
 
 	/* Not dirty yet */
 	sv->sv_dirty = false;
 
+	/* No reads yet */
+	bzero(sv->sv_ra, sizeof(sv->sv_ra));
+
 	/*
 	 * FORCETYPE is set if we're creating a new file, because the
 	 * block on disk will have been zeroed out and thus the type
@@ -1736,20 +2177,22 @@ sfs_loadvnode(struct sfs_fs *sfs, uint32_t ino, int forcetype,
 	/* Call the common vnode initializer */
 	result = VOP_INIT(&sv->sv_v, ops, &sfs->sfs_absfs, sv);
 	if (result) {
+		lock_destroy(sv->sv_lock);
 		kfree(sv);
+		lock_release(sfs->sfs_vnlock);
 		return result;
 	}
 
 	/* Set the other fields in our vnode structure */
 	sv->sv_ino = ino;
+	sv->sv_hashnext = NULL;
+	sv->sv_lruprev = sv->sv_lrunext = NULL;
+	sv->sv_cached = false;
 
 	/* Add it to our table */
-	result = vnodearray_add(sfs->sfs_vnodes, &sv->sv_v, NULL);
-	if (result) {
-		VOP_CLEANUP(&sv->sv_v);
-		kfree(sv);
-		return result;
-	}
+	sfs_vninsert(sfs, sv);
+
+	lock_release(sfs->sfs_vnlock);
 
 	/* Hand it back */
 	*ret = sv;
@@ -1767,14 +2210,10 @@ sfs_getroot(struct fs *fs)
 	struct sfs_vnode *sv;
 	int result;
 
-	vfs_biglock_acquire();
-
 	result = sfs_loadvnode(sfs, SFS_ROOT_LOCATION, SFS_TYPE_INVAL, &sv);
 	if (result) {
 		panic("sfs: getroot: Cannot load root vnode\n");
 	}
 
-	vfs_biglock_release();
-
 	return &sv->sv_v;
 }
@@ -101,6 +101,11 @@ struct addrspace {
  *    as_define_stack - set up the stack region in the address space.
  *                (Normally called *after* as_complete_load().) Hands
  *                back the initial stack pointer for the new process.
+ *
+ *    as_translate - find the physical address behind user address VA
+ *                in AS, which need not be the current address space.
+ *                Fails with EFAULT if VA isn't mapped, or if WRITE is
+ *                set and VA is read-only.
  */
 
 struct addrspace *as_create(void);
@@ -117,6 +122,8 @@ int               as_define_region(struct addrspace *as,
 int               as_prepare_load(struct addrspace *as);
 int               as_complete_load(struct addrspace *as);
 int               as_define_stack(struct addrspace *as, vaddr_t *initstackptr);
+int               as_translate(struct addrspace *as, vaddr_t va,
+                               bool write, paddr_t *ret);
 
 
 /*
@@ -0,0 +1,122 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#ifndef _BUF_H_
+#define _BUF_H_
+
+/*
+ * Block buffer cache.
+ *
+ * Buffers hold copies of disk blocks, keyed by (device, block
+ * number). They are found through a hash table; buffers nobody is
+ * using sit on an LRU list and the least recently used one is reused
+ * when the cache is full. A buffer that's been changed is dirty
+ * until it's written back.
+ *
+ * Dirty buffers are written back later, not when they're changed: by
+ * the syncer thread once they've been dirty a few seconds or when too
+ * many are dirty, by eviction, or by an explicit sync. The syncer
+ * sorts what it writes and writes runs of adjacent blocks together.
+ * Code that needs blocks on disk in a particular order (e.g. fsync
+ * writing data before the inode that points to it) syncs them itself
+ * with buffer_syncblock in that order.
+ *
+ * buffer_readahead asks for a block to be read into the cache in the
+ * background, by the readahead thread, so a later buffer_read of it
+ * finds it there. Filesystems use it when they see sequential reads.
+ *
+ * A buffer is used by one thread at a time. Getting a buffer marks
+ * it busy (other threads wanting the same block wait) and pins it in
+ * the cache until it's released. Don't hold a buffer across anything
+ * that might wait for another buffer the holder of which might want
+ * this one.
+ *
+ * Functions:
+ *     buffer_bootstrap  - set up at boot, and start the syncer and
+ *                         readahead threads.
+ *     buffer_read       - get a buffer for BLOCK on DEV with the
+ *                         block's contents, reading it if needed.
+ *     buffer_get        - get a buffer for BLOCK on DEV without
+ *                         reading it, for a caller who will overwrite
+ *                         all of it. The contents are only meaningful
+ *                         if buffer_isvalid says so.
+ *     buffer_release    - unpin a buffer.
+ *     buffer_map        - return a buffer's BUF_SIZE bytes of data.
+ *     buffer_isvalid    - true if the data matches the block (or the
+ *                         block as most recently written).
+ *     buffer_markdirty  - note the data has been changed; also makes
+ *                         the buffer valid.
+ *     buffer_invalidate - throw away the contents, e.g. after a
+ *                         failed attempt to fill a buffer from
+ *                         buffer_get.
+ *     buffer_sync       - write a buffer out if it's dirty.
+ *     buffer_syncblock  - write out BLOCK on DEV if it's cached and
+ *                         dirty, waiting if someone has it.
+ *     buffer_readahead  - start reading BLOCK on DEV into the cache,
+ *                         unless it's there already. Doesn't wait.
+ *     buffer_forget     - drop the cached copy of a block that's no
+ *                         longer in use, without writing it.
+ *     buffer_syncdev    - write out all dirty buffers for DEV.
+ *     buffer_dropdev    - sync, then drop all buffers for DEV, which
+ *                         must be unused. For unmount.
+ *     buffer_printstats - print hit rate and I/O counts.
+ */
+
+struct device;
+struct buf;
+
+/* Size of a buffer. Devices must have this block size. */
+#define BUF_SIZE	512
+
+/* Most buffers the cache will have at once. */
+#define BUF_MAXBUFS	256
+
+void buffer_bootstrap(void);
+
+int buffer_read(struct device *dev, uint32_t block, struct buf **ret);
+int buffer_get(struct device *dev, uint32_t block, struct buf **ret);
+void buffer_release(struct buf *b);
+
+void *buffer_map(struct buf *b);
+bool buffer_isvalid(struct buf *b);
+void buffer_markdirty(struct buf *b);
+void buffer_invalidate(struct buf *b);
+int buffer_sync(struct buf *b);
+
+void buffer_readahead(struct device *dev, uint32_t block);
+void buffer_forget(struct device *dev, uint32_t block);
+int buffer_syncblock(struct device *dev, uint32_t block);
+int buffer_syncdev(struct device *dev);
+int buffer_dropdev(struct device *dev);
+
+void buffer_printstats(void);
+
+
+#endif /* _BUF_H_ */
@@ -32,14 +32,17 @@
 
 #include "opt-synchprobs.h"
 
+struct timespec; /* from <kern/time.h> */
+
 /*
  * Time-related definitions.
  *
  * hardclock() is called on every CPU HZ times a second, possibly only
  * when the CPU is not idle, for scheduling.
  *
- * timerclock() is called on one CPU once a second to allow simple
- * timed operations. (This is a fairly simpleminded interface.)
+ * timerclock() is called on one CPU once every timer tick (see
+ * LT_GRANULARITY in kern/dev/lamebus/ltimer.h) and drives the callout
+ * wheel below.
  *
  * gettime() may be used to fetch the current time of day.
  * getinterval() computes the time from time1 to time2.
@@ -56,17 +59,80 @@
 #define HZ  100
 #endif
 
+/* timer ticks (callout resolution) per second */
+#define CALLOUT_HZ  100
+
 void hardclock_bootstrap(void);
 
 void hardclock(void);
 void timerclock(void);
 
+/*
+ * clock_idle() is called by a cpu with nothing to run just before it
+ * waits for an interrupt. It stops the cpu's periodic hardclock and
+ * instead asks for one backstop interrupt a second later.
+ * clock_unidle() restarts the hardclock once the cpu has work again.
+ * An idle cpu that is given work is woken by IPI_UNIDLE.
+ */
+void clock_idle(void);
+void clock_unidle(void);
+
 void gettime(time_t *seconds, uint32_t *nanoseconds);
 
 void getinterval(time_t secs1, uint32_t nsecs,
                  time_t secs2, uint32_t nsecs2,
                  time_t *rsecs, uint32_t *rnsecs);
 
+/*
+ * Callouts.
+ *
+ * A callout arranges for a function to be called once a given number
+ * of timer ticks have gone by, either once (callout_schedule) or
+ * repeatedly every so many ticks (callout_periodic). The function is
+ * called from the timer interrupt, so it must not sleep; typically it
+ * wakes something up.
+ *
+ * Callouts live on a hierarchical timing wheel, so scheduling and
+ * cancelling are constant time and each tick only touches the
+ * callouts that are actually due.
+ *
+ * The structure is public so callouts can be embedded in other
+ * structures or put on the stack; don't touch the fields directly.
+ *
+ *    callout_init       - set up a callout that will call FUNC(ARG).
+ *    callout_schedule   - fire once, TICKS ticks from now. Reschedules
+ *                         the callout if it was already pending.
+ *    callout_periodic   - fire TICKS ticks from now and every TICKS
+ *                         ticks after that until cancelled.
+ *    callout_cancel     - stop a callout. Returns true if it was still
+ *                         pending. If the function is running on another
+ *                         cpu, waits for it to finish, so on return the
+ *                         callout may be freed.
+ *    callout_pending    - true if the callout is scheduled.
+ *
+ *    clock_ticks        - number of timer ticks since boot.
+ *    timespec_to_ticks  - timer ticks needed to cover at least the
+ *                         given interval.
+ */
+struct callout {
+	struct callout *c_next;		/* next in wheel bucket */
+	struct callout **c_prevp;	/* pointer to us in wheel bucket */
+	uint32_t c_expire;		/* tick at which to fire */
+	unsigned c_period;		/* reload interval; 0 if one-shot */
+	void (*c_func)(void *);		/* function to call */
+	void *c_arg;			/* argument for c_func */
+	bool c_pending;			/* true if on the wheel */
+};
+
+void callout_init(struct callout *c, void (*func)(void *), void *arg);
+void callout_schedule(struct callout *c, unsigned ticks);
+void callout_periodic(struct callout *c, unsigned ticks);
+bool callout_cancel(struct callout *c);
+bool callout_pending(struct callout *c);
+
+uint32_t clock_ticks(void);
+unsigned timespec_to_ticks(const struct timespec *ts);
+
 /*
  * clocksleep() suspends execution for the requested number of seconds,
  * like userlevel sleep(3). (Don't confuse it with wchan_sleep.)
@@ -83,5 +149,12 @@ void clocksleep(int seconds);
  */
 void clocknap(int ticks);
 
+/*
+ * clock_sleepticks() suspends execution for at least the requested
+ * number of timer ticks. Only the calling thread is woken, at its
+ * deadline. clocksleep(), clocknap() and nanosleep() are built on it.
+ */
+void clock_sleepticks(unsigned ticks);
+
 
 #endif /* _CLOCK_H_ */
@@ -60,6 +60,13 @@ struct cpu {
 	struct thread *c_curthread;	/* Current thread on cpu */
 	struct threadlist c_zombies;	/* List of exited threads */
 	unsigned c_hardclocks;		/* Counter of hardclock() calls */
+	unsigned c_idlestops;		/* Times hardclock stopped for idle */
+	bool c_tickless;		/* True if hardclock is stopped */
+	struct threadlist c_threadcache; /* Dead threads kept for reuse */
+	unsigned c_tcache_hits;		/* Forks served from the cache */
+	unsigned c_tcache_misses;	/* Forks that had to allocate */
+	uint64_t c_acctstamp;		/* Cycle count at last accounting */
+	uint64_t c_idletime;		/* Cycles spent idle */
 
 	/*
 	 * Accessed by other cpus.
@@ -109,6 +116,15 @@ void cpu_machdep_init(struct cpu *);
 /*ASMLINKAGE*/ void cpu_start_secondary(void);
 void cpu_hatch(unsigned software_number);
 
+/*
+ * Print per-cpu clock interrupt counts, for checking how many
+ * hardclocks idle cpus are skipping.
+ */
+void cpu_printclocks(void);
+
+/* Number of cpus that have been attached. */
+unsigned cpu_numcpus(void);
+
 /*
  * Return a string describing the CPU type.
  */
@@ -0,0 +1,67 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#ifndef _EXECARGS_H_
+#define _EXECARGS_H_
+
+/*
+ * Argument strings for a program being started by execv, spawn, or
+ * runprogram.
+ *
+ * The strings are packed end to end, NUL-terminated, at the front of
+ * one ARG_MAX-sized buffer. That buffer is sized to hold, after the
+ * strings, the argv pointer array too, so the whole block that goes
+ * on the new program's stack can be built in place and copied out in
+ * one go. Buffers come from a small pool so exec doesn't have to find
+ * 64k of contiguous kernel memory every time. Arguments that wouldn't
+ * fit on the new stack are refused with E2BIG, even under ARG_MAX.
+ *
+ * Functions:
+ *     execargs_copyin    - fetch argv from user space (one pass).
+ *     execargs_fromkernel- build from an argv held in the kernel.
+ *     execargs_copyout   - lay the block out below *stackptr in the
+ *                          current address space.
+ *     execargs_cleanup   - release the buffer.
+ */
+
+struct execargs {
+	char *ea_buf;		/* ARG_MAX bytes */
+	size_t ea_len;		/* bytes of strings in ea_buf */
+	int ea_argc;		/* number of strings */
+};
+
+int execargs_copyin(struct execargs *ea, userptr_t uargv);
+int execargs_fromkernel(struct execargs *ea, char **argv, int argc);
+int execargs_copyout(struct execargs *ea, vaddr_t *stackptr,
+		     userptr_t *uargv);
+void execargs_cleanup(struct execargs *ea);
+
+
+#endif /* _EXECARGS_H_ */
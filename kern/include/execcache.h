@@ -0,0 +1,108 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#ifndef _EXECCACHE_H_
+#define _EXECCACHE_H_
+
+/*
+ * Cache of recently run executables.
+ *
+ * An execimage is what load_elf needs to set up a program: the entry
+ * point, the PT_LOAD segments, and the file contents of each segment.
+ * Images are kept, keyed by vnode, in a small table with LRU
+ * replacement, so exec of a program that ran recently neither parses
+ * the ELF headers nor reads the file again.
+ *
+ * An image holds a reference to its vnode and remembers the vnode's
+ * vn_writegen as of before the file was read. If the file is written
+ * or truncated after that, the generation no longer matches and the
+ * image is thrown away at the next lookup.
+ *
+ * Images are reference counted; the table holds one reference and
+ * each exec using an image holds another while copying from it.
+ *
+ * Functions:
+ *     execimage_create  - make an empty image for a vnode, with one
+ *                         reference belonging to the caller.
+ *     execimage_release - drop a reference to an image.
+ *     execcache_get     - find a current image for a vnode, and
+ *                         return it with a reference, or NULL.
+ *     execcache_put     - offer an image to the cache. It is only
+ *                         kept if all its contents were read in.
+ *     execcache_flush   - drop every image for files on FS (or all
+ *                         images if FS is NULL), so it can be
+ *                         unmounted.
+ *     execcache_noteload- record how long an exec's load took.
+ *     execcache_printstats - print hit rate and load times.
+ */
+
+#include <vnode.h>
+
+struct fs;
+
+#define EXECIMAGE_MAXSEGS	4	/* PT_LOAD segments per image */
+
+/*
+ * Programs with more than this much in their segments aren't cached;
+ * they would push out everything else for little gain.
+ */
+#define EXECCACHE_MAXIMAGE	(256*1024)
+
+struct execseg {
+	vaddr_t es_vaddr;	/* where it goes */
+	size_t es_memsize;	/* size in memory */
+	size_t es_filesize;	/* size in the file */
+	off_t es_offset;	/* offset in the file */
+	uint32_t es_flags;	/* PF_R, PF_W, PF_X */
+	char *es_data;		/* es_filesize bytes of contents, or NULL */
+};
+
+struct execimage {
+	struct vnode *ei_vnode;		/* file (referenced) */
+	unsigned ei_writegen;		/* ei_vnode->vn_writegen when read */
+	vaddr_t ei_entry;		/* entry point */
+	unsigned ei_nsegs;		/* number of segments */
+	struct execseg ei_segs[EXECIMAGE_MAXSEGS];
+	size_t ei_size;			/* total size of segment contents */
+	unsigned ei_refcount;
+	unsigned ei_lastuse;		/* for LRU */
+};
+
+struct execimage *execimage_create(struct vnode *v);
+void execimage_release(struct execimage *ei);
+
+struct execimage *execcache_get(struct vnode *v);
+void execcache_put(struct execimage *ei);
+void execcache_flush(struct fs *fs);
+void execcache_noteload(bool hit, uint64_t cycles);
+void execcache_printstats(void);
+
+
+#endif /* _EXECCACHE_H_ */
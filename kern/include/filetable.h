@@ -0,0 +1,78 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#ifndef _FILETABLE_H_
+#define _FILETABLE_H_
+
+/*
+ * Per-process table of file descriptors.
+ *
+ * A slot holds a reference to an openfile, or NULL. The table is only
+ * ever used by its own process's thread (fork fills in the child's
+ * before the child runs), so neither lookups nor changes need a lock;
+ * lookups in particular, which every read and write does, are just an
+ * array index. If processes ever get more than one thread, changes
+ * will need a lock and lookups will need to take a reference.
+ *
+ * Functions:
+ *     filetable_create  - make an empty table.
+ *     filetable_destroy - close everything and free the table.
+ *     filetable_copy    - make a table referring to the same openfiles
+ *                         (for fork).
+ *     filetable_openstd - open the console on stdin, stdout, and stderr.
+ *     filetable_get     - look up FD; EBADF if it isn't open.
+ *     filetable_place   - put FILE in the lowest free slot (EMFILE if
+ *                         none), taking over the caller's reference.
+ *     filetable_placeat - put FILE in slot FD, and hand back what was
+ *                         there (or NULL) in *OLDFILE.
+ *     filetable_remove  - empty slot FD, handing back its reference.
+ */
+
+#include <limits.h>
+
+struct openfile;
+
+struct filetable {
+	struct openfile *ft_files[OPEN_MAX];
+};
+
+struct filetable *filetable_create(void);
+void filetable_destroy(struct filetable *ft);
+int filetable_copy(struct filetable *src, struct filetable **ret);
+int filetable_openstd(struct filetable *ft);
+
+int filetable_get(struct filetable *ft, int fd, struct openfile **ret);
+int filetable_place(struct filetable *ft, struct openfile *file, int *fd);
+int filetable_placeat(struct filetable *ft, struct openfile *file, int fd,
+		      struct openfile **oldfile);
+int filetable_remove(struct filetable *ft, int fd, struct openfile **ret);
+
+
+#endif /* _FILETABLE_H_ */
@@ -31,9 +31,12 @@
 #define _KERN_IOCTL_H_
 
 /*
- * ioctl operation codes
+ * ioctl operation codes. The argument is a pointer to an int in each case.
  */
 
-/* (none yet) */
+#define FIONBIO		1	/* set (nonzero) or clear non-blocking I/O */
+#define FIONREAD	2	/* get the number of bytes ready to read */
+#define PIPEIOC_GETSIZE	3	/* get a pipe's buffer size */
+#define PIPEIOC_SETSIZE	4	/* set a pipe's buffer size */
 
 #endif /* _KERN_IOCTL_H_*/
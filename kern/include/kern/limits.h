@@ -91,7 +91,7 @@
  */
 
 /* Max open files per process */
-#define __OPEN_MAX      128
+#define __OPEN_MAX      256
 
 /* Max number of iovec structures at once for readv/writev/preadv/pwritev */
 #define __IOV_MAX       1024
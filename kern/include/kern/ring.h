@@ -0,0 +1,110 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _KERN_RING_H_
+#define _KERN_RING_H_
+
+/*
+ * System call ring: a submission queue and a completion queue in the
+ * process's memory, shared with the kernel, so that a batch of I/O
+ * requests costs one trap instead of one each.
+ *
+ * The process hands RING_SIZE(n) bytes of its memory, 8-byte aligned,
+ * to ring_setup(mem, n); n is a power of 2 up to RING_MAXENTRIES. It
+ * then fills in submission entries and calls ring_enter(count), which
+ * carries out up to count of them in order and posts a completion for
+ * each, and returns the number done. ring_enter stops early if the
+ * completion queue fills up. ring_setup(NULL, 0) unregisters the ring,
+ * as does execv.
+ *
+ * Each queue is a ring of n entries with a head and a tail that count
+ * up forever and are taken mod n to index it. The producer (the
+ * process for submissions, the kernel for completions) fills in an
+ * entry and then advances the tail; the consumer reads the entry and
+ * then advances the head.
+ *
+ * Operations, with the fields they use; the result is what the
+ * system call would return, or -errno:
+ *
+ *   RING_OP_NOP    nothing; result 0.
+ *   RING_OP_READ   read(fd, buf, len), or pread at off if off >= 0.
+ *   RING_OP_WRITE  write(fd, buf, len), or pwrite at off if off >= 0.
+ *   RING_OP_OPEN   open(buf, flags, len); buf is the path and len the
+ *                  mode. The result is the new fd.
+ *   RING_OP_CLOSE  close(fd).
+ *   RING_OP_FSYNC  fsync(fd).
+ *
+ * sqe_data is not looked at; it is copied into the completion so the
+ * process can tell which request it belongs to.
+ */
+
+#define RING_OP_NOP	0
+#define RING_OP_READ	1
+#define RING_OP_WRITE	2
+#define RING_OP_OPEN	3
+#define RING_OP_CLOSE	4
+#define RING_OP_FSYNC	5
+
+#define RING_MAXENTRIES	256
+
+struct ring_sqe {
+	int sqe_op;			/* RING_OP_* */
+	int sqe_fd;			/* file descriptor */
+	__off_t sqe_off;		/* position, or -1 for the seek position */
+#ifdef _KERNEL
+	userptr_t sqe_buf;		/* buffer, or path for open */
+#else
+	void *sqe_buf;			/* buffer, or path for open */
+#endif
+	__size_t sqe_len;		/* buffer length, or mode for open */
+	int sqe_flags;			/* open flags */
+	__u32 sqe_data;			/* caller's tag */
+};
+
+struct ring_cqe {
+	__u32 cqe_data;			/* sqe_data of the request */
+	int cqe_result;			/* result, or -errno */
+};
+
+struct ring {
+	volatile __u32 r_sqhead;	/* advanced by the kernel */
+	volatile __u32 r_sqtail;	/* advanced by the process */
+	volatile __u32 r_cqhead;	/* advanced by the process */
+	volatile __u32 r_cqtail;	/* advanced by the kernel */
+	__u32 r_entries;		/* n, set by ring_setup */
+	__u32 r_pad[3];			/* so the queues are 8-byte aligned */
+	/* followed by n ring_sqes, then n ring_cqes */
+};
+
+#define RING_SQ(r)	((struct ring_sqe *)((r) + 1))
+#define RING_CQ(r, n)	((struct ring_cqe *)(RING_SQ(r) + (n)))
+#define RING_SIZE(n)	(sizeof(struct ring) + \
+			 (n) * (sizeof(struct ring_sqe) + sizeof(struct ring_cqe)))
+
+#endif /* _KERN_RING_H_ */
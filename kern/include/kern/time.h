@@ -51,6 +51,16 @@ struct timespec {
 };
 
 
+/*
+ * Clock ids and flags for clock_nanosleep. OS/161 has only the one
+ * clock, which never gets set backwards, so the two are the same.
+ */
+#define CLOCK_REALTIME	0	/* Time of day. */
+#define CLOCK_MONOTONIC	1	/* Time since some fixed point. */
+
+#define TIMER_ABSTIME	1	/* Sleep until an absolute time. */
+
+
 /*
  * Bits for interval timers. Obscure and not really that important.
  */
@@ -0,0 +1,102 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _LOCKSTAT_H_
+#define _LOCKSTAT_H_
+
+/*
+ * Lock contention statistics.
+ *
+ * With the lockstat kernel option, spinlocks, locks, and wait channels
+ * record how often they are taken, how often someone had to wait, and
+ * how long waits and holds lasted. Stats are kept per name, not per
+ * lock, so e.g. all vnode locks add up in one entry. Spinlocks have no
+ * name unless given one with spinlock_setname (or initialized with
+ * SPINLOCK_NAMED_INITIALIZER); unnamed spinlocks aren't counted.
+ *
+ * Times are in nanoseconds and are only collected once the clock is
+ * up (lockstat_bootstrap). When the option is off none of this exists
+ * and the lock code doesn't call in here at all.
+ */
+
+#include "opt-lockstat.h"
+
+#if OPT_LOCKSTAT
+
+#include <spinlock.h>
+
+/* Kinds of things measured. Same name, different kind: separate entry. */
+#define LOCKSTAT_SPINLOCK	0
+#define LOCKSTAT_LOCK		1
+#define LOCKSTAT_WCHAN		2
+
+#define LOCKSTAT_NAMELEN	24	/* longer names are truncated */
+#define LOCKSTAT_MAX		256	/* number of distinct entries */
+
+struct lockstat {
+	char ls_name[LOCKSTAT_NAMELEN];
+	unsigned ls_kind;
+	volatile spinlock_data_t ls_lock; /* protects the counters */
+	uint32_t ls_acquires;		/* times acquired (or slept on) */
+	uint32_t ls_contended;		/* times someone had to wait */
+	uint64_t ls_waittime;		/* total ns spent waiting */
+	uint64_t ls_waitmax;		/* longest wait */
+	uint64_t ls_holdtime;		/* total ns held */
+	uint64_t ls_holdmax;		/* longest hold */
+};
+
+/*
+ * Functions:
+ *
+ * lockstat_bootstrap - start collecting times; call once the clock
+ *                      device is attached.
+ * lockstat_get       - find the entry for KIND and NAME, making one if
+ *                      needed. When the table is full, everything else
+ *                      goes into one overflow entry.
+ * lockstat_now       - current time in ns for starting a wait; 0 until
+ *                      bootstrap.
+ * lockstat_acquired  - record an acquisition that started waiting at
+ *                      START. Returns the acquire time, to be handed
+ *                      to lockstat_released.
+ * lockstat_released  - record the hold that began at ACQUIRED.
+ * lockstat_print     - print the N most contended entries.
+ * lockstat_reset     - zero all counters.
+ */
+void lockstat_bootstrap(void);
+struct lockstat *lockstat_get(unsigned kind, const char *name);
+uint64_t lockstat_now(void);
+uint64_t lockstat_acquired(struct lockstat *ls, bool contended,
+			   uint64_t start);
+void lockstat_released(struct lockstat *ls, uint64_t acquired);
+void lockstat_print(unsigned n);
+void lockstat_reset(void);
+
+#endif /* OPT_LOCKSTAT */
+
+#endif /* _LOCKSTAT_H_ */
@@ -52,6 +52,25 @@ void mainbus_interrupt(struct trapframe *);
 /* XXX this interface is not adequately MI */
 size_t mainbus_ramsize(void);
 
+/*
+ * Control of the current cpu's periodic clock (hardclock) interrupt.
+ *
+ * mainbus_timer_idle stops the periodic interrupt while the cpu idles
+ * and instead arranges one interrupt USECS microseconds from now.
+ * mainbus_timer_resume restarts the periodic interrupt.
+ */
+void mainbus_timer_idle(uint32_t usecs);
+void mainbus_timer_resume(void);
+
+/*
+ * Per-cpu cycle counter, for CPU time accounting. mainbus_cycles
+ * returns the cycles the current cpu has run; only differences taken
+ * on the same cpu mean anything. Call with interrupts off.
+ * mainbus_cyclehz is the rate the counter runs at.
+ */
+uint64_t mainbus_cycles(void);
+uint32_t mainbus_cyclehz(void);
+
 /* Switch on an inter-processor interrupt. (Low-level.) */
 void mainbus_send_ipi(struct cpu *target);
 
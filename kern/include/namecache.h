@@ -0,0 +1,90 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _NAMECACHE_H_
+#define _NAMECACHE_H_
+
+/*
+ * Pathname lookup cache.
+ *
+ * Maps (directory vnode, name) to the inode number the name refers
+ * to, or records that the name doesn't exist (a negative entry), so a lookup
+ * that's been done recently doesn't have to search the directory
+ * again. Entries are found through a hash table and the least
+ * recently used one is reused when the cache is full.
+ *
+ * The cache is a library for filesystems, called from their
+ * VOP_LOOKUP: the filesystem looks in the cache first, and on a miss
+ * searches the directory and enters what it found. A filesystem that
+ * uses it must purge a name whenever it might change what the name
+ * refers to: when creating, linking, removing, or renaming. Entries
+ * are only entered and purged with the directory locked, so the
+ * cache never says something the directory doesn't. A lookup that
+ * is going to load the inode it gets back should also hold the
+ * directory lock, so the name can't be removed and the inode freed
+ * in between.
+ *
+ * Entries hold no vnode references, so caching a name doesn't keep
+ * either the directory or the file loaded. The directory vnode is
+ * only a key: the filesystem must call namecache_purgedir before it
+ * frees a directory vnode. Names longer than NAMECACHE_NAMELEN
+ * aren't cached.
+ *
+ * Functions:
+ *     namecache_lookup  - look up NAME in DIR. Returns false if it
+ *                         isn't cached; otherwise true, with *RET set
+ *                         to the inode number, or to NAMECACHE_NOINO
+ *                         if the name is known not to exist.
+ *     namecache_enter   - record that NAME in DIR refers to inode INO,
+ *                         or doesn't exist if INO is NAMECACHE_NOINO.
+ *     namecache_purge   - forget NAME in DIR.
+ *     namecache_purgedir - forget every name in DIR, before its vnode
+ *                         is freed.
+ *     namecache_printstats - print hit rate and counts.
+ */
+
+struct vnode;
+
+/* Longest name cached. */
+#define NAMECACHE_NAMELEN	31
+
+/* Most entries the cache will have at once. */
+#define NAMECACHE_SIZE		256
+
+/* Inode number of a name that doesn't exist. */
+#define NAMECACHE_NOINO		((ino_t)-1)
+
+bool namecache_lookup(struct vnode *dir, const char *name, ino_t *ret);
+void namecache_enter(struct vnode *dir, const char *name, ino_t ino);
+void namecache_purge(struct vnode *dir, const char *name);
+void namecache_purgedir(struct vnode *dir);
+void namecache_printstats(void);
+
+
+#endif /* _NAMECACHE_H_ */
@@ -0,0 +1,82 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#ifndef _OPENFILE_H_
+#define _OPENFILE_H_
+
+/*
+ * An open file: what open() returns a descriptor for. One openfile
+ * can be referred to from several descriptors, after dup2 or fork,
+ * and those share the seek position.
+ *
+ * of_offset is protected by of_offsetlock, but only when the file is
+ * shared: while of_refcount is 1, the one descriptor that refers to
+ * the file belongs to the thread using it and nobody else can get at
+ * it. Files that aren't seekable (the console, say) have no position
+ * to protect and never take the lock.
+ *
+ * Functions:
+ *     openfile_open    - open PATH (which is modified) with vfs_open.
+ *     openfile_fromvnode - make an openfile for a vnode that has been
+ *                        opened some other way, such as a pipe end.
+ *     openfile_incref  - add a reference.
+ *     openfile_decref  - drop a reference; the last one closes the file.
+ *     openfile_lockoffset   - lock of_offset if needed; returns
+ *                             whether it did.
+ *     openfile_unlockoffset - undo openfile_lockoffset.
+ */
+
+#include <spinlock.h>
+
+struct lock;
+struct vnode;
+
+struct openfile {
+	struct vnode *of_vnode;		/* the file */
+	int of_accmode;			/* O_RDONLY, O_WRONLY, or O_RDWR */
+	bool of_append;			/* O_APPEND */
+	bool of_seekable;		/* has a seek position */
+	struct lock *of_offsetlock;	/* protects of_offset */
+	off_t of_offset;		/* seek position */
+	struct spinlock of_reflock;	/* protects of_refcount */
+	unsigned of_refcount;
+};
+
+int openfile_open(char *path, int openflags, mode_t mode,
+		  struct openfile **ret);
+int openfile_fromvnode(struct vnode *vn, int openflags,
+		       struct openfile **ret);
+void openfile_incref(struct openfile *file);
+void openfile_decref(struct openfile *file);
+bool openfile_lockoffset(struct openfile *file);
+void openfile_unlockoffset(struct openfile *file, bool locked);
+
+
+#endif /* _OPENFILE_H_ */
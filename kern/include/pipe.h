@@ -0,0 +1,61 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _PIPE_H_
+#define _PIPE_H_
+
+/*
+ * Pipes.
+ *
+ * A pipe is a ring buffer with a vnode for each end, so the ends go
+ * into file tables like any other open file and read, write, and
+ * close need nothing special. The vnodes belong to no filesystem.
+ *
+ * A reader that finds the pipe empty leaves its uio where the next
+ * writer can see it, and that writer copies straight into the
+ * reader's buffer instead of going through the ring.
+ *
+ * Writes of PIPE_BUF bytes or less are atomic. Each end can be put
+ * in non-blocking mode with FIONBIO, and the buffer size can be
+ * changed with PIPEIOC_SETSIZE; see <kern/ioctl.h>.
+ *
+ * pipe_create makes a pipe with a SIZE byte buffer (0 for the
+ * default) and hands back its two ends, each as if from vfs_open:
+ * close them with vfs_close.
+ */
+
+struct vnode;
+
+#define PIPE_DEFSIZE	PAGE_SIZE	/* default buffer size */
+#define PIPE_MAXSIZE	(64*1024)	/* largest buffer size allowed */
+
+int pipe_create(size_t size, struct vnode **readvn, struct vnode **writevn);
+
+
+#endif /* _PIPE_H_ */
@@ -0,0 +1,111 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _POLL_H_
+#define _POLL_H_
+
+/*
+ * Readiness notification, for poll and select.
+ *
+ * Anything that can be polled (a pipe, the console) embeds a
+ * pollhead. Its VOP_POLL reports which of the requested events are
+ * ready now and, if handed a pollent, registers it on the pollhead;
+ * both are done under the same lock the object's state changes are
+ * made under, so no wakeup can fall between the check and the
+ * registration. Whenever the object's state changes it calls
+ * pollwakeup with the events that might now be ready.
+ *
+ * Each poll call has one poller and a pollent per descriptor.
+ * pollwakeup puts the matching pollents on their poller's ready list
+ * and wakes it, so after a wakeup the poller looks at only the
+ * descriptors that fired, not all of them.
+ *
+ * Lock order: object lock, then ph_lock, then pl_lock. pollwakeup
+ * may be called from an interrupt handler.
+ *
+ * Functions:
+ *     pollhead_init/cleanup - set up and tear down a pollhead. It
+ *                          must be empty when cleaned up.
+ *     pollhead_add        - register PE on PH; called from VOP_POLL.
+ *                          A pollent is only registered once.
+ *     pollwakeup          - EVENTS may be ready on PH's object.
+ *
+ *     poller_init/cleanup - set up and tear down a poller.
+ *     pollent_init        - set up PE for EVENTS on poller PL.
+ *     pollent_remove      - unregister PE, if it was registered.
+ *     poller_wait         - sleep until some pollent fires or TICKS
+ *                          timer ticks go by (forever if TICKS is
+ *                          negative). Returns the pollents that fired,
+ *                          linked through pe_firednext, or NULL on
+ *                          timeout. They are rearmed on return.
+ */
+
+#include <spinlock.h>
+#include <clock.h>
+
+struct wchan;
+struct poller;
+
+struct pollent {
+	struct poller *pe_poller;	/* who to wake */
+	struct pollhead *pe_head;	/* registered on, or NULL */
+	struct pollent *pe_next;	/* next on pe_head */
+	struct pollent **pe_prevp;	/* pointer to us on pe_head */
+	struct pollent *pe_readynext;	/* next on the poller's ready list */
+	struct pollent *pe_firednext;	/* next as returned by poller_wait */
+	int pe_events;			/* events that wake the poller */
+	bool pe_fired;			/* on the poller's ready list */
+};
+
+struct pollhead {
+	struct spinlock ph_lock;	/* protects ph_entries */
+	struct pollent *ph_entries;	/* registered pollents */
+};
+
+struct poller {
+	struct spinlock pl_lock;	/* protects the rest */
+	struct wchan *pl_wchan;		/* poller sleeps here */
+	struct pollent *pl_ready;	/* pollents fired since last wait */
+	bool pl_timedout;		/* pl_timeout went off */
+	struct callout pl_timeout;	/* for poller_wait's TICKS */
+};
+
+void pollhead_init(struct pollhead *ph);
+void pollhead_cleanup(struct pollhead *ph);
+void pollhead_add(struct pollhead *ph, struct pollent *pe);
+void pollwakeup(struct pollhead *ph, int events);
+
+int poller_init(struct poller *pl);
+void poller_cleanup(struct poller *pl);
+void pollent_init(struct pollent *pe, struct poller *pl, int events);
+void pollent_remove(struct pollent *pe);
+struct pollent *poller_wait(struct poller *pl, int ticks);
+
+
+#endif /* _POLL_H_ */
@@ -43,10 +43,24 @@
 
 struct addrspace;
 struct vnode;
+#if OPT_A2
+struct filetable;
+struct ring;
+#endif /* OPT_A2 */
 #ifdef UW
 struct semaphore;
 #endif // UW
 
+/*
+ * CPU usage totals. Times are in cycles (see mainbus_cycles).
+ */
+struct proc_usage {
+	uint64_t pu_utime;		/* User time */
+	uint64_t pu_stime;		/* System time */
+	uint32_t pu_nvcsw;		/* Voluntary context switches */
+	uint32_t pu_nivcsw;		/* Involuntary context switches */
+};
+
 /*
  * Process structure.
  */
@@ -54,6 +68,12 @@ struct proc {
 	char *p_name;			/* Name of this process */
 	struct spinlock p_lock;		/* Lock for this structure */
 	struct threadarray p_threads;	/* Threads in this process */
+	struct proc *p_allnext;		/* Link on the list of all procs */
+	struct proc *p_allprev;
+
+	/* Accounting */
+	struct proc_usage p_usage;	/* Threads that have left */
+	struct proc_usage p_cusage;	/* Children that have been reaped */
 
 	/* VM */
 	struct addrspace *p_addrspace;	/* virtual address space */
@@ -61,6 +81,11 @@ struct proc {
 	/* VFS */
 	struct vnode *p_cwd;		/* current working directory */
 
+#if OPT_A2
+	struct filetable *p_filetable;	/* open files */
+	struct ring *p_ring;		/* syscall ring, kernel address */
+	unsigned p_ringentries;		/* its size */
+#else
 #ifdef UW
   /* a vnode to refer to the console device */
   /* this is a quick-and-dirty way to get console writes working */
@@ -69,19 +94,23 @@ struct proc {
      it has opened, not just the console. */
   struct vnode *console;                /* a vnode for the console device */
 #endif
+#endif /* OPT_A2 */
 
 #if OPT_A2
 	pid_t pid;			/* pid of the process */
+	struct proc *p_pidnext;		/* next in pid hash chain */
 
-	struct proc *p_parent;			/* parent of the process */
-	struct array *p_children;			/* children (alive) of the process */
+	/* parent/child links; protected by pid_lock */
+	struct proc *p_parent;		/* parent, or NULL if owned by the kernel */
+	struct proc *p_children;	/* first running child */
+	struct proc *p_zombies;		/* first exited child, not yet reaped */
+	struct proc *p_sibnext;		/* next on p_parent's list */
+	struct proc *p_sibprev;		/* previous on p_parent's list */
 
 	int exitcode;                      /* its exit code */
 	bool alive;                        /* process's alive status */
-	bool hasWaited;                    /* check if the process has been called on wait_pid */
-
-	struct cv *cv_wake_parent;         /* cv used to wake the parent */
-	struct lock *cv_lock;              /* lock used for cv */
+	bool exited;                       /* done exiting; on p_zombies */
+	bool p_vforked;                    /* using p_parent's addrspace */
 #endif /* OPT_A2 */
 
 };
@@ -98,7 +127,7 @@ extern struct semaphore *no_proc_sem;
 void proc_bootstrap(void);
 
 /* Create a fresh process for use by runprogram(). */
-struct proc *proc_create_runprogram(const char *name);
+int proc_create_runprogram(const char *name, struct proc **ret);
 
 /* Destroy a process. */
 void proc_destroy(struct proc *proc);
@@ -109,6 +138,18 @@ int proc_addthread(struct proc *proc, struct thread *t);
 /* Detach a thread from its process. */
 void proc_remthread(struct thread *t);
 
+/* Move a thread's CPU usage counters into its process's totals. */
+void proc_chargethread(struct thread *t);
+
+/* Get a process's CPU usage, including that of its live threads. */
+void proc_getusage(struct proc *proc, struct proc_usage *pu);
+
+/* Add a reaped child's usage (its own and its children's) to proc. */
+void proc_addchildusage(struct proc *proc, struct proc *child);
+
+/* Print all processes with their CPU usage (for the menu). */
+void proc_printall(void);
+
 /* Fetch the address space of the current process. */
 struct addrspace *curproc_getas(void);
 
@@ -124,6 +165,29 @@ void detach_child(struct proc *c_proc, struct proc *p_proc);
 
 /* verify if proc has a child with pid _pid. If success return the pointer to that process, if fail then return NULL*/
 struct proc *search_pid(struct proc *proc, pid_t pid);
+
+/*
+ * Finish exiting, after the last thread has left: hand any children
+ * over to the kernel and post to the parent's zombie list. Destroys
+ * the process if no one is going to wait for it.
+ */
+void proc_zombify(struct proc *proc);
+
+/*
+ * Wait for an exited child of proc (pid -1 for any) and detach it.
+ * The caller collects its exit status and destroys it. With nohang,
+ * returns 0 with *childp NULL rather than sleep.
+ */
+int proc_waitchild(struct proc *proc, pid_t pid, bool nohang,
+		   struct proc **childp);
+
+/*
+ * vfork support. The parent sleeps in proc_vfork_wait until the child
+ * calls proc_vfork_done, on exec or exit, to give back the borrowed
+ * address space.
+ */
+void proc_vfork_wait(struct proc *child);
+void proc_vfork_done(struct proc *child);
 #endif /* OPT_A2 */
 
 
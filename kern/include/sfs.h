@@ -48,11 +48,72 @@
  */
 #include <kern/sfs.h>
 
+/*
+ * Locking.
+ *
+ * sv_lock covers a vnode's inode (sv_i, sv_dirty), the readahead
+ * state, and the file's contents, including its indirect block. For
+ * a directory it is also the directory lock: it is held across
+ * lookups in the directory and changes to its entries, so a name
+ * can't vanish between being found and being used. Name cache
+ * entries for the directory are made and purged under it too;
+ * lookups that hit in the name cache don't take it. sv_ino never
+ * changes and needs no lock.
+ *
+ * sfs_vnlock covers the table of loaded vnodes (sfs_vnhash, the
+ * sv_hashnext and sv_lru* links, sv_cached, and the counts) and is
+ * what loadvnode and reclaim serialize on. sfs_freemaplock covers
+ * the free block bitmap and the superblock, and their dirty flags.
+ * The superblock's volume name never changes after mount.
+ *
+ * Locks are taken in this order (the VFS-wide order is in vfs.h):
+ *
+ *    directory sv_lock
+ *    file sv_lock
+ *    sfs_vnlock
+ *    sfs_freemaplock
+ *    buffer cache
+ *
+ * SFS has only the root directory, so no operation ever needs two
+ * directory locks.
+ */
+
+/*
+ * Loaded vnodes are found by inode number through a hash table. When
+ * the last reference to a file that still has a name goes away, its
+ * vnode isn't freed but kept on an LRU list, still in the table, so
+ * a file that is opened and closed over and over isn't read in from
+ * its inode block each time. At most SFS_VNCACHE are kept like this.
+ * A cached vnode holds the one reference reclaim was handed; reusing
+ * it takes that over instead of adding one.
+ */
+#define SFS_VNHASHSIZE	256	/* hash chains; a power of 2 */
+#define SFS_VNCACHE	64	/* unreferenced vnodes kept around */
+
+/*
+ * Readahead state for one sequential reader of a file. Each vnode
+ * tracks a few, so readers at different places in the same file
+ * don't reset each other's windows.
+ */
+#define SFS_RASTREAMS	4	/* sequential readers tracked per vnode */
+
+struct sfs_rastream {
+	off_t ra_off;                   /* where the last read stopped */
+	unsigned ra_window;             /* readahead window, in blocks */
+	uint32_t ra_end;                /* file block read ahead up to */
+};
+
 struct sfs_vnode {
 	struct vnode sv_v;              /* abstract vnode structure */
+	struct lock *sv_lock;           /* see above */
 	struct sfs_inode sv_i;		/* on-disk inode */
 	uint32_t sv_ino;                /* inode number */
 	bool sv_dirty;                  /* true if sv_i modified */
+	struct sfs_rastream sv_ra[SFS_RASTREAMS]; /* most recent first */
+	struct sfs_vnode *sv_hashnext;  /* hash chain */
+	struct sfs_vnode *sv_lruprev;   /* LRU list, when */
+	struct sfs_vnode *sv_lrunext;   /*   sv_cached */
+	bool sv_cached;                 /* unreferenced, on the LRU list */
 };
 
 struct sfs_fs {
@@ -60,7 +121,13 @@ struct sfs_fs {
 	struct sfs_super sfs_super;	/* on-disk superblock */
 	bool sfs_superdirty;            /* true if superblock modified */
 	struct device *sfs_device;      /* device mounted on */
-	struct vnodearray *sfs_vnodes;  /* vnodes loaded into memory */
+	struct lock *sfs_vnlock;        /* protects the vnode table */
+	struct sfs_vnode *sfs_vnhash[SFS_VNHASHSIZE]; /* loaded vnodes */
+	unsigned sfs_nvnodes;           /* number loaded, including... */
+	unsigned sfs_ncached;           /* ...these on the LRU list */
+	struct sfs_vnode *sfs_lruhead;  /* most recently released */
+	struct sfs_vnode *sfs_lrutail;  /* least recently released */
+	struct lock *sfs_freemaplock;   /* protects freemap and super */
 	struct bitmap *sfs_freemap;     /* blocks in use are marked 1 */
 	bool sfs_freemapdirty;          /* true if freemap modified */
 };
@@ -75,17 +142,29 @@ int sfs_mount(const char *device);
  * Internal functions
  */
 
-/* Initialize uio structure */
-#define SFSUIO(iov, uio, ptr, block, rw) \
-    uio_kinit(iov, uio, ptr, SFS_BLOCKSIZE, ((off_t)(block))*SFS_BLOCKSIZE, rw)
-
-/* Convenience functions for block I/O */
-int sfs_rwblock(struct sfs_fs *sfs, struct uio *uio);
+/*
+ * Convenience functions for block I/O. These copy whole blocks in or
+ * out of the buffer cache; code that works on a block in place gets
+ * the buffer with buffer_read or buffer_get on sfs_device and calls
+ * sfs_writebuf after changing it.
+ */
+struct buf;
 int sfs_rblock(struct sfs_fs *sfs, void *data, uint32_t block);
 int sfs_wblock(struct sfs_fs *sfs, void *data, uint32_t block);
+int sfs_writebuf(struct buf *b);
 
 /* Get root vnode */
 struct vnode *sfs_getroot(struct fs *fs);
 
+/* Free the cached unreferenced vnodes; EBUSY if others are in use */
+int sfs_dropvnodes(struct sfs_fs *sfs);
+
+/*
+ * Write a dirty in-memory inode (caller holds sv_lock), or the free
+ * map, to the buffer cache
+ */
+int sfs_sync_inode(struct sfs_vnode *sv);
+int sfs_sync_freemap(struct sfs_fs *sfs);
+
 
 #endif /* _SFS_H_ */
@@ -36,6 +36,7 @@
  */
 
 #include <cdefs.h>
+#include "opt-lockstat.h"
 
 /* Inlining support - for making sure an out-of-line copy gets built */
 #ifndef SPINLOCK_INLINE
@@ -50,19 +51,46 @@
  *
  * Note that spinlocks are held by CPUs, not by threads.
  *
+ * These are ticket locks: each CPU that wants the lock takes the next
+ * number from lk_next and spins until lk_serving reaches it. This
+ * hands the lock out in FIFO order, so no CPU can be starved, and
+ * waiters only read while they spin instead of all hammering the
+ * lock word with LL/SC.
+ *
+ * With the lockstat option a spinlock can be given a name, and named
+ * spinlocks report their contention through lockstat (see lockstat.h).
+ *
  * This structure is made public so spinlocks do not have to be
  * malloc'd; however, code that uses spinlocks should not look inside
  * the structure directly but always use the spinlock API functions.
  */
+struct lockstat;	/* Opaque. */
+
 struct spinlock {
-	volatile spinlock_data_t lk_lock; /* The memory word where we spin. */
+	volatile spinlock_data_t lk_next;    /* Next ticket to hand out. */
+	volatile spinlock_data_t lk_serving; /* Ticket that holds the lock. */
 	struct cpu *lk_holder;		/* CPU holding this lock. */
+#if OPT_LOCKSTAT
+	const char *lk_name;		/* Name for lockstat, or NULL. */
+	struct lockstat *lk_stat;	/* Stats entry, looked up lazily. */
+	uint64_t lk_acqtime;		/* When the holder got it. */
+#endif
 };
 
 /*
- * Initializer for cases where a spinlock needs to be static or global.
+ * Initializers for cases where a spinlock needs to be static or global.
+ * The named version sets the lockstat name; without lockstat it's the
+ * same as the plain one.
  */
-#define SPINLOCK_INITIALIZER	{ SPINLOCK_DATA_INITIALIZER, NULL }
+#if OPT_LOCKSTAT
+#define SPINLOCK_NAMED_INITIALIZER(name) \
+	{ SPINLOCK_DATA_INITIALIZER, SPINLOCK_DATA_INITIALIZER, NULL, \
+	  name, NULL, 0 }
+#else
+#define SPINLOCK_NAMED_INITIALIZER(name) \
+	{ SPINLOCK_DATA_INITIALIZER, SPINLOCK_DATA_INITIALIZER, NULL }
+#endif
+#define SPINLOCK_INITIALIZER	SPINLOCK_NAMED_INITIALIZER(NULL)
 
 /*
  * Spinlock functions.
@@ -74,6 +102,9 @@ struct spinlock {
  * release	Release the lock. May re-enable interrupts.
  *
  * do_i_hold	Check if the current CPU holds the lock.
+ *
+ * setname	Name the lock for lockstat. The string must stay around
+ *		as long as the lock does. Does nothing without lockstat.
  */
 
 void spinlock_init(struct spinlock *lk);
@@ -84,5 +115,11 @@ void spinlock_release(struct spinlock *lk);
 
 bool spinlock_do_i_hold(struct spinlock *lk);
 
+#if OPT_LOCKSTAT
+void spinlock_setname(struct spinlock *lk, const char *name);
+#else
+#define spinlock_setname(lk, name) ((void)(lk), (void)(name))
+#endif
+
 
 #endif /* _SPINLOCK_H_ */
@@ -77,9 +77,15 @@ struct lock {
         // add what you need here
         // (don't forget to mark things volatile as needed)
 
-        volatile struct thread *owner;
+        struct thread *volatile owner;  /* holder, NULL if free */
         struct spinlock spin;
         struct wchan *wc;
+        volatile unsigned waiters;      /* threads asleep on wc */
+        volatile bool woken;            /* a waiter is on its way */
+#if OPT_LOCKSTAT
+        struct lockstat *stat;          /* contention stats */
+        uint64_t acqtime;               /* when the holder got it */
+#endif
 };
 
 struct lock *lock_create(const char *name);
@@ -88,7 +94,10 @@ void lock_acquire(struct lock *);
 /*
  * Operations:
  *    lock_acquire - Get the lock. Only one thread can hold the lock at the
- *                   same time.
+ *                   same time. Locks are adaptive: while the holder is
+ *                   running on another cpu, a waiter spins (for a while)
+ *                   instead of going to sleep, since the lock will
+ *                   probably be released soon.
  *    lock_release - Free the lock. Only the thread holding the lock may do
  *                   this.
  *    lock_do_i_hold - Return true if the current thread holds the lock; 
@@ -145,4 +154,47 @@ void cv_signal(struct cv *cv, struct lock *lock);
 void cv_broadcast(struct cv *cv, struct lock *lock);
 
 
+/*
+ * Reader-writer lock.
+ *
+ * Any number of readers may hold the lock at once, or one writer.
+ * Writers are preferred: once a writer is waiting, new readers wait
+ * too, so a steady stream of readers can't starve writers out.
+ *
+ * The name field is for easier debugging. A copy of the name is
+ * made internally.
+ */
+struct rwlock {
+        char *rwlock_name;
+        struct spinlock rw_lock;
+        struct wchan *rw_readwc;           /* readers wait here */
+        struct wchan *rw_writewc;          /* writers wait here */
+        volatile unsigned rw_readers;      /* readers holding the lock */
+        volatile unsigned rw_writewait;    /* writers waiting */
+        struct thread *volatile rw_writer; /* writer holding the lock */
+};
+
+struct rwlock *rwlock_create(const char *name);
+void rwlock_destroy(struct rwlock *);
+
+/*
+ * Operations:
+ *    rwlock_acquire_read   - Get the lock for shared (read) access.
+ *    rwlock_release_read   - Give up shared access.
+ *    rwlock_acquire_write  - Get the lock for exclusive (write) access.
+ *    rwlock_release_write  - Give up exclusive access.
+ *    rwlock_do_i_hold_write - Return true if the current thread holds
+ *                   the lock for writing.
+ *    rwlock_is_held - Return true if anyone holds the lock in either
+ *                   mode. Readers aren't tracked individually, so this
+ *                   is the best a reader can assert.
+ */
+void rwlock_acquire_read(struct rwlock *);
+void rwlock_release_read(struct rwlock *);
+void rwlock_acquire_write(struct rwlock *);
+void rwlock_release_write(struct rwlock *);
+bool rwlock_do_i_hold_write(struct rwlock *);
+bool rwlock_is_held(struct rwlock *);
+
+
 #endif /* _SYNCH_H_ */
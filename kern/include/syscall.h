@@ -52,6 +52,20 @@ void enter_forked_process(void *t, unsigned long stub);
 void enter_forked_process(struct trapframe *tf);
 #endif /* OPT_A2 */
 
+/* Set up the futex hash table. */
+void futex_bootstrap(void);
+
+#if OPT_A2
+struct addrspace;
+struct vnode;
+struct execargs;
+
+/* Load a program and its arguments into a new address space. */
+int loadexec(struct vnode *v, struct execargs *args,
+	     struct addrspace **oldasp, vaddr_t *entrypoint,
+	     vaddr_t *stackptr, userptr_t *uargv);
+#endif /* OPT_A2 */
+
 /* Enter user mode. Does not return. */
 void enter_new_process(int argc, userptr_t argv, vaddr_t stackptr,
 		       vaddr_t entrypoint);
@@ -63,6 +77,9 @@ void enter_new_process(int argc, userptr_t argv, vaddr_t stackptr,
 
 int sys_reboot(int code);
 int sys___time(userptr_t user_seconds, userptr_t user_nanoseconds);
+int sys_nanosleep(userptr_t user_req, userptr_t user_rem);
+int sys_futex(userptr_t uaddr, int op, int val, int *retval);
+int sys_getrusage(int who, userptr_t usage);
 
 #ifdef UW
 int sys_write(int fdesc,userptr_t ubuf,unsigned int nbytes,int *retval);
@@ -74,7 +91,29 @@ int sys_waitpid(pid_t pid, userptr_t status, int options, pid_t *retval);
 
 #if OPT_A2
 int sys_fork(struct trapframe *tf, pid_t *retval);
+int sys_vfork(struct trapframe *tf, pid_t *retval);
 int sys_execv(const userptr_t program, const userptr_t args);
+int sys___spawn(userptr_t path, userptr_t argv, pid_t *retval);
+
+int sys_open(userptr_t path, int flags, mode_t mode, int *retval);
+int sys_read(int fd, userptr_t buf, size_t nbytes, int *retval);
+int sys_pread(int fd, userptr_t buf, size_t nbytes, off_t pos, int *retval);
+int sys_pwrite(int fd, userptr_t buf, size_t nbytes, off_t pos, int *retval);
+int sys_readv(int fd, userptr_t iov, int iovcnt, int *retval);
+int sys_writev(int fd, userptr_t iov, int iovcnt, int *retval);
+int sys_preadv(int fd, userptr_t iov, int iovcnt, off_t pos, int *retval);
+int sys_pwritev(int fd, userptr_t iov, int iovcnt, off_t pos, int *retval);
+int sys_close(int fd);
+int sys_lseek(int fd, off_t pos, int whence, off_t *retval);
+int sys_dup2(int oldfd, int newfd, int *retval);
+int sys_fsync(int fd);
+int sys_ioctl(int fd, int code, userptr_t data);
+int sys_pipe(userptr_t fds);
+int sys_poll(userptr_t fds, unsigned nfds, int timeout, int *retval);
+int sys_select(int nfds, userptr_t readfds, userptr_t writefds,
+	       userptr_t exceptfds, userptr_t timeout, int *retval);
+int sys_ring_setup(userptr_t mem, unsigned entries);
+int sys_ring_enter(unsigned count, int *retval);
 #endif /* OPT_A2 */
 
 #endif /* _SYSCALL_H_ */
@@ -62,6 +62,12 @@ int threadtest3(int, char **);
 int semtest(int, char **);
 int locktest(int, char **);
 int cvtest(int, char **);
+int rwlocktest(int, char **);
+int spinlockbench(int, char **);
+
+/* clock tests */
+int clocktest(int, char **);
+int clocktest2(int, char **);
 
 #ifdef UW
 /* Another thread and synchronization test */
@@ -77,6 +83,7 @@ int writestress(int, char **);
 int writestress2(int, char **);
 int createstress(int, char **);
 int printfile(int, char **);
+int buftest(int, char **);
 
 /* other tests */
 int malloctest(int, char **);
@@ -55,6 +55,9 @@ struct cpu;
 /* Macro to test if two addresses are on the same kernel stack */
 #define SAME_STACK(p1, p2)     (((p1) & STACK_MASK) == ((p2) & STACK_MASK))
 
+/* Default number of dead threads (with stacks) each cpu keeps for reuse */
+#define THREAD_CACHE_DEPTH 8
+
 
 /* States a thread can be in. */
 typedef enum {
@@ -101,6 +104,15 @@ struct thread {
 	int t_curspl;			/* Current spl*() state */
 	int t_iplhigh_count;		/* # of times IPL has been raised */
 
+	/*
+	 * CPU time accounting, in cycles (see mainbus_cycles).
+	 * Only updated by the cpu the thread is running on.
+	 */
+	uint64_t t_utime;		/* Time spent in user mode */
+	uint64_t t_stime;		/* Time spent in the kernel */
+	uint32_t t_nvcsw;		/* Voluntary context switches */
+	uint32_t t_nivcsw;		/* Involuntary context switches */
+
 	/*
 	 * Public fields
 	 */
@@ -168,5 +180,26 @@ void schedule(void);
  */
 void thread_consider_migration(void);
 
+/*
+ * Per-cpu cache of exited threads, reused by thread_fork to save
+ * allocating and freeing the thread and its stack.
+ *
+ * thread_cache_setdepth - set how many threads each cpu keeps; 0
+ *                         turns the cache off. Excess cached threads
+ *                         are freed as the cpus get to them.
+ * thread_cache_print    - print per-cpu hit and miss counts.
+ */
+void thread_cache_setdepth(unsigned depth);
+void thread_cache_print(void);
+
+/*
+ * CPU time accounting hooks for the trap code. Call with interrupts
+ * off, thread_acct_enterkernel on entry to the kernel from user mode
+ * and thread_acct_exitkernel on the way back out. Context switches
+ * are accounted for by thread_switch.
+ */
+void thread_acct_enterkernel(void);
+void thread_acct_exitkernel(void);
+
 
 #endif /* _THREAD_H_ */
@@ -185,12 +185,17 @@ DECLARRAY(vnode);
 DEFARRAY(vnode, VFSINLINE);
 
 /*
- * Global one-big-lock for all filesystem operations.
- * You must remove this for the filesystem assignment.
+ * There is no global filesystem lock. Where more than one of the
+ * following is held, they must be acquired in this order:
+ *
+ *    knowndevs_lock       - the device table (vfslist.c); held across
+ *                           mount, unmount, sync, and vfs_getroot
+ *    filesystem locks     - per-fs, per-directory, and per-vnode locks;
+ *                           for SFS see sfs.h
+ *    name cache           - namecache.c
+ *    buffer cache         - buf.c
+ *    vn_countlock         - a vnode's reference and open counts
  */
-void vfs_biglock_acquire(void);
-void vfs_biglock_release(void);
-bool vfs_biglock_do_i_hold(void);
 
 
 #endif /* _VFS_H_ */
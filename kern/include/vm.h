@@ -44,6 +44,9 @@
 #define VM_FAULT_WRITE       1    /* A write was attempted */
 #define VM_FAULT_READONLY    2    /* A write to a readonly page was attempted*/
 
+/* Pages of stack a new user address space gets */
+#define VM_STACKPAGES        12
+
 
 /* Initialization function */
 void vm_bootstrap(void);
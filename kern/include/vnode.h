@@ -30,9 +30,11 @@
 #ifndef _VNODE_H_
 #define _VNODE_H_
 
+#include <spinlock.h>
 
 struct uio;
 struct stat;
+struct pollent;
 
 /*
  * A struct vnode is an abstract representation of a file.
@@ -50,10 +52,21 @@ struct stat;
  * vn_opencount is managed using VOP_INCOPEN and VOP_DECOPEN by
  * vfs_open() and vfs_close(). Code above the VFS layer should not
  * need to worry about it.
+ *
+ * vn_writegen is bumped after every VOP_WRITE and VOP_TRUNCATE, so
+ * something that caches file contents can tell whether the file has
+ * changed since it looked.
+ *
+ * vn_countlock protects vn_refcount and vn_opencount, and changes to
+ * vn_writegen; reading vn_writegen needs no lock. It is the innermost
+ * lock in the VFS; filesystems take it last, in reclaim, to decide
+ * whether the vnode can really go away.
  */
 struct vnode {
+	struct spinlock vn_countlock;   /* Protects the counts */
 	int vn_refcount;                /* Reference count */
 	int vn_opencount;
+	unsigned vn_writegen;		/* Changes when the file does */
 
 	struct fs *vn_fs;               /* Filesystem vnode belongs to */
 
@@ -89,7 +102,12 @@ struct vnode {
  *
  *    vop_reclaim     - Called when vnode is no longer in use. Note that
  *                      this may be substantially after vop_close is
- *                      called.
+ *                      called. The caller passes in the last
+ *                      reference, but someone may have found the
+ *                      vnode again in the meantime; the filesystem
+ *                      must recheck vn_refcount under vn_countlock
+ *                      and, if it is above 1, drop the reference and
+ *                      return EBUSY instead.
  *
  *****************************************
  *
@@ -120,6 +138,10 @@ struct vnode {
  *                      DATA. The interpretation of the data is specific
  *                      to each ioctl.
  *
+ *    vop_poll        - Set *REVENTS to those of EVENTS (see kern/poll.h)
+ *                      that are ready now, and if PE isn't null,
+ *                      register it to hear about changes. See poll.h.
+ *
  *    vop_stat        - Return info about a file. The pointer is a 
  *                      pointer to struct stat; see kern/stat.h.
  *
@@ -205,6 +227,8 @@ struct vnode_ops {
 	int (*vop_getdirentry)(struct vnode *dir, struct uio *uio);
 	int (*vop_write)(struct vnode *file, struct uio *uio);
 	int (*vop_ioctl)(struct vnode *object, int op, userptr_t data);
+	int (*vop_poll)(struct vnode *object, int events,
+			struct pollent *pe, int *revents);
 	int (*vop_stat)(struct vnode *object, struct stat *statbuf);
 	int (*vop_gettype)(struct vnode *object, mode_t *result);
 	int (*vop_tryseek)(struct vnode *object, off_t pos);
@@ -248,14 +272,15 @@ struct vnode_ops {
 #define VOP_READ(vn, uio)               (__VOP(vn, read)(vn, uio))
 #define VOP_READLINK(vn, uio)           (__VOP(vn, readlink)(vn, uio))
 #define VOP_GETDIRENTRY(vn, uio)        (__VOP(vn,getdirentry)(vn, uio))
-#define VOP_WRITE(vn, uio)              (__VOP(vn, write)(vn, uio))
+#define VOP_WRITE(vn, uio)              vnode_write(vn, uio)
 #define VOP_IOCTL(vn, code, buf)        (__VOP(vn, ioctl)(vn,code,buf))
+#define VOP_POLL(vn, ev, pe, rev)       (__VOP(vn, poll)(vn, ev, pe, rev))
 #define VOP_STAT(vn, ptr) 	        (__VOP(vn, stat)(vn, ptr))
 #define VOP_GETTYPE(vn, result)         (__VOP(vn, gettype)(vn, result))
 #define VOP_TRYSEEK(vn, pos)            (__VOP(vn, tryseek)(vn, pos))
 #define VOP_FSYNC(vn)                   (__VOP(vn, fsync)(vn))
 #define VOP_MMAP(vn /*add stuff */)     (__VOP(vn, mmap)(vn /*add stuff */))
-#define VOP_TRUNCATE(vn, pos)           (__VOP(vn, truncate)(vn, pos))
+#define VOP_TRUNCATE(vn, pos)           vnode_truncate(vn, pos)
 #define VOP_NAMEFILE(vn, uio)           (__VOP(vn, namefile)(vn, uio))
 
 #define VOP_CREAT(vn,nm,excl,mode,res)  (__VOP(vn, creat)(vn,nm,excl,mode,res))
@@ -274,6 +299,13 @@ struct vnode_ops {
  */
 void vnode_check(struct vnode *, const char *op);
 
+/*
+ * Write and truncate (VOP_WRITE and VOP_TRUNCATE), which also bump
+ * vn_writegen.
+ */
+int vnode_write(struct vnode *, struct uio *);
+int vnode_truncate(struct vnode *, off_t);
+
 /*
  * Reference count manipulation (handled above filesystem level)
  */
@@ -49,7 +49,13 @@
 #include <vnode.h>
 #include <vfs.h>
 #include <synch.h>
+#include <wchan.h>
+#include <kern/errno.h>
 #include <kern/fcntl.h>  
+#include <limits.h>
+#include <bitmap.h>
+#include <mainbus.h>
+#include <filetable.h>
 
 #include "opt-A2.h" /* required for A2 */
 
@@ -59,11 +65,117 @@
 struct proc *kproc;
 
 /*
- * Global variable that track the next available pid number and its lock
+ * List of all processes, for ps. Protected by proclist_lock.
  */
+static struct proc *proclist;
+static struct spinlock proclist_lock = SPINLOCK_NAMED_INITIALIZER("proclist");
+
 #if OPT_A2
-	static volatile pid_t curpid;
-	struct spinlock pid_lock;
+/*
+ * The pid table. pid_map records which pids are in use and pid_hash
+ * finds the process for a pid. Pids stay allocated until the process
+ * is destroyed, i.e. through its zombie phase until it's reaped.
+ *
+ * Pids are handed out round-robin: the search for a free one starts
+ * after the last pid given out, so a freed pid isn't reused until the
+ * rest of the pid space has been gone through. That keeps a stale pid
+ * from promptly naming some unrelated new process.
+ *
+ * pid_lock protects all of this, and also the parent/child links
+ * between processes.
+ *
+ * A parent waiting for its children sleeps on one of proc_waitchans,
+ * picked by its pid, instead of each process carrying its own. An
+ * exiting child posts itself on the parent's p_zombies list and wakes
+ * the channel. The lock order is wait channel, then pid_lock.
+ */
+#define PID_HASHSIZE	256
+static struct bitmap *pid_map;
+static struct proc *pid_hash[PID_HASHSIZE];
+static pid_t pid_next;
+static unsigned pid_count;
+static struct spinlock pid_lock;
+
+#define NWAITCHANS	16
+static struct wchan *proc_waitchans[NWAITCHANS];
+#define proc_waitchan(proc) (proc_waitchans[(proc)->pid % NWAITCHANS])
+
+/*
+ * Give a process a pid. Fails with ENPROC if they're all in use.
+ */
+static
+int
+pid_alloc(struct proc *proc)
+{
+	pid_t pid;
+
+	KASSERT(proc->pid == 0);
+
+	spinlock_acquire(&pid_lock);
+	if (pid_count == PID_MAX - PID_MIN + 1) {
+		spinlock_release(&pid_lock);
+		return ENPROC;
+	}
+	pid = pid_next;
+	while (bitmap_isset(pid_map, pid)) {
+		pid = (pid == PID_MAX) ? PID_MIN : pid + 1;
+	}
+	bitmap_mark(pid_map, pid);
+	pid_count++;
+	pid_next = (pid == PID_MAX) ? PID_MIN : pid + 1;
+
+	proc->pid = pid;
+	proc->p_pidnext = pid_hash[pid % PID_HASHSIZE];
+	pid_hash[pid % PID_HASHSIZE] = proc;
+	spinlock_release(&pid_lock);
+
+	return 0;
+}
+
+/*
+ * Release a process's pid.
+ */
+static
+void
+pid_free(struct proc *proc)
+{
+	struct proc **pp;
+
+	spinlock_acquire(&pid_lock);
+	for (pp = &pid_hash[proc->pid % PID_HASHSIZE]; *pp != proc;
+	     pp = &(*pp)->p_pidnext) {
+		KASSERT(*pp != NULL);
+	}
+	*pp = proc->p_pidnext;
+	bitmap_unmark(pid_map, proc->pid);
+	pid_count--;
+	spinlock_release(&pid_lock);
+
+	proc->pid = 0;
+}
+
+/*
+ * Find the process with a given pid. Call with pid_lock held.
+ */
+static
+struct proc *
+pid_lookup(pid_t pid)
+{
+	struct proc *proc;
+
+	KASSERT(spinlock_do_i_hold(&pid_lock));
+
+	if (pid < PID_MIN || pid > PID_MAX) {
+		return NULL;
+	}
+	for (proc = pid_hash[pid % PID_HASHSIZE]; proc != NULL;
+	     proc = proc->p_pidnext) {
+		if (proc->pid == pid) {
+			return proc;
+		}
+	}
+	return NULL;
+}
 #endif /* OPT_A2 */
 
 /*
@@ -103,38 +215,53 @@ proc_create(const char *name)
 	threadarray_init(&proc->p_threads);
 	spinlock_init(&proc->p_lock);
 
+	/* Accounting fields */
+	bzero(&proc->p_usage, sizeof(proc->p_usage));
+	bzero(&proc->p_cusage, sizeof(proc->p_cusage));
+
 	/* VM fields */
 	proc->p_addrspace = NULL;
 
 	/* VFS fields */
 	proc->p_cwd = NULL;
 
+#if OPT_A2
+	proc->p_filetable = NULL;
+	proc->p_ring = NULL;
+	proc->p_ringentries = 0;
+#else
 #ifdef UW
 	proc->console = NULL;
 #endif // UW
+#endif /* OPT_A2 */
 
 #if OPT_A2
-	/* set pid for new process */
-	proc->pid = curpid;
-	spinlock_acquire(&pid_lock);
-	curpid++;
-	spinlock_release(&pid_lock);
+	/* no pid yet; see pid_alloc */
+	proc->pid = 0;
+	proc->p_pidnext = NULL;
 
 	/* set parent and children */
 	proc->p_parent = NULL;
-	proc->p_children = array_create();
+	proc->p_children = NULL;
+	proc->p_zombies = NULL;
+	proc->p_sibnext = NULL;
+	proc->p_sibprev = NULL;
 
 	/* set alive status */
 	proc->alive = true;
-
-	/* set waited status */
-	proc->hasWaited = false;
-
-	/* setup cv and its lock */
-	proc->cv_wake_parent = cv_create("");
-	proc->cv_lock = lock_create("");
+	proc->exited = false;
+	proc->p_vforked = false;
 #endif /* OPT_A2 */
 
+	spinlock_acquire(&proclist_lock);
+	proc->p_allprev = NULL;
+	proc->p_allnext = proclist;
+	if (proclist != NULL) {
+		proclist->p_allprev = proc;
+	}
+	proclist = proc;
+	spinlock_release(&proclist_lock);
+
 	return proc;
 }
 
@@ -189,31 +316,43 @@ proc_destroy(struct proc *proc)
 	}
 #endif // UW
 
+#if OPT_A2
+	/* normally closed in sys__exit, but not if fork failed */
+	if (proc->p_filetable != NULL) {
+		filetable_destroy(proc->p_filetable);
+		proc->p_filetable = NULL;
+	}
+#else
 #ifdef UW
 	if (proc->console) {
 	  vfs_close(proc->console);
 	}
 #endif // UW
+#endif /* OPT_A2 */
 
 #if OPT_A2
-	/* detach all children processes, set their parent to null */
-	if (proc->p_children != NULL) {
-		while (proc->p_children->num > 0) {
-			detach_child((struct proc *)array_get(proc->p_children, 0), proc);
-		}
-	}
-
-	/* detach from parent process */
-	proc->p_parent = NULL;
-
-	array_destroy(proc->p_children);
-
-	/* destroy cv and its lock */
-	cv_destroy(proc->cv_wake_parent);
-	lock_destroy(proc->cv_lock);
+	/* proc_zombify or proc_waitchild has already cut these links */
+	KASSERT(proc->p_parent == NULL);
+	KASSERT(proc->p_children == NULL);
+	KASSERT(proc->p_zombies == NULL);
 
+	if (proc->pid != 0) {
+		pid_free(proc);
+	}
 #endif /* OPT_A2 */
 
+	spinlock_acquire(&proclist_lock);
+	if (proc->p_allprev != NULL) {
+		proc->p_allprev->p_allnext = proc->p_allnext;
+	}
+	else {
+		proclist = proc->p_allnext;
+	}
+	if (proc->p_allnext != NULL) {
+		proc->p_allnext->p_allprev = proc->p_allprev;
+	}
+	spinlock_release(&proclist_lock);
+
 	threadarray_cleanup(&proc->p_threads);
 	spinlock_cleanup(&proc->p_lock);
 
@@ -242,6 +381,23 @@ proc_destroy(struct proc *proc)
 void
 proc_bootstrap(void)
 {
+#if OPT_A2
+	spinlock_init(&pid_lock);
+	spinlock_setname(&pid_lock, "pid");
+	pid_map = bitmap_create(PID_MAX + 1);
+	if (pid_map == NULL) {
+		panic("Cannot create pid map\n");
+	}
+	pid_next = PID_MIN;
+	pid_count = 0;
+	for (unsigned i = 0; i < NWAITCHANS; i++) {
+		proc_waitchans[i] = wchan_create("waitpid");
+		if (proc_waitchans[i] == NULL) {
+			panic("Cannot create waitpid wait channel\n");
+		}
+	}
+#endif /* OPT_A2 */
+
   kproc = proc_create("[kernel]");
   if (kproc == NULL) {
     panic("proc_create for kproc failed\n");
@@ -257,11 +413,6 @@ proc_bootstrap(void)
     panic("could not create no_proc_sem semaphore\n");
   }
 #endif // UW 
-
-#if OPT_A2
-	curpid = 1;
-	spinlock_init(&pid_lock);
-#endif /* OPT_A2 */
 }
 
 /*
@@ -269,18 +420,29 @@ proc_bootstrap(void)
  *
  * It will have no address space and will inherit the current
  * process's (that is, the kernel menu's) current directory.
+ *
+ * It also inherits the current process's open files; when that is the
+ * kernel menu, which has none, it gets the console on stdin, stdout,
+ * and stderr instead.
+ *
+ * Fails with ENOMEM, or ENPROC if there are no pids left.
  */
-struct proc *
-proc_create_runprogram(const char *name)
+int
+proc_create_runprogram(const char *name, struct proc **ret)
 {
 	struct proc *proc;
+#if OPT_A2
+	int result;
+#else
 	char *console_path;
+#endif /* OPT_A2 */
 
 	proc = proc_create(name);
 	if (proc == NULL) {
-		return NULL;
+		return ENOMEM;
 	}
 
+#if !OPT_A2
 #ifdef UW
 	/* open the console - this should always succeed */
 	console_path = kstrdup("con:");
@@ -292,6 +454,7 @@ proc_create_runprogram(const char *name)
 	}
 	kfree(console_path);
 #endif // UW
+#endif /* !OPT_A2 */
 	  
 	/* VM fields */
 
@@ -325,7 +488,30 @@ proc_create_runprogram(const char *name)
 	V(proc_count_mutex);
 #endif // UW
 
-	return proc;
+#if OPT_A2
+	if (curproc->p_filetable != NULL) {
+		result = filetable_copy(curproc->p_filetable,
+					&proc->p_filetable);
+	}
+	else {
+		proc->p_filetable = filetable_create();
+		result = proc->p_filetable == NULL ? ENOMEM :
+			filetable_openstd(proc->p_filetable);
+	}
+	if (result) {
+		proc_destroy(proc);
+		return result;
+	}
+
+	result = pid_alloc(proc);
+	if (result) {
+		proc_destroy(proc);
+		return result;
+	}
+#endif /* OPT_A2 */
+
+	*ret = proc;
+	return 0;
 }
 
 /*
@@ -349,6 +535,179 @@ proc_addthread(struct proc *proc, struct thread *t)
 	return 0;
 }
 
+/*
+ * Move a thread's usage counters into a usage total and clear them.
+ * The caller holds the lock of the process the total belongs to;
+ * since that's a spinlock, interrupts are off, so the counters can't
+ * change under us if the thread is current.
+ */
+static
+void
+proc_foldthread(struct proc_usage *pu, struct thread *t)
+{
+	pu->pu_utime += t->t_utime;
+	pu->pu_stime += t->t_stime;
+	pu->pu_nvcsw += t->t_nvcsw;
+	pu->pu_nivcsw += t->t_nivcsw;
+	t->t_utime = 0;
+	t->t_stime = 0;
+	t->t_nvcsw = 0;
+	t->t_nivcsw = 0;
+}
+
+/*
+ * Charge the current thread's usage so far to its process, so it is
+ * visible before the thread actually leaves (e.g. to a parent that
+ * wakes up in waitpid while the thread is still finishing _exit).
+ */
+void
+proc_chargethread(struct thread *t)
+{
+	struct proc *proc = t->t_proc;
+
+	KASSERT(t == curthread);
+	KASSERT(proc != NULL);
+
+	spinlock_acquire(&proc->p_lock);
+	proc_foldthread(&proc->p_usage, t);
+	spinlock_release(&proc->p_lock);
+}
+
+/*
+ * Get the usage of a process: what its departed threads left behind
+ * plus what the live ones have run up so far. The live counters may
+ * be changing on other cpus as we read them; that's fine for this.
+ */
+void
+proc_getusage(struct proc *proc, struct proc_usage *pu)
+{
+	struct thread *t;
+	unsigned i, num;
+
+	spinlock_acquire(&proc->p_lock);
+	*pu = proc->p_usage;
+	num = threadarray_num(&proc->p_threads);
+	for (i=0; i<num; i++) {
+		t = threadarray_get(&proc->p_threads, i);
+		pu->pu_utime += t->t_utime;
+		pu->pu_stime += t->t_stime;
+		pu->pu_nvcsw += t->t_nvcsw;
+		pu->pu_nivcsw += t->t_nivcsw;
+	}
+	spinlock_release(&proc->p_lock);
+}
+
+/*
+ * Credit a dead child's usage, and that of the children it reaped,
+ * to the process that reaped it.
+ */
+void
+proc_addchildusage(struct proc *proc, struct proc *child)
+{
+	struct proc_usage cu;
+
+	KASSERT(proc != child);
+
+	spinlock_acquire(&child->p_lock);
+	cu.pu_utime = child->p_usage.pu_utime + child->p_cusage.pu_utime;
+	cu.pu_stime = child->p_usage.pu_stime + child->p_cusage.pu_stime;
+	cu.pu_nvcsw = child->p_usage.pu_nvcsw + child->p_cusage.pu_nvcsw;
+	cu.pu_nivcsw = child->p_usage.pu_nivcsw + child->p_cusage.pu_nivcsw;
+	spinlock_release(&child->p_lock);
+
+	spinlock_acquire(&proc->p_lock);
+	proc->p_cusage.pu_utime += cu.pu_utime;
+	proc->p_cusage.pu_stime += cu.pu_stime;
+	proc->p_cusage.pu_nvcsw += cu.pu_nvcsw;
+	proc->p_cusage.pu_nivcsw += cu.pu_nivcsw;
+	spinlock_release(&proc->p_lock);
+}
+
+/*
+ * Convert cycles to milliseconds, for printing.
+ */
+static
+unsigned
+proc_cycles_ms(uint64_t cycles)
+{
+	return cycles * 1000 / mainbus_cyclehz();
+}
+
+/*
+ * One line of the process list, copied out so it can be printed
+ * without holding proclist_lock (kprintf can be slow, or sleep).
+ */
+struct proc_psent {
+	int pe_pid, pe_ppid;
+	unsigned pe_nthreads;
+	struct proc_usage pe_usage;
+	char pe_name[24];
+};
+
+/*
+ * Print the process list.
+ */
+void
+proc_printall(void)
+{
+	struct proc *proc;
+	struct proc_psent *ents = NULL, *pe;
+	unsigned num, max = 0, i;
+
+	/* Size the array, and try again if processes appear meanwhile. */
+	while (1) {
+		spinlock_acquire(&proclist_lock);
+		num = 0;
+		for (proc = proclist; proc != NULL; proc = proc->p_allnext) {
+			num++;
+		}
+		if (num <= max) {
+			break;
+		}
+		spinlock_release(&proclist_lock);
+		kfree(ents);
+		max = num + 8;
+		ents = kmalloc(max * sizeof(*ents));
+		if (ents == NULL) {
+			kprintf("ps: Out of memory\n");
+			return;
+		}
+	}
+
+	for (proc = proclist, pe = ents; proc != NULL;
+	     proc = proc->p_allnext, pe++) {
+		proc_getusage(proc, &pe->pe_usage);
+		spinlock_acquire(&proc->p_lock);
+		pe->pe_nthreads = threadarray_num(&proc->p_threads);
+		spinlock_release(&proc->p_lock);
+#if OPT_A2
+		spinlock_acquire(&pid_lock);
+		pe->pe_pid = proc->pid;
+		pe->pe_ppid = proc->p_parent != NULL ?
+			proc->p_parent->pid : 0;
+		spinlock_release(&pid_lock);
+#else
+		pe->pe_pid = pe->pe_ppid = 0;
+#endif /* OPT_A2 */
+		snprintf(pe->pe_name, sizeof(pe->pe_name), "%s",
+			 proc->p_name);
+	}
+	spinlock_release(&proclist_lock);
+
+	kprintf("  pid  ppid state thr    user ms     sys ms    vcsw   ivcsw name\n");
+	for (i=0; i<num; i++) {
+		pe = &ents[i];
+		kprintf("%5d %5d %-5s %3u %10u %10u %7u %7u %s\n",
+			pe->pe_pid, pe->pe_ppid,
+			pe->pe_nthreads > 0 ? "run" : "zomb", pe->pe_nthreads,
+			proc_cycles_ms(pe->pe_usage.pu_utime),
+			proc_cycles_ms(pe->pe_usage.pu_stime),
+			pe->pe_usage.pu_nvcsw, pe->pe_usage.pu_nivcsw,
+			pe->pe_name);
+	}
+	kfree(ents);
+}
+
 /*
  * Remove a thread from its process. Either the thread or the process
  * might or might not be current.
@@ -368,6 +727,7 @@ proc_remthread(struct thread *t)
 	for (i=0; i<num; i++) {
 		if (threadarray_get(&proc->p_threads, i) == t) {
 			threadarray_remove(&proc->p_threads, i);
+			proc_foldthread(&proc->p_usage, t);
 			spinlock_release(&proc->p_lock);
 			t->t_proc = NULL;
 			return;
@@ -420,6 +780,54 @@ curproc_setas(struct addrspace *newas)
 }
 
 #if OPT_A2
+/*
+ * Take c_proc off its parent's list of children (running or exited).
+ * Call with pid_lock held.
+ */
+static
+void
+unlink_child(struct proc *c_proc)
+{
+	struct proc *p_proc = c_proc->p_parent;
+	struct proc **head;
+
+	KASSERT(spinlock_do_i_hold(&pid_lock));
+	KASSERT(p_proc != NULL);
+
+	head = c_proc->exited ? &p_proc->p_zombies : &p_proc->p_children;
+	if (c_proc->p_sibprev != NULL) {
+		c_proc->p_sibprev->p_sibnext = c_proc->p_sibnext;
+	}
+	else {
+		KASSERT(*head == c_proc);
+		*head = c_proc->p_sibnext;
+	}
+	if (c_proc->p_sibnext != NULL) {
+		c_proc->p_sibnext->p_sibprev = c_proc->p_sibprev;
+	}
+	c_proc->p_sibnext = NULL;
+	c_proc->p_sibprev = NULL;
+	c_proc->p_parent = NULL;
+}
+
+/*
+ * Put c_proc at the head of a list of children. Call with pid_lock
+ * held.
+ */
+static
+void
+link_child(struct proc *c_proc, struct proc **head)
+{
+	KASSERT(spinlock_do_i_hold(&pid_lock));
+
+	c_proc->p_sibprev = NULL;
+	c_proc->p_sibnext = *head;
+	if (*head != NULL) {
+		(*head)->p_sibprev = c_proc;
+	}
+	*head = c_proc;
+}
+
 /*
  * Attach c_proc as a child to p_proc 
  */
@@ -429,13 +837,12 @@ attach_child(struct proc *c_proc, struct proc *p_proc)
 	KASSERT (c_proc != NULL);
 	KASSERT (p_proc != NULL);
 
-	spinlock_acquire(&p_proc->p_lock);
-	array_add(p_proc->p_children, c_proc, NULL);
-	spinlock_release(&p_proc->p_lock);
-
-	spinlock_acquire(&c_proc->p_lock);
+	spinlock_acquire(&pid_lock);
+	KASSERT(c_proc->p_parent == NULL);
+	KASSERT(!c_proc->exited);
 	c_proc->p_parent = p_proc;
-	spinlock_release(&c_proc->p_lock);
+	link_child(c_proc, &p_proc->p_children);
+	spinlock_release(&pid_lock);
 }
 
 /*
@@ -447,47 +854,222 @@ detach_child(struct proc *c_proc, struct proc *p_proc)
 	KASSERT (c_proc != NULL);
 	KASSERT (p_proc != NULL);
 
-	/* detach c_proc from children array of p_proc */
-	spinlock_acquire(&p_proc->p_lock);
-	for (unsigned int i = 0; i < p_proc->p_children->num; i++) {
-		struct proc *curr_proc = (struct proc *) array_get(p_proc->p_children, i);
-		if (curr_proc == c_proc) {
-			array_remove(p_proc->p_children, i);
-			break;
-		}
+	spinlock_acquire(&pid_lock);
+	KASSERT(c_proc->p_parent == p_proc);
+	unlink_child(c_proc);
+	spinlock_release(&pid_lock);
+}
+
+/*
+ * verify if proc has a child with pid pid. If success return the
+ * pointer to that process, if fail then return NULL. The child can't
+ * go away until proc reaps it, so the pointer stays good.
+ */
+struct proc *
+search_pid(struct proc *proc, pid_t pid) 
+{
+	struct proc *proc_c;
+
+	KASSERT(proc != NULL);
+
+	spinlock_acquire(&pid_lock);
+	proc_c = pid_lookup(pid);
+	if (proc_c != NULL && proc_c->p_parent != proc) {
+		proc_c = NULL;
 	}
-	spinlock_release(&p_proc->p_lock);
+	spinlock_release(&pid_lock);
+	return proc_c;
+}
 
-	/* set c_proc's parent to NULL */
-	spinlock_acquire(&c_proc->p_lock);
-	c_proc->p_parent = NULL;
-	spinlock_release(&c_proc->p_lock);
+/*
+ * Finish exiting. The process's last thread has already left it.
+ *
+ * Children are handed to the kernel, which never waits for anything:
+ * ones still running will destroy themselves when they exit, and ones
+ * that are already zombies are destroyed here. Then, if a parent is
+ * around to wait for us, move to its zombie list and wake it up; if
+ * not, we destroy ourselves.
+ *
+ * The parent can only change from under us by going to NULL (when it
+ * exits itself), so if it's still there once we hold its wait channel
+ * and pid_lock, it's the one whose channel we have.
+ */
+void
+proc_zombify(struct proc *proc)
+{
+	struct proc *p_proc, *c_proc, *reap;
+	struct wchan *wc;
+
+	KASSERT(threadarray_num(&proc->p_threads) == 0);
+
+	spinlock_acquire(&pid_lock);
+	wc = proc->p_parent != NULL ? proc_waitchan(proc->p_parent) : NULL;
+	spinlock_release(&pid_lock);
+
+	if (wc != NULL) {
+		wchan_lock(wc);
+	}
+	spinlock_acquire(&pid_lock);
+
+	/* give away the running children */
+	while ((c_proc = proc->p_children) != NULL) {
+		unlink_child(c_proc);
+	}
+
+	/* take the zombies along to destroy, chained through p_sibnext */
+	reap = proc->p_zombies;
+	proc->p_zombies = NULL;
+	for (c_proc = reap; c_proc != NULL; c_proc = c_proc->p_sibnext) {
+		c_proc->p_parent = NULL;
+		c_proc->p_sibprev = NULL;
+	}
 
-	/* check if c_proc is a zombie (!alive), if so, completely destroy it */
-	if (!c_proc->alive) {
+	/* post ourselves to our parent, if any */
+	p_proc = proc->p_parent;
+	if (p_proc != NULL) {
+		KASSERT(wc == proc_waitchan(p_proc));
+		unlink_child(proc);
+		proc->exited = true;
+		proc->p_parent = p_proc;
+		link_child(proc, &p_proc->p_zombies);
+	}
+	spinlock_release(&pid_lock);
+
+	/*
+	 * Once pid_lock is dropped the parent may reap us at any time;
+	 * from here on, don't touch proc unless we're an orphan.
+	 */
+	if (wc != NULL) {
+		wchan_unlock(wc);
+		wchan_wakeall(wc);
+	}
+
+	while (reap != NULL) {
+		c_proc = reap;
+		reap = c_proc->p_sibnext;
+		c_proc->p_sibnext = NULL;
 		proc_destroy(c_proc);
 	}
+
+	/*
+	 * if this is the last user process in the system, proc_destroy()
+	 * will wake up the kernel menu thread
+	 */
+	if (p_proc == NULL) {
+		proc_destroy(proc);
+	}
 }
 
 /*
- * Verify if proc has a child with pid _pid 
+ * Wait for a child of proc to exit, and take it off proc's zombie
+ * list. pid is the child to wait for, or -1 for any child.
+ *
+ * The zombie list is checked with the wait channel locked, and
+ * proc_zombify posts to it with the channel locked, so a child can't
+ * exit between our check and our sleep without waking us.
  */
-struct proc *
-search_pid(struct proc *proc, pid_t pid) 
+int
+proc_waitchild(struct proc *proc, pid_t pid, bool nohang,
+	       struct proc **childp)
 {
-	KASSERT(proc != NULL);
-	KASSERT(pid > 0);
+	struct wchan *wc = proc_waitchan(proc);
+	struct proc *child;
+	int result = 0;
 
-	spinlock_acquire(&proc->p_lock);
-	for (unsigned int i = 0; i < proc->p_children->num; i++) {
-		struct proc *proc_c = (struct proc *) array_get(proc->p_children, i);
-		if (proc_c->pid == pid) {
-			spinlock_release(&proc->p_lock);
-			return proc_c;
+	wchan_lock(wc);
+	spinlock_acquire(&pid_lock);
+	while (1) {
+		if (pid == -1) {
+			if (proc->p_zombies == NULL &&
+			    proc->p_children == NULL) {
+				result = ECHILD;
+				break;
+			}
+			child = proc->p_zombies;
+		}
+		else {
+			child = pid_lookup(pid);
+			if (child == NULL) {
+				result = ESRCH;
+				break;
+			}
+			if (child->p_parent != proc) {
+				result = ECHILD;
+				break;
+			}
+			if (!child->exited) {
+				child = NULL;
+			}
 		}
+
+		if (child != NULL) {
+			unlink_child(child);
+			break;
+		}
+		if (nohang) {
+			break;
+		}
+
+		spinlock_release(&pid_lock);
+		wchan_sleep(wc);
+		wchan_lock(wc);
+		spinlock_acquire(&pid_lock);
 	}
-	spinlock_release(&proc->p_lock);
-	return NULL;
+	spinlock_release(&pid_lock);
+	wchan_unlock(wc);
+
+	*childp = result ? NULL : child;
+	return result;
+}
+
+/*
+ * Sleep until a vforked child is done with our address space. We
+ * can't exit or reap the child meanwhile, so it stays valid. Uses our
+ * wait channel, like waitpid; the child can't be both exiting and
+ * still have p_vforked set (see sys__exit), so these don't clash.
+ */
+void
+proc_vfork_wait(struct proc *child)
+{
+	struct wchan *wc = proc_waitchan(curproc);
+
+	wchan_lock(wc);
+	spinlock_acquire(&pid_lock);
+	KASSERT(child->p_parent == curproc);
+	while (child->p_vforked) {
+		spinlock_release(&pid_lock);
+		wchan_sleep(wc);
+		wchan_lock(wc);
+		spinlock_acquire(&pid_lock);
+	}
+	spinlock_release(&pid_lock);
+	wchan_unlock(wc);
+}
+
+/*
+ * A vforked child has stopped using its parent's address space; let
+ * the parent go.
+ */
+void
+proc_vfork_done(struct proc *child)
+{
+	struct wchan *wc;
+
+	KASSERT(child == curproc);
+	KASSERT(child->p_vforked);
+
+	/* the parent is asleep in proc_vfork_wait, so it's still there */
+	spinlock_acquire(&pid_lock);
+	KASSERT(child->p_parent != NULL);
+	wc = proc_waitchan(child->p_parent);
+	spinlock_release(&pid_lock);
+
+	wchan_lock(wc);
+	spinlock_acquire(&pid_lock);
+	child->p_vforked = false;
+	spinlock_release(&pid_lock);
+	wchan_unlock(wc);
+	wchan_wakeall(wc);
 }
 
 #endif /* OPT_A2 */
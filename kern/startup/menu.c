@@ -35,6 +35,7 @@
 #include <lib.h>
 #include <uio.h>
 #include <clock.h>
+#include <cpu.h>
 #include <thread.h>
 #include <proc.h>
 #include <synch.h>
@@ -42,6 +43,10 @@
 #include <sfs.h>
 #include <syscall.h>
 #include <test.h>
+#include <lockstat.h>
+#include <execcache.h>
+#include <buf.h>
+#include <namecache.h>
 #include "opt-synchprobs.h"
 #include "opt-sfs.h"
 #include "opt-net.h"
@@ -149,9 +154,9 @@ common_prog(int nargs, char **args)
 #endif
 
 	/* Create a process for the new program to run in. */
-	proc = proc_create_runprogram(args[0] /* name */);
-	if (proc == NULL) {
-		return ENOMEM;
+	result = proc_create_runprogram(args[0] /* name */, &proc);
+	if (result) {
+		return result;
 	}
 
 	result = thread_fork(args[0] /* thread name */,
@@ -408,6 +413,141 @@ cmd_kheapstats(int nargs, char **args)
 	return 0;
 }
 
+/*
+ * Command for printing thread cache statistics, optionally setting
+ * the cache depth first.
+ */
+static
+int
+cmd_threadcache(int nargs, char **args)
+{
+	if (nargs > 2) {
+		kprintf("Usage: tcache [depth]\n");
+		return EINVAL;
+	}
+	if (nargs == 2) {
+		if (atoi(args[1]) < 0) {
+			kprintf("Usage: tcache [depth]\n");
+			return EINVAL;
+		}
+		thread_cache_setdepth(atoi(args[1]));
+	}
+
+	thread_cache_print();
+
+	return 0;
+}
+
+#if OPT_LOCKSTAT
+/*
+ * Command for printing the most contended locks, or clearing the
+ * counters.
+ */
+static
+int
+cmd_lockstat(int nargs, char **args)
+{
+	int n = 10;
+
+	if (nargs > 2) {
+		kprintf("Usage: lockstat [count | reset]\n");
+		return EINVAL;
+	}
+	if (nargs == 2) {
+		if (!strcmp(args[1], "reset")) {
+			lockstat_reset();
+			return 0;
+		}
+		n = atoi(args[1]);
+		if (n <= 0) {
+			kprintf("Usage: lockstat [count | reset]\n");
+			return EINVAL;
+		}
+	}
+
+	lockstat_print(n);
+
+	return 0;
+}
+#endif /* OPT_LOCKSTAT */
+
+/*
+ * Command for listing processes and their CPU usage.
+ */
+static
+int
+cmd_ps(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	proc_printall();
+	kprintf("\n");
+	cpu_printclocks();
+
+	return 0;
+}
+
+/*
+ * Command for printing per-cpu clock interrupt counts.
+ */
+static
+int
+cmd_cpuclocks(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	cpu_printclocks();
+
+	return 0;
+}
+
+/*
+ * Command for printing buffer cache statistics.
+ */
+static
+int
+cmd_buffercache(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	buffer_printstats();
+
+	return 0;
+}
+
+/*
+ * Command for printing name cache statistics.
+ */
+static
+int
+cmd_namecache(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	namecache_printstats();
+
+	return 0;
+}
+
+/*
+ * Command for printing exec cache statistics.
+ */
+static
+int
+cmd_execcache(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	execcache_printstats();
+
+	return 0;
+}
+
 /*
  Command to enable the output of debugging messages of type DB_THREADS 
  */
@@ -490,6 +630,10 @@ static const char *testmenu[] = {
 	"[sy1] Semaphore test                ",
 	"[sy2] Lock test             (1)     ",
 	"[sy3] CV test               (1)     ",
+	"[sy4] Reader-writer lock test       ",
+	"[sy5] Spinlock benchmark            ",
+	"[ct1] Clock/callout test            ",
+	"[ct2] Clock wakeup test             ",
 #ifdef UW
 	"[uw1] UW lock test          (1)     ",
 	"[uw2] UW vmstats test       (3)     ",
@@ -499,6 +643,9 @@ static const char *testmenu[] = {
 	"[fs3] FS write stress       (4)     ",
 	"[fs4] FS write stress 2     (4)     ",
 	"[fs5] FS create stress      (4)     ",
+#if OPT_SFS
+	"[bc1] Buffer cache test             ",
+#endif
 	NULL
 };
 
@@ -530,6 +677,15 @@ static const char *mainmenu[] = {
 #endif /* UW */
 #endif
 	"[kh] Kernel heap stats              ",
+	"[cpu] Per-cpu clock counts          ",
+	"[ps] Process CPU usage              ",
+	"[tcache] Thread cache stats         ",
+	"[ecache] Exec cache stats           ",
+	"[bcache] Buffer cache stats         ",
+	"[ncache] Name cache stats           ",
+#if OPT_LOCKSTAT
+	"[lockstat] Lock contention stats    ",
+#endif
 	"[q] Quit and shut down              ",
 	NULL
 };
@@ -587,6 +743,15 @@ static struct {
 
 	/* stats */
 	{ "kh",         cmd_kheapstats },
+	{ "cpu",        cmd_cpuclocks },
+	{ "ps",         cmd_ps },
+	{ "tcache",     cmd_threadcache },
+	{ "ecache",     cmd_execcache },
+	{ "bcache",     cmd_buffercache },
+	{ "ncache",     cmd_namecache },
+#if OPT_LOCKSTAT
+	{ "lockstat",   cmd_lockstat },
+#endif
 
 	/* base system tests */
 	{ "at",		arraytest },
@@ -600,10 +765,14 @@ static struct {
 	{ "tt2",	threadtest2 },
 	{ "tt3",	threadtest3 },
 	{ "sy1",	semtest },
+	{ "ct1",	clocktest },
+	{ "ct2",	clocktest2 },
 
 	/* synchronization assignment tests */
 	{ "sy2",	locktest },
 	{ "sy3",	cvtest },
+	{ "sy4",	rwlocktest },
+	{ "sy5",	spinlockbench },
 #ifdef UW
 	{ "uw1",	uwlocktest1 },
 	{ "uw2",	uwvmstatstest },
@@ -615,6 +784,9 @@ static struct {
 	{ "fs3",	writestress },
 	{ "fs4",	writestress2 },
 	{ "fs5",	createstress },
+#if OPT_SFS
+	{ "bc1",	buftest },
+#endif
 
 	{ NULL, NULL }
 };
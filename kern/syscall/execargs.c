@@ -0,0 +1,246 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Argument handling for starting programs. See <execargs.h>.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <limits.h>
+#include <spinlock.h>
+#include <copyinout.h>
+#include <vm.h>
+#include <execargs.h>
+
+/*
+ * Most bytes of arguments, strings and argv together, we take:
+ * ARG_MAX, but no more than fits on the new program's stack leaving
+ * it a page to run in. Bigger gets E2BIG while the caller can still
+ * be told, instead of failing the copyout after the old image is gone.
+ */
+#define EXECARGS_STACKMAX	((VM_STACKPAGES - 1) * PAGE_SIZE)
+#define EXECARGS_MAX \
+	(EXECARGS_STACKMAX < ARG_MAX ? EXECARGS_STACKMAX : ARG_MAX)
+
+/*
+ * Pool of spare ARG_MAX buffers. A couple is plenty: the buffer is
+ * only held from the start of an exec until its arguments are on the
+ * new stack.
+ */
+#define EXECARGS_POOLSIZE 2
+
+static char *execargs_pool[EXECARGS_POOLSIZE];
+static unsigned execargs_npool;
+static struct spinlock execargs_lock =
+	SPINLOCK_NAMED_INITIALIZER("execargs");
+
+/*
+ * Set ea up empty, with a buffer.
+ */
+static
+int
+execargs_init(struct execargs *ea)
+{
+	char *buf = NULL;
+
+	spinlock_acquire(&execargs_lock);
+	if (execargs_npool > 0) {
+		buf = execargs_pool[--execargs_npool];
+	}
+	spinlock_release(&execargs_lock);
+
+	if (buf == NULL) {
+		buf = kmalloc(ARG_MAX);
+		if (buf == NULL) {
+			return ENOMEM;
+		}
+	}
+
+	ea->ea_buf = buf;
+	ea->ea_len = 0;
+	ea->ea_argc = 0;
+	return 0;
+}
+
+void
+execargs_cleanup(struct execargs *ea)
+{
+	char *buf = ea->ea_buf;
+
+	if (buf == NULL) {
+		return;
+	}
+	ea->ea_buf = NULL;
+
+	spinlock_acquire(&execargs_lock);
+	if (execargs_npool < EXECARGS_POOLSIZE) {
+		execargs_pool[execargs_npool++] = buf;
+		buf = NULL;
+	}
+	spinlock_release(&execargs_lock);
+
+	kfree(buf);
+}
+
+/*
+ * How long a string (with its NUL) can be added, leaving space for its
+ * pointer, the NULL that ends argv, and padding the strings out to a
+ * pointer boundary. Zero if we're full.
+ */
+static
+size_t
+execargs_room(struct execargs *ea)
+{
+	size_t used;
+
+	used = ea->ea_len + (sizeof(userptr_t) - 1) +
+		(ea->ea_argc + 2) * sizeof(userptr_t);
+	return used < EXECARGS_MAX ? EXECARGS_MAX - used : 0;
+}
+
+/*
+ * Fetch a user argv, reading each pointer once and copying each string
+ * straight into place with copyinstr. The total is limited to
+ * EXECARGS_MAX (E2BIG beyond that). On error nothing is left allocated.
+ */
+int
+execargs_copyin(struct execargs *ea, userptr_t uargv)
+{
+	userptr_t uarg;
+	size_t room, got;
+	int result;
+
+	result = execargs_init(ea);
+	if (result) {
+		return result;
+	}
+
+	while (1) {
+		result = copyin(uargv + ea->ea_argc * sizeof(userptr_t),
+				&uarg, sizeof(uarg));
+		if (result) {
+			goto fail;
+		}
+		if (uarg == NULL) {
+			break;
+		}
+
+		room = execargs_room(ea);
+		if (room == 0) {
+			result = E2BIG;
+			goto fail;
+		}
+		result = copyinstr(uarg, ea->ea_buf + ea->ea_len, room, &got);
+		if (result == ENAMETOOLONG) {
+			result = E2BIG;
+		}
+		if (result) {
+			goto fail;
+		}
+		ea->ea_len += got;
+		ea->ea_argc++;
+	}
+	return 0;
+
+ fail:
+	execargs_cleanup(ea);
+	return result;
+}
+
+/*
+ * Same, from an argv of kernel strings (e.g. from the menu).
+ */
+int
+execargs_fromkernel(struct execargs *ea, char **argv, int argc)
+{
+	size_t len;
+	int result, i;
+
+	result = execargs_init(ea);
+	if (result) {
+		return result;
+	}
+
+	for (i=0; i<argc; i++) {
+		len = strlen(argv[i]) + 1;
+		if (len > execargs_room(ea)) {
+			execargs_cleanup(ea);
+			return E2BIG;
+		}
+		memcpy(ea->ea_buf + ea->ea_len, argv[i], len);
+		ea->ea_len += len;
+		ea->ea_argc++;
+	}
+	return 0;
+}
+
+/*
+ * Put the arguments on the stack of the current address space, just
+ * below *stackptr: the strings, padded to a pointer boundary, then
+ * the argv array pointing at them. The array is filled in right
+ * after the strings in ea_buf (execargs_room kept space for it), so
+ * the whole thing goes out with one copyout. Updates *stackptr to
+ * the new top of stack and sets *uargv to the user argv.
+ */
+int
+execargs_copyout(struct execargs *ea, vaddr_t *stackptr, userptr_t *uargv)
+{
+	size_t strspace, total, off;
+	vaddr_t base;
+	vaddr_t *ptrs;
+	int i, result;
+
+	strspace = ROUNDUP(ea->ea_len, sizeof(userptr_t));
+	total = strspace + (ea->ea_argc + 1) * sizeof(userptr_t);
+	KASSERT(total <= EXECARGS_MAX);
+
+	/* keep the stack 8-aligned */
+	base = (*stackptr - total) & ~(vaddr_t)7;
+
+	bzero(ea->ea_buf + ea->ea_len, strspace - ea->ea_len);
+	ptrs = (vaddr_t *)(ea->ea_buf + strspace);
+	off = 0;
+	for (i=0; i<ea->ea_argc; i++) {
+		ptrs[i] = base + off;
+		off += strlen(ea->ea_buf + off) + 1;
+	}
+	KASSERT(off == ea->ea_len);
+	ptrs[ea->ea_argc] = 0;
+
+	result = copyout(ea->ea_buf, (userptr_t)base, total);
+	if (result) {
+		return result;
+	}
+
+	*stackptr = base;
+	*uargv = (userptr_t)(base + strspace);
+	return 0;
+}
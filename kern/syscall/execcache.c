@@ -0,0 +1,331 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Cache of recently run executables. See <execcache.h>.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <spinlock.h>
+#include <mainbus.h>
+#include <vnode.h>
+#include <execcache.h>
+
+#define EXECCACHE_SIZE		8		/* images */
+#define EXECCACHE_MAXBYTES	(512*1024)	/* of segment contents */
+
+static struct execimage *execcache[EXECCACHE_SIZE];
+static size_t execcache_bytes;
+static unsigned execcache_clock;
+static struct spinlock execcache_lock =
+	SPINLOCK_NAMED_INITIALIZER("execcache");
+
+/* Statistics, also protected by execcache_lock. */
+static struct execcache_stats {
+	unsigned hits;		/* lookups that found a current image */
+	unsigned misses;	/* lookups that didn't */
+	unsigned stale;		/* misses because the file had changed */
+	unsigned evictions;	/* images pushed out to make room */
+	unsigned uncached;	/* images too big or not read in */
+	unsigned hitloads;	/* loads timed, from the cache */
+	unsigned missloads;	/* loads timed, from the file */
+	uint64_t hitcycles;	/* total time for those */
+	uint64_t misscycles;
+} execcache_stats;
+
+struct execimage *
+execimage_create(struct vnode *v)
+{
+	struct execimage *ei;
+
+	ei = kmalloc(sizeof(*ei));
+	if (ei == NULL) {
+		return NULL;
+	}
+	bzero(ei, sizeof(*ei));
+
+	VOP_INCREF(v);
+	ei->ei_vnode = v;
+	ei->ei_writegen = v->vn_writegen;
+	ei->ei_refcount = 1;
+	return ei;
+}
+
+static
+void
+execimage_destroy(struct execimage *ei)
+{
+	unsigned i;
+
+	KASSERT(ei->ei_refcount == 0);
+	for (i=0; i<ei->ei_nsegs; i++) {
+		kfree(ei->ei_segs[i].es_data);
+	}
+	VOP_DECREF(ei->ei_vnode);
+	kfree(ei);
+}
+
+void
+execimage_release(struct execimage *ei)
+{
+	unsigned refs;
+
+	spinlock_acquire(&execcache_lock);
+	KASSERT(ei->ei_refcount > 0);
+	refs = --ei->ei_refcount;
+	spinlock_release(&execcache_lock);
+
+	if (refs == 0) {
+		execimage_destroy(ei);
+	}
+}
+
+/*
+ * Take slot IX out of the table, dropping the table's reference.
+ * Returns the image if that was the last reference, so the caller can
+ * destroy it once the lock is released. (Destroying an image drops a
+ * vnode reference, which can sleep.)
+ */
+static
+struct execimage *
+execcache_remove(unsigned ix)
+{
+	struct execimage *ei;
+
+	KASSERT(spinlock_do_i_hold(&execcache_lock));
+
+	ei = execcache[ix];
+	KASSERT(ei != NULL);
+	execcache[ix] = NULL;
+	execcache_bytes -= ei->ei_size;
+
+	KASSERT(ei->ei_refcount > 0);
+	ei->ei_refcount--;
+	return ei->ei_refcount == 0 ? ei : NULL;
+}
+
+struct execimage *
+execcache_get(struct vnode *v)
+{
+	struct execimage *ei = NULL, *dead = NULL;
+	unsigned i;
+
+	spinlock_acquire(&execcache_lock);
+	for (i=0; i<EXECCACHE_SIZE; i++) {
+		if (execcache[i] != NULL && execcache[i]->ei_vnode == v) {
+			ei = execcache[i];
+			break;
+		}
+	}
+	if (ei != NULL && ei->ei_writegen != v->vn_writegen) {
+		/* file has changed since; toss it */
+		dead = execcache_remove(i);
+		ei = NULL;
+		execcache_stats.stale++;
+	}
+	if (ei != NULL) {
+		ei->ei_refcount++;
+		ei->ei_lastuse = ++execcache_clock;
+		execcache_stats.hits++;
+	}
+	else {
+		execcache_stats.misses++;
+	}
+	spinlock_release(&execcache_lock);
+
+	if (dead != NULL) {
+		execimage_destroy(dead);
+	}
+	return ei;
+}
+
+void
+execcache_put(struct execimage *ei)
+{
+	struct execimage *dead[EXECCACHE_SIZE];
+	unsigned ndead = 0, i, victim;
+	bool complete;
+
+	complete = ei->ei_size <= EXECCACHE_MAXIMAGE;
+	for (i=0; i<ei->ei_nsegs; i++) {
+		if (ei->ei_segs[i].es_filesize > 0 &&
+		    ei->ei_segs[i].es_data == NULL) {
+			complete = false;
+		}
+	}
+
+	spinlock_acquire(&execcache_lock);
+
+	if (!complete) {
+		execcache_stats.uncached++;
+		spinlock_release(&execcache_lock);
+		return;
+	}
+
+	/*
+	 * If the same file was cached by someone else meanwhile, replace
+	 * theirs; ours might be newer.
+	 */
+	for (i=0; i<EXECCACHE_SIZE; i++) {
+		if (execcache[i] != NULL &&
+		    execcache[i]->ei_vnode == ei->ei_vnode) {
+			dead[ndead] = execcache_remove(i);
+			if (dead[ndead] != NULL) {
+				ndead++;
+			}
+		}
+	}
+
+	/* Evict least recently used images until there's room. */
+	while (1) {
+		victim = EXECCACHE_SIZE;
+		for (i=0; i<EXECCACHE_SIZE; i++) {
+			if (execcache[i] == NULL) {
+				if (execcache_bytes + ei->ei_size <=
+				    EXECCACHE_MAXBYTES) {
+					break;
+				}
+				continue;
+			}
+			if (victim == EXECCACHE_SIZE ||
+			    execcache[i]->ei_lastuse <
+			    execcache[victim]->ei_lastuse) {
+				victim = i;
+			}
+		}
+		if (i < EXECCACHE_SIZE) {
+			/* found a free slot and there's space */
+			break;
+		}
+		KASSERT(victim < EXECCACHE_SIZE);
+		dead[ndead] = execcache_remove(victim);
+		if (dead[ndead] != NULL) {
+			ndead++;
+		}
+		execcache_stats.evictions++;
+	}
+
+	ei->ei_refcount++;
+	ei->ei_lastuse = ++execcache_clock;
+	execcache[i] = ei;
+	execcache_bytes += ei->ei_size;
+
+	spinlock_release(&execcache_lock);
+
+	for (i=0; i<ndead; i++) {
+		execimage_destroy(dead[i]);
+	}
+}
+
+void
+execcache_flush(struct fs *fs)
+{
+	struct execimage *dead[EXECCACHE_SIZE];
+	unsigned ndead = 0, i;
+
+	spinlock_acquire(&execcache_lock);
+	for (i=0; i<EXECCACHE_SIZE; i++) {
+		if (execcache[i] == NULL) {
+			continue;
+		}
+		if (fs != NULL && execcache[i]->ei_vnode->vn_fs != fs) {
+			continue;
+		}
+		dead[ndead] = execcache_remove(i);
+		if (dead[ndead] != NULL) {
+			ndead++;
+		}
+	}
+	spinlock_release(&execcache_lock);
+
+	for (i=0; i<ndead; i++) {
+		execimage_destroy(dead[i]);
+	}
+}
+
+void
+execcache_noteload(bool hit, uint64_t cycles)
+{
+	spinlock_acquire(&execcache_lock);
+	if (hit) {
+		execcache_stats.hitloads++;
+		execcache_stats.hitcycles += cycles;
+	}
+	else {
+		execcache_stats.missloads++;
+		execcache_stats.misscycles += cycles;
+	}
+	spinlock_release(&execcache_lock);
+}
+
+/*
+ * Average of TOTAL cycles over N, in microseconds.
+ */
+static
+unsigned
+execcache_avg_us(uint64_t total, unsigned n)
+{
+	if (n == 0) {
+		return 0;
+	}
+	return total * 1000000 / mainbus_cyclehz() / n;
+}
+
+void
+execcache_printstats(void)
+{
+	struct execcache_stats st;
+	unsigned lookups, images, i;
+	size_t bytes;
+
+	spinlock_acquire(&execcache_lock);
+	images = 0;
+	for (i=0; i<EXECCACHE_SIZE; i++) {
+		if (execcache[i] != NULL) {
+			images++;
+		}
+	}
+	bytes = execcache_bytes;
+	st = execcache_stats;
+	spinlock_release(&execcache_lock);
+
+	lookups = st.hits + st.misses;
+	kprintf("exec cache: %u/%u images, %lu/%lu bytes\n",
+		images, EXECCACHE_SIZE,
+		(unsigned long)bytes, (unsigned long)EXECCACHE_MAXBYTES);
+	kprintf("  %u lookups, %u hits (%u%%), %u misses (%u stale)\n",
+		lookups, st.hits, lookups ? st.hits * 100 / lookups : 0,
+		st.misses, st.stale);
+	kprintf("  %u evictions, %u not cached\n",
+		st.evictions, st.uncached);
+	kprintf("  load time: %u us from cache, %u us from file\n",
+		execcache_avg_us(st.hitcycles, st.hitloads),
+		execcache_avg_us(st.misscycles, st.missloads));
+}
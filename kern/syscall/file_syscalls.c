@@ -9,6 +9,448 @@
 #include <current.h>
 #include <proc.h>
 
+#include "opt-A2.h" /* required for A2 */
+
+#if OPT_A2
+#include <kern/fcntl.h>
+#include <kern/seek.h>
+#include <stat.h>
+#include <limits.h>
+#include <copyinout.h>
+#include <vm.h>
+#include <openfile.h>
+#include <filetable.h>
+#include <pipe.h>
+#endif /* OPT_A2 */
+
+#if OPT_A2
+/*
+ * File system calls. Each process has a table of descriptors (see
+ * <filetable.h>) referring to shared openfiles (see <openfile.h>),
+ * which hold the vnode and the seek position.
+ */
+
+/*
+ * open() - copy in the path, open it, and give it a descriptor.
+ */
+int
+sys_open(userptr_t upath, int flags, mode_t mode, int *retval)
+{
+  struct openfile *file;
+  char *path;
+  int result;
+
+  path = kmalloc(PATH_MAX);
+  if (path == NULL) {
+    return ENOMEM;
+  }
+  result = copyinstr(upath, path, PATH_MAX, NULL);
+  if (result) {
+    kfree(path);
+    return result;
+  }
+
+  result = openfile_open(path, flags, mode, &file);
+  kfree(path);
+  if (result) {
+    return result;
+  }
+
+  result = filetable_place(curproc->p_filetable, file, retval);
+  if (result) {
+    openfile_decref(file);
+    return result;
+  }
+  return 0;
+}
+
+/*
+ * Common code for the read and write calls: move LEN bytes between
+ * the user buffers in IOV (IOVCNT of them) and the file, in one
+ * VOP_READ or VOP_WRITE. If POSITIONAL, the transfer is at POS and
+ * the seek position is neither used nor changed; otherwise it's at
+ * the seek position, which is advanced.
+ */
+static int
+file_rw(int fd, struct iovec *iov, int iovcnt, size_t len,
+        bool positional, off_t pos, enum uio_rw rw, int *retval)
+{
+  struct openfile *file;
+  struct uio u;
+  struct stat st;
+  bool locked = false;
+  int result;
+
+  result = filetable_get(curproc->p_filetable, fd, &file);
+  if (result) {
+    return result;
+  }
+  if (file->of_accmode == (rw == UIO_READ ? O_WRONLY : O_RDONLY)) {
+    return EBADF;
+  }
+
+  if (positional) {
+    if (!file->of_seekable) {
+      return ESPIPE;
+    }
+    if (pos < 0) {
+      return EINVAL;
+    }
+  }
+  else {
+    locked = openfile_lockoffset(file);
+
+    if (rw == UIO_WRITE && file->of_append && file->of_seekable) {
+      result = VOP_STAT(file->of_vnode, &st);
+      if (result) {
+        openfile_unlockoffset(file, locked);
+        return result;
+      }
+      file->of_offset = st.st_size;
+    }
+    pos = file->of_offset;
+  }
+
+  u.uio_iov = iov;
+  u.uio_iovcnt = iovcnt;
+  u.uio_offset = pos;
+  u.uio_resid = len;
+  u.uio_segflg = UIO_USERSPACE;
+  u.uio_rw = rw;
+  u.uio_space = curproc->p_addrspace;
+
+  if (rw == UIO_READ) {
+    result = VOP_READ(file->of_vnode, &u);
+  }
+  else {
+    result = VOP_WRITE(file->of_vnode, &u);
+  }
+
+  if (!positional) {
+    if (file->of_seekable) {
+      file->of_offset = u.uio_offset;
+    }
+    openfile_unlockoffset(file, locked);
+  }
+
+  if (result) {
+    return result;
+  }
+  *retval = len - u.uio_resid;
+  return 0;
+}
+
+/* Most bytes one call can move; the count has to fit in the return value. */
+#define RW_MAX ((size_t)0x7fffffff)
+
+/*
+ * Read and write of a single buffer.
+ */
+static int
+file_rw1(int fd, userptr_t ubuf, size_t len, bool positional, off_t pos,
+         enum uio_rw rw, int *retval)
+{
+  struct iovec iov;
+
+  if (len > RW_MAX) {
+    return EINVAL;
+  }
+  iov.iov_ubase = ubuf;
+  iov.iov_len = len;
+  return file_rw(fd, &iov, 1, len, positional, pos, rw, retval);
+}
+
+/* Vectors up to this long are copied in on the stack. */
+#define IOV_ONSTACK 8
+
+/*
+ * Vectored read and write. The iovec array is copied in whole and
+ * checked in one pass: the count, that the lengths add up to
+ * something that can be returned, and that each buffer is in user
+ * space. Then the whole thing is one transfer.
+ */
+static int
+file_rwv(int fd, userptr_t uiov, int iovcnt, bool positional, off_t pos,
+         enum uio_rw rw, int *retval)
+{
+  struct iovec stackiov[IOV_ONSTACK];
+  struct iovec *iov;
+  size_t len;
+  vaddr_t base;
+  int i, result;
+
+  if (iovcnt <= 0 || iovcnt > IOV_MAX) {
+    return EINVAL;
+  }
+  if (iovcnt <= IOV_ONSTACK) {
+    iov = stackiov;
+  }
+  else {
+    iov = kmalloc(iovcnt * sizeof(struct iovec));
+    if (iov == NULL) {
+      return ENOMEM;
+    }
+  }
+
+  result = copyin(uiov, iov, iovcnt * sizeof(struct iovec));
+  if (result) {
+    goto out;
+  }
+
+  len = 0;
+  for (i = 0; i < iovcnt; i++) {
+    if (iov[i].iov_len > RW_MAX - len) {
+      result = EINVAL;
+      goto out;
+    }
+    len += iov[i].iov_len;
+
+    base = (vaddr_t)iov[i].iov_ubase;
+    if (iov[i].iov_len > 0 &&
+        (base >= USERSPACETOP || iov[i].iov_len > USERSPACETOP - base)) {
+      result = EFAULT;
+      goto out;
+    }
+  }
+
+  result = file_rw(fd, iov, iovcnt, len, positional, pos, rw, retval);
+
+ out:
+  if (iov != stackiov) {
+    kfree(iov);
+  }
+  return result;
+}
+
+int
+sys_read(int fd, userptr_t ubuf, size_t nbytes, int *retval)
+{
+  DEBUG(DB_SYSCALL,"Syscall: read(%d,%x,%d)\n",fd,(unsigned int)ubuf,nbytes);
+  return file_rw1(fd, ubuf, nbytes, false, 0, UIO_READ, retval);
+}
+
+int
+sys_write(int fdesc,userptr_t ubuf,unsigned int nbytes,int *retval)
+{
+  DEBUG(DB_SYSCALL,"Syscall: write(%d,%x,%d)\n",fdesc,(unsigned int)ubuf,nbytes);
+  return file_rw1(fdesc, ubuf, nbytes, false, 0, UIO_WRITE, retval);
+}
+
+int
+sys_pread(int fd, userptr_t ubuf, size_t nbytes, off_t pos, int *retval)
+{
+  return file_rw1(fd, ubuf, nbytes, true, pos, UIO_READ, retval);
+}
+
+int
+sys_pwrite(int fd, userptr_t ubuf, size_t nbytes, off_t pos, int *retval)
+{
+  return file_rw1(fd, ubuf, nbytes, true, pos, UIO_WRITE, retval);
+}
+
+int
+sys_readv(int fd, userptr_t iov, int iovcnt, int *retval)
+{
+  return file_rwv(fd, iov, iovcnt, false, 0, UIO_READ, retval);
+}
+
+int
+sys_writev(int fd, userptr_t iov, int iovcnt, int *retval)
+{
+  return file_rwv(fd, iov, iovcnt, false, 0, UIO_WRITE, retval);
+}
+
+int
+sys_preadv(int fd, userptr_t iov, int iovcnt, off_t pos, int *retval)
+{
+  return file_rwv(fd, iov, iovcnt, true, pos, UIO_READ, retval);
+}
+
+int
+sys_pwritev(int fd, userptr_t iov, int iovcnt, off_t pos, int *retval)
+{
+  return file_rwv(fd, iov, iovcnt, true, pos, UIO_WRITE, retval);
+}
+
+int
+sys_close(int fd)
+{
+  struct openfile *file;
+  int result;
+
+  result = filetable_remove(curproc->p_filetable, fd, &file);
+  if (result) {
+    return result;
+  }
+  openfile_decref(file);
+  return 0;
+}
+
+/*
+ * lseek(). The dispatcher has already fetched whence from the stack.
+ */
+int
+sys_lseek(int fd, off_t pos, int whence, off_t *retval)
+{
+  struct openfile *file;
+  struct stat st;
+  off_t newpos;
+  bool locked;
+  int result;
+
+  result = filetable_get(curproc->p_filetable, fd, &file);
+  if (result) {
+    return result;
+  }
+  if (!file->of_seekable) {
+    return ESPIPE;
+  }
+
+  locked = openfile_lockoffset(file);
+
+  switch (whence) {
+    case SEEK_SET:
+      newpos = pos;
+      break;
+    case SEEK_CUR:
+      newpos = file->of_offset + pos;
+      break;
+    case SEEK_END:
+      result = VOP_STAT(file->of_vnode, &st);
+      if (result) {
+        openfile_unlockoffset(file, locked);
+        return result;
+      }
+      newpos = st.st_size + pos;
+      break;
+    default:
+      openfile_unlockoffset(file, locked);
+      return EINVAL;
+  }
+
+  if (newpos < 0) {
+    openfile_unlockoffset(file, locked);
+    return EINVAL;
+  }
+  result = VOP_TRYSEEK(file->of_vnode, newpos);
+  if (result) {
+    openfile_unlockoffset(file, locked);
+    return result;
+  }
+
+  file->of_offset = newpos;
+  openfile_unlockoffset(file, locked);
+
+  *retval = newpos;
+  return 0;
+}
+
+int
+sys_dup2(int oldfd, int newfd, int *retval)
+{
+  struct filetable *ft = curproc->p_filetable;
+  struct openfile *file, *oldfile;
+  int result;
+
+  result = filetable_get(ft, oldfd, &file);
+  if (result) {
+    return result;
+  }
+  if (newfd < 0 || newfd >= OPEN_MAX) {
+    return EBADF;
+  }
+
+  if (newfd != oldfd) {
+    openfile_incref(file);
+    result = filetable_placeat(ft, file, newfd, &oldfile);
+    KASSERT(result == 0);
+    if (oldfile != NULL) {
+      openfile_decref(oldfile);
+    }
+  }
+
+  *retval = newfd;
+  return 0;
+}
+
+int
+sys_fsync(int fd)
+{
+  struct openfile *file;
+  int result;
+
+  result = filetable_get(curproc->p_filetable, fd, &file);
+  if (result) {
+    return result;
+  }
+  return VOP_FSYNC(file->of_vnode);
+}
+
+int
+sys_ioctl(int fd, int code, userptr_t data)
+{
+  struct openfile *file;
+  int result;
+
+  result = filetable_get(curproc->p_filetable, fd, &file);
+  if (result) {
+    return result;
+  }
+  return VOP_IOCTL(file->of_vnode, code, data);
+}
+
+int
+sys_pipe(userptr_t ufds)
+{
+  struct filetable *ft = curproc->p_filetable;
+  struct vnode *readvn, *writevn;
+  struct openfile *readfile, *writefile;
+  struct openfile *junk;
+  int fds[2];
+  int result;
+
+  result = pipe_create(0, &readvn, &writevn);
+  if (result) {
+    return result;
+  }
+  result = openfile_fromvnode(readvn, O_RDONLY, &readfile);
+  if (result) {
+    vfs_close(readvn);
+    vfs_close(writevn);
+    return result;
+  }
+  result = openfile_fromvnode(writevn, O_WRONLY, &writefile);
+  if (result) {
+    openfile_decref(readfile);
+    vfs_close(writevn);
+    return result;
+  }
+
+  result = filetable_place(ft, readfile, &fds[0]);
+  if (result) {
+    goto fail;
+  }
+  result = filetable_place(ft, writefile, &fds[1]);
+  if (result) {
+    filetable_remove(ft, fds[0], &junk);
+    goto fail;
+  }
+
+  result = copyout(fds, ufds, sizeof(fds));
+  if (result) {
+    filetable_remove(ft, fds[1], &junk);
+    filetable_remove(ft, fds[0], &junk);
+    goto fail;
+  }
+  return 0;
+
+ fail:
+  openfile_decref(writefile);
+  openfile_decref(readfile);
+  return result;
+}
+
+#else
 /* handler for write() system call                  */
 /*
  * n.b.
@@ -58,3 +500,4 @@ sys_write(int fdesc,userptr_t ubuf,unsigned int nbytes,int *retval)
   KASSERT(*retval >= 0);
   return 0;
 }
+#endif /* OPT_A2 */
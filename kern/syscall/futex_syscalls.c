@@ -0,0 +1,254 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Futexes: user-level locks that only enter the kernel to sleep or to
+ * wake sleepers.
+ *
+ * Threads waiting on a user address hang off an entry in a hash table
+ * keyed by (address space, virtual address). Entries are created by
+ * the first waiter and freed by the last one to leave. Each bucket has
+ * a sleeping lock, since we copy in the user's value while holding it;
+ * holding it across the check and the wchan_lock is what makes the
+ * compare-and-sleep atomic with respect to FUTEX_WAKE.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/futex.h>
+#include <lib.h>
+#include <synch.h>
+#include <wchan.h>
+#include <proc.h>
+#include <current.h>
+#include <copyinout.h>
+#include <syscall.h>
+
+#define FUTEX_HASHSIZE	64	/* must be a power of 2 */
+
+struct futex {
+	struct futex *f_next;		/* next entry in bucket */
+	struct addrspace *f_as;		/* key: address space */
+	vaddr_t f_addr;			/* key: user address */
+	struct wchan *f_wchan;		/* waiters sleep here */
+	unsigned f_sleepers;		/* waiters not yet woken */
+	unsigned f_refs;		/* waiters not yet gone */
+};
+
+struct futex_bucket {
+	struct lock *fb_lock;
+	struct futex *fb_head;
+};
+
+static struct futex_bucket futex_table[FUTEX_HASHSIZE];
+
+void
+futex_bootstrap(void)
+{
+	unsigned i;
+
+	for (i=0; i<FUTEX_HASHSIZE; i++) {
+		futex_table[i].fb_lock = lock_create("futex");
+		if (futex_table[i].fb_lock == NULL) {
+			panic("futex_bootstrap: Out of memory\n");
+		}
+		futex_table[i].fb_head = NULL;
+	}
+}
+
+static
+struct futex_bucket *
+futex_hash(struct addrspace *as, vaddr_t addr)
+{
+	uint32_t h;
+
+	/* Addresses are word aligned; mix in the address space too. */
+	h = (addr >> 2) ^ ((uint32_t)as >> 4);
+	h ^= h >> 11;
+	return &futex_table[h & (FUTEX_HASHSIZE - 1)];
+}
+
+/*
+ * Find the entry for (as, addr) in bucket fb. Bucket must be locked.
+ */
+static
+struct futex *
+futex_find(struct futex_bucket *fb, struct addrspace *as, vaddr_t addr)
+{
+	struct futex *f;
+
+	for (f = fb->fb_head; f != NULL; f = f->f_next) {
+		if (f->f_as == as && f->f_addr == addr) {
+			return f;
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Drop a waiter's reference, freeing the entry when it's the last.
+ * Bucket must be locked.
+ */
+static
+void
+futex_unref(struct futex_bucket *fb, struct futex *f)
+{
+	struct futex **fp;
+
+	KASSERT(f->f_refs > 0);
+	f->f_refs--;
+	if (f->f_refs > 0) {
+		return;
+	}
+	for (fp = &fb->fb_head; *fp != f; fp = &(*fp)->f_next) {
+		KASSERT(*fp != NULL);
+	}
+	*fp = f->f_next;
+	wchan_destroy(f->f_wchan);
+	kfree(f);
+}
+
+static
+int
+futex_wait(struct addrspace *as, userptr_t uaddr, int val)
+{
+	struct futex_bucket *fb;
+	struct futex *f, *newf;
+	int curval;
+	int result;
+
+	/*
+	 * Allocate an entry up front in case we're the first waiter,
+	 * so we don't call kmalloc with the bucket locked.
+	 */
+	newf = kmalloc(sizeof(*newf));
+	if (newf == NULL) {
+		return ENOMEM;
+	}
+	newf->f_wchan = wchan_create("futex");
+	if (newf->f_wchan == NULL) {
+		kfree(newf);
+		return ENOMEM;
+	}
+
+	fb = futex_hash(as, (vaddr_t)uaddr);
+	lock_acquire(fb->fb_lock);
+
+	result = copyin(uaddr, &curval, sizeof(curval));
+	if (result == 0 && curval != val) {
+		result = EAGAIN;
+	}
+	if (result) {
+		lock_release(fb->fb_lock);
+		wchan_destroy(newf->f_wchan);
+		kfree(newf);
+		return result;
+	}
+
+	f = futex_find(fb, as, (vaddr_t)uaddr);
+	if (f == NULL) {
+		f = newf;
+		f->f_as = as;
+		f->f_addr = (vaddr_t)uaddr;
+		f->f_sleepers = 0;
+		f->f_refs = 0;
+		f->f_next = fb->fb_head;
+		fb->fb_head = f;
+	}
+	else {
+		wchan_destroy(newf->f_wchan);
+		kfree(newf);
+	}
+	f->f_sleepers++;
+	f->f_refs++;
+
+	/* Bridge from the bucket lock to the wchan, as in P(). */
+	wchan_lock(f->f_wchan);
+	lock_release(fb->fb_lock);
+	wchan_sleep(f->f_wchan);
+
+	lock_acquire(fb->fb_lock);
+	futex_unref(fb, f);
+	lock_release(fb->fb_lock);
+
+	return 0;
+}
+
+static
+int
+futex_wake(struct addrspace *as, userptr_t uaddr, int val, int *retval)
+{
+	struct futex_bucket *fb;
+	struct futex *f;
+	int woken = 0;
+
+	fb = futex_hash(as, (vaddr_t)uaddr);
+	lock_acquire(fb->fb_lock);
+	f = futex_find(fb, as, (vaddr_t)uaddr);
+	while (f != NULL && f->f_sleepers > 0 && woken < val) {
+		/*
+		 * A sleeper holds the wchan lock from before it drops
+		 * the bucket lock until it's asleep, so wakeone can't
+		 * miss it.
+		 */
+		wchan_wakeone(f->f_wchan);
+		f->f_sleepers--;
+		woken++;
+	}
+	lock_release(fb->fb_lock);
+
+	*retval = woken;
+	return 0;
+}
+
+int
+sys_futex(userptr_t uaddr, int op, int val, int *retval)
+{
+	struct addrspace *as;
+
+	if ((vaddr_t)uaddr % sizeof(int) != 0) {
+		return EINVAL;
+	}
+	as = curproc_getas();
+	if (as == NULL) {
+		return EFAULT;
+	}
+
+	*retval = 0;
+	switch (op) {
+	    case FUTEX_WAIT:
+		return futex_wait(as, uaddr, val);
+	    case FUTEX_WAKE:
+		if (val < 0) {
+			return EINVAL;
+		}
+		return futex_wake(as, uaddr, val, retval);
+	}
+	return EINVAL;
+}
@@ -42,6 +42,10 @@
  * circumstances, as_prepare_load and as_complete_load probably don't
  * need to do anything.
  *
+ * The headers and segment contents of programs that are run often
+ * are kept in the exec cache (see <execcache.h>), so that loading
+ * them again is a matter of copying from kernel memory.
+ *
  * If you wanted to support memory-mapped executables you would need
  * to rearrange this to map each segment.
  *
@@ -59,6 +63,8 @@
 #include <addrspace.h>
 #include <vnode.h>
 #include <elf.h>
+#include <mainbus.h>
+#include <execcache.h>
 
 #include "opt-A3.h" /* required for A3 */
 
@@ -71,6 +77,9 @@
  * FILESIZE may be less than MEMSIZE; if so the remaining portion of
  * the in-memory segment should be zero-filled.
  *
+ * If DATA is not NULL, it holds the FILESIZE bytes of the segment
+ * (from the exec cache) and the file isn't read.
+ *
  * Note that uiomove will catch it if someone tries to load an
  * executable whose load address is in kernel space. If you should
  * change this code to not use uiomove, be sure to check for this case
@@ -81,17 +90,12 @@ int
 load_segment(struct addrspace *as, struct vnode *v,
 	     off_t offset, vaddr_t vaddr, 
 	     size_t memsize, size_t filesize,
-	     int is_executable)
+	     int is_executable, char *data)
 {
 	struct iovec iov;
 	struct uio u;
 	int result;
 
-	if (filesize > memsize) {
-		kprintf("ELF: warning: segment filesize > segment memsize\n");
-		filesize = memsize;
-	}
-
 	DEBUG(DB_EXEC, "ELF: Loading %lu bytes to 0x%lx\n", 
 	      (unsigned long) filesize, (unsigned long) vaddr);
 
@@ -105,7 +109,12 @@ load_segment(struct addrspace *as, struct vnode *v,
 	u.uio_rw = UIO_READ;
 	u.uio_space = as;
 
-	result = VOP_READ(v, &u);
+	if (data != NULL) {
+		result = uiomove(data, filesize, &u);
+	}
+	else {
+		result = VOP_READ(v, &u);
+	}
 	if (result) {
 		return result;
 	}
@@ -148,21 +157,19 @@ load_segment(struct addrspace *as, struct vnode *v,
 }
 
 /*
- * Load an ELF executable user program into the current address space.
- *
- * Returns the entry point (initial PC) for the program in ENTRYPOINT.
+ * Read the executable header and program headers of V and fill in
+ * the entry point and segment list of EI.
  */
+static
 int
-load_elf(struct vnode *v, vaddr_t *entrypoint)
+elf_parse(struct vnode *v, struct execimage *ei)
 {
 	Elf_Ehdr eh;   /* Executable header */
 	Elf_Phdr ph;   /* "Program header" = segment header */
+	struct execseg *es;
 	int result, i;
 	struct iovec iov;
 	struct uio ku;
-	struct addrspace *as;
-
-	as = curproc_getas();
 
 	/*
 	 * Read the executable header from offset 0 in the file.
@@ -204,13 +211,15 @@ load_elf(struct vnode *v, vaddr_t *entrypoint)
 		return ENOEXEC;
 	}
 
+	ei->ei_entry = eh.e_entry;
+
 	/*
-	 * Go through the list of segments and set up the address space.
+	 * Go through the list of segments and remember the loadable
+	 * ones.
 	 *
 	 * Ordinarily there will be one code segment, one read-only
 	 * data segment, and one data/bss segment, but there might
-	 * conceivably be more. You don't need to support such files
-	 * if it's unduly awkward to do so.
+	 * conceivably be more. We allow up to EXECIMAGE_MAXSEGS.
 	 *
 	 * Note that the expression eh.e_phoff + i*eh.e_phentsize is 
 	 * mandated by the ELF standard - we use sizeof(ph) to load,
@@ -245,11 +254,93 @@ load_elf(struct vnode *v, vaddr_t *entrypoint)
 			return ENOEXEC;
 		}
 
+		if (ei->ei_nsegs == EXECIMAGE_MAXSEGS) {
+			kprintf("loadelf: too many segments\n");
+			return ENOEXEC;
+		}
+
+		if (ph.p_filesz > ph.p_memsz) {
+			kprintf("ELF: warning: segment filesize > "
+				"segment memsize\n");
+			ph.p_filesz = ph.p_memsz;
+		}
+
+		es = &ei->ei_segs[ei->ei_nsegs++];
+		es->es_vaddr = ph.p_vaddr;
+		es->es_memsize = ph.p_memsz;
+		es->es_filesize = ph.p_filesz;
+		es->es_offset = ph.p_offset;
+		es->es_flags = ph.p_flags;
+		es->es_data = NULL;
+		ei->ei_size += ph.p_filesz;
+	}
+
+	return 0;
+}
+
+/*
+ * Read the contents of the segments of EI into kernel memory, for the
+ * exec cache. This is only an optimization; if the image is too big
+ * or anything goes wrong, the segments that weren't read are loaded
+ * straight from the file instead, and any error shows up there.
+ */
+static
+void
+elf_readsegs(struct vnode *v, struct execimage *ei)
+{
+	struct execseg *es;
+	struct iovec iov;
+	struct uio ku;
+	unsigned i;
+	int result;
+
+	if (ei->ei_size > EXECCACHE_MAXIMAGE) {
+		return;
+	}
+
+	for (i=0; i<ei->ei_nsegs; i++) {
+		es = &ei->ei_segs[i];
+		if (es->es_filesize == 0) {
+			continue;
+		}
+
+		es->es_data = kmalloc(es->es_filesize);
+		if (es->es_data == NULL) {
+			return;
+		}
+
+		uio_kinit(&iov, &ku, es->es_data, es->es_filesize,
+			  es->es_offset, UIO_READ);
+		result = VOP_READ(v, &ku);
+		if (result || ku.uio_resid != 0) {
+			kfree(es->es_data);
+			es->es_data = NULL;
+			return;
+		}
+	}
+}
+
+/*
+ * Set up the current address space from EI.
+ */
+static
+int
+load_image(struct vnode *v, struct execimage *ei)
+{
+	struct addrspace *as;
+	struct execseg *es;
+	unsigned i;
+	int result;
+
+	as = curproc_getas();
+
+	for (i=0; i<ei->ei_nsegs; i++) {
+		es = &ei->ei_segs[i];
 		result = as_define_region(as,
-					  ph.p_vaddr, ph.p_memsz,
-					  ph.p_flags & PF_R,
-					  ph.p_flags & PF_W,
-					  ph.p_flags & PF_X);
+					  es->es_vaddr, es->es_memsize,
+					  es->es_flags & PF_R,
+					  es->es_flags & PF_W,
+					  es->es_flags & PF_X);
 		if (result) {
 			return result;
 		}
@@ -264,35 +355,11 @@ load_elf(struct vnode *v, vaddr_t *entrypoint)
 	 * Now actually load each segment.
 	 */
 
-	for (i=0; i<eh.e_phnum; i++) {
-		off_t offset = eh.e_phoff + i*eh.e_phentsize;
-		uio_kinit(&iov, &ku, &ph, sizeof(ph), offset, UIO_READ);
-
-		result = VOP_READ(v, &ku);
-		if (result) {
-			return result;
-		}
-
-		if (ku.uio_resid != 0) {
-			/* short read; problem with executable? */
-			kprintf("ELF: short read on phdr - file truncated?\n");
-			return ENOEXEC;
-		}
-
-		switch (ph.p_type) {
-		    case PT_NULL: /* skip */ continue;
-		    case PT_PHDR: /* skip */ continue;
-		    case PT_MIPS_REGINFO: /* skip */ continue;
-		    case PT_LOAD: break;
-		    default:
-			kprintf("loadelf: unknown segment type %d\n", 
-				ph.p_type);
-			return ENOEXEC;
-		}
-
-		result = load_segment(as, v, ph.p_offset, ph.p_vaddr, 
-				      ph.p_memsz, ph.p_filesz,
-				      ph.p_flags & PF_X);
+	for (i=0; i<ei->ei_nsegs; i++) {
+		es = &ei->ei_segs[i];
+		result = load_segment(as, v, es->es_offset, es->es_vaddr,
+				      es->es_memsize, es->es_filesize,
+				      es->es_flags & PF_X, es->es_data);
 		if (result) {
 			return result;
 		}
@@ -303,8 +370,6 @@ load_elf(struct vnode *v, vaddr_t *entrypoint)
 		return result;
 	}
 
-	*entrypoint = eh.e_entry;
-
 	#if OPT_A3
 	/* flip hasLoaded flag to indicate current address space has been loaded into the memory */
 	as->hasLoaded = true;
@@ -316,3 +381,52 @@ load_elf(struct vnode *v, vaddr_t *entrypoint)
 
 	return 0;
 }
+
+/*
+ * Load an ELF executable user program into the current address space.
+ *
+ * Returns the entry point (initial PC) for the program in ENTRYPOINT.
+ */
+int
+load_elf(struct vnode *v, vaddr_t *entrypoint)
+{
+	struct execimage *ei;
+	uint64_t start, end;
+	bool hit;
+	int result;
+
+	start = mainbus_cycles();
+
+	ei = execcache_get(v);
+	hit = ei != NULL;
+	if (!hit) {
+		ei = execimage_create(v);
+		if (ei == NULL) {
+			return ENOMEM;
+		}
+		result = elf_parse(v, ei);
+		if (result) {
+			execimage_release(ei);
+			return result;
+		}
+		elf_readsegs(v, ei);
+	}
+
+	result = load_image(v, ei);
+	if (result) {
+		execimage_release(ei);
+		return result;
+	}
+
+	*entrypoint = ei->ei_entry;
+
+	if (!hit) {
+		execcache_put(ei);
+	}
+	execimage_release(ei);
+
+	end = mainbus_cycles();
+	execcache_noteload(hit, end > start ? end - start : 0);
+
+	return 0;
+}
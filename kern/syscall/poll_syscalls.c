@@ -0,0 +1,347 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * poll and select.
+ *
+ * Both come down to poll_fds, which asks each descriptor's vnode
+ * whether it's ready and registers a pollent with it, then sleeps.
+ * A wakeup hands back only the pollents that fired, and only those
+ * descriptors are asked again; the rest are known not to have
+ * changed. Once anything is ready, later descriptors are checked
+ * but not registered, since we won't be sleeping.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/poll.h>
+#include <kern/select.h>
+#include <kern/time.h>
+#include <lib.h>
+#include <limits.h>
+#include <clock.h>
+#include <copyinout.h>
+#include <proc.h>
+#include <current.h>
+#include <vnode.h>
+#include <poll.h>
+#include <openfile.h>
+#include <filetable.h>
+#include <syscall.h>
+
+#include "opt-A2.h" /* required for A2 */
+
+#if OPT_A2
+
+/*
+ * Convert a timeout to timer ticks for poller_wait: rounded up, plus
+ * one because the current tick is already partly over. Null means
+ * forever (-1).
+ */
+static
+int
+poll_ticks(const struct timespec *ts)
+{
+	if (ts == NULL) {
+		return -1;
+	}
+	if (ts->tv_sec == 0 && ts->tv_nsec == 0) {
+		return 0;
+	}
+	return timespec_to_ticks(ts) + 1;
+}
+
+/*
+ * Wait up to TICKS timer ticks (as for poller_wait) for any of the
+ * NFDS descriptors in FDS to be ready, and fill in their revents.
+ * Sets *NREADY to the number with revents set.
+ */
+static
+int
+poll_fds(struct pollfd *fds, unsigned nfds, int ticks, int *nready)
+{
+	struct filetable *ft = curproc->p_filetable;
+	struct openfile **files;
+	struct pollent *pes, *pe;
+	struct poller pl;
+	uint32_t deadline;
+	int32_t left;
+	unsigned i;
+	int n, revents, result;
+
+	/* kmalloc(0) isn't allowed; poll with no descriptors just sleeps */
+	files = kmalloc((nfds > 0 ? nfds : 1) * sizeof(*files));
+	pes = kmalloc((nfds > 0 ? nfds : 1) * sizeof(*pes));
+	if (files == NULL || pes == NULL) {
+		kfree(files);
+		kfree(pes);
+		return ENOMEM;
+	}
+	result = poller_init(&pl);
+	if (result) {
+		kfree(files);
+		kfree(pes);
+		return result;
+	}
+
+	for (i=0; i<nfds; i++) {
+		files[i] = NULL;
+		pollent_init(&pes[i], &pl, fds[i].events);
+	}
+
+	n = 0;
+	for (i=0; i<nfds; i++) {
+		fds[i].revents = 0;
+		if (fds[i].fd < 0) {
+			continue;
+		}
+		if (filetable_get(ft, fds[i].fd, &files[i])) {
+			files[i] = NULL;
+			fds[i].revents = POLLNVAL;
+			n++;
+			continue;
+		}
+		/* hold it in case another thread closes the descriptor */
+		openfile_incref(files[i]);
+
+		result = VOP_POLL(files[i]->of_vnode, fds[i].events,
+				  n == 0 ? &pes[i] : NULL, &revents);
+		if (result) {
+			goto out;
+		}
+		if (revents != 0) {
+			fds[i].revents = revents;
+			n++;
+		}
+	}
+
+	deadline = clock_ticks() + ticks;
+	while (n == 0 && ticks != 0) {
+		left = -1;
+		if (ticks > 0) {
+			left = (int32_t)(deadline - clock_ticks());
+			if (left <= 0) {
+				break;
+			}
+		}
+
+		pe = poller_wait(&pl, left);
+		if (pe == NULL) {
+			/* timed out */
+			break;
+		}
+		for (; pe != NULL; pe = pe->pe_firednext) {
+			i = pe - pes;
+			result = VOP_POLL(files[i]->of_vnode, fds[i].events,
+					  NULL, &revents);
+			if (result) {
+				goto out;
+			}
+			if (revents != 0) {
+				fds[i].revents = revents;
+				n++;
+			}
+		}
+	}
+
+	*nready = n;
+	result = 0;
+
+ out:
+	for (i=0; i<nfds; i++) {
+		pollent_remove(&pes[i]);
+		if (files[i] != NULL) {
+			openfile_decref(files[i]);
+		}
+	}
+	poller_cleanup(&pl);
+	kfree(pes);
+	kfree(files);
+	return result;
+}
+
+int
+sys_poll(userptr_t ufds, unsigned nfds, int timeout, int *retval)
+{
+	struct pollfd *fds;
+	struct timespec ts;
+	int result;
+
+	if (nfds > OPEN_MAX) {
+		return EINVAL;
+	}
+
+	fds = kmalloc((nfds > 0 ? nfds : 1) * sizeof(*fds));
+	if (fds == NULL) {
+		return ENOMEM;
+	}
+	result = copyin(ufds, fds, nfds * sizeof(*fds));
+	if (result) {
+		kfree(fds);
+		return result;
+	}
+
+	ts.tv_sec = timeout / 1000;
+	ts.tv_nsec = (timeout % 1000) * 1000000;
+	result = poll_fds(fds, nfds, poll_ticks(timeout < 0 ? NULL : &ts),
+			  retval);
+	if (result == 0) {
+		result = copyout(fds, ufds, nfds * sizeof(*fds));
+	}
+	kfree(fds);
+	return result;
+}
+
+/*
+ * Copy in an fd_set, or clear SET if the pointer is null.
+ */
+static
+int
+select_copyin(userptr_t uset, fd_set *set)
+{
+	if (uset == NULL) {
+		FD_ZERO(set);
+		return 0;
+	}
+	return copyin(uset, set, sizeof(*set));
+}
+
+int
+sys_select(int nfds, userptr_t ureadfds, userptr_t uwritefds,
+	   userptr_t uexceptfds, userptr_t utimeout, int *retval)
+{
+	fd_set sets[3];		/* read, write, except */
+	struct pollfd *fds;
+	struct timeval tv;
+	struct timespec ts;
+	unsigned i, n;
+	int fd, nready, result;
+
+	if (nfds < 0 || nfds > FD_SETSIZE) {
+		return EINVAL;
+	}
+
+	result = select_copyin(ureadfds, &sets[0]);
+	if (!result) {
+		result = select_copyin(uwritefds, &sets[1]);
+	}
+	if (!result) {
+		result = select_copyin(uexceptfds, &sets[2]);
+	}
+	if (result) {
+		return result;
+	}
+
+	if (utimeout != NULL) {
+		result = copyin(utimeout, &tv, sizeof(tv));
+		if (result) {
+			return result;
+		}
+		if (tv.tv_sec < 0 || tv.tv_usec < 0 ||
+		    tv.tv_usec >= 1000000) {
+			return EINVAL;
+		}
+		ts.tv_sec = tv.tv_sec;
+		ts.tv_nsec = tv.tv_usec * 1000;
+	}
+
+	fds = kmalloc((nfds > 0 ? nfds : 1) * sizeof(*fds));
+	if (fds == NULL) {
+		return ENOMEM;
+	}
+	n = 0;
+	for (fd=0; fd<nfds; fd++) {
+		fds[n].fd = fd;
+		fds[n].events = 0;
+		if (FD_ISSET(fd, &sets[0])) {
+			fds[n].events |= POLLIN;
+		}
+		if (FD_ISSET(fd, &sets[1])) {
+			fds[n].events |= POLLOUT;
+		}
+		if (FD_ISSET(fd, &sets[2])) {
+			fds[n].events |= POLLPRI;
+		}
+		if (fds[n].events != 0) {
+			n++;
+		}
+	}
+
+	result = poll_fds(fds, n, poll_ticks(utimeout == NULL ? NULL : &ts),
+			  &nready);
+	if (result) {
+		kfree(fds);
+		return result;
+	}
+
+	FD_ZERO(&sets[0]);
+	FD_ZERO(&sets[1]);
+	FD_ZERO(&sets[2]);
+	nready = 0;
+	for (i=0; i<n; i++) {
+		if (fds[i].revents & POLLNVAL) {
+			kfree(fds);
+			return EBADF;
+		}
+		if ((fds[i].events & POLLIN) &&
+		    (fds[i].revents & (POLLIN | POLLHUP | POLLERR))) {
+			FD_SET(fds[i].fd, &sets[0]);
+			nready++;
+		}
+		if ((fds[i].events & POLLOUT) &&
+		    (fds[i].revents & (POLLOUT | POLLERR))) {
+			FD_SET(fds[i].fd, &sets[1]);
+			nready++;
+		}
+		if ((fds[i].events & POLLPRI) &&
+		    (fds[i].revents & POLLPRI)) {
+			FD_SET(fds[i].fd, &sets[2]);
+			nready++;
+		}
+	}
+	kfree(fds);
+
+	if (ureadfds != NULL) {
+		result = copyout(&sets[0], ureadfds, sizeof(sets[0]));
+	}
+	if (!result && uwritefds != NULL) {
+		result = copyout(&sets[1], uwritefds, sizeof(sets[1]));
+	}
+	if (!result && uexceptfds != NULL) {
+		result = copyout(&sets[2], uexceptfds, sizeof(sets[2]));
+	}
+	if (result) {
+		return result;
+	}
+
+	*retval = nready;
+	return 0;
+}
+
+#endif /* OPT_A2 */
@@ -9,6 +9,9 @@
 #include <thread.h>
 #include <addrspace.h>
 #include <copyinout.h>
+#include <mainbus.h>
+#include <kern/time.h>
+#include <kern/resource.h>
 
 #include "opt-A2.h" /* required for A2 */
 #include "opt-A3.h" /* required for A3 */
@@ -20,6 +23,9 @@
 #include <vfs.h>
 #include <kern/fcntl.h>
 #include <mips/vm.h>
+#include <limits.h>
+#include <execargs.h>
+#include <filetable.h>
 #endif /* OPT_A2 */
 
   /* this implementation of sys__exit does not do anything with the exit code */
@@ -47,17 +53,15 @@ void sys__exit(int exitcode) {
   exitcode = _MKWAIT_EXIT(exitcode);
 #endif /* OPT_A3 */
 
+  /* make our CPU time visible to the parent before it can wake up */
+  proc_chargethread(curthread);
+
   /* update process with exit information */
   spinlock_acquire(&p->p_lock);
   p->exitcode = exitcode;
   p->alive = false;
   spinlock_release(&p->p_lock);
 
-  if (p->p_parent != NULL) {
-    /* signal the parent that waits on the wchan to wake up */
-    cv_signal(p->cv_wake_parent, p->cv_lock);
-  }
-
 #else
   /* for now, just include this to keep the compiler from complaining about
      an unused variable */
@@ -66,7 +70,6 @@ void sys__exit(int exitcode) {
 
   DEBUG(DB_SYSCALL,"Syscall: _exit(%d)\n",exitcode);
 
-  KASSERT(curproc->p_addrspace != NULL);
   as_deactivate();
   /*
    * clear p_addrspace before calling as_destroy. Otherwise if
@@ -76,23 +79,33 @@ void sys__exit(int exitcode) {
    * messily fatal.
    */
   as = curproc_setas(NULL);
+#if OPT_A2
+  if (p->p_vforked) {
+    /* it's our parent's; give it back */
+    proc_vfork_done(p);
+  }
+  else if (as != NULL) {
+    /* (a spawned child that failed to load has none) */
+    as_destroy(as);
+  }
+#else
   as_destroy(as);
+#endif /* OPT_A2 */
+
+#if OPT_A2
+  /* close our files now, rather than whenever we get reaped */
+  filetable_destroy(p->p_filetable);
+  p->p_filetable = NULL;
+#endif /* OPT_A2 */
 
   /* detach this thread from its process */
   /* note: curproc cannot be used after this call */
   proc_remthread(curthread);
 
 #if OPT_A2
-  /* if this is the last user process in the system, proc_destroy()
-     will wake up the kernel menu thread */
-  /* if this process has a living parent, instead of call proc_destroy(),
-     we simply set its alive status to false */
-  if (p->p_parent == NULL) {
-    proc_destroy(p);
-  }
-  else if (!p->p_parent->alive) {
-    proc_destroy(p);
-  }
+  /* give away our children, then either wake our parent to reap us
+     or, if we have none, destroy ourselves */
+  proc_zombify(p);
 #else
   /* if this is the last user process in the system, proc_destroy()
      will wake up the kernel menu thread */
@@ -124,6 +137,48 @@ sys_getpid(pid_t *retval)
   #endif /* OPT_A2 */
 }
 
+/*
+ * Convert a cycle count to a timeval.
+ */
+static void
+cycles_to_timeval(uint64_t cycles, struct timeval *tv)
+{
+  uint32_t hz = mainbus_cyclehz();
+
+  tv->tv_sec = cycles / hz;
+  tv->tv_usec = (cycles % hz) * 1000000 / hz;
+}
+
+/* handler for getrusage() system call */
+int
+sys_getrusage(int who, userptr_t usage)
+{
+  struct proc_usage pu;
+  struct rusage ru;
+
+  switch (who) {
+    case RUSAGE_SELF:
+      proc_getusage(curproc, &pu);
+      break;
+    case RUSAGE_CHILDREN:
+      spinlock_acquire(&curproc->p_lock);
+      pu = curproc->p_cusage;
+      spinlock_release(&curproc->p_lock);
+      break;
+    default:
+      return EINVAL;
+  }
+
+  /* we only keep track of times and context switches */
+  bzero(&ru, sizeof(ru));
+  cycles_to_timeval(pu.pu_utime, &ru.ru_utime);
+  cycles_to_timeval(pu.pu_stime, &ru.ru_stime);
+  ru.ru_nvcsw = pu.pu_nvcsw;
+  ru.ru_nivcsw = pu.pu_nivcsw;
+
+  return copyout(&ru, usage, sizeof(ru));
+}
+
 /* stub handler for waitpid() system call                */
 
 int
@@ -137,54 +192,45 @@ sys_waitpid(pid_t pid,
 
 #if OPT_A2
   struct proc *p = curproc;
+  struct proc *proc_c;
+  pid_t pid_c;
 
-  /* verify the pid is one of curproc's children */
-  struct proc *proc_c = search_pid(p, pid);
-  if (proc_c == NULL) {
-    // panic("Given pid: %d is not a valid child of parent %d.\n", (int) pid, (int) curproc->pid);
-    return -1; /* error -1: not a valid child */
-  }
-
-  /* verify if sys_waitpid has been called on this process before */
-  if (proc_c->hasWaited) {
-    // panic("Given pid: %d has already been called on this child process before.\n", (int) pid);
-    return -2; /* error -2: duplicated call on waitpid */
+  if ((options & ~WNOHANG) != 0) {
+    return(EINVAL);
   }
 
-  spinlock_acquire(&proc_c->p_lock);
-  proc_c->hasWaited = true;
-  spinlock_release(&proc_c->p_lock);
-
   /* 
-   * if pass this point, the child must be in the children array
+   * wait for the child (or any child, for pid -1) to post itself on
+   * our zombie list, and take it off
    */
+  result = proc_waitchild(p, pid, (options & WNOHANG) != 0, &proc_c);
+  if (result) {
+    return(result);
+  }
+  if (proc_c == NULL) {
+    /* WNOHANG and nobody has exited yet */
+    *retval = 0;
+    return(0);
+  }
 
-  if (proc_c->alive) {
-    /* 
-     * the child process has not exited yet
-     * make curproc go to sleep by keeping it waiting on the child process's conditional variable "cv_wake_parent"
-     * the child process will use its conditional variable to wake the parent up when its execution has finished
-     */
-    lock_acquire(proc_c->cv_lock);
-    cv_wait(proc_c->cv_wake_parent, proc_c->cv_lock);
-    lock_release(proc_c->cv_lock);
-
-    /* at this point, proc_c should not be alive */
-    KASSERT(!proc_c->alive);
-  } 
+  /* at this point, proc_c should not be alive */
+  KASSERT(!proc_c->alive);
 
   /* proc_c's exitcode should be updated */
   exitstatus = proc_c->exitcode;
- 
-  if (options != 0) {
-    return(EINVAL);
-  }
-  
-  result = copyout((void *)&exitstatus,status,sizeof(int));
-  if (result) {
-    return(result);
+  pid_c = proc_c->pid;
+
+  /* its CPU time now counts as ours; then it can go, and its pid too */
+  proc_addchildusage(p, proc_c);
+  proc_destroy(proc_c);
+
+  if (status != NULL) {
+    result = copyout((void *)&exitstatus,status,sizeof(int));
+    if (result) {
+      return(result);
+    }
   }
-  *retval = pid;
+  *retval = pid_c;
   return(0);
 
 #else
@@ -216,233 +262,283 @@ int
 sys_fork(struct trapframe *tf, pid_t *retval)
 {
   char name_c[] = {'\0'};
+  struct proc *proc_c;
+  struct addrspace *as_c;
+  struct trapframe *tf_copy;
+  int result;
 
-  /* create a new process structure */
-  struct proc *proc_c = proc_create_runprogram(name_c);
-  if (proc_c == NULL) {
-    // an error occured when create process structure
-    panic("An error occured when creating process structure.\n");
-    return -1;
+  /* create a new process structure; ENOMEM, or ENPROC if out of pids */
+  result = proc_create_runprogram(name_c, &proc_c);
+  if (result) {
+    return result;
   }
 
-  /* create and copy the address space */
-  struct addrspace *as_c = as_create();
-  int as_cp = as_copy(curproc->p_addrspace, &as_c);
-  if (as_cp != 0) {
-    // an error occured when copy address space
-    panic("An error occured when copying address space: error code %d.\n", as_cp);
-    return -1;
+  /* copy the address space; as_copy makes the new one */
+  result = as_copy(curproc->p_addrspace, &as_c);
+  if (result) {
+    proc_destroy(proc_c);
+    return result;
   }
   spinlock_acquire(&proc_c->p_lock);
-	proc_c->p_addrspace = as_c;
-	spinlock_release(&proc_c->p_lock);
+  proc_c->p_addrspace = as_c;
+  spinlock_release(&proc_c->p_lock);
+
+  /* make a copy of tf on the kernel heap for the child to start from */
+  tf_copy = kmalloc(sizeof(struct trapframe));
+  if (tf_copy == NULL) {
+    result = ENOMEM;
+    goto fail_as;
+  }
+  *tf_copy = *tf;
 
   /* setup parent/child relationship */
   attach_child(proc_c, curproc);
 
-  /* create a thread for child process, and call enter_forked_process */
-  char thread_name[] = {'\0'};
+  /* enter_forked_process will setup the child's trapframe */
+  result = thread_fork(name_c, proc_c, enter_forked_process,
+                       (void *) tf_copy, 0);
+  if (result) {
+    kfree(tf_copy);
+    detach_child(proc_c, curproc);
+    goto fail_as;
+  }
+
+  /* setup return value */
+  *retval = proc_c->pid;
+
+  return 0;
+
+ fail_as:
+  /* proc_destroy leaves the address space to sys__exit */
+  proc_c->p_addrspace = NULL;
+  as_destroy(as_c);
+  proc_destroy(proc_c);
+  return result;
+}
+
 
-  // make a copy of tf on OS heap
-	struct trapframe *tf_copy = (struct trapframe *) kmalloc(sizeof(struct trapframe));
+/*
+ * vfork: like fork, but the child runs in our address space instead
+ * of a copy of it, and we sleep until it execs or exits. Only safe
+ * for a child that does nothing else, but that's the common case and
+ * it saves copying the whole address space just to throw it away.
+ */
+int
+sys_vfork(struct trapframe *tf, pid_t *retval)
+{
+  struct proc *proc_c;
+  struct trapframe *tf_copy;
+  int result;
 
-	// copy parent's trapframe to OS heap
-	*tf_copy = *tf;
+  result = proc_create_runprogram(curproc->p_name, &proc_c);
+  if (result) {
+    return result;
+  }
 
-  int t_fork = thread_fork(thread_name, proc_c, enter_forked_process, (void *) tf_copy, 0);
-  /* enter_forked_process will setup child process (proc_c)'s trapframe */
-  if (t_fork != 0) {
-    // an error occured when forking thread
-    panic("An error occured when forking thread: error code %d.\n", t_fork);
-    return -1;
+  tf_copy = kmalloc(sizeof(struct trapframe));
+  if (tf_copy == NULL) {
+    proc_destroy(proc_c);
+    return ENOMEM;
   }
+  *tf_copy = *tf;
 
-  /* setup return value */
+  /* borrow our address space; no one else can see proc_c yet */
+  spinlock_acquire(&proc_c->p_lock);
+  proc_c->p_addrspace = curproc_getas();
+  spinlock_release(&proc_c->p_lock);
+  proc_c->p_vforked = true;
+
+  attach_child(proc_c, curproc);
+
+  result = thread_fork(curthread->t_name, proc_c, enter_forked_process,
+                       (void *) tf_copy, 0);
+  if (result) {
+    kfree(tf_copy);
+    detach_child(proc_c, curproc);
+    proc_c->p_vforked = false;
+    proc_c->p_addrspace = NULL;
+    proc_destroy(proc_c);
+    return result;
+  }
+
+  /* proc_c can't be reaped until we return, so its pid stays put */
   *retval = proc_c->pid;
 
+  /* wait for the child to be done with our address space */
+  proc_vfork_wait(proc_c);
+
   return 0;
 }
 
-
-int 
-sys_execv(const userptr_t progname, const userptr_t args)
+/*
+ * What a spawned child needs to start up.
+ */
+struct spawn_args {
+  struct vnode *sa_vnode;
+  struct execargs sa_args;
+};
+
+/*
+ * First function of a spawned child's thread: load the program and
+ * go. If loading fails, exit with 127, as a shell would.
+ */
+static void
+spawn_child(void *data, unsigned long unused)
 {
-  struct addrspace *as;
+  struct spawn_args *sa = data;
   struct addrspace *oldas;
-	struct vnode *v;
-	vaddr_t entrypoint, stackptr;
-	int result;
+  vaddr_t entrypoint, stackptr;
+  userptr_t uargv;
+  int argc, result;
 
-  /* total length of argv */
-  int argv_total_len = 0;
+  (void)unused;
 
-  /* count number of args */
-  int argc = 0;
+  argc = sa->sa_args.ea_argc;
+  result = loadexec(sa->sa_vnode, &sa->sa_args, &oldas,
+                    &entrypoint, &stackptr, &uargv);
+  vfs_close(sa->sa_vnode);
+  execargs_cleanup(&sa->sa_args);
+  kfree(sa);
 
-  /* copy the program name from user addrspace to the kernel */
-  int progNameLen = strlen((char *)progname);
-  char *prog = kmalloc((progNameLen + 1) * sizeof(char));
-  result = copyinstr(progname, (void *) prog, progNameLen + 1, NULL);
   if (result) {
-    return result;
+    DEBUG(DB_SYSCALL, "spawn: loading failed: %s\n", strerror(result));
+    sys__exit(127);
+  }
+  KASSERT(oldas == NULL);
+
+  enter_new_process(argc, uargv, stackptr, entrypoint);
+  panic("enter_new_process returned\n");
+}
+
+/*
+ * spawn: start a new child process running program path with
+ * arguments argv, without copying or borrowing our address space.
+ * The program is opened here so a bad path is reported to the
+ * caller; the rest of the loading happens in the child.
+ */
+int
+sys___spawn(userptr_t path, userptr_t uargv, pid_t *retval)
+{
+  struct spawn_args *sa;
+  struct proc *proc_c;
+  char *kpath;
+  int result;
+
+  sa = kmalloc(sizeof(*sa));
+  kpath = kmalloc(PATH_MAX);
+  if (sa == NULL || kpath == NULL) {
+    result = ENOMEM;
+    goto fail_alloc;
   }
-  /* DEBUG: program name */
-  // kprintf("\n");
-  // kprintf("Program name: %s\n", prog);
-
-  /* copy the address of first argument to the kernel */
-  KASSERT(args != NULL);
-  char **argAddr = kmalloc(sizeof(char*));     /* argAddr holds the address of argument */
-  result = copyin(args, (void *) argAddr, sizeof(char*));
+
+  result = copyinstr(path, kpath, PATH_MAX, NULL);
   if (result) {
-    return result;
+    goto fail_alloc;
+  }
+  result = execargs_copyin(&sa->sa_args, uargv);
+  if (result) {
+    goto fail_alloc;
   }
 
-  while (*argAddr != NULL) {
-    /* a valid argument is found, copy the next address */
-    argc++;
-    result = copyin(args + argc * sizeof(char*), (void *) argAddr, sizeof(char*));
-    if (result) {
-      return result;
-    }
+  /* vfs_open may destroy kpath, so name the process first */
+  result = proc_create_runprogram(kpath, &proc_c);
+  if (result) {
+    goto fail_argv;
   }
 
-  /* since NULL ptr is argv[argc] and program name is argv[0], add 1 to argc */
-  argc += 1;
+  result = vfs_open(kpath, O_RDONLY, 0, &sa->sa_vnode);
+  if (result) {
+    goto fail_proc;
+  }
 
-  /* DEBUG: program argument number */
-  //kprintf("Program Arg Number: %d\n", argc);
-  
-  /* allocate space for an array of pointer to the args in the kernel */
-  char **argv = kmalloc((argc + 1) * sizeof(char *));
+  attach_child(proc_c, curproc);
 
-  /* recursively copy all args from argv[1] to arg[argc - 1] to the argv */
-  for (int i = 1; i < argc; i++) {
-    /* copy the ith argument into the argv's ith space */
-    result = copyin(args + (i - 1) * sizeof(char*), (void *) argAddr, sizeof(char*));
-    if (result) {
-      return result;
-    }
-    char *actArg = kmalloc((strlen(*argAddr) + 1) * sizeof(char));
-    strcpy(actArg, *argAddr);
-    /* set the ith arg address point to this argument */
-    argv[i] = actArg;
-    /* add length of this argument to argv_total_len */
-    argv_total_len += (strlen(argv[i]) + 1);
+  result = thread_fork(proc_c->p_name, proc_c, spawn_child, sa, 0);
+  if (result) {
+    detach_child(proc_c, curproc);
+    vfs_close(sa->sa_vnode);
+    goto fail_proc;
   }
-  argv[0] = prog;
-  argv_total_len += (strlen(argv[0]) + 1);
-  argv[argc] = NULL;
-
-  /* DEBUG: program arguments */
-  //kprintf("args: ");
-  //for (int i = 0; i <= argc; i++) {
-  //kprintf("%s ", argv[i]);
-  //}
-  //kprintf("\n");
-
-	/* Open the file. */
-	result = vfs_open((char *) progname, O_RDONLY, 0, &v);
-	if (result) {
-		return result;
-	}
-
-	/* Create a new address space. */
-	as = as_create();
-	if (as ==NULL) {
-		vfs_close(v);
-		return ENOMEM;
-	}
-
-	/* Switch to it and activate it. */
-	oldas = curproc_setas(as);
-	as_activate();
-
-  /* delete the old address space */
-  as_destroy(oldas);
-
-	/* Load the executable. */
-	result = load_elf(v, &entrypoint);
-	if (result) {
-		/* p_addrspace will go away when curproc is destroyed */
-		vfs_close(v);
-		return result;
-	}
-
-	/* Done with the file now. */
-	vfs_close(v);
-
-	/* Define the user stack in the address space */
-	result = as_define_stack(as, &stackptr);
-	if (result) {
-		/* p_addrspace will go away when curproc is destroyed */
-		return result;
-	}
-
-  /* CRITICAL: copy arguments to user stack */
-  /* --STEP 1--: Determine the space needed for argv and argv offset stack */
-  int argv_space = ROUNDUP(argv_total_len * sizeof(char), 4);
-  int offset_space = ROUNDUP((argc + 1) * sizeof(char *), sizeof(vaddr_t));
-
-  /* move the stack pointer to beginning of argv offset, and set a pointer to that address (top of stack) */
-  stackptr -= (argv_space + offset_space);
-
-  userptr_t startptr = (userptr_t) stackptr;
-
-  /* determine the stack address of current argument */
-  userptr_t currArgAddr = startptr + offset_space;
-
-  /* argvOffset[i] stores the offset to argv[i] */
-  char **argvOffset = kmalloc((argc + 1) * sizeof(char *));
-
-  size_t actual;
-
-  /* --STEP 2--: copy all arguments (argv[0] to argv[argc - 1]) to the stack */
-  for (int i = 0; i < argc; i++) {
-    char *currArgv = argv[i];
-    // kprintf("Current: %s\n", currArgv);
-
-    // copy currArgv to currArgAddr at user stack
-    result = copyoutstr(currArgv, currArgAddr, strlen(currArgv) + 1, &actual);
-    // kprintf("Actual: %d\n", (int) actual);
-    if (result) {
-      return result;
-    }
 
-    argvOffset[i] = (char *) currArgAddr;
+  kfree(kpath);
+  *retval = proc_c->pid;
+  return 0;
 
-    // progress stack address tracker
-    currArgAddr += actual * sizeof(char);
+ fail_proc:
+  proc_destroy(proc_c);
+ fail_argv:
+  execargs_cleanup(&sa->sa_args);
+ fail_alloc:
+  kfree(kpath);
+  kfree(sa);
+  return result;
+}
+
+int 
+sys_execv(const userptr_t progname, const userptr_t args)
+{
+  struct execargs ea;
+  struct addrspace *oldas;
+  struct vnode *v;
+  vaddr_t entrypoint, stackptr;
+  userptr_t uargv;
+  char *path;
+  int argc, result;
+
+  /* copy the program name and the arguments into the kernel */
+  path = kmalloc(PATH_MAX);
+  if (path == NULL) {
+    return ENOMEM;
+  }
+  result = copyinstr(progname, path, PATH_MAX, NULL);
+  if (result) {
+    kfree(path);
+    return result;
   }
-  argvOffset[argc] = NULL;
+  result = execargs_copyin(&ea, args);
+  if (result) {
+    kfree(path);
+    return result;
+  }
+  argc = ea.ea_argc;
 
-  /* --STEP 3--: copy all argument offsets to the stack */
-  result = copyout(argvOffset, startptr, (argc + 1) * sizeof(char *));
+  /* Open the file. (This may destroy path.) */
+  result = vfs_open(path, O_RDONLY, 0, &v);
+  kfree(path);
   if (result) {
+    execargs_cleanup(&ea);
     return result;
   }
 
-  /* Now free the space allocated in the kernel */
-  kfree(argvOffset);
-  
-  for (int i = 0; i < argc; i++) {
-    kfree(argv[i]);
+  /* Load it into a new address space, with the arguments on its stack */
+  result = loadexec(v, &ea, &oldas, &entrypoint, &stackptr, &uargv);
+
+  /* Done with the file and the arguments now. */
+  vfs_close(v);
+  execargs_cleanup(&ea);
+
+  if (result) {
+    /* still running the old program */
+    return result;
   }
 
-  kfree(argAddr);
+  /* a syscall ring set up in the old address space is gone with it */
+  curproc->p_ring = NULL;
+  curproc->p_ringentries = 0;
 
-  kfree(argv);
+  /* the old address space is no longer needed, unless it was borrowed */
+  if (curproc->p_vforked) {
+    proc_vfork_done(curproc);
+  }
+  else {
+    as_destroy(oldas);
+  }
 
-	/* Warp to user mode. */
-  /*
-   * first parameter should be the number of arguments
-   * second parameter should be the address to the arguments on the stack
-   * third parameter should be the stackptr
-   */
-  enter_new_process(argc, startptr, stackptr, entrypoint);
-	
-	/* enter_new_process does not return. */
-	panic("enter_new_process returned\n");
-	return EINVAL;
+  /* Warp to user mode. */
+  enter_new_process(argc, uargv, stackptr, entrypoint);
+
+  /* enter_new_process does not return. */
+  panic("enter_new_process returned\n");
+  return EINVAL;
 }
 
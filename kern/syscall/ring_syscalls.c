@@ -0,0 +1,200 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * System call rings. See <kern/ring.h>.
+ *
+ * The ring is reached through the kernel's direct mapping of
+ * physical memory, so ring_setup insists that it be physically
+ * contiguous; under dumbvm anything within one segment is. Nothing
+ * in the ring is trusted: indexes are taken mod our own copy of the
+ * size, and each submission is copied out before it's looked at.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/ring.h>
+#include <lib.h>
+#include <proc.h>
+#include <current.h>
+#include <addrspace.h>
+#include <vm.h>
+#include <syscall.h>
+
+#include "opt-A2.h" /* required for A2 */
+
+#if OPT_A2
+
+int
+sys_ring_setup(userptr_t mem, unsigned entries)
+{
+	struct addrspace *as = curproc_getas();
+	struct ring *ring;
+	vaddr_t va;
+	paddr_t pa0, pa;
+	size_t size, off;
+	int result;
+
+	if (mem == NULL && entries == 0) {
+		curproc->p_ring = NULL;
+		curproc->p_ringentries = 0;
+		return 0;
+	}
+
+	if (entries == 0 || entries > RING_MAXENTRIES ||
+	    (entries & (entries - 1)) != 0) {
+		return EINVAL;
+	}
+	va = (vaddr_t)mem;
+	size = RING_SIZE(entries);
+	if (va % 8 != 0) {
+		return EINVAL;
+	}
+	if (va >= USERSPACETOP || size > USERSPACETOP - va) {
+		return EFAULT;
+	}
+
+	result = as_translate(as, va, true, &pa0);
+	if (result) {
+		return result;
+	}
+	for (off = PAGE_SIZE - (va & ~PAGE_FRAME); off < size;
+	     off += PAGE_SIZE) {
+		result = as_translate(as, va + off, true, &pa);
+		if (result) {
+			return result;
+		}
+		if (pa != pa0 + off) {
+			/* not physically contiguous */
+			return EINVAL;
+		}
+	}
+
+	ring = (struct ring *)PADDR_TO_KVADDR(pa0);
+	ring->r_sqhead = 0;
+	ring->r_sqtail = 0;
+	ring->r_cqhead = 0;
+	ring->r_cqtail = 0;
+	ring->r_entries = entries;
+
+	curproc->p_ring = ring;
+	curproc->p_ringentries = entries;
+	return 0;
+}
+
+/*
+ * Carry out one submission. Returns the value for the completion.
+ */
+static
+int
+ring_do(const struct ring_sqe *sqe)
+{
+	int result, val = 0;
+
+	switch (sqe->sqe_op) {
+	    case RING_OP_NOP:
+		result = 0;
+		break;
+	    case RING_OP_READ:
+		if (sqe->sqe_off < 0) {
+			result = sys_read(sqe->sqe_fd, sqe->sqe_buf,
+					  sqe->sqe_len, &val);
+		}
+		else {
+			result = sys_pread(sqe->sqe_fd, sqe->sqe_buf,
+					   sqe->sqe_len, sqe->sqe_off, &val);
+		}
+		break;
+	    case RING_OP_WRITE:
+		if (sqe->sqe_off < 0) {
+			result = sys_write(sqe->sqe_fd, sqe->sqe_buf,
+					   sqe->sqe_len, &val);
+		}
+		else {
+			result = sys_pwrite(sqe->sqe_fd, sqe->sqe_buf,
+					    sqe->sqe_len, sqe->sqe_off, &val);
+		}
+		break;
+	    case RING_OP_OPEN:
+		result = sys_open(sqe->sqe_buf, sqe->sqe_flags,
+				  sqe->sqe_len, &val);
+		break;
+	    case RING_OP_CLOSE:
+		result = sys_close(sqe->sqe_fd);
+		break;
+	    case RING_OP_FSYNC:
+		result = sys_fsync(sqe->sqe_fd);
+		break;
+	    default:
+		result = ENOSYS;
+		break;
+	}
+	return result ? -result : val;
+}
+
+int
+sys_ring_enter(unsigned count, int *retval)
+{
+	struct ring *ring = curproc->p_ring;
+	unsigned mask = curproc->p_ringentries - 1;
+	struct ring_sqe sqe;
+	struct ring_cqe *cqe;
+	uint32_t sqhead, cqtail;
+	unsigned done;
+
+	if (ring == NULL) {
+		return EINVAL;
+	}
+
+	sqhead = ring->r_sqhead;
+	cqtail = ring->r_cqtail;
+	for (done = 0; done < count; done++) {
+		if (sqhead == ring->r_sqtail) {
+			/* nothing more submitted */
+			break;
+		}
+		if (cqtail - ring->r_cqhead > mask) {
+			/* no room for the completion */
+			break;
+		}
+
+		sqe = RING_SQ(ring)[sqhead & mask];
+		cqe = &RING_CQ(ring, mask + 1)[cqtail & mask];
+		cqe->cqe_result = ring_do(&sqe);
+		cqe->cqe_data = sqe.sqe_data;
+
+		ring->r_cqtail = ++cqtail;
+		ring->r_sqhead = ++sqhead;
+	}
+
+	*retval = done;
+	return 0;
+}
+
+#endif /* OPT_A2 */
@@ -48,118 +48,110 @@
 #include "opt-A2.h" /* required for A2 */
 
 #if OPT_A2
-#include <copyinout.h>
+#include <execargs.h>
 #endif /* OPT_A2 */
 
 #if OPT_A2
 /*
- * Load program "progname" and start running it in usermode.
- * Does not return except on error.
+ * Set the current process up to run the program in vnode v: make a
+ * new address space, load the program into it, and put the arguments
+ * in args on its stack. On success the new address space is current
+ * and active, and the one it replaced (NULL for a new process) is
+ * handed back in *oldasp for the caller to dispose of. On failure the
+ * old address space is put back.
  *
- * Calls vfs_open on progname and thus may destroy it.
+ * Used by runprogram, execv, and spawn.
  */
 int
-runprogram(char *progname, char **args, int argc)
+loadexec(struct vnode *v, struct execargs *args, struct addrspace **oldasp,
+	 vaddr_t *entrypoint, vaddr_t *stackptr, userptr_t *uargv)
 {
-	struct addrspace *as;
-	struct vnode *v;
-	vaddr_t entrypoint, stackptr;
+	struct addrspace *as, *oldas;
 	int result;
 
-	(void) args;
-
-	/* Open the file. */
-	result = vfs_open(progname, O_RDONLY, 0, &v);
-	if (result) {
-		return result;
-	}
-
-	/* We should be a new process. */
-	KASSERT(curproc_getas() == NULL);
-
 	/* Create a new address space. */
 	as = as_create();
-	if (as ==NULL) {
-		vfs_close(v);
+	if (as == NULL) {
 		return ENOMEM;
 	}
 
 	/* Switch to it and activate it. */
-	curproc_setas(as);
+	oldas = curproc_setas(as);
 	as_activate();
 
 	/* Load the executable. */
-	result = load_elf(v, &entrypoint);
+	result = load_elf(v, entrypoint);
 	if (result) {
-		/* p_addrspace will go away when curproc is destroyed */
-		vfs_close(v);
-		return result;
+		goto fail;
 	}
 
-	/* Done with the file now. */
-	vfs_close(v);
-
 	/* Define the user stack in the address space */
-	result = as_define_stack(as, &stackptr);
+	result = as_define_stack(as, stackptr);
 	if (result) {
-		/* p_addrspace will go away when curproc is destroyed */
-		return result;
+		goto fail;
 	}
 
-	/* CRITICAL: copy arguments to user stack */
-	/* --STEP 1--: determine total length of arguments */
-	int argv_total_len = 0;
-	for (int i = 0; i < argc; i++) {
-		argv_total_len += (strlen(args[i]) + 1);
+	/* Copy the arguments onto the stack */
+	result = execargs_copyout(args, stackptr, uargv);
+	if (result) {
+		goto fail;
 	}
 
-	/* Determine the space needed for argv and argv offset stack */
-	int argv_space = ROUNDUP(argv_total_len * sizeof(char), 4);
-  	int offset_space = ROUNDUP((argc + 1) * sizeof(char *), sizeof(vaddr_t));
+	*oldasp = oldas;
+	return 0;
 
-	/* move the stack pointer to beginning of argv offset, and set a pointer to that address (top of stack) */
-	stackptr -= (argv_space + offset_space);
-
-	userptr_t startptr = (userptr_t) stackptr;
-
-	/* determine the stack address of current argument */
-	userptr_t currArgAddr = startptr + offset_space;
+ fail:
+	curproc_setas(oldas);
+	as_activate();
+	as_destroy(as);
+	return result;
+}
 
-	/* argvOffset[i] stores the offset to argv[i] */
-  	char **argvOffset = kmalloc((argc + 1) * sizeof(char *));
+/*
+ * Load program "progname" and start running it in usermode.
+ * Does not return except on error.
+ *
+ * Calls vfs_open on progname and thus may destroy it.
+ */
+int
+runprogram(char *progname, char **args, int argc)
+{
+	struct execargs ea;
+	struct addrspace *oldas;
+	struct vnode *v;
+	vaddr_t entrypoint, stackptr;
+	userptr_t uargv;
+	int result;
 
-	size_t actual;
+	/* Open the file. */
+	result = vfs_open(progname, O_RDONLY, 0, &v);
+	if (result) {
+		return result;
+	}
 
-	/* --STEP 2--: copy all arguments (argv[0] to argv[argc - 1]) to the stack */
-	for (int i = 0; i < argc; i++) {
-		char *currArgv = args[i];
-		// kprintf("Current: %s\n", currArgv);
+	/* We should be a new process. */
+	KASSERT(curproc_getas() == NULL);
 
-		// copy currArgv to currArgAddr at user stack
-		result = copyoutstr(currArgv, currArgAddr, strlen(currArgv) + 1, &actual);
-		// kprintf("Actual: %d\n", (int) actual);
-		if (result) {
-			return result;
-		}
+	result = execargs_fromkernel(&ea, args, argc);
+	if (result) {
+		vfs_close(v);
+		return result;
+	}
 
-		argvOffset[i] = (char *) currArgAddr;
+	/* Load it, with the arguments on its stack. */
+	result = loadexec(v, &ea, &oldas, &entrypoint, &stackptr, &uargv);
 
-		// progress stack address tracker
-		currArgAddr += actual * sizeof(char);
-	}
-	argvOffset[argc] = NULL;
+	/* Done with the file and the arguments now. */
+	vfs_close(v);
+	execargs_cleanup(&ea);
 
-	/* --STEP 3--: copy all argument offsets to the stack */
-	result = copyout(argvOffset, startptr, (argc + 1) * sizeof(char *));
 	if (result) {
 		return result;
 	}
-
-	/* Now free the space allocated in the kernel */
-	kfree(argvOffset);
+	KASSERT(oldas == NULL);
 
 	/* Warp to user mode. */
-	enter_new_process(argc /*argc*/, (userptr_t) stackptr /*userspace addr of argv*/,
+	enter_new_process(argc /*argc*/, uargv /*userspace addr of argv*/,
 			  stackptr, entrypoint);
 	
 	/* enter_new_process does not return. */
@@ -28,6 +28,8 @@
  */
 
 #include <types.h>
+#include <kern/errno.h>
+#include <kern/time.h>
 #include <clock.h>
 #include <copyinout.h>
 #include <syscall.h>
@@ -56,3 +58,45 @@ sys___time(userptr_t user_seconds_ptr, userptr_t user_nanoseconds_ptr)
 
 	return 0;
 }
+
+/*
+ * nanosleep: suspend the calling thread for at least the requested
+ * interval. The thread is woken by a callout at its deadline rather
+ * than polling the clock.
+ *
+ * We have no signals, so a sleep is never interrupted and the
+ * remaining time, if asked for, is always zero.
+ */
+int
+sys_nanosleep(userptr_t user_req, userptr_t user_rem)
+{
+	struct timespec req, rem;
+	int result;
+
+	result = copyin(user_req, &req, sizeof(req));
+	if (result) {
+		return result;
+	}
+	if (req.tv_sec < 0 || req.tv_nsec < 0 || req.tv_nsec >= 1000000000) {
+		return EINVAL;
+	}
+
+	/*
+	 * Round up, and add one tick because the current tick is
+	 * already partly over; nanosleep may not return early.
+	 */
+	if (req.tv_sec > 0 || req.tv_nsec > 0) {
+		clock_sleepticks(timespec_to_ticks(&req) + 1);
+	}
+
+	if (user_rem != NULL) {
+		rem.tv_sec = 0;
+		rem.tv_nsec = 0;
+		result = copyout(&rem, user_rem, sizeof(rem));
+		if (result) {
+			return result;
+		}
+	}
+
+	return 0;
+}
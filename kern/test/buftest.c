@@ -0,0 +1,281 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * buftest - buffer cache test
+ *
+ * Mounts SFS on the device named (which must be unmounted and hold an
+ * SFS volume), so the superblock, free map and root directory come in
+ * through the cache. Writes a file of BT_NBLOCKS blocks, each filled
+ * with a pattern depending on its number, and reads it back; then
+ * unmounts, which writes everything out and empties the cache of the
+ * device, mounts again, and reads the file back from disk.
+ *
+ * Last it reads the first 2*BUF_MAXBUFS blocks of the raw device
+ * through the cache twice, so buffers get reused for other blocks,
+ * and checks each against what reading the device directly gives.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/fcntl.h>
+#include <lib.h>
+#include <uio.h>
+#include <vfs.h>
+#include <vnode.h>
+#include <device.h>
+#include <sfs.h>
+#include <buf.h>
+#include <test.h>
+
+#define BT_FILENAME	"buftest.tmp"
+#define BT_NBLOCKS	128		/* fits in direct + indirect blocks */
+
+static
+void
+bt_fill(char *data, unsigned blockno)
+{
+	unsigned i;
+
+	for (i=0; i<BUF_SIZE; i++) {
+		data[i] = (char)(blockno * 7 + i);
+	}
+}
+
+/* The kernel has no memcmp. */
+static
+bool
+bt_same(const char *a, const char *b)
+{
+	unsigned i;
+
+	for (i=0; i<BUF_SIZE; i++) {
+		if (a[i] != b[i]) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/*
+ * Write or check the test file on DEVICE. Returns 0 if all went well.
+ */
+static
+int
+bt_file(const char *device, enum uio_rw rw, char *data, char *expect)
+{
+	char name[64];
+	struct vnode *vn;
+	struct iovec iov;
+	struct uio ku;
+	unsigned i;
+	int result;
+
+	snprintf(name, sizeof(name), "%s:%s", device, BT_FILENAME);
+	result = vfs_open(name, rw == UIO_WRITE ? O_WRONLY|O_CREAT|O_TRUNC
+			  : O_RDONLY, 0664, &vn);
+	if (result) {
+		kprintf("buftest: %s: %s\n", BT_FILENAME, strerror(result));
+		return result;
+	}
+
+	for (i=0; i<BT_NBLOCKS; i++) {
+		bt_fill(expect, i);
+		if (rw == UIO_WRITE) {
+			memcpy(data, expect, BUF_SIZE);
+		}
+		uio_kinit(&iov, &ku, data, BUF_SIZE,
+			  (off_t)i * BUF_SIZE, rw);
+		result = rw == UIO_WRITE ? VOP_WRITE(vn, &ku)
+			: VOP_READ(vn, &ku);
+		if (result) {
+			kprintf("buftest: block %u: %s\n", i,
+				strerror(result));
+			break;
+		}
+		if (ku.uio_resid > 0) {
+			kprintf("buftest: block %u: short %s\n", i,
+				rw == UIO_WRITE ? "write" : "read");
+			result = EIO;
+			break;
+		}
+		if (rw == UIO_READ && !bt_same(data, expect)) {
+			kprintf("buftest: block %u: wrong contents\n", i);
+			result = EIO;
+			break;
+		}
+	}
+
+	vfs_close(vn);
+	return result;
+}
+
+/*
+ * Read blocks of the raw device through the cache and directly, and
+ * compare.
+ */
+static
+int
+bt_raw(const char *device, char *data, char *expect)
+{
+	char name[64];
+	struct vnode *vn;
+	struct device *dev;
+	struct buf *b;
+	struct iovec iov;
+	struct uio ku;
+	unsigned i, pass, nblocks;
+	int result;
+
+	snprintf(name, sizeof(name), "%sraw:", device);
+	result = vfs_open(name, O_RDONLY, 0, &vn);
+	if (result) {
+		kprintf("buftest: %s: %s\n", name, strerror(result));
+		return result;
+	}
+	dev = vn->vn_data;
+
+	nblocks = 2 * BUF_MAXBUFS;
+	if (nblocks > dev->d_blocks) {
+		nblocks = dev->d_blocks;
+	}
+
+	for (pass=0; pass<2; pass++) {
+		for (i=0; i<nblocks; i++) {
+			uio_kinit(&iov, &ku, expect, BUF_SIZE,
+				  (off_t)i * BUF_SIZE, UIO_READ);
+			result = VOP_READ(vn, &ku);
+			if (result) {
+				kprintf("buftest: raw block %u: %s\n", i,
+					strerror(result));
+				goto out;
+			}
+
+			result = buffer_read(dev, i, &b);
+			if (result) {
+				kprintf("buftest: buffer_read of block %u: "
+					"%s\n", i, strerror(result));
+				goto out;
+			}
+			memcpy(data, buffer_map(b), BUF_SIZE);
+			buffer_release(b);
+
+			if (!bt_same(data, expect)) {
+				kprintf("buftest: cached block %u differs "
+					"from disk\n", i);
+				result = EIO;
+				goto out;
+			}
+		}
+	}
+
+ out:
+	/* Leave nothing behind for the device. */
+	if (buffer_dropdev(dev) && result == 0) {
+		result = EIO;
+	}
+	vfs_close(vn);
+	return result;
+}
+
+int
+buftest(int nargs, char **args)
+{
+	char name[64];
+	char *device;
+	char *data, *expect;
+	int result;
+
+	if (nargs != 2) {
+		kprintf("Usage: bc1 device\n");
+		return EINVAL;
+	}
+
+	device = args[1];
+
+	/* Allow (but do not require) colon after device name */
+	if (device[strlen(device)-1]==':') {
+		device[strlen(device)-1] = 0;
+	}
+
+	data = kmalloc(BUF_SIZE);
+	expect = kmalloc(BUF_SIZE);
+	if (data == NULL || expect == NULL) {
+		kfree(data);
+		kfree(expect);
+		return ENOMEM;
+	}
+
+	kprintf("*** Starting buffer cache test on %s:\n", device);
+
+	result = sfs_mount(device);
+	if (result) {
+		kprintf("buftest: mount %s: %s\n", device, strerror(result));
+		goto done;
+	}
+	result = bt_file(device, UIO_WRITE, data, expect);
+	if (result == 0) {
+		result = bt_file(device, UIO_READ, data, expect);
+	}
+	if (vfs_unmount(device) && result == 0) {
+		kprintf("buftest: unmount %s failed\n", device);
+		result = EIO;
+	}
+	if (result) {
+		goto done;
+	}
+
+	/* Again, after it's all been written and dropped from the cache. */
+	result = sfs_mount(device);
+	if (result) {
+		kprintf("buftest: remount %s: %s\n", device, strerror(result));
+		goto done;
+	}
+	result = bt_file(device, UIO_READ, data, expect);
+	snprintf(name, sizeof(name), "%s:%s", device, BT_FILENAME);
+	if (vfs_remove(name) && result == 0) {
+		kprintf("buftest: could not remove %s\n", BT_FILENAME);
+		result = EIO;
+	}
+	if (vfs_unmount(device) && result == 0) {
+		kprintf("buftest: unmount %s failed\n", device);
+		result = EIO;
+	}
+	if (result) {
+		goto done;
+	}
+
+	result = bt_raw(device, data, expect);
+
+ done:
+	kfree(data);
+	kfree(expect);
+	kprintf("*** Buffer cache test %s\n", result ? "failed" : "done");
+	return result;
+}
@@ -0,0 +1,250 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Callout and sleep tests.
+ *
+ * ct1 checks sleep accuracy: each sleep must last at least as long as
+ * asked for, and should not overshoot by more than about a tick. It
+ * also checks periodic callouts and cancellation.
+ *
+ * ct2 measures wakeup cost with a crowd of sleepers: threads sleep
+ * with deadlines staggered a tick apart, and we report how late each
+ * one woke up. Each sleeper is woken only by its own callout, so the
+ * lateness should not grow with the number of sleepers.
+ *
+ * Both return EIO if a check fails, so the menu reports the failure.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <clock.h>
+#include <spinlock.h>
+#include <thread.h>
+#include <synch.h>
+#include <test.h>
+
+#define NSLEEPERS	32
+#define NPERIODS	10
+
+static const unsigned sleepticks[] = { 1, 2, 5, 10, 25, 100 };
+
+/* nanoseconds from (s1,ns1) to (s2,ns2) */
+static
+uint64_t
+elapsed_nsecs(time_t s1, uint32_t ns1, time_t s2, uint32_t ns2)
+{
+	time_t secs;
+	uint32_t nsecs;
+
+	getinterval(s1, ns1, s2, ns2, &secs, &nsecs);
+	return (uint64_t)secs * 1000000000ULL + nsecs;
+}
+
+static volatile unsigned periodic_count;
+
+static
+void
+periodic_func(void *data)
+{
+	(void)data;
+	periodic_count++;
+}
+
+static
+void
+never_func(void *data)
+{
+	(void)data;
+	panic("clocktest: cancelled callout fired\n");
+}
+
+int
+clocktest(int nargs, char **args)
+{
+	struct callout periodic, never;
+	time_t s1, s2;
+	uint32_t ns1, ns2;
+	uint64_t actual, want, tick;
+	unsigned i;
+	bool ok = true;
+
+	(void)nargs;
+	(void)args;
+
+	tick = 1000000000ULL / CALLOUT_HZ;
+
+	kprintf("Starting clock test...\n");
+	kprintf("%8s %12s %12s %12s\n", "ticks", "wanted(us)", "got(us)",
+		"late(us)");
+	for (i=0; i<sizeof(sleepticks)/sizeof(sleepticks[0]); i++) {
+		want = sleepticks[i] * tick;
+		gettime(&s1, &ns1);
+		clock_sleepticks(sleepticks[i] + 1);
+		gettime(&s2, &ns2);
+		actual = elapsed_nsecs(s1, ns1, s2, ns2);
+		kprintf("%8u %12llu %12llu %12llu\n", sleepticks[i],
+			want / 1000, actual / 1000,
+			actual > want ? (actual - want) / 1000 : 0);
+		if (actual < want) {
+			kprintf("clocktest: woke up early\n");
+			ok = false;
+		}
+		else if (actual > want + 2*tick) {
+			kprintf("clocktest: woke up more than two ticks late\n");
+			ok = false;
+		}
+	}
+
+	/* Periodic callout, stopped after NPERIODS firings. */
+	periodic_count = 0;
+	callout_init(&periodic, periodic_func, NULL);
+	callout_periodic(&periodic, 2);
+	while (periodic_count < NPERIODS) {
+		clock_sleepticks(1);
+	}
+	if (!callout_cancel(&periodic)) {
+		kprintf("clocktest: periodic callout was not pending\n");
+		ok = false;
+	}
+	i = periodic_count;
+	clock_sleepticks(5);
+	if (periodic_count != i) {
+		kprintf("clocktest: periodic callout fired after cancel\n");
+		ok = false;
+	}
+
+	/* Cancellation of a far-off one-shot. */
+	callout_init(&never, never_func, NULL);
+	callout_schedule(&never, 100000);
+	if (!callout_pending(&never) || !callout_cancel(&never)) {
+		kprintf("clocktest: one-shot callout was not pending\n");
+		ok = false;
+	}
+	if (callout_pending(&never)) {
+		kprintf("clocktest: callout still pending after cancel\n");
+		ok = false;
+	}
+
+	kprintf("Clock test %s.\n", ok ? "done" : "FAILED");
+	return ok ? 0 : EIO;
+}
+
+static struct semaphore *sleepers_done;
+static struct spinlock sleeper_lock = SPINLOCK_INITIALIZER;
+static volatile unsigned sleeper_runs;
+static volatile uint64_t sleeper_late_total;
+static volatile uint64_t sleeper_late_max;
+
+static
+void
+sleeperthread(void *junk, unsigned long num)
+{
+	time_t s1, s2;
+	uint32_t ns1, ns2;
+	uint64_t actual, want;
+	unsigned ticks;
+
+	(void)junk;
+
+	/* Stagger the deadlines one tick apart. */
+	ticks = num + 1;
+	want = ticks * (1000000000ULL / CALLOUT_HZ);
+
+	gettime(&s1, &ns1);
+	clock_sleepticks(ticks + 1);
+	gettime(&s2, &ns2);
+	actual = elapsed_nsecs(s1, ns1, s2, ns2);
+
+	spinlock_acquire(&sleeper_lock);
+	sleeper_runs++;
+	if (actual > want) {
+		sleeper_late_total += actual - want;
+		if (actual - want > sleeper_late_max) {
+			sleeper_late_max = actual - want;
+		}
+	}
+	spinlock_release(&sleeper_lock);
+	V(sleepers_done);
+}
+
+int
+clocktest2(int nargs, char **args)
+{
+	time_t s1, s2;
+	uint32_t ns1, ns2;
+	uint32_t t1, t2;
+	unsigned i;
+	int result;
+	bool ok = true;
+
+	(void)nargs;
+	(void)args;
+
+	sleepers_done = sem_create("sleepers_done", 0);
+	if (sleepers_done == NULL) {
+		panic("clocktest2: sem_create failed\n");
+	}
+	sleeper_runs = 0;
+	sleeper_late_total = 0;
+	sleeper_late_max = 0;
+
+	kprintf("Starting clock wakeup test with %d sleepers...\n",
+		NSLEEPERS);
+	gettime(&s1, &ns1);
+	t1 = clock_ticks();
+	for (i=0; i<NSLEEPERS; i++) {
+		result = thread_fork("sleeper", NULL, sleeperthread, NULL, i);
+		if (result) {
+			panic("clocktest2: thread_fork failed: %s\n",
+			      strerror(result));
+		}
+	}
+	for (i=0; i<NSLEEPERS; i++) {
+		P(sleepers_done);
+	}
+	t2 = clock_ticks();
+	gettime(&s2, &ns2);
+
+	kprintf("elapsed: %llu us over %u ticks\n",
+		elapsed_nsecs(s1, ns1, s2, ns2) / 1000, t2 - t1);
+	if (sleeper_runs != NSLEEPERS) {
+		kprintf("clocktest2: only %u of %d sleepers ran\n",
+			sleeper_runs, NSLEEPERS);
+		ok = false;
+	}
+	kprintf("lateness: avg %llu us, max %llu us\n",
+		sleeper_late_total / NSLEEPERS / 1000,
+		sleeper_late_max / 1000);
+
+	sem_destroy(sleepers_done);
+	kprintf("Clock wakeup test %s.\n", ok ? "done" : "FAILED");
+	return ok ? 0 : EIO;
+}
@@ -34,14 +34,20 @@
 #include <types.h>
 #include <lib.h>
 #include <clock.h>
+#include <cpu.h>
 #include <thread.h>
+#include <spinlock.h>
 #include <synch.h>
+#include <lockstat.h>
 #include <test.h>
 
 #define NSEMLOOPS     63
 #define NLOCKLOOPS    120
 #define NCVLOOPS      5
 #define NTHREADS      32
+#define NRWLOOPS      200
+#define NRWSPIN       500
+#define NSPINTHREADS  16
 
 static volatile unsigned long testval1;
 static volatile unsigned long testval2;
@@ -347,3 +353,300 @@ cvtest(int nargs, char **args)
 
 	return 0;
 }
+
+/*
+ * Reader-writer lock test.
+ *
+ * First every thread hammers on one rwlock, one in four as a writer,
+ * checking that writers are exclusive and that readers overlap.
+ * Then readers alone run the same critical section under the rwlock
+ * and under a plain lock with increasing thread counts, so the times
+ * show whether read-side acquisition scales.
+ */
+
+static struct rwlock *testrw;
+static volatile unsigned rwreaders;
+static volatile unsigned rwmaxreaders;
+static volatile unsigned rwfailed;
+static volatile bool rwuselock;
+static struct spinlock rwstatlock = SPINLOCK_INITIALIZER;
+
+static
+void
+rwspin(void)
+{
+	volatile int j;
+
+	for (j=0; j<NRWSPIN; j++);
+}
+
+static
+void
+rwtestthread(void *junk, unsigned long num)
+{
+	int i;
+
+	(void)junk;
+
+	for (i=0; i<NRWLOOPS; i++) {
+		if (num % 4 == 0) {
+			rwlock_acquire_write(testrw);
+			testval2 = num;
+			testval3 = num;
+			if (rwreaders != 0) {
+				kprintf("Thread %lu: writer saw %u readers\n",
+					num, rwreaders);
+				rwfailed = 1;
+			}
+			rwspin();
+			if (testval2 != num || testval3 != num) {
+				kprintf("Thread %lu: writer data changed\n",
+					num);
+				rwfailed = 1;
+			}
+			rwlock_release_write(testrw);
+		}
+		else {
+			rwlock_acquire_read(testrw);
+			spinlock_acquire(&rwstatlock);
+			rwreaders++;
+			if (rwreaders > rwmaxreaders) {
+				rwmaxreaders = rwreaders;
+			}
+			spinlock_release(&rwstatlock);
+
+			if (testval2 != testval3) {
+				kprintf("Thread %lu: reader saw torn data\n",
+					num);
+				rwfailed = 1;
+			}
+			rwspin();
+
+			spinlock_acquire(&rwstatlock);
+			rwreaders--;
+			spinlock_release(&rwstatlock);
+			rwlock_release_read(testrw);
+		}
+	}
+	V(donesem);
+#ifdef UW
+  thread_exit();
+#endif
+}
+
+static
+void
+rwreadthread(void *junk, unsigned long num)
+{
+	int i;
+
+	(void)junk;
+	(void)num;
+
+	for (i=0; i<NRWLOOPS; i++) {
+		if (rwuselock) {
+			lock_acquire(testlock);
+			rwspin();
+			lock_release(testlock);
+		}
+		else {
+			rwlock_acquire_read(testrw);
+			rwspin();
+			rwlock_release_read(testrw);
+		}
+	}
+	V(donesem);
+#ifdef UW
+  thread_exit();
+#endif
+}
+
+/*
+ * Run nthreads readers through the read-only workload and return the
+ * elapsed time in microseconds.
+ */
+static
+uint32_t
+rwreadrun(unsigned nthreads, bool uselock)
+{
+	unsigned i;
+	int result;
+	time_t secs1, secs2;
+	uint32_t nsecs1, nsecs2;
+
+	rwuselock = uselock;
+	gettime(&secs1, &nsecs1);
+	for (i=0; i<nthreads; i++) {
+		result = thread_fork("rwreadtest", NULL, rwreadthread,
+				     NULL, i);
+		if (result) {
+			panic("rwlocktest: thread_fork failed: %s\n",
+			      strerror(result));
+		}
+	}
+	for (i=0; i<nthreads; i++) {
+		P(donesem);
+	}
+	gettime(&secs2, &nsecs2);
+
+	if (nsecs2 < nsecs1) {
+		secs2--;
+		nsecs2 += 1000000000;
+	}
+	return (secs2 - secs1) * 1000000 + (nsecs2 - nsecs1) / 1000;
+}
+
+int
+rwlocktest(int nargs, char **args)
+{
+	int i, result;
+	unsigned n;
+	uint32_t rwtime, locktime;
+
+	(void)nargs;
+	(void)args;
+
+	inititems();
+	testrw = rwlock_create("testrw");
+	if (testrw == NULL) {
+		panic("rwlocktest: rwlock_create failed\n");
+	}
+	kprintf("Starting rwlock test...\n");
+
+	rwreaders = 0;
+	rwmaxreaders = 0;
+	rwfailed = 0;
+	testval2 = testval3 = 0;
+
+	for (i=0; i<NTHREADS; i++) {
+		result = thread_fork("rwlocktest", NULL, rwtestthread,
+				     NULL, i);
+		if (result) {
+			panic("rwlocktest: thread_fork failed: %s\n",
+			      strerror(result));
+		}
+	}
+	for (i=0; i<NTHREADS; i++) {
+		P(donesem);
+	}
+	kprintf("Most readers inside at once: %u\n", rwmaxreaders);
+	if (rwfailed) {
+		kprintf("rwlock test FAILED\n");
+	}
+
+	kprintf("Read scalability (%d reads per thread):\n", NRWLOOPS);
+	kprintf("threads   rwlock usec   lock usec\n");
+	for (n=1; n<=NTHREADS; n*=2) {
+		rwtime = rwreadrun(n, false);
+		locktime = rwreadrun(n, true);
+		kprintf("%7u   %11u   %9u\n", n, rwtime, locktime);
+	}
+
+	rwlock_destroy(testrw);
+	testrw = NULL;
+#ifdef UW
+  cleanitems();
+#endif
+	kprintf("Rwlock test done.\n");
+
+	return 0;
+}
+
+/*
+ * Spinlock benchmark.
+ *
+ * 2, 4, 8 and 16 threads take turns on one spinlock for a second
+ * each, with a little work inside and outside the critical section.
+ * Reports total acquisitions and the fewest and most any one thread
+ * got; with a fair lock the two should be close. Boot with at least
+ * as many cpus as threads (the cpus line in sys161.conf) or the
+ * numbers mostly measure the scheduler.
+ */
+
+static struct spinlock benchlock = SPINLOCK_NAMED_INITIALIZER("spinbench");
+static volatile bool benchstop;
+static volatile unsigned long benchcount;
+static volatile unsigned long benchper[NSPINTHREADS];
+
+static
+void
+spinbenchthread(void *junk, unsigned long num)
+{
+	volatile int j;
+	unsigned long mine = 0;
+
+	(void)junk;
+
+	while (!benchstop) {
+		spinlock_acquire(&benchlock);
+		benchcount++;
+		for (j=0; j<20; j++);
+		spinlock_release(&benchlock);
+		mine++;
+		for (j=0; j<20; j++);
+	}
+	benchper[num] = mine;
+	V(donesem);
+#ifdef UW
+  thread_exit();
+#endif
+}
+
+int
+spinlockbench(int nargs, char **args)
+{
+	unsigned i, n;
+	int result;
+	unsigned long lo, hi;
+
+	(void)nargs;
+	(void)args;
+
+	inititems();
+	kprintf("Starting spinlock benchmark on %u cpus...\n",
+		cpu_numcpus());
+	kprintf("threads   acquires/sec   min/thread   max/thread\n");
+
+	for (n=2; n<=NSPINTHREADS; n*=2) {
+		benchstop = false;
+		benchcount = 0;
+#if OPT_LOCKSTAT
+		lockstat_reset();
+#endif
+		for (i=0; i<n; i++) {
+			result = thread_fork("spinbench", NULL,
+					     spinbenchthread, NULL, i);
+			if (result) {
+				panic("spinlockbench: thread_fork failed: "
+				      "%s\n", strerror(result));
+			}
+		}
+		clock_sleepticks(CALLOUT_HZ);
+		benchstop = true;
+		for (i=0; i<n; i++) {
+			P(donesem);
+		}
+
+		lo = hi = benchper[0];
+		for (i=1; i<n; i++) {
+			if (benchper[i] < lo) {
+				lo = benchper[i];
+			}
+			if (benchper[i] > hi) {
+				hi = benchper[i];
+			}
+		}
+		kprintf("%7u   %12lu   %10lu   %10lu\n", n, benchcount,
+			lo, hi);
+#if OPT_LOCKSTAT
+		lockstat_print(1);
+#endif
+	}
+
+#ifdef UW
+  cleanitems();
+#endif
+	kprintf("Spinlock benchmark done.\n");
+
+	return 0;
+}
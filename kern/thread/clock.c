@@ -28,20 +28,25 @@
  */
 
 #include <types.h>
+#include <kern/time.h>
 #include <lib.h>
 #include <cpu.h>
+#include <spinlock.h>
 #include <wchan.h>
 #include <clock.h>
 #include <thread.h>
+#include <mainbus.h>
 #include <lamebus/ltimer.h>
 #include <current.h>
 
 /*
  * Time handling.
  *
- * This is pretty primitive. A real kernel will typically have some
- * kind of support for scheduling callbacks to happen at specific
- * points in the future, usually with more resolution that one second.
+ * This is still fairly primitive, but there is now a callout
+ * mechanism: timerclock() advances a hierarchical timing wheel once
+ * per timer tick and calls whatever functions have come due. Sleeping
+ * for a period of time is done by scheduling a callout that wakes
+ * just the sleeping thread.
  *
  * A real kernel also has to maintain the time of day; in OS/161 we
  * skimp on that because we have a known-good hardware clock.
@@ -55,57 +60,362 @@
 #define MIGRATE_HARDCLOCKS	16	/* Migrate every 16 hardclocks. */
 
 /*
- * Once a second, everything waiting on lbolt is awakened by CPU 0.
+ * Longest an idle cpu goes without a clock interrupt, in timer ticks.
+ * This is only a backstop; idle cpus are normally woken by IPI.
+ * Pending callouts don't shorten it: they are run by timerclock from
+ * the interval timer, not by the idle cpu, and anything they make
+ * runnable on an idle cpu sends it IPI_UNIDLE.
  */
-static struct wchan *lbolt;
+#define IDLE_MAXTICKS		CALLOUT_HZ
+
+#if CALLOUT_HZ * LT_GRANULARITY != 1000000
+#error "CALLOUT_HZ does not match LT_GRANULARITY"
+#endif
+
+/* nanoseconds per timer tick */
+#define NSEC_PER_TICK (LT_GRANULARITY * 1000)
+
 /*
- * Once every LT_GRANULARITY usec, everything on minibolt is awakenened by CPU 0
+ * The timing wheel.
+ *
+ * Level 0 has one bucket per tick for the next 256 ticks. Each level
+ * above it has 64 buckets, each covering a whole revolution of the
+ * level below. When level 0 wraps around, the next bucket of level 1
+ * is emptied and its callouts are refiled one level down, and so on
+ * up the hierarchy (the "cascade"). Callouts too far in the future
+ * to fit are parked in the top level and refiled as they come closer.
+ *
+ * cw_ticks is the next tick to be processed; it runs one ahead of
+ * the tick currently being processed.
+ *
+ * Everything is protected by callout_lock. Callout functions are
+ * called with the lock released; callout_running records which
+ * callout is being run so callout_cancel can wait for it.
  */
-static struct wchan *minibolt;
+#define CW_L0_BITS	8
+#define CW_LN_BITS	6
+#define CW_L0_SIZE	(1U << CW_L0_BITS)
+#define CW_LN_SIZE	(1U << CW_LN_BITS)
+#define CW_L0_MASK	(CW_L0_SIZE - 1)
+#define CW_LN_MASK	(CW_LN_SIZE - 1)
+#define CW_UPPER	3	/* number of levels above level 0 */
+#define CW_MAXDELTA	((1U << (CW_L0_BITS + CW_UPPER*CW_LN_BITS)) - 1)
+
+static struct callout *cw_level0[CW_L0_SIZE];
+static struct callout *cw_upper[CW_UPPER][CW_LN_SIZE];
+static uint32_t cw_ticks;
+static unsigned cw_due;			/* ticks not yet processed */
+static bool cw_busy;			/* some cpu is processing ticks */
+static struct callout *callout_running;
+static struct cpu *callout_running_cpu;
+static struct spinlock callout_lock = SPINLOCK_NAMED_INITIALIZER("callout");
 
-/* 
- * number of minibolts per second
+/*
+ * Setup.
  */
-#define MINI_PER_SECOND (1000000/LT_GRANULARITY);
+void
+hardclock_bootstrap(void)
+{
+	unsigned i, j;
+
+	for (i=0; i<CW_L0_SIZE; i++) {
+		cw_level0[i] = NULL;
+	}
+	for (i=0; i<CW_UPPER; i++) {
+		for (j=0; j<CW_LN_SIZE; j++) {
+			cw_upper[i][j] = NULL;
+		}
+	}
+	cw_ticks = 0;
+	cw_due = 0;
+	cw_busy = false;
+}
+
+////////////////////////////////////////////////////////////
+//
+// Callout wheel internals. All of these require callout_lock.
+
+static
+void
+callout_link(struct callout **bucket, struct callout *c)
+{
+	c->c_next = *bucket;
+	if (c->c_next != NULL) {
+		c->c_next->c_prevp = &c->c_next;
+	}
+	c->c_prevp = bucket;
+	*bucket = c;
+	c->c_pending = true;
+}
+
+static
+void
+callout_unlink(struct callout *c)
+{
+	KASSERT(c->c_pending);
+	*c->c_prevp = c->c_next;
+	if (c->c_next != NULL) {
+		c->c_next->c_prevp = c->c_prevp;
+	}
+	c->c_next = NULL;
+	c->c_prevp = NULL;
+	c->c_pending = false;
+}
 
 /*
- * minibolt countdown
+ * Choose the bucket for a callout expiring at tick EXPIRE.
  */
-static int minicount;
+static
+struct callout **
+callout_bucket(uint32_t expire)
+{
+	uint32_t delta;
+	unsigned level, shift;
+
+	delta = expire - cw_ticks;
+	if ((int32_t)delta < 0) {
+		/* Overdue; run it on the next tick. */
+		return &cw_level0[cw_ticks & CW_L0_MASK];
+	}
+	if (delta < CW_L0_SIZE) {
+		return &cw_level0[expire & CW_L0_MASK];
+	}
+	if (delta > CW_MAXDELTA) {
+		/* Too far out; it gets refiled on the way down. */
+		expire = cw_ticks + CW_MAXDELTA;
+		delta = CW_MAXDELTA;
+	}
+	for (level=0; level<CW_UPPER; level++) {
+		shift = CW_L0_BITS + level*CW_LN_BITS;
+		if (delta < (1U << (shift + CW_LN_BITS))) {
+			break;
+		}
+	}
+	KASSERT(level < CW_UPPER);
+	return &cw_upper[level][(expire >> shift) & CW_LN_MASK];
+}
 
 /*
- * Setup.
+ * Move everything in one upper-level bucket down the hierarchy.
  */
+static
 void
-hardclock_bootstrap(void)
+callout_cascade(struct callout **bucket)
 {
-	lbolt = wchan_create("lbolt");
-	if (lbolt == NULL) {
-		panic("Couldn't create lbolt\n");
+	struct callout *c;
+
+	while ((c = *bucket) != NULL) {
+		callout_unlink(c);
+		callout_link(callout_bucket(c->c_expire), c);
+	}
+}
+
+/*
+ * Process one tick: cascade if level 0 wrapped, then run everything
+ * in the current level 0 bucket.
+ */
+static
+void
+callout_tick(void)
+{
+	struct callout *list, *c;
+	void (*func)(void *);
+	void *arg;
+	uint32_t now;
+	unsigned level, index;
+
+	KASSERT(spinlock_do_i_hold(&callout_lock));
+
+	now = cw_ticks;
+	if ((now & CW_L0_MASK) == 0) {
+		for (level=0; level<CW_UPPER; level++) {
+			index = (now >> (CW_L0_BITS + level*CW_LN_BITS))
+				& CW_LN_MASK;
+			callout_cascade(&cw_upper[level][index]);
+			if (index != 0) {
+				break;
+			}
+		}
+	}
+	cw_ticks++;
+
+	/*
+	 * Move the due callouts to a private list. They stay pending
+	 * while there, so callout_cancel (called by one of the
+	 * functions we run, say) can still unlink them.
+	 */
+	list = NULL;
+	while ((c = cw_level0[now & CW_L0_MASK]) != NULL) {
+		callout_unlink(c);
+		callout_link(&list, c);
 	}
-	minibolt = wchan_create("minibolt");
-	if (minibolt == NULL) {
-		panic("Couldn't create minibolt\n");
+
+	while ((c = list) != NULL) {
+		callout_unlink(c);
+		if ((int32_t)(c->c_expire - now) > 0) {
+			/* Was parked because it was too far out. */
+			callout_link(callout_bucket(c->c_expire), c);
+			continue;
+		}
+		if (c->c_period > 0) {
+			c->c_expire = now + c->c_period;
+			callout_link(callout_bucket(c->c_expire), c);
+		}
+
+		/* Don't touch C after the function is called. */
+		func = c->c_func;
+		arg = c->c_arg;
+		callout_running = c;
+		callout_running_cpu = curcpu->c_self;
+		spinlock_release(&callout_lock);
+
+		func(arg);
+
+		spinlock_acquire(&callout_lock);
+		callout_running = NULL;
+		callout_running_cpu = NULL;
 	}
-	minicount = MINI_PER_SECOND;
-	/* we assume MINI_PER_SECOND > 0 */
-	KASSERT(minicount > 0);
+}
+
+////////////////////////////////////////////////////////////
+//
+// Callout interface.
+
+void
+callout_init(struct callout *c, void (*func)(void *), void *arg)
+{
+	KASSERT(func != NULL);
+
+	c->c_next = NULL;
+	c->c_prevp = NULL;
+	c->c_expire = 0;
+	c->c_period = 0;
+	c->c_func = func;
+	c->c_arg = arg;
+	c->c_pending = false;
 }
 
+/*
+ * Common code for callout_schedule and callout_periodic. A callout
+ * asked to fire TICKS ticks from now is filed at the TICKS'th tick
+ * that timerclock will process; the current tick is already partly
+ * over, so the real delay is between TICKS-1 and TICKS tick periods.
+ */
+static
+void
+callout_start(struct callout *c, unsigned ticks, unsigned period)
+{
+	spinlock_acquire(&callout_lock);
+	if (c->c_pending) {
+		callout_unlink(c);
+	}
+	c->c_expire = cw_ticks + (ticks > 0 ? ticks - 1 : 0);
+	c->c_period = period;
+	callout_link(callout_bucket(c->c_expire), c);
+	spinlock_release(&callout_lock);
+}
+
+void
+callout_schedule(struct callout *c, unsigned ticks)
+{
+	callout_start(c, ticks, 0);
+}
+
+void
+callout_periodic(struct callout *c, unsigned ticks)
+{
+	KASSERT(ticks > 0);
+	callout_start(c, ticks, ticks);
+}
+
+bool
+callout_cancel(struct callout *c)
+{
+	bool wasPending;
+
+	spinlock_acquire(&callout_lock);
+	wasPending = c->c_pending;
+	if (wasPending) {
+		callout_unlink(c);
+	}
+	c->c_period = 0;
+
+	/*
+	 * If the function is running on another cpu, wait for it.
+	 * (If it's running on this cpu, we're being called from it.)
+	 */
+	while (callout_running == c &&
+	       callout_running_cpu != curcpu->c_self) {
+		spinlock_release(&callout_lock);
+		spinlock_acquire(&callout_lock);
+	}
+	spinlock_release(&callout_lock);
+
+	return wasPending;
+}
+
+bool
+callout_pending(struct callout *c)
+{
+	bool ret;
+
+	spinlock_acquire(&callout_lock);
+	ret = c->c_pending;
+	spinlock_release(&callout_lock);
+	return ret;
+}
+
+uint32_t
+clock_ticks(void)
+{
+	return cw_ticks;
+}
+
+unsigned
+timespec_to_ticks(const struct timespec *ts)
+{
+	unsigned ticks;
+
+	if (ts->tv_sec < 0) {
+		return 0;
+	}
+	if (ts->tv_sec >= (time_t)(CW_MAXDELTA / CALLOUT_HZ)) {
+		/* Far enough out that it doesn't matter exactly. */
+		return CW_MAXDELTA;
+	}
+	ticks = ts->tv_sec * CALLOUT_HZ;
+	ticks += DIVROUNDUP((uint32_t)ts->tv_nsec, NSEC_PER_TICK);
+	return ticks;
+}
+
+////////////////////////////////////////////////////////////
+//
+// Clock interrupts.
+
 /*
  * This is called once every every LT_GRANULARITY usec, on one processor,
  * by the timer code.
+ *
+ * If another cpu is still busy running callouts from an earlier tick,
+ * leave this tick for it to pick up, so ticks are processed in order
+ * and only one cpu runs callout functions at a time.
  */
 void
 timerclock(void)
 {
-	/* Broadcast on minibolt */
-	wchan_wakeall(minibolt);
-	/* Broadcast on lbolt if a second has elapsed */
-	if (--minicount <= 0) {
-	  minicount = MINI_PER_SECOND;
-	  wchan_wakeall(lbolt);
+	spinlock_acquire(&callout_lock);
+	cw_due++;
+	if (cw_busy) {
+		spinlock_release(&callout_lock);
+		return;
 	}
+	cw_busy = true;
+	while (cw_due > 0) {
+		cw_due--;
+		callout_tick();
+	}
+	cw_busy = false;
+	spinlock_release(&callout_lock);
 }
 
 /*
@@ -129,17 +439,115 @@ hardclock(void)
 	thread_yield();
 }
 
+/*
+ * Stop the periodic hardclock on an idle cpu.
+ *
+ * Leave the clock alone until the cpu has taken at least one
+ * hardclock; before that it may not have been set up yet.
+ */
+void
+clock_idle(void)
+{
+	if (curcpu->c_hardclocks == 0) {
+		return;
+	}
+
+	curcpu->c_tickless = true;
+	curcpu->c_idlestops++;
+	mainbus_timer_idle(IDLE_MAXTICKS * LT_GRANULARITY);
+}
+
+/*
+ * Restart the periodic hardclock when an idle cpu gets work.
+ */
+void
+clock_unidle(void)
+{
+	if (curcpu->c_tickless) {
+		curcpu->c_tickless = false;
+		mainbus_timer_resume();
+	}
+}
+
+////////////////////////////////////////////////////////////
+//
+// Sleeping.
+
+/*
+ * State shared between a sleeping thread and its wakeup callout.
+ */
+struct clocksleeper {
+	struct spinlock cs_lock;
+	struct wchan *cs_wchan;
+	volatile bool cs_done;
+};
+
+/*
+ * Callout function: wake the sleeper. cs_lock is released last, and
+ * the sleeper doesn't return until it has acquired cs_lock after
+ * seeing cs_done, so the sleeper's stack stays valid until we're
+ * finished with it.
+ */
+static
+void
+clock_wakeup(void *data)
+{
+	struct clocksleeper *cs = data;
+
+	spinlock_acquire(&cs->cs_lock);
+	cs->cs_done = true;
+	wchan_wakeone(cs->cs_wchan);
+	spinlock_release(&cs->cs_lock);
+}
+
+void
+clock_sleepticks(unsigned ticks)
+{
+	struct clocksleeper cs;
+	struct callout c;
+	uint32_t deadline;
+
+	if (ticks == 0) {
+		return;
+	}
+
+	cs.cs_wchan = wchan_create("clocksleep");
+	if (cs.cs_wchan == NULL) {
+		/* Out of memory; fall back to polling. */
+		deadline = cw_ticks + ticks;
+		while ((int32_t)(deadline - cw_ticks) > 0) {
+			thread_yield();
+		}
+		return;
+	}
+	spinlock_init(&cs.cs_lock);
+	cs.cs_done = false;
+	callout_init(&c, clock_wakeup, &cs);
+
+	spinlock_acquire(&cs.cs_lock);
+	callout_schedule(&c, ticks);
+	while (!cs.cs_done) {
+		wchan_lock(cs.cs_wchan);
+		spinlock_release(&cs.cs_lock);
+		wchan_sleep(cs.cs_wchan);
+		spinlock_acquire(&cs.cs_lock);
+	}
+	spinlock_release(&cs.cs_lock);
+
+	KASSERT(!callout_pending(&c));
+	spinlock_cleanup(&cs.cs_lock);
+	wchan_destroy(cs.cs_wchan);
+}
+
 /*
  * Suspend execution for n seconds.
  */
 void
 clocksleep(int num_secs)
 {
-  while (num_secs > 0) {
-    wchan_lock(lbolt);
-    wchan_sleep(lbolt);
-    num_secs--;
-  }
+	if (num_secs > 0) {
+		clock_sleepticks(num_secs * CALLOUT_HZ);
+	}
 }
 
 /*
@@ -149,9 +557,7 @@ clocksleep(int num_secs)
 void
 clocknap(int num_ticks)
 {
-  while (num_ticks > 0) {
-    wchan_lock(minibolt);
-    wchan_sleep(minibolt);
-    num_ticks--;
-  }
+	if (num_ticks > 0) {
+		clock_sleepticks(num_ticks);
+	}
 }
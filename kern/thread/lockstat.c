@@ -0,0 +1,265 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Lock contention statistics. See lockstat.h.
+ *
+ * Entries live in a fixed table so that looking one up never calls
+ * kmalloc (which takes a spinlock we may be measuring). Each entry has
+ * its own bare test-and-set lock word rather than a struct spinlock,
+ * for the same reason.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <spl.h>
+#include <clock.h>
+#include <lockstat.h>
+
+static struct lockstat lockstat_table[LOCKSTAT_MAX];
+static unsigned lockstat_count;
+static volatile spinlock_data_t lockstat_tablelock;
+static volatile bool lockstat_timing;
+
+static const char *const lockstat_kinds[] = {
+	"spin",
+	"lock",
+	"wchan",
+};
+
+static
+int
+lockstat_lock(volatile spinlock_data_t *sd)
+{
+	int spl;
+
+	spl = splhigh();
+	while (spinlock_data_get(sd) != 0 ||
+	       spinlock_data_testandset(sd) != 0) {
+		/* spin */
+	}
+	return spl;
+}
+
+static
+void
+lockstat_unlock(volatile spinlock_data_t *sd, int spl)
+{
+	spinlock_data_set(sd, 0);
+	splx(spl);
+}
+
+/*
+ * Compare a table name with a full name, allowing for the table name
+ * having been truncated.
+ */
+static
+bool
+lockstat_namematch(const char *tabname, const char *name)
+{
+	unsigned i;
+
+	for (i=0; i<LOCKSTAT_NAMELEN - 1; i++) {
+		if (tabname[i] != name[i]) {
+			return false;
+		}
+		if (tabname[i] == '\0') {
+			return true;
+		}
+	}
+	return true;
+}
+
+void
+lockstat_bootstrap(void)
+{
+	lockstat_timing = true;
+}
+
+struct lockstat *
+lockstat_get(unsigned kind, const char *name)
+{
+	struct lockstat *ls;
+	unsigned i;
+	int spl;
+
+	KASSERT(name != NULL);
+
+	spl = lockstat_lock(&lockstat_tablelock);
+	for (i=0; i<lockstat_count; i++) {
+		ls = &lockstat_table[i];
+		if (ls->ls_kind == kind &&
+		    lockstat_namematch(ls->ls_name, name)) {
+			lockstat_unlock(&lockstat_tablelock, spl);
+			return ls;
+		}
+	}
+
+	/* The last slot is the overflow entry. */
+	if (lockstat_count == LOCKSTAT_MAX - 1) {
+		ls = &lockstat_table[LOCKSTAT_MAX - 1];
+		if (ls->ls_name[0] == '\0') {
+			snprintf(ls->ls_name, LOCKSTAT_NAMELEN, "(other)");
+		}
+	}
+	else {
+		ls = &lockstat_table[lockstat_count++];
+		snprintf(ls->ls_name, LOCKSTAT_NAMELEN, "%s", name);
+		ls->ls_kind = kind;
+	}
+	lockstat_unlock(&lockstat_tablelock, spl);
+	return ls;
+}
+
+uint64_t
+lockstat_now(void)
+{
+	time_t secs;
+	uint32_t nsecs;
+
+	if (!lockstat_timing) {
+		return 0;
+	}
+	gettime(&secs, &nsecs);
+	return (uint64_t)secs * 1000000000 + nsecs;
+}
+
+uint64_t
+lockstat_acquired(struct lockstat *ls, bool contended, uint64_t start)
+{
+	uint64_t now, wait;
+	int spl;
+
+	now = lockstat_now();
+
+	spl = lockstat_lock(&ls->ls_lock);
+	ls->ls_acquires++;
+	if (contended) {
+		ls->ls_contended++;
+		if (start != 0) {
+			wait = now - start;
+			ls->ls_waittime += wait;
+			if (wait > ls->ls_waitmax) {
+				ls->ls_waitmax = wait;
+			}
+		}
+	}
+	lockstat_unlock(&ls->ls_lock, spl);
+
+	return now;
+}
+
+void
+lockstat_released(struct lockstat *ls, uint64_t acquired)
+{
+	uint64_t hold;
+	int spl;
+
+	if (acquired == 0) {
+		/* taken before timing started */
+		return;
+	}
+	hold = lockstat_now() - acquired;
+
+	spl = lockstat_lock(&ls->ls_lock);
+	ls->ls_holdtime += hold;
+	if (hold > ls->ls_holdmax) {
+		ls->ls_holdmax = hold;
+	}
+	lockstat_unlock(&ls->ls_lock, spl);
+}
+
+/*
+ * Print the N entries with the most contended acquisitions, ties
+ * broken by total wait time. The table is small, so just pick the
+ * next biggest N times. The counters are read without locking;
+ * they're only statistics.
+ */
+void
+lockstat_print(unsigned n)
+{
+	bool shown[LOCKSTAT_MAX];
+	struct lockstat *ls, *best;
+	unsigned i, j, best_i;
+
+	for (i=0; i<LOCKSTAT_MAX; i++) {
+		shown[i] = false;
+	}
+
+	kprintf("%-5s %-23s %9s %9s %11s %9s %11s %9s\n",
+		"kind", "name", "acquires", "contended", "wait usec",
+		"max wait", "hold usec", "max hold");
+	for (j=0; j<n; j++) {
+		best = NULL;
+		best_i = 0;
+		for (i=0; i<LOCKSTAT_MAX; i++) {
+			ls = &lockstat_table[i];
+			if (shown[i] || ls->ls_acquires == 0) {
+				continue;
+			}
+			if (best == NULL ||
+			    ls->ls_contended > best->ls_contended ||
+			    (ls->ls_contended == best->ls_contended &&
+			     ls->ls_waittime > best->ls_waittime)) {
+				best = ls;
+				best_i = i;
+			}
+		}
+		if (best == NULL) {
+			break;
+		}
+		shown[best_i] = true;
+		kprintf("%-5s %-23s %9u %9u %11llu %9llu %11llu %9llu\n",
+			best_i == LOCKSTAT_MAX - 1 ? "-" :
+			lockstat_kinds[best->ls_kind],
+			best->ls_name, best->ls_acquires, best->ls_contended,
+			best->ls_waittime / 1000, best->ls_waitmax / 1000,
+			best->ls_holdtime / 1000, best->ls_holdmax / 1000);
+	}
+}
+
+void
+lockstat_reset(void)
+{
+	struct lockstat *ls;
+	unsigned i;
+	int spl;
+
+	for (i=0; i<LOCKSTAT_MAX; i++) {
+		ls = &lockstat_table[i];
+		spl = lockstat_lock(&ls->ls_lock);
+		ls->ls_acquires = 0;
+		ls->ls_contended = 0;
+		ls->ls_waittime = 0;
+		ls->ls_waitmax = 0;
+		ls->ls_holdtime = 0;
+		ls->ls_holdmax = 0;
+		lockstat_unlock(&ls->ls_lock, spl);
+	}
+}
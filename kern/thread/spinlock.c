@@ -35,6 +35,7 @@
 #include <cpu.h>
 #include <spl.h>
 #include <spinlock.h>
+#include <lockstat.h>
 #include <current.h>	/* for curcpu */
 
 /*
@@ -48,8 +49,14 @@
 void
 spinlock_init(struct spinlock *lk)
 {
-	spinlock_data_set(&lk->lk_lock, 0);
+	spinlock_data_set(&lk->lk_next, 0);
+	spinlock_data_set(&lk->lk_serving, 0);
 	lk->lk_holder = NULL;
+#if OPT_LOCKSTAT
+	lk->lk_name = NULL;
+	lk->lk_stat = NULL;
+	lk->lk_acqtime = 0;
+#endif
 }
 
 /*
@@ -59,20 +66,26 @@ void
 spinlock_cleanup(struct spinlock *lk)
 {
 	KASSERT(lk->lk_holder == NULL);
-	KASSERT(spinlock_data_get(&lk->lk_lock) == 0);
+	KASSERT(spinlock_data_get(&lk->lk_next) ==
+		spinlock_data_get(&lk->lk_serving));
 }
 
 /*
  * Get the lock.
  *
  * First disable interrupts (otherwise, if we get a timer interrupt we
- * might come back to this lock and deadlock), then use a machine-level
- * atomic operation to wait for the lock to be free.
+ * might come back to this lock and deadlock), then take a ticket and
+ * wait for it to come up.
  */
 void
 spinlock_acquire(struct spinlock *lk)
 {
 	struct cpu *mycpu;
+	spinlock_data_t ticket;
+#if OPT_LOCKSTAT
+	bool contended;
+	uint64_t start;
+#endif
 
 	splraise(IPL_NONE, IPL_HIGH);
 
@@ -87,27 +100,33 @@ spinlock_acquire(struct spinlock *lk)
 		mycpu = NULL;
 	}
 
-	while (1) {
-		/*
-		 * Do test-test-and-set, that is, read first before
-		 * doing test-and-set, to reduce bus contention.
-		 *
-		 * Test-and-set is a machine-level atomic operation
-		 * that writes 1 into the lock word and returns the
-		 * previous value. If that value was 0, the lock was
-		 * previously unheld and we now own it. If it was 1,
-		 * we don't.
-		 */
-		if (spinlock_data_get(&lk->lk_lock) != 0) {
-			continue;
-		}
-		if (spinlock_data_testandset(&lk->lk_lock) != 0) {
-			continue;
-		}
-		break;
+	/*
+	 * Fetch-and-increment is a machine-level atomic operation
+	 * that hands each caller a distinct ticket. The holder bumps
+	 * lk_serving on release, so the lock passes to the waiters
+	 * in the order they arrived. Spinning is read-only.
+	 */
+#if OPT_LOCKSTAT
+	start = lk->lk_stat != NULL ? lockstat_now() : 0;
+#endif
+	ticket = spinlock_data_fetchinc(&lk->lk_next);
+#if OPT_LOCKSTAT
+	contended = spinlock_data_get(&lk->lk_serving) != ticket;
+#endif
+	while (spinlock_data_get(&lk->lk_serving) != ticket) {
+		/* spin */
 	}
 
 	lk->lk_holder = mycpu;
+#if OPT_LOCKSTAT
+	if (lk->lk_stat == NULL && lk->lk_name != NULL) {
+		lk->lk_stat = lockstat_get(LOCKSTAT_SPINLOCK, lk->lk_name);
+	}
+	if (lk->lk_stat != NULL) {
+		lk->lk_acqtime = lockstat_acquired(lk->lk_stat, contended,
+						   start);
+	}
+#endif
 }
 
 /*
@@ -121,8 +140,15 @@ spinlock_release(struct spinlock *lk)
 		KASSERT(lk->lk_holder == curcpu->c_self);
 	}
 
+#if OPT_LOCKSTAT
+	if (lk->lk_stat != NULL) {
+		lockstat_released(lk->lk_stat, lk->lk_acqtime);
+	}
+#endif
 	lk->lk_holder = NULL;
-	spinlock_data_set(&lk->lk_lock, 0);
+	/* Only the holder writes lk_serving, so a plain store will do. */
+	spinlock_data_set(&lk->lk_serving,
+			  spinlock_data_get(&lk->lk_serving) + 1);
 	spllower(IPL_HIGH, IPL_NONE);
 }
 
@@ -139,3 +165,16 @@ spinlock_do_i_hold(struct spinlock *lk)
 	/* Assume we can read lk_holder atomically enough for this to work */
 	return (lk->lk_holder == curcpu->c_self);
 }
+
+#if OPT_LOCKSTAT
+/*
+ * Name the lock for lockstat. The stats entry is found on the next
+ * acquire.
+ */
+void
+spinlock_setname(struct spinlock *lk, const char *name)
+{
+	lk->lk_name = name;
+	lk->lk_stat = NULL;
+}
+#endif /* OPT_LOCKSTAT */
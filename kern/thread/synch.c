@@ -37,8 +37,10 @@
 #include <spinlock.h>
 #include <wchan.h>
 #include <thread.h>
+#include <cpu.h>
 #include <current.h>
 #include <synch.h>
+#include <lockstat.h>
 
 ////////////////////////////////////////////////////////////
 //
@@ -70,6 +72,7 @@ sem_create(const char *name, int initial_count)
 	}
 
 	spinlock_init(&sem->sem_lock);
+	spinlock_setname(&sem->sem_lock, sem->sem_name);
         sem->sem_count = initial_count;
 
         return sem;
@@ -164,8 +167,11 @@ lock_create(const char *name)
         }
 
         lock->owner = NULL;
+        lock->waiters = 0;
+        lock->woken = false;
 
         spinlock_init(&lock->spin);
+        spinlock_setname(&lock->spin, lock->lk_name);
 
         lock->wc = wchan_create(lock->lk_name);
         if (lock->wc == NULL){
@@ -173,6 +179,11 @@ lock_create(const char *name)
                 kfree(lock);
                 return NULL;
         }
+
+#if OPT_LOCKSTAT
+        lock->stat = lockstat_get(LOCKSTAT_LOCK, lock->lk_name);
+        lock->acqtime = 0;
+#endif
         
         return lock;
 }
@@ -190,25 +201,98 @@ lock_destroy(struct lock *lock)
         kfree(lock);
 }
 
+/*
+ * How many times a waiter polls the lock while its holder is running
+ * before giving up and going to sleep.
+ */
+#define LOCK_SPIN_MAX 1000
+
+/*
+ * Spin while OWNER holds the lock and is running on another cpu, up to
+ * LOCK_SPIN_MAX polls, or until the lock changes hands.
+ *
+ * OWNER may exit and be freed while we look at it, but then it no
+ * longer holds the lock, which we check on every poll; a stale t_state
+ * can only make us stop spinning early.
+ */
+static
+void
+lock_spin(struct lock *lock, struct thread *owner)
+{
+        unsigned i;
+
+        for (i=0; i<LOCK_SPIN_MAX; i++) {
+                if (lock->owner != owner || owner->t_state != S_RUN) {
+                        return;
+                }
+        }
+}
+
 void
 lock_acquire(struct lock *lock)
 {
+        struct thread *owner;
+        bool spun = false;
+#if OPT_LOCKSTAT
+        bool contended = false;
+        uint64_t start;
+#endif
+
         KASSERT(lock != NULL);
         KASSERT(!lock_do_i_hold(lock));
-        
+
+#if OPT_LOCKSTAT
+        start = lockstat_now();
+#endif
         spinlock_acquire(&lock->spin);
 
         while (lock->owner != NULL) {
+                owner = lock->owner;
+#if OPT_LOCKSTAT
+                contended = true;
+#endif
+
+                /*
+                 * If the holder is running on another cpu, it'll
+                 * likely let go shortly; spin for it rather than
+                 * paying for two context switches. Only do this once
+                 * per sleep, so a lock with a long hold time doesn't
+                 * make its waiters burn cpu indefinitely.
+                 */
+                if (!spun && owner->t_state == S_RUN &&
+                    owner->t_cpu != curcpu->c_self) {
+                        spun = true;
+                        spinlock_release(&lock->spin);
+                        lock_spin(lock, owner);
+                        spinlock_acquire(&lock->spin);
+                        continue;
+                }
+
+                lock->waiters++;
                 wchan_lock(lock->wc);
                 spinlock_release(&lock->spin);
                 wchan_sleep(lock->wc);
 
                 spinlock_acquire(&lock->spin);
+                lock->waiters--;
+                lock->woken = false;
+                spun = false;
         }
         lock->owner = curthread;
+#if OPT_LOCKSTAT
+        lock->acqtime = lockstat_acquired(lock->stat, contended, start);
+#endif
         spinlock_release(&lock->spin);
 }
 
+/*
+ * Release the lock.
+ *
+ * Only wake a waiter if nobody already woken is still on the way to
+ * take the lock; waking more would just have them all race for it
+ * and all but one go back to sleep. If there are no sleepers (the
+ * common case, or only spinning waiters) the wchan isn't touched.
+ */
 void
 lock_release(struct lock *lock)
 {
@@ -216,8 +300,14 @@ lock_release(struct lock *lock)
         KASSERT(lock_do_i_hold(lock));
 
         spinlock_acquire(&lock->spin);
+#if OPT_LOCKSTAT
+        lockstat_released(lock->stat, lock->acqtime);
+#endif
         lock->owner = NULL;
-        wchan_wakeone(lock->wc);
+        if (lock->waiters > 0 && !lock->woken) {
+                lock->woken = true;
+                wchan_wakeone(lock->wc);
+        }
         spinlock_release(&lock->spin);
 }
 
@@ -314,3 +404,155 @@ cv_broadcast(struct cv *cv, struct lock *lock)
         wchan_wakeall(cv->wc);
         lock_release(cv->lk);
 }
+
+////////////////////////////////////////////////////////////
+//
+// Reader-writer lock.
+
+struct rwlock *
+rwlock_create(const char *name)
+{
+        struct rwlock *rw;
+
+        rw = kmalloc(sizeof(struct rwlock));
+        if (rw == NULL) {
+                return NULL;
+        }
+
+        rw->rwlock_name = kstrdup(name);
+        if (rw->rwlock_name == NULL) {
+                kfree(rw);
+                return NULL;
+        }
+
+        rw->rw_readwc = wchan_create(rw->rwlock_name);
+        if (rw->rw_readwc == NULL) {
+                kfree(rw->rwlock_name);
+                kfree(rw);
+                return NULL;
+        }
+
+        rw->rw_writewc = wchan_create(rw->rwlock_name);
+        if (rw->rw_writewc == NULL) {
+                wchan_destroy(rw->rw_readwc);
+                kfree(rw->rwlock_name);
+                kfree(rw);
+                return NULL;
+        }
+
+        spinlock_init(&rw->rw_lock);
+        spinlock_setname(&rw->rw_lock, rw->rwlock_name);
+        rw->rw_readers = 0;
+        rw->rw_writewait = 0;
+        rw->rw_writer = NULL;
+
+        return rw;
+}
+
+void
+rwlock_destroy(struct rwlock *rw)
+{
+        KASSERT(rw != NULL);
+        KASSERT(rw->rw_readers == 0);
+        KASSERT(rw->rw_writer == NULL);
+
+        spinlock_cleanup(&rw->rw_lock);
+        wchan_destroy(rw->rw_readwc);
+        wchan_destroy(rw->rw_writewc);
+
+        kfree(rw->rwlock_name);
+        kfree(rw);
+}
+
+void
+rwlock_acquire_read(struct rwlock *rw)
+{
+        KASSERT(rw != NULL);
+        KASSERT(curthread->t_in_interrupt == false);
+        KASSERT(rw->rw_writer != curthread);
+
+        spinlock_acquire(&rw->rw_lock);
+        /* Stay out while a writer holds the lock or is waiting for it. */
+        while (rw->rw_writer != NULL || rw->rw_writewait > 0) {
+                wchan_lock(rw->rw_readwc);
+                spinlock_release(&rw->rw_lock);
+                wchan_sleep(rw->rw_readwc);
+
+                spinlock_acquire(&rw->rw_lock);
+        }
+        rw->rw_readers++;
+        spinlock_release(&rw->rw_lock);
+}
+
+void
+rwlock_release_read(struct rwlock *rw)
+{
+        KASSERT(rw != NULL);
+
+        spinlock_acquire(&rw->rw_lock);
+        KASSERT(rw->rw_readers > 0);
+        KASSERT(rw->rw_writer == NULL);
+        rw->rw_readers--;
+        if (rw->rw_readers == 0 && rw->rw_writewait > 0) {
+                wchan_wakeone(rw->rw_writewc);
+        }
+        spinlock_release(&rw->rw_lock);
+}
+
+void
+rwlock_acquire_write(struct rwlock *rw)
+{
+        KASSERT(rw != NULL);
+        KASSERT(curthread->t_in_interrupt == false);
+        KASSERT(rw->rw_writer != curthread);
+
+        spinlock_acquire(&rw->rw_lock);
+        rw->rw_writewait++;
+        while (rw->rw_writer != NULL || rw->rw_readers > 0) {
+                wchan_lock(rw->rw_writewc);
+                spinlock_release(&rw->rw_lock);
+                wchan_sleep(rw->rw_writewc);
+
+                spinlock_acquire(&rw->rw_lock);
+        }
+        rw->rw_writewait--;
+        rw->rw_writer = curthread;
+        spinlock_release(&rw->rw_lock);
+}
+
+/*
+ * Hand the lock to the next waiting writer if there is one; otherwise
+ * let in all the readers that queued up behind us.
+ */
+void
+rwlock_release_write(struct rwlock *rw)
+{
+        KASSERT(rw != NULL);
+        KASSERT(rwlock_do_i_hold_write(rw));
+
+        spinlock_acquire(&rw->rw_lock);
+        rw->rw_writer = NULL;
+        if (rw->rw_writewait > 0) {
+                wchan_wakeone(rw->rw_writewc);
+        }
+        else {
+                wchan_wakeall(rw->rw_readwc);
+        }
+        spinlock_release(&rw->rw_lock);
+}
+
+bool
+rwlock_do_i_hold_write(struct rwlock *rw)
+{
+        KASSERT(rw != NULL);
+
+        return (rw->rw_writer == curthread);
+}
+
+bool
+rwlock_is_held(struct rwlock *rw)
+{
+        KASSERT(rw != NULL);
+
+        return (rw->rw_writer != NULL || rw->rw_readers > 0);
+}
@@ -50,6 +50,8 @@
 #include <addrspace.h>
 #include <mainbus.h>
 #include <vnode.h>
+#include <clock.h>
+#include <lockstat.h>
 
 #include "opt-synchprobs.h"
 
@@ -62,8 +64,14 @@ struct wchan {
 	const char *wc_name;		/* name for this channel */
 	struct threadlist wc_threads;	/* list of waiting threads */
 	struct spinlock wc_lock;	/* lock for mutual exclusion */
+#if OPT_LOCKSTAT
+	struct lockstat *wc_stat;	/* sleep stats */
+#endif
 };
 
+/* How many dead threads each cpu's thread cache may hold. */
+static unsigned thread_cachedepth = THREAD_CACHE_DEPTH;
+
 /* Master array of CPUs. */
 DECLARRAY(cpu);
 DEFARRAY(cpu, /*no inline*/ );
@@ -111,6 +119,38 @@ thread_checkstack(struct thread *thread)
 	}
 }
 
+/*
+ * Set up the fields of a new (or recycled) thread other than its name.
+ */
+static
+void
+thread_initfields(struct thread *thread)
+{
+	thread->t_wchan_name = "NEW";
+	thread->t_state = S_READY;
+
+	/* Thread subsystem fields */
+	thread_machdep_init(&thread->t_machdep);
+	threadlistnode_init(&thread->t_listnode, thread);
+	thread->t_stack = NULL;
+	thread->t_context = NULL;
+	thread->t_cpu = NULL;
+	thread->t_proc = NULL;
+
+	/* Interrupt state fields */
+	thread->t_in_interrupt = false;
+	thread->t_curspl = IPL_HIGH;
+	thread->t_iplhigh_count = 1; /* corresponding to t_curspl */
+
+	/* Accounting fields */
+	thread->t_utime = 0;
+	thread->t_stime = 0;
+	thread->t_nvcsw = 0;
+	thread->t_nivcsw = 0;
+
+	/* If you add to struct thread, be sure to initialize here */
+}
+
 /*
  * Create a thread. This is used both to create a first thread
  * for each CPU and to create subsequent forked threads.
@@ -133,27 +173,137 @@ thread_create(const char *name)
 		kfree(thread);
 		return NULL;
 	}
-	thread->t_wchan_name = "NEW";
-	thread->t_state = S_READY;
+	thread_initfields(thread);
 
-	/* Thread subsystem fields */
-	thread_machdep_init(&thread->t_machdep);
-	threadlistnode_init(&thread->t_listnode, thread);
-	thread->t_stack = NULL;
-	thread->t_context = NULL;
-	thread->t_cpu = NULL;
-	thread->t_proc = NULL;
+	return thread;
+}
 
-	/* Interrupt state fields */
-	thread->t_in_interrupt = false;
-	thread->t_curspl = IPL_HIGH;
-	thread->t_iplhigh_count = 1; /* corresponding to t_curspl */
+/*
+ * Thread cache.
+ *
+ * Rather than freeing a dead thread and its stack, thread_destroy
+ * parks it on the current cpu's c_threadcache, and thread_fork takes
+ * it back from there, saving two kmallocs and two kfrees per thread.
+ * The cache is only touched by its own cpu with interrupts off, so it
+ * needs no lock. Cached threads keep their stack and nothing else.
+ */
 
-	/* If you add to struct thread, be sure to initialize here */
+/*
+ * Free a thread taken off a cache.
+ */
+static
+void
+thread_cache_free(struct thread *thread)
+{
+	threadlistnode_cleanup(&thread->t_listnode);
+	kfree(thread->t_stack);
+	kfree(thread);
+}
+
+/*
+ * Put a dead thread in the cache if there's room. Returns true if it
+ * was taken.
+ */
+static
+bool
+thread_cache_put(struct thread *thread)
+{
+	int spl;
+
+	KASSERT(thread->t_stack != NULL);
+
+	spl = splhigh();
+	if (curcpu->c_threadcache.tl_count >= thread_cachedepth) {
+		splx(spl);
+		return false;
+	}
+	thread_machdep_cleanup(&thread->t_machdep);
+	kfree(thread->t_name);
+	thread->t_name = NULL;
+	thread->t_wchan_name = "CACHED";
+	threadlist_addhead(&curcpu->c_threadcache, thread);
+	splx(spl);
+	return true;
+}
+
+/*
+ * Get a thread, with stack, from the cache and set it up as if new.
+ * Returns NULL if the cache is empty (or we're out of memory for the
+ * name).
+ */
+static
+struct thread *
+thread_cache_get(const char *name)
+{
+	struct thread *thread;
+	void *stack;
+	int spl;
+
+	spl = splhigh();
+	thread = threadlist_remhead(&curcpu->c_threadcache);
+	if (thread == NULL) {
+		curcpu->c_tcache_misses++;
+		splx(spl);
+		return NULL;
+	}
+	curcpu->c_tcache_hits++;
+	splx(spl);
+
+	stack = thread->t_stack;
+	thread_initfields(thread);
+	thread->t_stack = stack;
 
+	thread->t_name = kstrdup(name);
+	if (thread->t_name == NULL) {
+		thread_cache_free(thread);
+		return NULL;
+	}
 	return thread;
 }
 
+/*
+ * Free cached threads beyond the current depth. Called from exorcise,
+ * so the cache shrinks shortly after the depth is lowered.
+ */
+static
+void
+thread_cache_trim(void)
+{
+	struct thread *thread;
+
+	while (curcpu->c_threadcache.tl_count > thread_cachedepth) {
+		thread = threadlist_remtail(&curcpu->c_threadcache);
+		thread_cache_free(thread);
+	}
+}
+
+void
+thread_cache_setdepth(unsigned depth)
+{
+	thread_cachedepth = depth;
+}
+
+/*
+ * Print thread cache statistics. The counters are read without
+ * locking; they're only statistics.
+ */
+void
+thread_cache_print(void)
+{
+	unsigned i, numcpus;
+	struct cpu *c;
+
+	kprintf("Thread cache depth %u\n", thread_cachedepth);
+	kprintf("%4s %8s %10s %10s\n", "cpu", "cached", "hits", "misses");
+	numcpus = cpuarray_num(&allcpus);
+	for (i=0; i<numcpus; i++) {
+		c = cpuarray_get(&allcpus, i);
+		kprintf("%4u %8u %10u %10u\n", c->c_number,
+			c->c_threadcache.tl_count, c->c_tcache_hits,
+			c->c_tcache_misses);
+	}
+}
+
 /*
  * Create a CPU structure. This is used for the bootup CPU and
  * also for secondary CPUs.
@@ -179,11 +329,19 @@ cpu_create(unsigned hardware_number)
 
 	c->c_curthread = NULL;
 	threadlist_init(&c->c_zombies);
+	threadlist_init(&c->c_threadcache);
+	c->c_tcache_hits = 0;
+	c->c_tcache_misses = 0;
+	c->c_acctstamp = 0;
+	c->c_idletime = 0;
 	c->c_hardclocks = 0;
+	c->c_idlestops = 0;
+	c->c_tickless = false;
 
 	c->c_isidle = false;
 	threadlist_init(&c->c_runqueue);
 	spinlock_init(&c->c_runqueue_lock);
+	spinlock_setname(&c->c_runqueue_lock, "runqueue");
 
 	c->c_ipi_pending = 0;
 	c->c_numshootdown = 0;
@@ -249,6 +407,9 @@ thread_destroy(struct thread *thread)
 
 	/* Thread subsystem fields */
 	KASSERT(thread->t_proc == NULL);
+	if (thread->t_stack != NULL && thread_cache_put(thread)) {
+		return;
+	}
 	if (thread->t_stack != NULL) {
 		kfree(thread->t_stack);
 	}
@@ -279,6 +440,7 @@ exorcise(void)
 		KASSERT(z->t_state == S_ZOMBIE);
 		thread_destroy(z);
 	}
+	thread_cache_trim();
 }
 
 /*
@@ -406,6 +568,40 @@ cpu_hatch(unsigned software_number)
 	thread_exit();
 }
 
+/*
+ * Print clock interrupt counts for each cpu, along with how many
+ * hardclocks it would have taken had it never stopped its clock, and
+ * how long it has spent idle.
+ * The counters are read without locking; they're only statistics.
+ */
+void
+cpu_printclocks(void)
+{
+	unsigned i, numcpus;
+	unsigned expected;
+	struct cpu *c;
+
+	expected = (uint64_t)clock_ticks() * HZ / CALLOUT_HZ;
+	kprintf("%4s %12s %12s %12s %12s\n", "cpu", "hardclocks", "skipped",
+		"idle stops", "idle ms");
+	numcpus = cpuarray_num(&allcpus);
+	for (i=0; i<numcpus; i++) {
+		c = cpuarray_get(&allcpus, i);
+		kprintf("%4u %12u %12u %12u %12u\n", c->c_number,
+			c->c_hardclocks,
+			expected > c->c_hardclocks ?
+			expected - c->c_hardclocks : 0,
+			c->c_idlestops,
+			(unsigned)(c->c_idletime * 1000 / mainbus_cyclehz()));
+	}
+}
+
+unsigned
+cpu_numcpus(void)
+{
+	return cpuarray_num(&allcpus);
+}
+
 /*
  * Start up secondary cpus. Called from boot().
  */
@@ -487,16 +683,20 @@ thread_fork(const char *name,
 	DEBUG(DB_THREADS,"Forking thread: %s\n",name);
 #endif // UW
 
-	newthread = thread_create(name);
+	/* Reuse a dead thread and its stack if this cpu has one handy */
+	newthread = thread_cache_get(name);
 	if (newthread == NULL) {
-		return ENOMEM;
-	}
+		newthread = thread_create(name);
+		if (newthread == NULL) {
+			return ENOMEM;
+		}
 
-	/* Allocate a stack */
-	newthread->t_stack = kmalloc(STACK_SIZE);
-	if (newthread->t_stack == NULL) {
-		thread_destroy(newthread);
-		return ENOMEM;
+		/* Allocate a stack */
+		newthread->t_stack = kmalloc(STACK_SIZE);
+		if (newthread->t_stack == NULL) {
+			thread_destroy(newthread);
+			return ENOMEM;
+		}
 	}
 	thread_checkstack_init(newthread);
 
@@ -534,6 +734,45 @@ thread_fork(const char *name,
 	return 0;
 }
 
+/*
+ * CPU time accounting.
+ *
+ * Each cpu keeps the cycle count at its last accounting point. At the
+ * next one, the cycles since then are charged to whoever had the cpu:
+ * the current thread's user or system time, or the cpu's idle time.
+ * The accounting points are entry to and exit from the kernel (called
+ * from the trap code) and context switches. All of this runs with
+ * interrupts off on the cpu concerned, so it needs no locking.
+ */
+static
+uint64_t
+thread_acct_elapsed(void)
+{
+	uint64_t now, delta;
+
+	now = mainbus_cycles();
+	/*
+	 * The count can appear to step back a little if it wrapped
+	 * and the timer interrupt is still pending; don't charge
+	 * anybody for that.
+	 */
+	delta = now > curcpu->c_acctstamp ? now - curcpu->c_acctstamp : 0;
+	curcpu->c_acctstamp = now;
+	return delta;
+}
+
+void
+thread_acct_enterkernel(void)
+{
+	curthread->t_utime += thread_acct_elapsed();
+}
+
+void
+thread_acct_exitkernel(void)
+{
+	curthread->t_stime += thread_acct_elapsed();
+}
+
 /*
  * High level, machine-independent context switch code.
  *
@@ -612,6 +851,18 @@ thread_switch(threadstate_t newstate, struct wchan *wc)
 	}
 	cur->t_state = newstate;
 
+	/*
+	 * Charge the outgoing thread for its time. Being bumped by the
+	 * timer is an involuntary switch; anything else is voluntary.
+	 */
+	cur->t_stime += thread_acct_elapsed();
+	if (newstate == S_READY && cur->t_in_interrupt) {
+		cur->t_nivcsw++;
+	}
+	else {
+		cur->t_nvcsw++;
+	}
+
 	/*
 	 * Get the next thread. While there isn't one, call md_idle().
 	 * curcpu->c_isidle must be true when md_idle is
@@ -629,17 +880,26 @@ thread_switch(threadstate_t newstate, struct wchan *wc)
 	 * lock to look at it, this should not be visible or matter.
 	 */
 
+	/*
+	 * While idle, the cpu's periodic hardclock is switched off
+	 * (see clock_idle) so it isn't woken up HZ times a second for
+	 * nothing.
+	 */
+
 	/* The current cpu is now idle. */
 	curcpu->c_isidle = true;
 	do {
 		next = threadlist_remhead(&curcpu->c_runqueue);
 		if (next == NULL) {
 			spinlock_release(&curcpu->c_runqueue_lock);
+			clock_idle();
 			cpu_idle();
 			spinlock_acquire(&curcpu->c_runqueue_lock);
 		}
 	} while (next == NULL);
 	curcpu->c_isidle = false;
+	clock_unidle();
+	curcpu->c_idletime += thread_acct_elapsed();
 
 	/*
 	 * Note that curcpu->c_curthread may be the same variable as
@@ -983,6 +1243,9 @@ wchan_create(const char *name)
 	spinlock_init(&wc->wc_lock);
 	threadlist_init(&wc->wc_threads);
 	wc->wc_name = name;
+#if OPT_LOCKSTAT
+	wc->wc_stat = lockstat_get(LOCKSTAT_WCHAN, name);
+#endif
 	return wc;
 }
 
@@ -1022,10 +1285,21 @@ wchan_unlock(struct wchan *wc)
 void
 wchan_sleep(struct wchan *wc)
 {
+#if OPT_LOCKSTAT
+	uint64_t start;
+#endif
+
 	/* may not sleep in an interrupt handler */
 	KASSERT(!curthread->t_in_interrupt);
 
+#if OPT_LOCKSTAT
+	/* Count each sleep as a contended acquire of the channel. */
+	start = lockstat_now();
 	thread_switch(S_SLEEP, wc);
+	lockstat_acquired(wc->wc_stat, true, start);
+#else
+	thread_switch(S_SLEEP, wc);
+#endif
 }
 
 /*
@@ -0,0 +1,1179 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Block buffer cache. See <buf.h>.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <spinlock.h>
+#include <wchan.h>
+#include <thread.h>
+#include <clock.h>
+#include <uio.h>
+#include <vfs.h>
+#include <device.h>
+#include <buf.h>
+
+#define BUF_HASHSIZE	128	/* hash chains; a power of 2 */
+
+/*
+ * Write-back policy. Once a second the syncer writes out buffers that
+ * have been dirty for BUF_DIRTYAGE seconds or more. If more than
+ * BUF_DIRTYHIGH buffers are dirty it is woken at once, and writes
+ * buffers regardless of age until BUF_DIRTYLOW are left. Every
+ * BUF_UPDATEAGE seconds it also calls vfs_sync, so inodes and free
+ * maps held in filesystems' own structures get to disk too.
+ */
+#define BUF_DIRTYAGE	5
+#define BUF_UPDATEAGE	30
+#define BUF_DIRTYHIGH	(BUF_MAXBUFS / 2)
+#define BUF_DIRTYLOW	(BUF_MAXBUFS / 4)
+#define BUF_SYNCBATCH	32	/* buffers written per batch */
+
+#define BUF_RAQUEUE	64	/* readahead requests pending at once */
+
+struct buf {
+	struct device *b_dev;		/* device, or NULL if on freelist */
+	uint32_t b_block;		/* block number on b_dev */
+	void *b_data;			/* BUF_SIZE bytes */
+	unsigned b_refcount;		/* holder plus waiters */
+	bool b_busy;			/* somebody holds it */
+	bool b_valid;			/* b_data is the block's contents */
+	bool b_dirty;			/* b_data needs writing back */
+	uint32_t b_dirtytime;		/* clock_ticks when it got dirty */
+	bool b_readahead;		/* read ahead, not yet asked for */
+	struct wchan *b_wchan;		/* to wait for b_busy to clear */
+	struct buf *b_hashnext;		/* hash chain */
+	struct buf *b_lruprev;		/* LRU or free list, when */
+	struct buf *b_lrunext;		/*   b_refcount is 0 */
+};
+
+/*
+ * The hash table, the LRU and free lists, b_refcount and b_busy are
+ * protected by buf_lock. The rest of a buffer belongs to whoever has
+ * it busy, and is only looked at by others when nobody has it, except
+ * that b_dirty (and b_dirtytime) are only changed with buf_lock held
+ * so buf_ndirty stays right and the syncer can look for dirty buffers.
+ */
+static struct spinlock buf_lock = SPINLOCK_NAMED_INITIALIZER("buf");
+static struct buf *buf_hash[BUF_HASHSIZE];
+static struct buf *buf_lruhead;		/* most recently used */
+static struct buf *buf_lrutail;		/* least recently used */
+static struct buf *buf_free;		/* not holding any block */
+static unsigned buf_count;		/* buffers allocated */
+static unsigned buf_allocating;		/* being allocated right now */
+static bool buf_cantgrow;		/* kmalloc failed; stop trying */
+static unsigned buf_ndirty;		/* dirty buffers */
+static struct wchan *buf_freewchan;	/* to wait for a buffer */
+
+/* The syncer thread and its once-a-second callout. */
+static struct wchan *buf_syncwchan;
+static struct callout buf_synccallout;
+static bool buf_syncwanted;
+
+/* Readahead requests, for the readahead thread. */
+static struct buf_rareq {
+	struct device *rr_dev;
+	uint32_t rr_block;
+} buf_raq[BUF_RAQUEUE];
+static unsigned buf_rahead, buf_racount;
+static struct device *buf_radev;	/* device being read ahead on */
+static struct wchan *buf_rawchan;
+
+/* Statistics, also protected by buf_lock. */
+static struct buf_stats {
+	unsigned hits;		/* buffer_read found the block */
+	unsigned misses;	/* buffer_read had to read it */
+	unsigned reads;		/* blocks read from devices */
+	unsigned writes;	/* blocks written to devices */
+	unsigned evictions;	/* buffers reused for another block */
+	unsigned writebacks;	/* dirty buffers written to evict them */
+	unsigned waits;		/* waits for a free buffer */
+	unsigned flushed;	/* written by the syncer */
+	unsigned runs;		/* multi-block writes */
+	unsigned runblocks;	/* blocks in those */
+	unsigned highwater;	/* times dirty count passed BUF_DIRTYHIGH */
+	unsigned rarequests;	/* buffer_readahead calls */
+	unsigned raqueued;	/* of those, not cached or queued already */
+	unsigned radropped;	/* of those, dropped as the queue was full */
+	unsigned rareads;	/* blocks read by the readahead thread */
+	unsigned rahits;	/* of those, later asked for by buffer_read */
+	unsigned rawasted;	/* of those, evicted without being used */
+} buf_stats;
+
+static void buf_synctimer(void *arg);
+static void buf_syncer(void *data1, unsigned long data2);
+static void buf_reader(void *data1, unsigned long data2);
+static void buf_radropdev(struct device *dev);
+
+void
+buffer_bootstrap(void)
+{
+	int result;
+
+	buf_freewchan = wchan_create("buffree");
+	buf_syncwchan = wchan_create("syncer");
+	buf_rawchan = wchan_create("readahead");
+	if (buf_freewchan == NULL || buf_syncwchan == NULL ||
+	    buf_rawchan == NULL) {
+		panic("buffer_bootstrap: Out of memory\n");
+	}
+
+	callout_init(&buf_synccallout, buf_synctimer, NULL);
+	callout_periodic(&buf_synccallout, CALLOUT_HZ);
+
+	result = thread_fork("syncer", NULL, buf_syncer, NULL, 0);
+	if (result) {
+		panic("buffer_bootstrap: thread_fork: %s\n", strerror(result));
+	}
+	result = thread_fork("readahead", NULL, buf_reader, NULL, 0);
+	if (result) {
+		panic("buffer_bootstrap: thread_fork: %s\n", strerror(result));
+	}
+}
+
+////////////////////////////////////////////////////////////
+// lists
+
+static
+unsigned
+buf_hashfunc(struct device *dev, uint32_t block)
+{
+	return (block ^ ((uintptr_t)dev >> 4)) & (BUF_HASHSIZE - 1);
+}
+
+static
+struct buf *
+buf_hashfind(struct device *dev, uint32_t block)
+{
+	struct buf *b;
+
+	for (b = buf_hash[buf_hashfunc(dev, block)]; b; b = b->b_hashnext) {
+		if (b->b_dev == dev && b->b_block == block) {
+			return b;
+		}
+	}
+	return NULL;
+}
+
+static
+void
+buf_hashinsert(struct buf *b)
+{
+	unsigned h = buf_hashfunc(b->b_dev, b->b_block);
+
+	b->b_hashnext = buf_hash[h];
+	buf_hash[h] = b;
+}
+
+static
+void
+buf_hashremove(struct buf *b)
+{
+	struct buf **pp;
+
+	pp = &buf_hash[buf_hashfunc(b->b_dev, b->b_block)];
+	while (*pp != b) {
+		KASSERT(*pp != NULL);
+		pp = &(*pp)->b_hashnext;
+	}
+	*pp = b->b_hashnext;
+	b->b_hashnext = NULL;
+}
+
+/* Put B on the LRU list, at the most-recently-used end. */
+static
+void
+buf_lruinsert(struct buf *b)
+{
+	b->b_lruprev = NULL;
+	b->b_lrunext = buf_lruhead;
+	if (buf_lruhead != NULL) {
+		buf_lruhead->b_lruprev = b;
+	}
+	else {
+		buf_lrutail = b;
+	}
+	buf_lruhead = b;
+}
+
+static
+void
+buf_lruremove(struct buf *b)
+{
+	if (b->b_lruprev != NULL) {
+		b->b_lruprev->b_lrunext = b->b_lrunext;
+	}
+	else {
+		KASSERT(buf_lruhead == b);
+		buf_lruhead = b->b_lrunext;
+	}
+	if (b->b_lrunext != NULL) {
+		b->b_lrunext->b_lruprev = b->b_lruprev;
+	}
+	else {
+		KASSERT(buf_lrutail == b);
+		buf_lrutail = b->b_lruprev;
+	}
+	b->b_lruprev = b->b_lrunext = NULL;
+}
+
+/* Mark B clean. Called with buf_lock held. */
+static
+void
+buf_setclean(struct buf *b)
+{
+	if (b->b_dirty) {
+		KASSERT(buf_ndirty > 0);
+		buf_ndirty--;
+		b->b_dirty = false;
+	}
+}
+
+/* Take B out of the cache and put it on the free list. */
+static
+void
+buf_tofree(struct buf *b)
+{
+	KASSERT(b->b_refcount == 0);
+	buf_hashremove(b);
+	b->b_dev = NULL;
+	b->b_valid = false;
+	buf_setclean(b);
+	b->b_lrunext = buf_free;
+	buf_free = b;
+}
+
+////////////////////////////////////////////////////////////
+// I/O
+
+/*
+ * Read or write B's block. The caller has B busy.
+ */
+static
+int
+buf_io(struct buf *b, enum uio_rw rw)
+{
+	struct iovec iov;
+	struct uio ku;
+	struct device *dev = b->b_dev;
+	int result;
+	int tries = 0;
+
+ retry:
+	uio_kinit(&iov, &ku, b->b_data, BUF_SIZE,
+		  ((off_t)b->b_block) * BUF_SIZE, rw);
+	result = dev->d_io(dev, &ku);
+	if (result == EINVAL) {
+		/*
+		 * This means the sector we requested was out of range,
+		 * or the seek address we gave wasn't sector-aligned,
+		 * or a couple of other things that are our fault.
+		 */
+		panic("buf: d_io returned EINVAL\n");
+	}
+	if (result == EIO) {
+		if (tries == 0) {
+			tries++;
+			kprintf("buf: block %u I/O error, retrying\n",
+				b->b_block);
+			goto retry;
+		}
+		else if (tries < 10) {
+			tries++;
+			goto retry;
+		}
+		else {
+			kprintf("buf: block %u I/O error, giving up after "
+				"%d retries\n", b->b_block, tries);
+		}
+	}
+
+	spinlock_acquire(&buf_lock);
+	if (rw == UIO_READ) {
+		buf_stats.reads++;
+	}
+	else {
+		buf_stats.writes++;
+	}
+	spinlock_release(&buf_lock);
+
+	return result;
+}
+
+////////////////////////////////////////////////////////////
+// getting and releasing buffers
+
+/*
+ * Make a new buffer and put it on the free list. Called with buf_lock
+ * held; releases it while allocating.
+ */
+static
+void
+buf_create(void)
+{
+	struct buf *b;
+
+	buf_allocating++;
+	spinlock_release(&buf_lock);
+
+	b = kmalloc(sizeof(*b));
+	if (b != NULL) {
+		b->b_data = kmalloc(BUF_SIZE);
+		b->b_wchan = wchan_create("buf");
+		if (b->b_data == NULL || b->b_wchan == NULL) {
+			kfree(b->b_data);
+			if (b->b_wchan != NULL) {
+				wchan_destroy(b->b_wchan);
+			}
+			kfree(b);
+			b = NULL;
+		}
+	}
+
+	spinlock_acquire(&buf_lock);
+	buf_allocating--;
+	if (b == NULL) {
+		/* make do with what we have */
+		buf_cantgrow = true;
+		return;
+	}
+	b->b_dev = NULL;
+	b->b_block = 0;
+	b->b_refcount = 0;
+	b->b_busy = false;
+	b->b_valid = false;
+	b->b_dirty = false;
+	b->b_readahead = false;
+	b->b_hashnext = NULL;
+	b->b_lruprev = NULL;
+	b->b_lrunext = buf_free;
+	buf_free = b;
+	buf_count++;
+}
+
+/*
+ * Write out VICTIM, the least recently used buffer, which is dirty,
+ * so it can be reused. Called with buf_lock held; releases it while
+ * writing.
+ */
+static
+void
+buf_writeback(struct buf *victim)
+{
+	int result;
+
+	buf_lruremove(victim);
+	victim->b_refcount++;
+	victim->b_busy = true;
+	buf_stats.writebacks++;
+	spinlock_release(&buf_lock);
+
+	result = buf_io(victim, UIO_WRITE);
+
+	spinlock_acquire(&buf_lock);
+	if (result == 0) {
+		buf_setclean(victim);
+	}
+	victim->b_busy = false;
+	victim->b_refcount--;
+	if (victim->b_refcount > 0) {
+		/* someone wanted it while we were writing */
+		wchan_wakeone(victim->b_wchan);
+	}
+	else if (result) {
+		/* can't write it; try others first */
+		buf_lruinsert(victim);
+	}
+	else {
+		/* back on the least recently used end, to be reused */
+		victim->b_lruprev = buf_lrutail;
+		victim->b_lrunext = NULL;
+		if (buf_lrutail != NULL) {
+			buf_lrutail->b_lrunext = victim;
+		}
+		else {
+			buf_lruhead = victim;
+		}
+		buf_lrutail = victim;
+	}
+}
+
+/*
+ * Find a buffer that isn't holding any block and take it off the free
+ * list, evicting the least recently used buffer if need be. Called
+ * with buf_lock held. If it has to release the lock along the way,
+ * returns NULL, and the caller has to look again for the block it
+ * wants since someone else might have loaded it meanwhile.
+ */
+static
+struct buf *
+buf_getfree(void)
+{
+	struct buf *b;
+
+	if (buf_free != NULL) {
+		b = buf_free;
+		buf_free = b->b_lrunext;
+		b->b_lrunext = NULL;
+		return b;
+	}
+
+	if (!buf_cantgrow && buf_count + buf_allocating < BUF_MAXBUFS) {
+		buf_create();
+		return NULL;
+	}
+
+	b = buf_lrutail;
+	if (b == NULL) {
+		/* everything is in use; wait for something to come back */
+		buf_stats.waits++;
+		wchan_lock(buf_freewchan);
+		spinlock_release(&buf_lock);
+		wchan_sleep(buf_freewchan);
+		spinlock_acquire(&buf_lock);
+		return NULL;
+	}
+
+	KASSERT(b->b_refcount == 0);
+	if (b->b_dirty) {
+		buf_writeback(b);
+		return NULL;
+	}
+
+	buf_lruremove(b);
+	buf_hashremove(b);
+	b->b_dev = NULL;
+	b->b_valid = false;
+	buf_stats.evictions++;
+	if (b->b_readahead) {
+		buf_stats.rawasted++;
+	}
+	return b;
+}
+
+/*
+ * Get BLOCK on DEV, pinned and busy. Counts a hit or miss if READING.
+ */
+static
+struct buf *
+buf_acquire(struct device *dev, uint32_t block, bool reading)
+{
+	struct buf *b;
+
+	KASSERT(dev->d_blocksize == BUF_SIZE);
+
+	spinlock_acquire(&buf_lock);
+	while (1) {
+		b = buf_hashfind(dev, block);
+		if (b != NULL) {
+			if (b->b_refcount == 0) {
+				/* unused, so it's on the LRU list */
+				buf_lruremove(b);
+			}
+			break;
+		}
+		b = buf_getfree();
+		if (b != NULL) {
+			/* already off the free or LRU list */
+			KASSERT(b->b_refcount == 0);
+			b->b_dev = dev;
+			b->b_block = block;
+			b->b_valid = false;
+			b->b_dirty = false;
+			b->b_readahead = false;
+			buf_hashinsert(b);
+			break;
+		}
+	}
+
+	b->b_refcount++;
+	while (b->b_busy) {
+		wchan_lock(b->b_wchan);
+		spinlock_release(&buf_lock);
+		wchan_sleep(b->b_wchan);
+		spinlock_acquire(&buf_lock);
+	}
+	b->b_busy = true;
+
+	if (reading && b->b_valid) {
+		buf_stats.hits++;
+	}
+	else if (reading) {
+		buf_stats.misses++;
+	}
+	spinlock_release(&buf_lock);
+
+	return b;
+}
+
+int
+buffer_read(struct device *dev, uint32_t block, struct buf **ret)
+{
+	struct buf *b;
+	int result;
+
+	b = buf_acquire(dev, block, true);
+	if (b->b_readahead) {
+		b->b_readahead = false;
+		spinlock_acquire(&buf_lock);
+		buf_stats.rahits++;
+		spinlock_release(&buf_lock);
+	}
+	if (!b->b_valid) {
+		result = buf_io(b, UIO_READ);
+		if (result) {
+			buffer_release(b);
+			return result;
+		}
+		b->b_valid = true;
+	}
+	*ret = b;
+	return 0;
+}
+
+int
+buffer_get(struct device *dev, uint32_t block, struct buf **ret)
+{
+	*ret = buf_acquire(dev, block, false);
+	return 0;
+}
+
+void
+buffer_release(struct buf *b)
+{
+	spinlock_acquire(&buf_lock);
+	KASSERT(b->b_busy);
+	KASSERT(b->b_refcount > 0);
+	b->b_busy = false;
+	b->b_refcount--;
+	if (b->b_refcount > 0) {
+		wchan_wakeone(b->b_wchan);
+	}
+	else {
+		if (b->b_valid) {
+			buf_lruinsert(b);
+		}
+		else {
+			/* nothing worth keeping */
+			buf_tofree(b);
+		}
+		wchan_wakeone(buf_freewchan);
+	}
+	spinlock_release(&buf_lock);
+}
+
+////////////////////////////////////////////////////////////
+// operations on held buffers
+
+void *
+buffer_map(struct buf *b)
+{
+	KASSERT(b->b_busy);
+	return b->b_data;
+}
+
+bool
+buffer_isvalid(struct buf *b)
+{
+	KASSERT(b->b_busy);
+	return b->b_valid;
+}
+
+void
+buffer_markdirty(struct buf *b)
+{
+	KASSERT(b->b_busy);
+	b->b_valid = true;
+	if (b->b_dirty) {
+		return;
+	}
+
+	spinlock_acquire(&buf_lock);
+	b->b_dirty = true;
+	b->b_dirtytime = clock_ticks();
+	buf_ndirty++;
+	if (buf_ndirty == BUF_DIRTYHIGH + 1) {
+		/* too many; get the syncer going now */
+		buf_stats.highwater++;
+		buf_syncwanted = true;
+		wchan_wakeone(buf_syncwchan);
+	}
+	spinlock_release(&buf_lock);
+}
+
+void
+buffer_invalidate(struct buf *b)
+{
+	KASSERT(b->b_busy);
+	b->b_valid = false;
+	spinlock_acquire(&buf_lock);
+	buf_setclean(b);
+	spinlock_release(&buf_lock);
+}
+
+int
+buffer_sync(struct buf *b)
+{
+	int result;
+
+	KASSERT(b->b_busy);
+	if (!b->b_dirty) {
+		return 0;
+	}
+	KASSERT(b->b_valid);
+	result = buf_io(b, UIO_WRITE);
+	if (result) {
+		return result;
+	}
+	spinlock_acquire(&buf_lock);
+	buf_setclean(b);
+	spinlock_release(&buf_lock);
+	return 0;
+}
+
+////////////////////////////////////////////////////////////
+// whole-cache operations
+
+void
+buffer_forget(struct device *dev, uint32_t block)
+{
+	struct buf *b;
+
+	spinlock_acquire(&buf_lock);
+	b = buf_hashfind(dev, block);
+	if (b != NULL && b->b_refcount == 0) {
+		buf_lruremove(b);
+		buf_tofree(b);
+		wchan_wakeone(buf_freewchan);
+	}
+	spinlock_release(&buf_lock);
+}
+
+/*
+ * Find a dirty buffer for DEV. Called with buf_lock held.
+ */
+static
+struct buf *
+buf_finddirty(struct device *dev)
+{
+	struct buf *b;
+	unsigned i;
+
+	for (i=0; i<BUF_HASHSIZE; i++) {
+		for (b = buf_hash[i]; b != NULL; b = b->b_hashnext) {
+			if (b->b_dev == dev && b->b_dirty) {
+				return b;
+			}
+		}
+	}
+	return NULL;
+}
+
+int
+buffer_syncblock(struct device *dev, uint32_t block)
+{
+	struct buf *b;
+	int result;
+
+	spinlock_acquire(&buf_lock);
+	b = buf_hashfind(dev, block);
+	if (b == NULL || !b->b_dirty) {
+		spinlock_release(&buf_lock);
+		return 0;
+	}
+	spinlock_release(&buf_lock);
+
+	b = buf_acquire(dev, block, false);
+	result = buffer_sync(b);
+	buffer_release(b);
+	return result;
+}
+
+/*
+ * Pick up to MAX dirty buffers that nobody is using, for DEV (or any
+ * device if DEV is NULL), and make them busy. Takes buffers dirty for
+ * BUF_DIRTYAGE seconds or more, plus EXCESS more regardless of age, or
+ * every one if ALL is set. Called with buf_lock held.
+ */
+static
+unsigned
+buf_collect(struct device *dev, bool all, unsigned excess,
+	    struct buf **bufs, unsigned max)
+{
+	struct buf *b, *prev;
+	uint32_t now;
+	unsigned n = 0;
+
+	now = clock_ticks();
+	for (b = buf_lrutail; b != NULL && n < max; b = prev) {
+		prev = b->b_lruprev;
+		if (!b->b_dirty || (dev != NULL && b->b_dev != dev)) {
+			continue;
+		}
+		if (!all && now - b->b_dirtytime < BUF_DIRTYAGE * CALLOUT_HZ) {
+			if (excess == 0) {
+				continue;
+			}
+			excess--;
+		}
+		KASSERT(b->b_refcount == 0);
+		buf_lruremove(b);
+		b->b_refcount++;
+		b->b_busy = true;
+		bufs[n++] = b;
+	}
+	return n;
+}
+
+/* Sort order for buf_writebatch: by device, then block. */
+static
+bool
+buf_before(struct buf *a, struct buf *b)
+{
+	if (a->b_dev != b->b_dev) {
+		return (uintptr_t)a->b_dev < (uintptr_t)b->b_dev;
+	}
+	return a->b_block < b->b_block;
+}
+
+/*
+ * Write out N busy buffers from buf_collect, and release them. Runs of
+ * adjacent blocks are written with one d_io call. If that fails, the
+ * blocks are written one at a time so each gets the usual retries.
+ */
+static
+void
+buf_writebatch(struct buf **bufs, unsigned n)
+{
+	struct iovec iov[BUF_SYNCBATCH];
+	bool written[BUF_SYNCBATCH];
+	struct uio ku;
+	struct device *dev;
+	struct buf *b;
+	unsigned i, j, k;
+	int result;
+
+	KASSERT(n <= BUF_SYNCBATCH);
+
+	/* Sort (insertion sort; N is small). */
+	for (i=1; i<n; i++) {
+		b = bufs[i];
+		for (j=i; j>0 && buf_before(b, bufs[j-1]); j--) {
+			bufs[j] = bufs[j-1];
+		}
+		bufs[j] = b;
+	}
+
+	for (i=0; i<n; i=j) {
+		/* Find the run of adjacent blocks starting at I. */
+		dev = bufs[i]->b_dev;
+		for (j=i+1; j<n; j++) {
+			if (bufs[j]->b_dev != dev ||
+			    bufs[j]->b_block != bufs[i]->b_block + (j-i)) {
+				break;
+			}
+		}
+
+		if (j - i > 1) {
+			for (k=i; k<j; k++) {
+				iov[k-i].iov_kbase = bufs[k]->b_data;
+				iov[k-i].iov_len = BUF_SIZE;
+			}
+			ku.uio_iov = iov;
+			ku.uio_iovcnt = j - i;
+			ku.uio_offset = ((off_t)bufs[i]->b_block) * BUF_SIZE;
+			ku.uio_resid = (j - i) * BUF_SIZE;
+			ku.uio_segflg = UIO_SYSSPACE;
+			ku.uio_rw = UIO_WRITE;
+			ku.uio_space = NULL;
+			result = dev->d_io(dev, &ku);
+			if (result == 0) {
+				spinlock_acquire(&buf_lock);
+				buf_stats.writes += j - i;
+				buf_stats.runs++;
+				buf_stats.runblocks += j - i;
+				spinlock_release(&buf_lock);
+				for (k=i; k<j; k++) {
+					written[k] = true;
+				}
+				continue;
+			}
+		}
+
+		for (k=i; k<j; k++) {
+			written[k] = buf_io(bufs[k], UIO_WRITE) == 0;
+		}
+	}
+
+	spinlock_acquire(&buf_lock);
+	for (i=0; i<n; i++) {
+		b = bufs[i];
+		if (written[i]) {
+			buf_setclean(b);
+			buf_stats.flushed++;
+		}
+		b->b_busy = false;
+		b->b_refcount--;
+		if (b->b_refcount > 0) {
+			wchan_wakeone(b->b_wchan);
+		}
+		else {
+			buf_lruinsert(b);
+		}
+	}
+	wchan_wakeall(buf_freewchan);
+	spinlock_release(&buf_lock);
+}
+
+int
+buffer_syncdev(struct device *dev)
+{
+	struct buf *bufs[BUF_SYNCBATCH];
+	struct buf *b;
+	unsigned n;
+	int result;
+
+	/* First the ones nobody is using, in batches. */
+	spinlock_acquire(&buf_lock);
+	while (1) {
+		n = buf_collect(dev, true, 0, bufs, BUF_SYNCBATCH);
+		if (n == 0) {
+			break;
+		}
+		spinlock_release(&buf_lock);
+		buf_writebatch(bufs, n);
+		spinlock_acquire(&buf_lock);
+	}
+
+	/*
+	 * Then any that were in use, one at a time, waiting for them.
+	 * This also retries any from the batches that failed.
+	 */
+	while ((b = buf_finddirty(dev)) != NULL) {
+		spinlock_release(&buf_lock);
+
+		b = buf_acquire(dev, b->b_block, false);
+		result = buffer_sync(b);
+		buffer_release(b);
+		if (result) {
+			return result;
+		}
+
+		spinlock_acquire(&buf_lock);
+	}
+	spinlock_release(&buf_lock);
+	return 0;
+}
+
+int
+buffer_dropdev(struct device *dev)
+{
+	struct buf *b;
+	unsigned i;
+	int result;
+
+	result = buffer_syncdev(dev);
+	if (result) {
+		return result;
+	}
+
+	/*
+	 * Nothing should be using the device any more, but the syncer
+	 * might have some of its buffers for a moment; so get each one
+	 * properly and throw it away by releasing it invalid. Likewise
+	 * the readahead thread.
+	 */
+	spinlock_acquire(&buf_lock);
+	buf_radropdev(dev);
+	while (buf_radev == dev) {
+		wchan_lock(buf_freewchan);
+		spinlock_release(&buf_lock);
+		wchan_sleep(buf_freewchan);
+		spinlock_acquire(&buf_lock);
+	}
+	i = 0;
+	while (i < BUF_HASHSIZE) {
+		for (b = buf_hash[i]; b != NULL; b = b->b_hashnext) {
+			if (b->b_dev == dev) {
+				break;
+			}
+		}
+		if (b == NULL) {
+			i++;
+			continue;
+		}
+		spinlock_release(&buf_lock);
+
+		b = buf_acquire(dev, b->b_block, false);
+		KASSERT(!b->b_dirty);
+		buffer_invalidate(b);
+		buffer_release(b);
+
+		spinlock_acquire(&buf_lock);
+	}
+	spinlock_release(&buf_lock);
+	return 0;
+}
+
+////////////////////////////////////////////////////////////
+// readahead
+
+void
+buffer_readahead(struct device *dev, uint32_t block)
+{
+	unsigned i;
+
+	KASSERT(dev->d_blocksize == BUF_SIZE);
+
+	spinlock_acquire(&buf_lock);
+	buf_stats.rarequests++;
+
+	/* Already cached, or being read? */
+	if (buf_hashfind(dev, block) != NULL) {
+		spinlock_release(&buf_lock);
+		return;
+	}
+
+	/* Already asked for? */
+	for (i=0; i<buf_racount; i++) {
+		struct buf_rareq *rr;
+
+		rr = &buf_raq[(buf_rahead + i) % BUF_RAQUEUE];
+		if (rr->rr_dev == dev && rr->rr_block == block) {
+			spinlock_release(&buf_lock);
+			return;
+		}
+	}
+
+	if (buf_racount == BUF_RAQUEUE) {
+		/* Behind already; don't make it worse. */
+		buf_stats.radropped++;
+		spinlock_release(&buf_lock);
+		return;
+	}
+
+	i = (buf_rahead + buf_racount) % BUF_RAQUEUE;
+	buf_raq[i].rr_dev = dev;
+	buf_raq[i].rr_block = block;
+	buf_racount++;
+	buf_stats.raqueued++;
+	wchan_wakeone(buf_rawchan);
+	spinlock_release(&buf_lock);
+}
+
+/*
+ * Drop queued readahead requests for DEV. Called with buf_lock held.
+ */
+static
+void
+buf_radropdev(struct device *dev)
+{
+	unsigned i, n;
+	struct buf_rareq *from, *to;
+
+	n = 0;
+	for (i=0; i<buf_racount; i++) {
+		from = &buf_raq[(buf_rahead + i) % BUF_RAQUEUE];
+		if (from->rr_dev == dev) {
+			continue;
+		}
+		to = &buf_raq[(buf_rahead + n) % BUF_RAQUEUE];
+		*to = *from;
+		n++;
+	}
+	buf_racount = n;
+}
+
+/*
+ * Readahead thread. Reads the blocks asked for with buffer_readahead
+ * into the cache, so the thread that wants them next doesn't have to
+ * wait for the disk (or waits less).
+ */
+static
+void
+buf_reader(void *data1, unsigned long data2)
+{
+	struct buf_rareq rr;
+	struct buf *b;
+
+	(void)data1;
+	(void)data2;
+
+	spinlock_acquire(&buf_lock);
+	while (1) {
+		while (buf_racount == 0) {
+			wchan_lock(buf_rawchan);
+			spinlock_release(&buf_lock);
+			wchan_sleep(buf_rawchan);
+			spinlock_acquire(&buf_lock);
+		}
+		rr = buf_raq[buf_rahead];
+		buf_rahead = (buf_rahead + 1) % BUF_RAQUEUE;
+		buf_racount--;
+		buf_radev = rr.rr_dev;
+		spinlock_release(&buf_lock);
+
+		b = buf_acquire(rr.rr_dev, rr.rr_block, false);
+		if (!b->b_valid && buf_io(b, UIO_READ) == 0) {
+			b->b_valid = true;
+			b->b_readahead = true;
+			spinlock_acquire(&buf_lock);
+			buf_stats.rareads++;
+			spinlock_release(&buf_lock);
+		}
+		buffer_release(b);
+
+		spinlock_acquire(&buf_lock);
+		buf_radev = NULL;
+		wchan_wakeall(buf_freewchan);
+	}
+}
+
+////////////////////////////////////////////////////////////
+// the syncer
+
+/*
+ * Callout function: wake the syncer once a second.
+ */
+static
+void
+buf_synctimer(void *arg)
+{
+	(void)arg;
+
+	spinlock_acquire(&buf_lock);
+	buf_syncwanted = true;
+	wchan_wakeone(buf_syncwchan);
+	spinlock_release(&buf_lock);
+}
+
+/*
+ * Syncer thread. Writes out old dirty buffers, and enough others to
+ * get the dirty count down when it gets too high; see BUF_DIRTYAGE
+ * and friends above.
+ */
+static
+void
+buf_syncer(void *data1, unsigned long data2)
+{
+	struct buf *bufs[BUF_SYNCBATCH];
+	unsigned n, excess;
+	bool draining = false;
+	uint32_t lastupdate;
+
+	(void)data1;
+	(void)data2;
+
+	lastupdate = clock_ticks();
+
+	spinlock_acquire(&buf_lock);
+	while (1) {
+		while (!buf_syncwanted) {
+			wchan_lock(buf_syncwchan);
+			spinlock_release(&buf_lock);
+			wchan_sleep(buf_syncwchan);
+			spinlock_acquire(&buf_lock);
+		}
+		buf_syncwanted = false;
+
+		do {
+			if (buf_ndirty > BUF_DIRTYHIGH) {
+				draining = true;
+			}
+			else if (buf_ndirty <= BUF_DIRTYLOW) {
+				draining = false;
+			}
+			excess = draining ? buf_ndirty - BUF_DIRTYLOW : 0;
+
+			n = buf_collect(NULL, false, excess,
+					bufs, BUF_SYNCBATCH);
+			if (n > 0) {
+				spinlock_release(&buf_lock);
+				buf_writebatch(bufs, n);
+				spinlock_acquire(&buf_lock);
+			}
+		} while (n == BUF_SYNCBATCH);
+
+		if (clock_ticks() - lastupdate >= BUF_UPDATEAGE * CALLOUT_HZ) {
+			spinlock_release(&buf_lock);
+			vfs_sync();
+			lastupdate = clock_ticks();
+			spinlock_acquire(&buf_lock);
+		}
+	}
+}
+
+void
+buffer_printstats(void)
+{
+	struct buf_stats st;
+	struct buf *b;
+	unsigned count, inuse = 0, dirty, nfree = 0, lookups, i;
+
+	spinlock_acquire(&buf_lock);
+	count = buf_count;
+	dirty = buf_ndirty;
+	for (i=0; i<BUF_HASHSIZE; i++) {
+		for (b = buf_hash[i]; b != NULL; b = b->b_hashnext) {
+			if (b->b_refcount > 0) {
+				inuse++;
+			}
+		}
+	}
+	for (b = buf_free; b != NULL; b = b->b_lrunext) {
+		nfree++;
+	}
+	st = buf_stats;
+	spinlock_release(&buf_lock);
+
+	lookups = st.hits + st.misses;
+	kprintf("buffer cache: %u/%u buffers, %u in use, %u dirty, "
+		"%u free\n", count, BUF_MAXBUFS, inuse, dirty, nfree);
+	kprintf("  %u reads, %u hits (%u%%), %u misses\n",
+		lookups, st.hits, lookups ? st.hits * 100 / lookups : 0,
+		st.misses);
+	kprintf("  %u blocks read, %u written (%u to evict)\n",
+		st.reads, st.writes, st.writebacks);
+	kprintf("  %u evictions, %u waits for a buffer\n",
+		st.evictions, st.waits);
+	kprintf("  syncer: %u blocks written, %u multi-block writes "
+		"(%u blocks), %u times over %u dirty\n",
+		st.flushed, st.runs, st.runblocks, st.highwater,
+		BUF_DIRTYHIGH);
+	kprintf("  readahead: %u requests, %u queued, %u dropped\n",
+		st.rarequests, st.raqueued, st.radropped);
+	kprintf("  readahead: %u blocks read, %u used (%u%%), "
+		"%u evicted unused\n",
+		st.rareads, st.rahits,
+		st.rareads ? st.rahits * 100 / st.rareads : 0, st.rawasted);
+}
@@ -36,6 +36,7 @@
 #include <types.h>
 #include <kern/errno.h>
 #include <kern/fcntl.h>
+#include <kern/poll.h>
 #include <stat.h>
 #include <lib.h>
 #include <uio.h>
@@ -134,6 +135,24 @@ dev_ioctl(struct vnode *v, int op, userptr_t data)
 	return d->d_ioctl(d, op, data);
 }
 
+/*
+ * Called for poll() and select(). Devices that never block (or block
+ * only briefly, like disks) leave d_poll null and are always ready.
+ */
+static
+int
+dev_poll(struct vnode *v, int events, struct pollent *pe, int *revents)
+{
+	struct device *d = v->vn_data;
+
+	if (d->d_poll == NULL) {
+		*revents = events &
+			(POLLIN | POLLRDNORM | POLLOUT | POLLWRNORM);
+		return 0;
+	}
+	return d->d_poll(d, events, pe, revents);
+}
+
 /*
  * Called for stat().
  * Set the type and the size (block devices only).
@@ -423,6 +442,7 @@ static const struct vnode_ops dev_vnode_ops = {
 	null_io,      /* getdirentry */
 	dev_write,
 	dev_ioctl,
+	dev_poll,
 	dev_stat,
 	dev_gettype,
 	dev_tryseek,
@@ -0,0 +1,327 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Pathname lookup cache. See <namecache.h>.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <spinlock.h>
+#include <namecache.h>
+
+#define NC_HASHSIZE	128	/* hash chains; a power of 2 */
+
+struct ncentry {
+	struct vnode *nc_dir;		/* directory (not referenced) */
+	ino_t nc_ino;			/* what NAME is, or NAMECACHE_NOINO */
+	struct ncentry *nc_hashnext;	/* hash chain */
+	struct ncentry *nc_lruprev;	/* LRU list, or free list */
+	struct ncentry *nc_lrunext;	/*   (through nc_lrunext) */
+	char nc_name[NAMECACHE_NAMELEN+1];
+};
+
+/*
+ * Everything is protected by nc_lock. Entries come from a fixed pool,
+ * handed out in order until it's used up and after that reused, from
+ * the free list if anything has been purged or else from the tail of
+ * the LRU list.
+ *
+ * Entries hold no vnode references, so the cache doesn't keep
+ * anything loaded. nc_dir is only used as a key; the filesystem
+ * calls namecache_purgedir before freeing a directory vnode, so a
+ * later vnode at the same address can't find its entries.
+ */
+static struct spinlock nc_lock = SPINLOCK_NAMED_INITIALIZER("namecache");
+static struct ncentry nc_pool[NAMECACHE_SIZE];
+static unsigned nc_used;		/* pool entries handed out */
+static struct ncentry *nc_free;		/* purged entries */
+static struct ncentry *nc_hash[NC_HASHSIZE];
+static struct ncentry *nc_lruhead;	/* most recently used */
+static struct ncentry *nc_lrutail;	/* least recently used */
+static unsigned nc_count;		/* entries in the hash table */
+static unsigned nc_negative;		/* of those, negative entries */
+
+/* Statistics, also protected by nc_lock. */
+static struct namecache_stats {
+	unsigned hits;		/* lookups that found a vnode */
+	unsigned neghits;	/* lookups that found the name doesn't exist */
+	unsigned misses;	/* lookups that found nothing cached */
+	unsigned toolong;	/* lookups of names too long to cache */
+	unsigned enters;	/* entries made */
+	unsigned evictions;	/* entries reused for another name */
+	unsigned purges;	/* entries dropped by purge or purgedir */
+} nc_stats;
+
+static
+unsigned
+nc_hashfunc(struct vnode *dir, const char *name)
+{
+	unsigned h;
+
+	h = (unsigned)((uintptr_t)dir >> 4);
+	for (; *name; name++) {
+		h = h * 31 + (unsigned char)*name;
+	}
+	return h & (NC_HASHSIZE - 1);
+}
+
+static
+struct ncentry *
+nc_find(struct vnode *dir, const char *name)
+{
+	struct ncentry *nc;
+
+	KASSERT(spinlock_do_i_hold(&nc_lock));
+
+	nc = nc_hash[nc_hashfunc(dir, name)];
+	for (; nc != NULL; nc = nc->nc_hashnext) {
+		if (nc->nc_dir == dir && !strcmp(nc->nc_name, name)) {
+			return nc;
+		}
+	}
+	return NULL;
+}
+
+static
+void
+nc_lruinsert(struct ncentry *nc)
+{
+	nc->nc_lruprev = NULL;
+	nc->nc_lrunext = nc_lruhead;
+	if (nc_lruhead != NULL) {
+		nc_lruhead->nc_lruprev = nc;
+	}
+	else {
+		nc_lrutail = nc;
+	}
+	nc_lruhead = nc;
+}
+
+static
+void
+nc_lruremove(struct ncentry *nc)
+{
+	if (nc->nc_lruprev != NULL) {
+		nc->nc_lruprev->nc_lrunext = nc->nc_lrunext;
+	}
+	else {
+		KASSERT(nc_lruhead == nc);
+		nc_lruhead = nc->nc_lrunext;
+	}
+	if (nc->nc_lrunext != NULL) {
+		nc->nc_lrunext->nc_lruprev = nc->nc_lruprev;
+	}
+	else {
+		KASSERT(nc_lrutail == nc);
+		nc_lrutail = nc->nc_lruprev;
+	}
+	nc->nc_lruprev = nc->nc_lrunext = NULL;
+}
+
+/*
+ * Take an entry out of the hash table and the LRU list.
+ */
+static
+void
+nc_remove(struct ncentry *nc)
+{
+	struct ncentry **pp;
+
+	KASSERT(spinlock_do_i_hold(&nc_lock));
+
+	pp = &nc_hash[nc_hashfunc(nc->nc_dir, nc->nc_name)];
+	while (*pp != nc) {
+		KASSERT(*pp != NULL);
+		pp = &(*pp)->nc_hashnext;
+	}
+	*pp = nc->nc_hashnext;
+	nc->nc_hashnext = NULL;
+	nc_lruremove(nc);
+
+	nc_count--;
+	if (nc->nc_ino == NAMECACHE_NOINO) {
+		nc_negative--;
+	}
+	nc->nc_dir = NULL;
+	nc->nc_ino = NAMECACHE_NOINO;
+}
+
+/*
+ * Put a removed entry on the free list.
+ */
+static
+void
+nc_discard(struct ncentry *nc)
+{
+	nc->nc_lrunext = nc_free;
+	nc_free = nc;
+	nc_stats.purges++;
+}
+
+bool
+namecache_lookup(struct vnode *dir, const char *name, ino_t *ret)
+{
+	struct ncentry *nc;
+
+	spinlock_acquire(&nc_lock);
+	if (strlen(name) > NAMECACHE_NAMELEN) {
+		nc_stats.toolong++;
+		spinlock_release(&nc_lock);
+		return false;
+	}
+
+	nc = nc_find(dir, name);
+	if (nc == NULL) {
+		nc_stats.misses++;
+		spinlock_release(&nc_lock);
+		return false;
+	}
+
+	nc_lruremove(nc);
+	nc_lruinsert(nc);
+	if (nc->nc_ino != NAMECACHE_NOINO) {
+		nc_stats.hits++;
+	}
+	else {
+		nc_stats.neghits++;
+	}
+	*ret = nc->nc_ino;
+	spinlock_release(&nc_lock);
+	return true;
+}
+
+void
+namecache_enter(struct vnode *dir, const char *name, ino_t ino)
+{
+	struct ncentry *nc;
+	unsigned h;
+
+	if (strlen(name) > NAMECACHE_NAMELEN) {
+		return;
+	}
+
+	spinlock_acquire(&nc_lock);
+
+	if (nc_find(dir, name) != NULL) {
+		/*
+		 * Another lookup entered it while we were searching
+		 * the directory. The directory is locked, so it's
+		 * still right.
+		 */
+		spinlock_release(&nc_lock);
+		return;
+	}
+
+	if (nc_free != NULL) {
+		nc = nc_free;
+		nc_free = nc->nc_lrunext;
+		nc->nc_lrunext = NULL;
+	}
+	else if (nc_used < NAMECACHE_SIZE) {
+		nc = &nc_pool[nc_used++];
+	}
+	else {
+		nc = nc_lrutail;
+		KASSERT(nc != NULL);
+		nc_remove(nc);
+		nc_stats.evictions++;
+	}
+
+	nc->nc_dir = dir;
+	nc->nc_ino = ino;
+	if (ino == NAMECACHE_NOINO) {
+		nc_negative++;
+	}
+	strcpy(nc->nc_name, name);
+
+	h = nc_hashfunc(dir, name);
+	nc->nc_hashnext = nc_hash[h];
+	nc_hash[h] = nc;
+	nc_lruinsert(nc);
+	nc_count++;
+	nc_stats.enters++;
+
+	spinlock_release(&nc_lock);
+}
+
+void
+namecache_purge(struct vnode *dir, const char *name)
+{
+	struct ncentry *nc;
+
+	spinlock_acquire(&nc_lock);
+	if (strlen(name) <= NAMECACHE_NAMELEN) {
+		nc = nc_find(dir, name);
+		if (nc != NULL) {
+			nc_remove(nc);
+			nc_discard(nc);
+		}
+	}
+	spinlock_release(&nc_lock);
+}
+
+void
+namecache_purgedir(struct vnode *dir)
+{
+	struct ncentry *nc, *next;
+
+	spinlock_acquire(&nc_lock);
+	for (nc = nc_lruhead; nc != NULL; nc = next) {
+		next = nc->nc_lrunext;
+		if (nc->nc_dir == dir) {
+			nc_remove(nc);
+			nc_discard(nc);
+		}
+	}
+	spinlock_release(&nc_lock);
+}
+
+void
+namecache_printstats(void)
+{
+	struct namecache_stats st;
+	unsigned count, negative, lookups;
+
+	spinlock_acquire(&nc_lock);
+	count = nc_count;
+	negative = nc_negative;
+	st = nc_stats;
+	spinlock_release(&nc_lock);
+
+	lookups = st.hits + st.neghits + st.misses + st.toolong;
+	kprintf("name cache: %u/%u entries, %u negative\n",
+		count, NAMECACHE_SIZE, negative);
+	kprintf("  %u lookups, %u hits, %u negative hits (%u%% hit), "
+		"%u misses, %u too long\n", lookups, st.hits, st.neghits,
+		lookups ? (st.hits + st.neghits) * 100 / lookups : 0,
+		st.misses, st.toolong);
+	kprintf("  %u entered, %u evicted, %u purged\n",
+		st.enters, st.evictions, st.purges);
+}
@@ -0,0 +1,763 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Pipes. See <pipe.h>.
+ */
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/ioctl.h>
+#include <kern/poll.h>
+#include <limits.h>
+#include <stat.h>
+#include <lib.h>
+#include <uio.h>
+#include <synch.h>
+#include <copyinout.h>
+#include <addrspace.h>
+#include <vm.h>
+#include <vnode.h>
+#include <poll.h>
+#include <pipe.h>
+
+/*
+ * A reader waiting on an empty pipe. The writer that serves it sets
+ * pw_done and leaves any error in pw_result.
+ */
+struct pipe_waiter {
+	struct uio *pw_uio;
+	int pw_result;
+	bool pw_done;
+};
+
+struct pipe {
+	struct vnode pp_readvn;		/* read end */
+	struct vnode pp_writevn;	/* write end */
+
+	struct lock *pp_lock;		/* protects everything below */
+	struct cv *pp_readcv;		/* readers wait here for data */
+	struct cv *pp_writecv;		/* writers wait here for space */
+	char *pp_buf;			/* the ring */
+	size_t pp_size;			/* its size */
+	size_t pp_head;			/* where the next read starts */
+	size_t pp_count;		/* bytes in the ring */
+	bool pp_readopen;		/* read end not yet reclaimed */
+	bool pp_writeopen;		/* write end not yet reclaimed */
+	bool pp_rnonblock;		/* read end is non-blocking */
+	bool pp_wnonblock;		/* write end is non-blocking */
+	struct pipe_waiter *pp_reader;	/* reader to copy into directly */
+	struct pollhead pp_pollhead;	/* pollers of either end */
+};
+
+static const struct vnode_ops pipe_vnode_ops;
+
+static
+void
+pipe_destroy(struct pipe *pp)
+{
+	pollhead_cleanup(&pp->pp_pollhead);
+	kfree(pp->pp_buf);
+	cv_destroy(pp->pp_writecv);
+	cv_destroy(pp->pp_readcv);
+	lock_destroy(pp->pp_lock);
+	kfree(pp);
+}
+
+static
+size_t
+pipe_min(size_t a, size_t b)
+{
+	return a < b ? a : b;
+}
+
+/*
+ * Copy from the writer's uio straight into the buffer of a reader
+ * blocked in pipe_read. The reader's memory is reached through the
+ * kernel's direct mapping of physical memory, a page at a time,
+ * since its address space isn't the one loaded. Only the writer's
+ * failures are returned; if the reader's buffer is bad, that error
+ * goes to the reader.
+ */
+static
+int
+pipe_directcopy(struct uio *wuio, struct pipe_waiter *w)
+{
+	struct uio *ruio = w->pw_uio;
+	struct iovec *riov;
+	vaddr_t va;
+	paddr_t pa;
+	void *dest;
+	size_t n;
+	int result;
+
+	while (wuio->uio_resid > 0 && ruio->uio_resid > 0) {
+		KASSERT(ruio->uio_iovcnt > 0);
+		riov = ruio->uio_iov;
+		if (riov->iov_len == 0) {
+			ruio->uio_iov++;
+			ruio->uio_iovcnt--;
+			continue;
+		}
+
+		n = pipe_min(riov->iov_len, ruio->uio_resid);
+		n = pipe_min(n, wuio->uio_resid);
+		if (ruio->uio_segflg == UIO_SYSSPACE) {
+			dest = riov->iov_kbase;
+		}
+		else {
+			va = (vaddr_t)riov->iov_ubase;
+			result = as_translate(ruio->uio_space, va, true, &pa);
+			if (result) {
+				w->pw_result = result;
+				return 0;
+			}
+			n = pipe_min(n, PAGE_SIZE - (va & ~PAGE_FRAME));
+			dest = (void *)PADDR_TO_KVADDR(pa);
+		}
+
+		result = uiomove(dest, n, wuio);
+		if (result) {
+			return result;
+		}
+
+		if (ruio->uio_segflg == UIO_SYSSPACE) {
+			riov->iov_kbase = (char *)riov->iov_kbase + n;
+		}
+		else {
+			riov->iov_ubase += n;
+		}
+		riov->iov_len -= n;
+		ruio->uio_resid -= n;
+		ruio->uio_offset += n;
+	}
+	return 0;
+}
+
+static
+int
+pipe_read(struct vnode *v, struct uio *uio)
+{
+	struct pipe *pp = v->vn_data;
+	struct pipe_waiter w;
+	size_t n, resid0;
+	int result = 0;
+
+	if (v != &pp->pp_readvn) {
+		return EBADF;
+	}
+	KASSERT(uio->uio_rw == UIO_READ);
+
+	resid0 = uio->uio_resid;
+	if (resid0 == 0) {
+		return 0;
+	}
+
+	lock_acquire(pp->pp_lock);
+
+	while (pp->pp_count == 0) {
+		if (!pp->pp_writeopen) {
+			/* EOF */
+			goto out;
+		}
+		if (pp->pp_rnonblock) {
+			result = EAGAIN;
+			goto out;
+		}
+
+		w.pw_uio = uio;
+		w.pw_result = 0;
+		w.pw_done = false;
+		if (pp->pp_reader == NULL) {
+			pp->pp_reader = &w;
+		}
+		cv_wait(pp->pp_readcv, pp->pp_lock);
+		if (w.pw_done) {
+			result = w.pw_result;
+			goto out;
+		}
+		if (pp->pp_reader == &w) {
+			pp->pp_reader = NULL;
+		}
+	}
+
+	while (pp->pp_count > 0 && uio->uio_resid > 0) {
+		n = pipe_min(pp->pp_count, pp->pp_size - pp->pp_head);
+		n = pipe_min(n, uio->uio_resid);
+		result = uiomove(pp->pp_buf + pp->pp_head, n, uio);
+		if (result) {
+			break;
+		}
+		pp->pp_head = (pp->pp_head + n) % pp->pp_size;
+		pp->pp_count -= n;
+	}
+	if (pp->pp_count == 0) {
+		pp->pp_head = 0;
+	}
+	cv_broadcast(pp->pp_writecv, pp->pp_lock);
+	pollwakeup(&pp->pp_pollhead, POLLOUT | POLLWRNORM);
+
+ out:
+	lock_release(pp->pp_lock);
+
+	/* Report what got through, if anything did, rather than the error. */
+	if (result && uio->uio_resid < resid0) {
+		result = 0;
+	}
+	return result;
+}
+
+static
+int
+pipe_write(struct vnode *v, struct uio *uio)
+{
+	struct pipe *pp = v->vn_data;
+	struct pipe_waiter *w;
+	size_t n, space, tail, resid0, rresid0;
+	bool atomic;
+	int result = 0;
+
+	if (v != &pp->pp_writevn) {
+		return EBADF;
+	}
+	KASSERT(uio->uio_rw == UIO_WRITE);
+
+	resid0 = uio->uio_resid;
+	atomic = resid0 <= PIPE_BUF;
+
+	lock_acquire(pp->pp_lock);
+
+	while (uio->uio_resid > 0) {
+		if (!pp->pp_readopen) {
+			result = EPIPE;
+			break;
+		}
+
+		/*
+		 * A waiting reader gets the data directly, but only
+		 * while the ring is empty; otherwise it would get
+		 * ahead of what's already there.
+		 */
+		if (pp->pp_reader != NULL && pp->pp_count == 0) {
+			w = pp->pp_reader;
+			rresid0 = w->pw_uio->uio_resid;
+			result = pipe_directcopy(uio, w);
+			if (w->pw_uio->uio_resid == rresid0 &&
+			    w->pw_result == 0) {
+				/*
+				 * Our own buffer failed before anything
+				 * moved. Leave the reader waiting; waking
+				 * it with nothing would look like EOF.
+				 */
+				KASSERT(result != 0);
+				break;
+			}
+			pp->pp_reader = NULL;
+			w->pw_done = true;
+			cv_broadcast(pp->pp_readcv, pp->pp_lock);
+			if (result) {
+				break;
+			}
+			continue;
+		}
+
+		space = pp->pp_size - pp->pp_count;
+		if (space == 0 || (atomic && space < uio->uio_resid)) {
+			if (pp->pp_wnonblock) {
+				result = EAGAIN;
+				break;
+			}
+			cv_wait(pp->pp_writecv, pp->pp_lock);
+			continue;
+		}
+
+		tail = (pp->pp_head + pp->pp_count) % pp->pp_size;
+		n = pipe_min(space, pp->pp_size - tail);
+		n = pipe_min(n, uio->uio_resid);
+		result = uiomove(pp->pp_buf + tail, n, uio);
+		if (result) {
+			break;
+		}
+		pp->pp_count += n;
+		cv_broadcast(pp->pp_readcv, pp->pp_lock);
+		pollwakeup(&pp->pp_pollhead, POLLIN | POLLRDNORM);
+	}
+
+	lock_release(pp->pp_lock);
+
+	if (result && uio->uio_resid < resid0) {
+		result = 0;
+	}
+	return result;
+}
+
+/*
+ * Change the buffer size. The contents are moved to the front of
+ * the new buffer; there must be room for them.
+ */
+static
+int
+pipe_resize(struct pipe *pp, size_t size)
+{
+	char *buf;
+	size_t n;
+
+	if (size < PIPE_BUF || size > PIPE_MAXSIZE) {
+		return EINVAL;
+	}
+
+	buf = kmalloc(size);
+	if (buf == NULL) {
+		return ENOMEM;
+	}
+
+	lock_acquire(pp->pp_lock);
+	if (pp->pp_count > size) {
+		lock_release(pp->pp_lock);
+		kfree(buf);
+		return EBUSY;
+	}
+	n = pipe_min(pp->pp_count, pp->pp_size - pp->pp_head);
+	memcpy(buf, pp->pp_buf + pp->pp_head, n);
+	memcpy(buf + n, pp->pp_buf, pp->pp_count - n);
+	kfree(pp->pp_buf);
+	pp->pp_buf = buf;
+	pp->pp_size = size;
+	pp->pp_head = 0;
+	cv_broadcast(pp->pp_writecv, pp->pp_lock);
+	pollwakeup(&pp->pp_pollhead, POLLOUT | POLLWRNORM);
+	lock_release(pp->pp_lock);
+	return 0;
+}
+
+static
+int
+pipe_ioctl(struct vnode *v, int op, userptr_t data)
+{
+	struct pipe *pp = v->vn_data;
+	int val, result;
+
+	switch (op) {
+	    case FIONBIO:
+		result = copyin(data, &val, sizeof(val));
+		if (result) {
+			return result;
+		}
+		lock_acquire(pp->pp_lock);
+		if (v == &pp->pp_readvn) {
+			pp->pp_rnonblock = val != 0;
+		}
+		else {
+			pp->pp_wnonblock = val != 0;
+		}
+		lock_release(pp->pp_lock);
+		return 0;
+
+	    case FIONREAD:
+		lock_acquire(pp->pp_lock);
+		val = pp->pp_count;
+		lock_release(pp->pp_lock);
+		return copyout(&val, data, sizeof(val));
+
+	    case PIPEIOC_GETSIZE:
+		lock_acquire(pp->pp_lock);
+		val = pp->pp_size;
+		lock_release(pp->pp_lock);
+		return copyout(&val, data, sizeof(val));
+
+	    case PIPEIOC_SETSIZE:
+		result = copyin(data, &val, sizeof(val));
+		if (result) {
+			return result;
+		}
+		if (val < 0) {
+			return EINVAL;
+		}
+		return pipe_resize(pp, val);
+	}
+	return EIOCTL;
+}
+
+/*
+ * The read end is readable when there's data, and hung up when the
+ * write end is gone. The write end is writable when there's room
+ * for an atomic write, and in error when the read end is gone.
+ */
+static
+int
+pipe_poll(struct vnode *v, int events, struct pollent *pe, int *revents)
+{
+	struct pipe *pp = v->vn_data;
+	int ready = 0;
+
+	lock_acquire(pp->pp_lock);
+	if (pe != NULL) {
+		pollhead_add(&pp->pp_pollhead, pe);
+	}
+	if (v == &pp->pp_readvn) {
+		if (pp->pp_count > 0) {
+			ready |= POLLIN | POLLRDNORM;
+		}
+		if (!pp->pp_writeopen) {
+			ready |= POLLHUP;
+		}
+	}
+	else {
+		if (!pp->pp_readopen) {
+			ready |= POLLERR;
+		}
+		else if (pp->pp_size - pp->pp_count >= PIPE_BUF) {
+			ready |= POLLOUT | POLLWRNORM;
+		}
+	}
+	lock_release(pp->pp_lock);
+
+	*revents = ready & (events | POLLERR | POLLHUP);
+	return 0;
+}
+
+static
+int
+pipe_stat(struct vnode *v, struct stat *statbuf)
+{
+	struct pipe *pp = v->vn_data;
+
+	bzero(statbuf, sizeof(*statbuf));
+	statbuf->st_mode = S_IFIFO | 0600;
+	statbuf->st_nlink = 1;
+	statbuf->st_blksize = PIPE_BUF;
+
+	lock_acquire(pp->pp_lock);
+	statbuf->st_size = pp->pp_count;
+	lock_release(pp->pp_lock);
+	return 0;
+}
+
+static
+int
+pipe_gettype(struct vnode *v, mode_t *ret)
+{
+	(void)v;
+	*ret = S_IFIFO;
+	return 0;
+}
+
+static
+int
+pipe_tryseek(struct vnode *v, off_t pos)
+{
+	(void)v;
+	(void)pos;
+	return ESPIPE;
+}
+
+/*
+ * Nothing to do on close; the end goes away when reclaimed.
+ */
+static
+int
+pipe_close(struct vnode *v)
+{
+	(void)v;
+	return 0;
+}
+
+/*
+ * The last reference to one end is gone. Wake up whoever is waiting
+ * on the other end so they see EOF or EPIPE, and free the pipe once
+ * both ends are gone.
+ */
+static
+int
+pipe_reclaim(struct vnode *v)
+{
+	struct pipe *pp = v->vn_data;
+	bool dead;
+
+	lock_acquire(pp->pp_lock);
+	if (v == &pp->pp_readvn) {
+		pp->pp_readopen = false;
+		cv_broadcast(pp->pp_writecv, pp->pp_lock);
+		pollwakeup(&pp->pp_pollhead, POLLERR);
+	}
+	else {
+		pp->pp_writeopen = false;
+		cv_broadcast(pp->pp_readcv, pp->pp_lock);
+		pollwakeup(&pp->pp_pollhead, POLLHUP);
+	}
+	dead = !pp->pp_readopen && !pp->pp_writeopen;
+	lock_release(pp->pp_lock);
+
+	VOP_CLEANUP(v);
+	if (dead) {
+		pipe_destroy(pp);
+	}
+	return 0;
+}
+
+/*
+ * Operations that make no sense on a pipe.
+ */
+
+static
+int
+pipe_open(struct vnode *v, int flags)
+{
+	(void)v;
+	(void)flags;
+	return EINVAL;
+}
+
+static
+int
+pipe_notdir(struct vnode *v, struct uio *uio)
+{
+	(void)v;
+	(void)uio;
+	return ENOTDIR;
+}
+
+static
+int
+pipe_fsync(struct vnode *v)
+{
+	(void)v;
+	return EINVAL;
+}
+
+static
+int
+pipe_mmap(struct vnode *v)
+{
+	(void)v;
+	return ENODEV;
+}
+
+static
+int
+pipe_truncate(struct vnode *v, off_t len)
+{
+	(void)v;
+	(void)len;
+	return EINVAL;
+}
+
+static
+int
+pipe_namefile(struct vnode *v, struct uio *uio)
+{
+	(void)v;
+	(void)uio;
+	return EINVAL;
+}
+
+static
+int
+pipe_creat(struct vnode *v, const char *name, bool excl, mode_t mode,
+	   struct vnode **result)
+{
+	(void)v;
+	(void)name;
+	(void)excl;
+	(void)mode;
+	(void)result;
+	return ENOTDIR;
+}
+
+static
+int
+pipe_symlink(struct vnode *v, const char *contents, const char *name)
+{
+	(void)v;
+	(void)contents;
+	(void)name;
+	return ENOTDIR;
+}
+
+static
+int
+pipe_mkdir(struct vnode *v, const char *name, mode_t mode)
+{
+	(void)v;
+	(void)name;
+	(void)mode;
+	return ENOTDIR;
+}
+
+static
+int
+pipe_link(struct vnode *v, const char *name, struct vnode *file)
+{
+	(void)v;
+	(void)name;
+	(void)file;
+	return ENOTDIR;
+}
+
+static
+int
+pipe_nameop(struct vnode *v, const char *name)
+{
+	(void)v;
+	(void)name;
+	return ENOTDIR;
+}
+
+static
+int
+pipe_rename(struct vnode *v, const char *n1, struct vnode *v2, const char *n2)
+{
+	(void)v;
+	(void)n1;
+	(void)v2;
+	(void)n2;
+	return ENOTDIR;
+}
+
+static
+int
+pipe_lookup(struct vnode *v, char *pathname, struct vnode **result)
+{
+	(void)v;
+	(void)pathname;
+	(void)result;
+	return ENOTDIR;
+}
+
+static
+int
+pipe_lookparent(struct vnode *v, char *pathname, struct vnode **result,
+		char *namebuf, size_t buflen)
+{
+	(void)v;
+	(void)pathname;
+	(void)result;
+	(void)namebuf;
+	(void)buflen;
+	return ENOTDIR;
+}
+
+/*
+ * Function table for pipe vnodes.
+ */
+static const struct vnode_ops pipe_vnode_ops = {
+	VOP_MAGIC,
+
+	pipe_open,
+	pipe_close,
+	pipe_reclaim,
+	pipe_read,
+	pipe_notdir,  /* readlink */
+	pipe_notdir,  /* getdirentry */
+	pipe_write,
+	pipe_ioctl,
+	pipe_poll,
+	pipe_stat,
+	pipe_gettype,
+	pipe_tryseek,
+	pipe_fsync,
+	pipe_mmap,
+	pipe_truncate,
+	pipe_namefile,
+	pipe_creat,
+	pipe_symlink,
+	pipe_mkdir,
+	pipe_link,
+	pipe_nameop,  /* remove */
+	pipe_nameop,  /* rmdir */
+	pipe_rename,
+	pipe_lookup,
+	pipe_lookparent,
+};
+
+int
+pipe_create(size_t size, struct vnode **readvn, struct vnode **writevn)
+{
+	struct pipe *pp;
+	int result;
+
+	if (size == 0) {
+		size = PIPE_DEFSIZE;
+	}
+	if (size < PIPE_BUF || size > PIPE_MAXSIZE) {
+		return EINVAL;
+	}
+
+	pp = kmalloc(sizeof(*pp));
+	if (pp == NULL) {
+		return ENOMEM;
+	}
+	pp->pp_lock = lock_create("pipe");
+	pp->pp_readcv = cv_create("pipe read");
+	pp->pp_writecv = cv_create("pipe write");
+	pp->pp_buf = kmalloc(size);
+	if (pp->pp_lock == NULL || pp->pp_readcv == NULL ||
+	    pp->pp_writecv == NULL || pp->pp_buf == NULL) {
+		kfree(pp->pp_buf);
+		if (pp->pp_writecv != NULL) {
+			cv_destroy(pp->pp_writecv);
+		}
+		if (pp->pp_readcv != NULL) {
+			cv_destroy(pp->pp_readcv);
+		}
+		if (pp->pp_lock != NULL) {
+			lock_destroy(pp->pp_lock);
+		}
+		kfree(pp);
+		return ENOMEM;
+	}
+	pp->pp_size = size;
+	pp->pp_head = 0;
+	pp->pp_count = 0;
+	pp->pp_readopen = true;
+	pp->pp_writeopen = true;
+	pp->pp_rnonblock = false;
+	pp->pp_wnonblock = false;
+	pp->pp_reader = NULL;
+	pollhead_init(&pp->pp_pollhead);
+
+	result = VOP_INIT(&pp->pp_readvn, &pipe_vnode_ops, NULL, pp);
+	if (result) {
+		pipe_destroy(pp);
+		return result;
+	}
+	result = VOP_INIT(&pp->pp_writevn, &pipe_vnode_ops, NULL, pp);
+	if (result) {
+		VOP_CLEANUP(&pp->pp_readvn);
+		pipe_destroy(pp);
+		return result;
+	}
+
+	/* Hand the ends back open, as vfs_open would. */
+	VOP_INCOPEN(&pp->pp_readvn);
+	VOP_INCOPEN(&pp->pp_writevn);
+
+	*readvn = &pp->pp_readvn;
+	*writevn = &pp->pp_writevn;
+	return 0;
+}
@@ -0,0 +1,203 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Readiness notification. See <poll.h>.
+ */
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/poll.h>
+#include <lib.h>
+#include <wchan.h>
+#include <poll.h>
+
+void
+pollhead_init(struct pollhead *ph)
+{
+	spinlock_init(&ph->ph_lock);
+	ph->ph_entries = NULL;
+}
+
+void
+pollhead_cleanup(struct pollhead *ph)
+{
+	KASSERT(ph->ph_entries == NULL);
+	spinlock_cleanup(&ph->ph_lock);
+}
+
+void
+pollhead_add(struct pollhead *ph, struct pollent *pe)
+{
+	if (pe->pe_head != NULL) {
+		KASSERT(pe->pe_head == ph);
+		return;
+	}
+
+	spinlock_acquire(&ph->ph_lock);
+	pe->pe_head = ph;
+	pe->pe_next = ph->ph_entries;
+	pe->pe_prevp = &ph->ph_entries;
+	if (ph->ph_entries != NULL) {
+		ph->ph_entries->pe_prevp = &pe->pe_next;
+	}
+	ph->ph_entries = pe;
+	spinlock_release(&ph->ph_lock);
+}
+
+void
+pollwakeup(struct pollhead *ph, int events)
+{
+	struct pollent *pe;
+	struct poller *pl;
+
+	spinlock_acquire(&ph->ph_lock);
+	for (pe = ph->ph_entries; pe != NULL; pe = pe->pe_next) {
+		if ((pe->pe_events & events) == 0) {
+			continue;
+		}
+		pl = pe->pe_poller;
+		spinlock_acquire(&pl->pl_lock);
+		if (!pe->pe_fired) {
+			if (pl->pl_ready == NULL) {
+				wchan_wakeall(pl->pl_wchan);
+			}
+			pe->pe_fired = true;
+			pe->pe_readynext = pl->pl_ready;
+			pl->pl_ready = pe;
+		}
+		spinlock_release(&pl->pl_lock);
+	}
+	spinlock_release(&ph->ph_lock);
+}
+
+/*
+ * Callout function for poller_wait's timeout.
+ */
+static
+void
+poller_timeout(void *data)
+{
+	struct poller *pl = data;
+
+	spinlock_acquire(&pl->pl_lock);
+	pl->pl_timedout = true;
+	wchan_wakeall(pl->pl_wchan);
+	spinlock_release(&pl->pl_lock);
+}
+
+int
+poller_init(struct poller *pl)
+{
+	pl->pl_wchan = wchan_create("poll");
+	if (pl->pl_wchan == NULL) {
+		return ENOMEM;
+	}
+	spinlock_init(&pl->pl_lock);
+	pl->pl_ready = NULL;
+	pl->pl_timedout = false;
+	callout_init(&pl->pl_timeout, poller_timeout, pl);
+	return 0;
+}
+
+void
+poller_cleanup(struct poller *pl)
+{
+	KASSERT(!callout_pending(&pl->pl_timeout));
+	spinlock_cleanup(&pl->pl_lock);
+	wchan_destroy(pl->pl_wchan);
+}
+
+void
+pollent_init(struct pollent *pe, struct poller *pl, int events)
+{
+	pe->pe_poller = pl;
+	pe->pe_head = NULL;
+	pe->pe_next = NULL;
+	pe->pe_prevp = NULL;
+	pe->pe_readynext = NULL;
+	pe->pe_firednext = NULL;
+	pe->pe_events = events | POLLERR | POLLHUP;
+	pe->pe_fired = false;
+}
+
+void
+pollent_remove(struct pollent *pe)
+{
+	struct pollhead *ph = pe->pe_head;
+
+	if (ph == NULL) {
+		return;
+	}
+
+	spinlock_acquire(&ph->ph_lock);
+	*pe->pe_prevp = pe->pe_next;
+	if (pe->pe_next != NULL) {
+		pe->pe_next->pe_prevp = pe->pe_prevp;
+	}
+	spinlock_release(&ph->ph_lock);
+	pe->pe_head = NULL;
+}
+
+struct pollent *
+poller_wait(struct poller *pl, int ticks)
+{
+	struct pollent *pe, *fired;
+
+	spinlock_acquire(&pl->pl_lock);
+	pl->pl_timedout = ticks == 0;
+	if (ticks > 0 && pl->pl_ready == NULL) {
+		callout_schedule(&pl->pl_timeout, ticks);
+	}
+	while (pl->pl_ready == NULL && !pl->pl_timedout) {
+		wchan_lock(pl->pl_wchan);
+		spinlock_release(&pl->pl_lock);
+		wchan_sleep(pl->pl_wchan);
+		spinlock_acquire(&pl->pl_lock);
+	}
+
+	/*
+	 * Hand back what fired and rearm it. Once pe_fired is clear a
+	 * pollwakeup can put the entry back on pl_ready, which is why
+	 * the list we return is linked through pe_firednext instead.
+	 */
+	fired = NULL;
+	for (pe = pl->pl_ready; pe != NULL; pe = pe->pe_readynext) {
+		pe->pe_fired = false;
+		pe->pe_firednext = fired;
+		fired = pe;
+	}
+	pl->pl_ready = NULL;
+	spinlock_release(&pl->pl_lock);
+
+	/* Not under pl_lock: the callout may be waiting for it. */
+	if (ticks > 0) {
+		callout_cancel(&pl->pl_timeout);
+	}
+	return fired;
+}
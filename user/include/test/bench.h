@@ -0,0 +1,57 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _TEST_BENCH_H_
+#define _TEST_BENCH_H_
+
+/*
+ * Timing and bookkeeping shared by the benchmarks in testbin
+ * (libtest).
+ *
+ *     bench_start      - start the clock.
+ *     bench_elapsed    - microseconds since bench_start; at least 1,
+ *                        so it can be divided by.
+ *     bench_report     - print the time for N operations of some
+ *                        kind (UNIT, plural), per operation and per
+ *                        second.
+ *     bench_throughput - print the time to move BYTES bytes, and the
+ *                        rate.
+ *     bench_reap       - wait for child PID, and exit with an error
+ *                        unless it exited with status 0.
+ */
+
+#include <sys/types.h>
+
+void bench_start(void);
+long bench_elapsed(void);
+void bench_report(const char *what, unsigned n, const char *unit);
+void bench_throughput(const char *what, unsigned long bytes);
+void bench_reap(pid_t pid);
+
+#endif /* _TEST_BENCH_H_ */
@@ -38,10 +38,16 @@
  * about the kern/ headers.
  */
 #include <kern/fcntl.h>
+#include <kern/futex.h>
 #include <kern/ioctl.h>
+#include <kern/iovec.h>
+#include <kern/poll.h>
 #include <kern/reboot.h>
+#include <kern/ring.h>
 #include <kern/seek.h>
+#include <kern/select.h>
 #include <kern/time.h>
+#include <kern/resource.h>	/* needs struct timeval */
 #include <kern/unistd.h>
 #include <kern/wait.h>
 
@@ -64,6 +70,8 @@
  *     open:     fcntl.h or sys/fcntl.h
  *     reboot:   sys/reboot.h
  *     ioctl:    sys/ioctl.h
+ *     poll:     poll.h
+ *     select:   sys/select.h
  *     remove:   stdio.h
  *     rename:   stdio.h
  *     time:     time.h
@@ -151,8 +159,24 @@ int getdirentry(int filehandle, char *buf, size_t buflen);
 int symlink(const char *target, const char *linkname);
 int readlink(const char *path, char *buf, size_t buflen);
 int dup2(int filehandle, int newhandle);
+int pread(int filehandle, void *buf, size_t size, off_t pos);
+int pwrite(int filehandle, const void *buf, size_t size, off_t pos);
+int readv(int filehandle, const struct iovec *iov, int iovcnt);
+int writev(int filehandle, const struct iovec *iov, int iovcnt);
+int preadv(int filehandle, const struct iovec *iov, int iovcnt, off_t pos);
+int pwritev(int filehandle, const struct iovec *iov, int iovcnt, off_t pos);
 int pipe(int filehandles[2]);
+int poll(struct pollfd *fds, unsigned nfds, int timeout);
+int select(int nfds, fd_set *readfds, fd_set *writefds, fd_set *exceptfds,
+	   struct timeval *timeout);
 time_t __time(time_t *seconds, unsigned long *nanoseconds);
+int nanosleep(const struct timespec *req, struct timespec *rem);
+int futex(volatile int *uaddr, int op, int val);
+int getrusage(int who, struct rusage *usage);
+pid_t vfork(void);
+pid_t __spawn(const char *path, char *const *args);
+int ring_setup(struct ring *ring, unsigned entries);
+int ring_enter(unsigned count);
 int __getcwd(char *buf, size_t buflen);
 /* stat - see sys/stat.h */
 /* lstat - see sys/stat.h */
@@ -163,5 +187,7 @@ int __getcwd(char *buf, size_t buflen);
 
 char *getcwd(char *buf, size_t buflen);		/* calls __getcwd */
 time_t time(time_t *seconds);			/* calls __time */
+int clock_nanosleep(int clockid, int flags,	/* calls nanosleep */
+		    const struct timespec *req, struct timespec *rem);
 
 #endif /* _UNISTD_H_ */
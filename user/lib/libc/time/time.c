@@ -28,6 +28,7 @@
  */
 
 #include <unistd.h>
+#include <errno.h>
 
 /*
  * POSIX C function: retrieve time in seconds since the epoch.
@@ -40,3 +41,64 @@ time(time_t *t)
 {
 	return __time(t, NULL);
 }
+
+/*
+ * POSIX C function: sleep on a particular clock, either for an
+ * interval or until an absolute time. Uses the nanosleep system call;
+ * for an absolute time the interval is worked out from __time.
+ *
+ * Unlike most of libc, this returns the error number itself, or 0,
+ * and leaves errno alone.
+ */
+
+/*
+ * Call nanosleep, handing back its error number instead of setting
+ * errno.
+ */
+static
+int
+clock_sleep(const struct timespec *req, struct timespec *rem)
+{
+	int saved_errno, result;
+
+	saved_errno = errno;
+	if (nanosleep(req, rem) == 0) {
+		return 0;
+	}
+	result = errno;
+	errno = saved_errno;
+	return result;
+}
+
+int
+clock_nanosleep(int clockid, int flags, const struct timespec *req,
+		struct timespec *rem)
+{
+	struct timespec delta;
+	time_t secs;
+	unsigned long nsecs;
+
+	if (clockid != CLOCK_REALTIME && clockid != CLOCK_MONOTONIC) {
+		return EINVAL;
+	}
+	if ((flags & TIMER_ABSTIME) == 0) {
+		return clock_sleep(req, rem);
+	}
+
+	__time(&secs, &nsecs);
+	if (req->tv_sec < secs ||
+	    (req->tv_sec == secs && req->tv_nsec <= (long)nsecs)) {
+		/* Already past. */
+		return 0;
+	}
+	delta.tv_sec = req->tv_sec - secs;
+	if (req->tv_nsec < (long)nsecs) {
+		delta.tv_sec--;
+		delta.tv_nsec = req->tv_nsec + 1000000000 - nsecs;
+	}
+	else {
+		delta.tv_nsec = req->tv_nsec - nsecs;
+	}
+	/* rem is not meaningful for absolute sleeps */
+	return clock_sleep(&delta, NULL);
+}
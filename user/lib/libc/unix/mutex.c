@@ -0,0 +1,202 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Futex-based mutexes and condition variables. See mutex.h.
+ *
+ * The mutex is the three-state one from Drepper's "Futexes Are
+ * Tricky": 0 free, 1 held, 2 held and someone may be asleep. Unlock
+ * only calls into the kernel if the state was 2.
+ */
+
+#include <unistd.h>
+#include <errno.h>
+#include <mutex.h>
+
+/*
+ * Atomic operations, using LL/SC. Each returns the previous value.
+ * If the SC fails, someone else got in between; go around again.
+ */
+
+static
+int
+atomic_cas(volatile int *p, int oldval, int newval)
+{
+	int prev, tmp;
+
+	__asm volatile(
+		".set push;"		/* save assembler mode */
+		".set mips32;"		/* allow MIPS32 instructions */
+		".set noreorder;"	/* we fill the delay slots */
+		"1: ll %0, 0(%2);"	/*   prev = *p */
+		"bne %0, %3, 2f;"	/*   if (prev != oldval) done */
+		" move %1, %4;"		/*   tmp = newval (delay slot) */
+		"sc %1, 0(%2);"		/*   *p = tmp; tmp = success? */
+		"beqz %1, 1b;"		/*   retry on failure */
+		" nop;"
+		"2:"
+		".set pop"		/* restore assembler mode */
+		: "=&r" (prev), "=&r" (tmp)
+		: "r" (p), "r" (oldval), "r" (newval)
+		: "memory");
+	return prev;
+}
+
+static
+int
+atomic_swap(volatile int *p, int newval)
+{
+	int prev, tmp;
+
+	__asm volatile(
+		".set push;"
+		".set mips32;"
+		".set noreorder;"
+		"1: ll %0, 0(%2);"	/*   prev = *p */
+		"move %1, %3;"		/*   tmp = newval */
+		"sc %1, 0(%2);"		/*   *p = tmp; tmp = success? */
+		"beqz %1, 1b;"
+		" nop;"
+		".set pop"
+		: "=&r" (prev), "=&r" (tmp)
+		: "r" (p), "r" (newval)
+		: "memory");
+	return prev;
+}
+
+static
+int
+atomic_add(volatile int *p, int delta)
+{
+	int prev, tmp;
+
+	__asm volatile(
+		".set push;"
+		".set mips32;"
+		".set noreorder;"
+		"1: ll %0, 0(%2);"	/*   prev = *p */
+		"addu %1, %0, %3;"	/*   tmp = prev + delta */
+		"sc %1, 0(%2);"		/*   *p = tmp; tmp = success? */
+		"beqz %1, 1b;"
+		" nop;"
+		".set pop"
+		: "=&r" (prev), "=&r" (tmp)
+		: "r" (p), "r" (delta)
+		: "memory");
+	return prev;
+}
+
+void
+mutex_init(mutex_t *m)
+{
+	m->m_state = 0;
+}
+
+/*
+ * Slow path: mark the mutex contended and sleep until we get it.
+ * Whoever holds it will see the 2 and wake someone on unlock.
+ */
+static
+void
+mutex_lock_contended(mutex_t *m)
+{
+	while (atomic_swap(&m->m_state, 2) != 0) {
+		/* EAGAIN just means it changed first; look again. */
+		futex(&m->m_state, FUTEX_WAIT, 2);
+	}
+}
+
+void
+mutex_lock(mutex_t *m)
+{
+	if (atomic_cas(&m->m_state, 0, 1) == 0) {
+		return;
+	}
+	mutex_lock_contended(m);
+}
+
+int
+mutex_trylock(mutex_t *m)
+{
+	if (atomic_cas(&m->m_state, 0, 1) == 0) {
+		return 0;
+	}
+	errno = EBUSY;
+	return -1;
+}
+
+void
+mutex_unlock(mutex_t *m)
+{
+	if (atomic_add(&m->m_state, -1) != 1) {
+		/* There may be sleepers. */
+		m->m_state = 0;
+		futex(&m->m_state, FUTEX_WAKE, 1);
+	}
+}
+
+void
+cond_init(cond_t *c)
+{
+	c->c_seq = 0;
+}
+
+/*
+ * Sleep unless the sequence number moves between reading it and the
+ * kernel checking it; a signal in that window makes the wait return
+ * at once. Like any condition variable, callers must recheck their
+ * condition.
+ *
+ * We don't know whether others are waiting for the mutex when we
+ * wake, so take it in the contended state to be safe.
+ */
+void
+cond_wait(cond_t *c, mutex_t *m)
+{
+	int seq;
+
+	seq = c->c_seq;
+	mutex_unlock(m);
+	futex(&c->c_seq, FUTEX_WAIT, seq);
+	mutex_lock_contended(m);
+}
+
+void
+cond_signal(cond_t *c)
+{
+	atomic_add(&c->c_seq, 1);
+	futex(&c->c_seq, FUTEX_WAKE, 1);
+}
+
+void
+cond_broadcast(cond_t *c)
+{
+	atomic_add(&c->c_seq, 1);
+	futex(&c->c_seq, FUTEX_WAKE, 0x7fffffff);
+}
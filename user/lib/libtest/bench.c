@@ -0,0 +1,106 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Benchmark support; see <test/bench.h>.
+ *
+ * Rates are worked out in long long: long is 32 bits here, and a few
+ * thousand operations times a million overflows it.
+ */
+
+#include <stdio.h>
+#include <unistd.h>
+#include <err.h>
+#include <sys/wait.h>
+#include <test/bench.h>
+
+static time_t start_s;
+static unsigned long start_ns;
+
+void
+bench_start(void)
+{
+	__time(&start_s, &start_ns);
+}
+
+long
+bench_elapsed(void)
+{
+	time_t s;
+	unsigned long ns;
+	long us;
+
+	__time(&s, &ns);
+	us = (long)(s - start_s) * 1000000L +
+		((long)ns - (long)start_ns) / 1000;
+	return us > 0 ? us : 1;
+}
+
+void
+bench_report(const char *what, unsigned n, const char *unit)
+{
+	long us;
+
+	us = bench_elapsed();
+	if (n == 0) {
+		printf("%-24s no %s\n", what, unit);
+		return;
+	}
+	printf("%-24s %7u %-8s %9ld us %9ld ns each %8ld/s\n",
+	       what, n, unit, us,
+	       (long)(us * 1000LL / n),
+	       (long)(n * 1000000LL / us));
+}
+
+void
+bench_throughput(const char *what, unsigned long bytes)
+{
+	long us;
+
+	us = bench_elapsed();
+	printf("%-24s %7lu KB %9ld us %8ld KB/s\n",
+	       what, bytes / 1024, us,
+	       (long)((bytes / 1024) * 1000000LL / us));
+}
+
+void
+bench_reap(pid_t pid)
+{
+	int status;
+
+	if (waitpid(pid, &status, 0) != pid) {
+		err(1, "waitpid %d", pid);
+	}
+	if (!WIFEXITED(status)) {
+		errx(1, "pid %d: abnormal exit, status 0x%x", pid, status);
+	}
+	if (WEXITSTATUS(status) != 0) {
+		errx(1, "pid %d: exit status %d", pid, WEXITSTATUS(status));
+	}
+}
@@ -0,0 +1,212 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * argbench - cost of passing arguments through execv.
+ *
+ * Usage: argbench [count] [nargs]
+ *
+ * Execs itself count times (default 100) in a chain, each time with
+ * nargs (default 256) filler arguments of ARGLEN characters, checking
+ * at every step that the arguments came through intact. The last one
+ * reports the time per exec. Run it with nargs 0 too to see how much
+ * of that is the arguments.
+ *
+ * Before starting, checks that an argv past ARG_MAX fails with E2BIG
+ * and leaves us running.
+ *
+ * Internally the chain passes: argv[0] "-chain" left total start_s
+ * start_ns nargs filler...
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <errno.h>
+#include <err.h>
+
+#define DEFAULT_COUNT 100
+#define DEFAULT_NARGS 256
+#define ARGLEN 63
+#define NHEADER 7
+
+/* enough filler to go comfortably past ARG_MAX, for toobig() */
+#define MAXARGS (ARG_MAX / (ARGLEN + 1) + 16)
+
+static char *prog;
+static char fillers[MAXARGS][ARGLEN + 1];
+static char *args[NHEADER + MAXARGS + 1];
+
+/*
+ * Make filler argument i: ARGLEN characters that depend on i.
+ */
+static
+char *
+filler(int i)
+{
+	char *s;
+	int j;
+
+	s = fillers[i];
+	for (j=0; j<ARGLEN; j++) {
+		s[j] = 'a' + (i + j) % 26;
+	}
+	s[ARGLEN] = 0;
+	return s;
+}
+
+static
+void
+checkfiller(const char *s, int i)
+{
+	int j;
+
+	for (j=0; j<ARGLEN; j++) {
+		if (s[j] != 'a' + (i + j) % 26) {
+			errx(1, "filler argument %d is corrupt", i);
+		}
+	}
+	if (s[ARGLEN] != 0) {
+		errx(1, "filler argument %d has the wrong length", i);
+	}
+}
+
+static
+char **
+makeargv(int nargs)
+{
+	int i;
+
+	for (i=0; i<nargs; i++) {
+		args[NHEADER + i] = filler(i);
+	}
+	args[NHEADER + nargs] = NULL;
+	return args;
+}
+
+/*
+ * Exec the next link of the chain.
+ */
+static
+void
+chain(char **argv, int left, int total, time_t start_s,
+      unsigned long start_ns, int nargs)
+{
+	char buf[5][16];
+
+	snprintf(buf[0], sizeof(buf[0]), "%d", left);
+	snprintf(buf[1], sizeof(buf[1]), "%d", total);
+	snprintf(buf[2], sizeof(buf[2]), "%d", (int)start_s);
+	snprintf(buf[3], sizeof(buf[3]), "%d", (int)start_ns);
+	snprintf(buf[4], sizeof(buf[4]), "%d", nargs);
+	argv[0] = prog;
+	argv[1] = (char *)"-chain";
+	argv[2] = buf[0];
+	argv[3] = buf[1];
+	argv[4] = buf[2];
+	argv[5] = buf[3];
+	argv[6] = buf[4];
+	execv(prog, argv);
+	err(1, "execv");
+}
+
+static
+void
+toobig(void)
+{
+	char **argv;
+	int nargs, i;
+
+	/* comfortably more than ARG_MAX, counting the pointers */
+	nargs = MAXARGS;
+	argv = makeargv(nargs);
+	for (i=0; i<NHEADER; i++) {
+		argv[i] = (char *)"x";
+	}
+	if (execv(prog, argv) != -1 || errno != E2BIG) {
+		errx(1, "execv with %d bytes of arguments didn't fail with "
+		     "E2BIG", nargs * (ARGLEN + 1));
+	}
+}
+
+int
+main(int argc, char *argv[])
+{
+	time_t start_s, now_s;
+	unsigned long start_ns, now_ns;
+	int count, nargs, left, i;
+	long us;
+
+	prog = argv[0];
+
+	if (argc >= NHEADER && !strcmp(argv[1], "-chain")) {
+		left = atoi(argv[2]);
+		count = atoi(argv[3]);
+		start_s = atoi(argv[4]);
+		start_ns = atoi(argv[5]);
+		nargs = atoi(argv[6]);
+		if (argc != NHEADER + nargs) {
+			errx(1, "expected %d arguments, got %d",
+			     NHEADER + nargs, argc);
+		}
+		for (i=0; i<nargs; i++) {
+			checkfiller(argv[NHEADER + i], i);
+		}
+		if (argv[argc] != NULL) {
+			errx(1, "argv isn't NULL-terminated");
+		}
+		if (left > 0) {
+			chain(argv, left - 1, count, start_s, start_ns, nargs);
+		}
+
+		__time(&now_s, &now_ns);
+		us = (long)(now_s - start_s) * 1000000L +
+			((long)now_ns - (long)start_ns) / 1000;
+		printf("argbench: %d args of %d bytes: %ld us per exec\n",
+		       nargs, ARGLEN + 1, us / count);
+		return 0;
+	}
+
+	count = argc > 1 ? atoi(argv[1]) : DEFAULT_COUNT;
+	nargs = argc > 2 ? atoi(argv[2]) : DEFAULT_NARGS;
+	if (count <= 0 || nargs < 0) {
+		errx(1, "Usage: argbench [count] [nargs]");
+	}
+	if (nargs > MAXARGS) {
+		errx(1, "At most %d arguments", MAXARGS);
+	}
+
+	toobig();
+
+	__time(&start_s, &start_ns);
+	chain(makeargv(nargs), count - 1, count, start_s, start_ns, nargs);
+	return 1;
+}
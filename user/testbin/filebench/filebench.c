@@ -0,0 +1,271 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * filebench - file system call throughput.
+ *
+ * Usage: filebench [kbytes]
+ *
+ * Writes a file of kbytes (default 256) sequentially, for each of a
+ * few chunk sizes, then reads it back and checks it, reporting KB/s
+ * both ways. Then forks a child that shares the descriptor, so the
+ * two of them append through one seek position, and checks that no
+ * chunk was lost or overwritten. Finally checks the error returns of
+ * the descriptor calls.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <err.h>
+#include <test/bench.h>
+
+#define FILENAME "filebench.tmp"
+#define DEFAULT_KB 256
+#define MAXCHUNK 8192
+
+static char buf[MAXCHUNK];
+
+/*
+ * Fill buf with the pattern for chunk number n.
+ */
+static
+void
+fill(size_t chunk, unsigned n)
+{
+	size_t i;
+
+	for (i=0; i<chunk; i++) {
+		buf[i] = (char)(n * 7 + i);
+	}
+}
+
+static
+void
+check(size_t chunk, unsigned n)
+{
+	size_t i;
+
+	for (i=0; i<chunk; i++) {
+		if (buf[i] != (char)(n * 7 + i)) {
+			errx(1, "chunk %u is corrupt at byte %lu", n,
+			     (unsigned long)i);
+		}
+	}
+}
+
+static
+void
+sequential(size_t chunk, size_t bytes)
+{
+	char what[32];
+	unsigned n, nchunks;
+	int fd, r;
+
+	nchunks = bytes / chunk;
+
+	fd = open(FILENAME, O_WRONLY|O_CREAT|O_TRUNC, 0664);
+	if (fd < 0) {
+		err(1, "%s: open for write", FILENAME);
+	}
+	bench_start();
+	for (n=0; n<nchunks; n++) {
+		fill(chunk, n);
+		r = write(fd, buf, chunk);
+		if (r < 0) {
+			err(1, "%s: write", FILENAME);
+		}
+		if ((size_t)r != chunk) {
+			errx(1, "%s: short write (%d)", FILENAME, r);
+		}
+	}
+	if (fsync(fd) < 0) {
+		err(1, "%s: fsync", FILENAME);
+	}
+	snprintf(what, sizeof(what), "write, %lu-byte chunks",
+		 (unsigned long)chunk);
+	bench_throughput(what, bytes);
+	close(fd);
+
+	fd = open(FILENAME, O_RDONLY);
+	if (fd < 0) {
+		err(1, "%s: open for read", FILENAME);
+	}
+	bench_start();
+	for (n=0; n<nchunks; n++) {
+		r = read(fd, buf, chunk);
+		if (r < 0) {
+			err(1, "%s: read", FILENAME);
+		}
+		if ((size_t)r != chunk) {
+			errx(1, "%s: short read (%d)", FILENAME, r);
+		}
+		check(chunk, n);
+	}
+	snprintf(what, sizeof(what), "read, %lu-byte chunks",
+		 (unsigned long)chunk);
+	bench_throughput(what, bytes);
+	if (read(fd, buf, chunk) != 0) {
+		errx(1, "%s: no EOF at end of file", FILENAME);
+	}
+	close(fd);
+}
+
+/*
+ * Parent and child write alternate-numbered chunks through one shared
+ * descriptor. Each chunk must turn up exactly once.
+ */
+static
+void
+shared(size_t bytes)
+{
+	const size_t chunk = 512;
+	unsigned n, nchunks, seen0, seen1;
+	pid_t pid;
+	int fd, r;
+
+	nchunks = bytes / chunk;
+
+	fd = open(FILENAME, O_RDWR|O_CREAT|O_TRUNC, 0664);
+	if (fd < 0) {
+		err(1, "%s: open", FILENAME);
+	}
+
+	pid = fork();
+	if (pid < 0) {
+		err(1, "fork");
+	}
+	for (n = (pid == 0); n < nchunks; n += 2) {
+		fill(chunk, n);
+		buf[0] = pid == 0;
+		r = write(fd, buf, chunk);
+		if (r != (int)chunk) {
+			err(1, "shared write");
+		}
+	}
+	if (pid == 0) {
+		_exit(0);
+	}
+	bench_reap(pid);
+
+	if (lseek(fd, 0, SEEK_END) != (off_t)(nchunks * chunk)) {
+		errx(1, "shared file is the wrong size; writes overlapped");
+	}
+	if (lseek(fd, 0, SEEK_SET) != 0) {
+		err(1, "lseek");
+	}
+	seen0 = seen1 = 0;
+	for (n=0; n<nchunks; n++) {
+		if (read(fd, buf, chunk) != (int)chunk) {
+			err(1, "shared read");
+		}
+		if (buf[0]) {
+			seen1++;
+		}
+		else {
+			seen0++;
+		}
+	}
+	if (seen0 != (nchunks + 1) / 2 || seen1 != nchunks / 2) {
+		errx(1, "shared file has %u parent and %u child chunks",
+		     seen0, seen1);
+	}
+	close(fd);
+	printf("shared descriptor: %u chunks from 2 processes, ok\n",
+	       nchunks);
+}
+
+static
+void
+errors(void)
+{
+	int fd;
+
+	if (read(-1, buf, 1) != -1 || errno != EBADF) {
+		errx(1, "read(-1) didn't fail with EBADF");
+	}
+	if (write(OPEN_MAX, buf, 1) != -1 || errno != EBADF) {
+		errx(1, "write(OPEN_MAX) didn't fail with EBADF");
+	}
+	if (close(OPEN_MAX - 1) != -1 || errno != EBADF) {
+		errx(1, "close of an unused fd didn't fail with EBADF");
+	}
+	if (lseek(STDOUT_FILENO, 0, SEEK_SET) != -1 || errno != ESPIPE) {
+		errx(1, "lseek on the console didn't fail with ESPIPE");
+	}
+
+	fd = open(FILENAME, O_RDONLY);
+	if (fd < 0) {
+		err(1, "%s: open", FILENAME);
+	}
+	if (write(fd, buf, 1) != -1 || errno != EBADF) {
+		errx(1, "write to a read-only fd didn't fail with EBADF");
+	}
+	if (lseek(fd, -1, SEEK_SET) != -1 || errno != EINVAL) {
+		errx(1, "lseek to -1 didn't fail with EINVAL");
+	}
+	if (lseek(fd, 0, 42) != -1 || errno != EINVAL) {
+		errx(1, "lseek with a bad whence didn't fail with EINVAL");
+	}
+	if (dup2(fd, OPEN_MAX - 1) != OPEN_MAX - 1) {
+		err(1, "dup2");
+	}
+	if (close(fd) < 0 || close(OPEN_MAX - 1) < 0) {
+		err(1, "close");
+	}
+	if (dup2(fd, 10) != -1 || errno != EBADF) {
+		errx(1, "dup2 of a closed fd didn't fail with EBADF");
+	}
+	printf("error checks ok\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+	static const size_t chunks[] = { 64, 512, 4096, MAXCHUNK };
+	size_t bytes;
+	unsigned i;
+
+	bytes = (argc > 1 ? atoi(argv[1]) : DEFAULT_KB) * 1024;
+	if (bytes < MAXCHUNK) {
+		errx(1, "Usage: filebench [kbytes]");
+	}
+
+	for (i=0; i<sizeof(chunks)/sizeof(chunks[0]); i++) {
+		sequential(chunks[i], bytes);
+	}
+	shared(bytes);
+	errors();
+
+	remove(FILENAME);
+	return 0;
+}
@@ -0,0 +1,202 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * forkbench - process creation and reaping throughput.
+ *
+ * Usage: forkbench [count]
+ *
+ * Forks count children (default 4000), each of which exits at once,
+ * in two patterns:
+ *   serial: fork one child and wait for it, over and over.
+ *   wide:   fork WIDTH children, then wait for them newest first, so
+ *           each waitpid has to find its child among many.
+ *   any:    fork WIDTH children, then reap them with waitpid(-1) in
+ *           whatever order they exit.
+ *
+ * Along the way, checks that a reaped child's pid can't be waited for
+ * again, that a just-freed pid isn't handed straight back out, and
+ * that WNOHANG and waitpid(-1) behave.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <err.h>
+#include <test/bench.h>
+
+#define DEFAULT_COUNT 4000
+#define WIDTH 200
+
+static
+pid_t
+spawn(void)
+{
+	pid_t pid;
+
+	pid = fork();
+	if (pid < 0) {
+		err(1, "fork");
+	}
+	if (pid == 0) {
+		_exit(0);
+	}
+	return pid;
+}
+
+static
+void
+serial(int count)
+{
+	pid_t pid, lastpid;
+	int i, status;
+
+	lastpid = -1;
+	bench_start();
+	for (i=0; i<count; i++) {
+		pid = spawn();
+		bench_reap(pid);
+		if (pid == lastpid) {
+			errx(1, "pid %d reused immediately", pid);
+		}
+		lastpid = pid;
+	}
+	bench_report("serial", count, "forks");
+
+	if (waitpid(lastpid, &status, 0) != -1 || errno != ESRCH) {
+		errx(1, "waitpid on reaped pid %d didn't fail with ESRCH",
+		     lastpid);
+	}
+	if (waitpid(-1, &status, 0) != -1 || errno != ECHILD) {
+		errx(1, "waitpid(-1) with no children didn't fail with ECHILD");
+	}
+}
+
+static
+void
+wide(int count)
+{
+	static pid_t pids[WIDTH];
+	int done, n, i;
+
+	bench_start();
+	for (done = 0; done < count; done += n) {
+		n = count - done < WIDTH ? count - done : WIDTH;
+		for (i=0; i<n; i++) {
+			pids[i] = spawn();
+		}
+		for (i=n-1; i>=0; i--) {
+			bench_reap(pids[i]);
+		}
+	}
+	bench_report("wide", count, "forks");
+}
+
+static
+void
+any(int count)
+{
+	int done, n, i, status;
+	pid_t pid;
+
+	bench_start();
+	for (done = 0; done < count; done += n) {
+		n = count - done < WIDTH ? count - done : WIDTH;
+		for (i=0; i<n; i++) {
+			spawn();
+		}
+		for (i=0; i<n; i++) {
+			pid = waitpid(-1, &status, 0);
+			if (pid < 0) {
+				err(1, "waitpid(-1)");
+			}
+			if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+				errx(1, "pid %d: bad exit status 0x%x",
+				     pid, status);
+			}
+		}
+	}
+	bench_report("any", count, "forks");
+}
+
+/*
+ * WNOHANG on a child that can't have exited yet returns 0; once it
+ * has, the same call reaps it.
+ */
+static
+void
+nohang(void)
+{
+	struct timespec ts;
+	int status;
+	pid_t pid, ret;
+
+	pid = fork();
+	if (pid < 0) {
+		err(1, "fork");
+	}
+	if (pid == 0) {
+		/* stay around for a while */
+		ts.tv_sec = 1;
+		ts.tv_nsec = 0;
+		nanosleep(&ts, NULL);
+		_exit(3);
+	}
+	ret = waitpid(pid, &status, WNOHANG);
+	if (ret != 0) {
+		errx(1, "WNOHANG on a running child returned %d", ret);
+	}
+	do {
+		ret = waitpid(pid, &status, WNOHANG);
+	} while (ret == 0);
+	if (ret != pid || !WIFEXITED(status) || WEXITSTATUS(status) != 3) {
+		errx(1, "WNOHANG reap of pid %d returned %d status 0x%x",
+		     pid, ret, status);
+	}
+}
+
+int
+main(int argc, char *argv[])
+{
+	int count;
+
+	count = argc > 1 ? atoi(argv[1]) : DEFAULT_COUNT;
+	if (count <= 0) {
+		errx(1, "Usage: forkbench [count]");
+	}
+
+	nohang();
+	serial(count);
+	wide(count);
+	any(count);
+
+	printf("forkbench done\n");
+	return 0;
+}
@@ -0,0 +1,125 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * futexbench - cost of the futex-based mutex and condvar paths.
+ *
+ * Times the uncontended mutex (which should never enter the kernel)
+ * against a null system call, then the kernel side of the slow paths:
+ * FUTEX_WAKE with nobody waiting and FUTEX_WAIT on a value that has
+ * already changed. Also checks the mutex states and error returns.
+ *
+ * OS/161 processes don't share memory and there are no user threads
+ * yet, so two waiters can't actually contend for one futex here; the
+ * per-operation costs below are what a contended lock would pay on
+ * top of the uncontended path.
+ */
+
+#include <stdio.h>
+#include <unistd.h>
+#include <errno.h>
+#include <err.h>
+#include <mutex.h>
+#include <test/bench.h>
+
+#define NLOOPS 20000
+
+int
+main(void)
+{
+	mutex_t m = MUTEX_INITIALIZER;
+	cond_t c = COND_INITIALIZER;
+	volatile int word = 0;
+	int i, r;
+
+	/* Sanity checks */
+	mutex_lock(&m);
+	if (m.m_state != 1) {
+		errx(1, "locked mutex has state %d", m.m_state);
+	}
+	if (mutex_trylock(&m) != -1 || errno != EBUSY) {
+		errx(1, "trylock of held mutex succeeded");
+	}
+	mutex_unlock(&m);
+	if (m.m_state != 0) {
+		errx(1, "unlocked mutex has state %d", m.m_state);
+	}
+	if (futex(&word, FUTEX_WAIT, 1) != -1 || errno != EAGAIN) {
+		errx(1, "FUTEX_WAIT on changed value didn't fail with EAGAIN");
+	}
+	r = futex(&word, FUTEX_WAKE, 1);
+	if (r != 0) {
+		errx(1, "FUTEX_WAKE with no waiters woke %d", r);
+	}
+	if (futex((volatile int *)((char *)&word + 1), FUTEX_WAKE, 1) != -1
+	    || errno != EINVAL) {
+		errx(1, "misaligned futex didn't fail with EINVAL");
+	}
+
+	bench_start();
+	for (i=0; i<NLOOPS; i++) {
+		mutex_lock(&m);
+		mutex_unlock(&m);
+	}
+	bench_report("mutex lock+unlock", NLOOPS, "ops");
+
+	bench_start();
+	for (i=0; i<NLOOPS; i++) {
+		mutex_trylock(&m);
+		mutex_unlock(&m);
+	}
+	bench_report("mutex trylock+unlock", NLOOPS, "ops");
+
+	bench_start();
+	for (i=0; i<NLOOPS; i++) {
+		cond_signal(&c);
+	}
+	bench_report("cond_signal, no waiters", NLOOPS, "ops");
+
+	bench_start();
+	for (i=0; i<NLOOPS; i++) {
+		getpid();
+	}
+	bench_report("getpid (null syscall)", NLOOPS, "ops");
+
+	bench_start();
+	for (i=0; i<NLOOPS; i++) {
+		futex(&word, FUTEX_WAKE, 1);
+	}
+	bench_report("FUTEX_WAKE, no waiters", NLOOPS, "ops");
+
+	bench_start();
+	for (i=0; i<NLOOPS; i++) {
+		futex(&word, FUTEX_WAIT, 1);
+	}
+	bench_report("FUTEX_WAIT, value changed", NLOOPS, "ops");
+
+	printf("futexbench done.\n");
+	return 0;
+}
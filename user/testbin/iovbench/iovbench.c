@@ -0,0 +1,301 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * iovbench - vectored and positional I/O.
+ *
+ * Usage: iovbench [nrecords]
+ *
+ * Writes nrecords (default 2048) records, each a 16-byte header and a
+ * 240-byte payload, three ways: a write for the header and another
+ * for the payload, one writev per record, and one writev per batch of
+ * records. Prints the system calls made and the throughput for each,
+ * then reads the file back with preadv and checks it.
+ *
+ * Also checks pread/pwrite (which must not move the seek position)
+ * and the error returns of the vectored calls.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <err.h>
+#include <test/bench.h>
+#include <sys/uio.h>
+
+#define FILENAME "iovbench.tmp"
+#define DEFAULT_NRECS 2048
+#define HDRSIZE 16
+#define PAYSIZE 240
+#define RECSIZE (HDRSIZE + PAYSIZE)
+#define BATCH 32
+
+struct rec {
+	char hdr[HDRSIZE];
+	char pay[PAYSIZE];
+};
+
+static struct rec recs[BATCH];
+static struct iovec iov[2 * BATCH];
+
+/*
+ * Report a run of NCALLS system calls that moved NRECS records.
+ */
+static
+void
+report(const char *what, unsigned ncalls, unsigned nrecs)
+{
+	char label[48];
+
+	snprintf(label, sizeof(label), "%s, %u calls", what, ncalls);
+	bench_throughput(label, (unsigned long)nrecs * RECSIZE);
+}
+
+/*
+ * Fill in record n in slot i of recs.
+ */
+static
+void
+makerec(unsigned i, unsigned n)
+{
+	unsigned j;
+
+	snprintf(recs[i].hdr, HDRSIZE, "rec %10u", n);
+	for (j=0; j<PAYSIZE; j++) {
+		recs[i].pay[j] = (char)(n + j);
+	}
+}
+
+static
+void
+checkrec(unsigned i, unsigned n)
+{
+	char hdr[HDRSIZE];
+	unsigned j;
+
+	snprintf(hdr, HDRSIZE, "rec %10u", n);
+	for (j=0; j<HDRSIZE; j++) {
+		if (recs[i].hdr[j] != hdr[j]) {
+			errx(1, "record %u: bad header", n);
+		}
+	}
+	for (j=0; j<PAYSIZE; j++) {
+		if (recs[i].pay[j] != (char)(n + j)) {
+			errx(1, "record %u: bad payload", n);
+		}
+	}
+}
+
+static
+int
+openfile(void)
+{
+	int fd;
+
+	fd = open(FILENAME, O_RDWR|O_CREAT|O_TRUNC, 0664);
+	if (fd < 0) {
+		err(1, "%s", FILENAME);
+	}
+	return fd;
+}
+
+static
+void
+xwrite(int r, size_t expected)
+{
+	if (r < 0) {
+		err(1, "%s: write", FILENAME);
+	}
+	if ((size_t)r != expected) {
+		errx(1, "%s: short write (%d of %lu)", FILENAME, r,
+		     (unsigned long)expected);
+	}
+}
+
+static
+void
+twowrites(unsigned nrecs)
+{
+	unsigned n;
+	int fd;
+
+	fd = openfile();
+	bench_start();
+	for (n=0; n<nrecs; n++) {
+		makerec(0, n);
+		xwrite(write(fd, recs[0].hdr, HDRSIZE), HDRSIZE);
+		xwrite(write(fd, recs[0].pay, PAYSIZE), PAYSIZE);
+	}
+	report("write hdr + payload", 2 * nrecs, nrecs);
+	close(fd);
+}
+
+static
+void
+writevs(unsigned nrecs, unsigned batch)
+{
+	unsigned n, i, ncalls;
+	int fd;
+
+	fd = openfile();
+	ncalls = 0;
+	bench_start();
+	for (n=0; n<nrecs; n += batch) {
+		for (i=0; i<batch; i++) {
+			makerec(i, n + i);
+			iov[2*i].iov_base = recs[i].hdr;
+			iov[2*i].iov_len = HDRSIZE;
+			iov[2*i+1].iov_base = recs[i].pay;
+			iov[2*i+1].iov_len = PAYSIZE;
+		}
+		xwrite(writev(fd, iov, 2 * batch), batch * RECSIZE);
+		ncalls++;
+	}
+	report(batch == 1 ? "writev per record" : "writev per batch",
+	       ncalls, nrecs);
+	close(fd);
+}
+
+/*
+ * Read the file back a batch at a time with preadv, from the end
+ * backwards, so every read is at an explicit position.
+ */
+static
+void
+readback(unsigned nrecs)
+{
+	unsigned n, i, ncalls;
+	int fd, r;
+
+	fd = open(FILENAME, O_RDONLY);
+	if (fd < 0) {
+		err(1, "%s", FILENAME);
+	}
+	for (i=0; i<BATCH; i++) {
+		iov[2*i].iov_base = recs[i].hdr;
+		iov[2*i].iov_len = HDRSIZE;
+		iov[2*i+1].iov_base = recs[i].pay;
+		iov[2*i+1].iov_len = PAYSIZE;
+	}
+	ncalls = 0;
+	bench_start();
+	for (n = nrecs; n > 0; n -= BATCH) {
+		r = preadv(fd, iov, 2 * BATCH,
+			   (off_t)(n - BATCH) * RECSIZE);
+		if (r != BATCH * RECSIZE) {
+			err(1, "%s: preadv", FILENAME);
+		}
+		for (i=0; i<BATCH; i++) {
+			checkrec(i, n - BATCH + i);
+		}
+		ncalls++;
+	}
+	report("preadv per batch", ncalls, nrecs);
+
+	if (lseek(fd, 0, SEEK_CUR) != 0) {
+		errx(1, "preadv moved the seek position");
+	}
+	close(fd);
+}
+
+static
+void
+positional(void)
+{
+	char c;
+	int fd;
+
+	fd = open(FILENAME, O_RDWR);
+	if (fd < 0) {
+		err(1, "%s", FILENAME);
+	}
+	if (lseek(fd, 5, SEEK_SET) != 5) {
+		err(1, "lseek");
+	}
+	c = 'Z';
+	if (pwrite(fd, &c, 1, RECSIZE) != 1) {
+		err(1, "pwrite");
+	}
+	c = 0;
+	if (pread(fd, &c, 1, RECSIZE) != 1 || c != 'Z') {
+		errx(1, "pread didn't see what pwrite wrote");
+	}
+	if (lseek(fd, 0, SEEK_CUR) != 5) {
+		errx(1, "pread/pwrite moved the seek position");
+	}
+	if (pread(fd, &c, 1, -1) != -1 || errno != EINVAL) {
+		errx(1, "pread at -1 didn't fail with EINVAL");
+	}
+	if (pread(STDIN_FILENO, &c, 1, 0) != -1 || errno != ESPIPE) {
+		errx(1, "pread on the console didn't fail with ESPIPE");
+	}
+
+	if (readv(fd, iov, 0) != -1 || errno != EINVAL) {
+		errx(1, "readv of 0 iovecs didn't fail with EINVAL");
+	}
+	if (readv(fd, iov, IOV_MAX + 1) != -1 || errno != EINVAL) {
+		errx(1, "readv of IOV_MAX+1 iovecs didn't fail with EINVAL");
+	}
+	if (readv(fd, (struct iovec *)0x40000000, 1) != -1 ||
+	    errno != EFAULT) {
+		errx(1, "readv with a bad iovec pointer didn't fail "
+		     "with EFAULT");
+	}
+	iov[0].iov_base = (void *)0x80000000;
+	iov[0].iov_len = 1;
+	if (writev(fd, iov, 1) != -1 || errno != EFAULT) {
+		errx(1, "writev from kernel memory didn't fail with EFAULT");
+	}
+	close(fd);
+	printf("positional and error checks ok\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+	unsigned nrecs;
+
+	nrecs = argc > 1 ? atoi(argv[1]) : DEFAULT_NRECS;
+	if (nrecs == 0 || nrecs % BATCH != 0) {
+		errx(1, "Usage: iovbench [nrecords], a multiple of %d",
+		     BATCH);
+	}
+
+	twowrites(nrecs);
+	writevs(nrecs, 1);
+	writevs(nrecs, BATCH);
+	readback(nrecs);
+	positional();
+
+	remove(FILENAME);
+	return 0;
+}
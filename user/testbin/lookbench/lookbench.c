@@ -0,0 +1,167 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * lookbench - pathname lookup speed.
+ *
+ * Usage: lookbench [count]
+ *
+ * Creates NFILES files in the current directory, then times count
+ * (default 2000) opens of them in turn, count opens of names that
+ * don't exist, and count/20 runs of a program from /testbin (this
+ * one, which exits at once when given -x). Each of those is mostly
+ * pathname lookup, which the name cache should make cheap for names
+ * in the same directory looked up over and over, including names
+ * that aren't there.
+ *
+ * Only SFS uses the name cache, so run this with the current
+ * directory on an SFS volume; the exec times only benefit if /testbin
+ * is on one too.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <err.h>
+#include <test/bench.h>
+
+#define DEFAULT_COUNT 2000
+#define NFILES 32
+#define PROG "/testbin/lookbench"
+
+static
+void
+mkname(char *buf, size_t len, const char *prefix, int n)
+{
+	snprintf(buf, len, "%s.%d", prefix, n);
+}
+
+static
+void
+makefiles(void)
+{
+	char name[32];
+	int i, fd;
+
+	for (i=0; i<NFILES; i++) {
+		mkname(name, sizeof(name), "lookbench", i);
+		fd = open(name, O_WRONLY|O_CREAT|O_TRUNC, 0664);
+		if (fd < 0) {
+			err(1, "%s: open", name);
+		}
+		close(fd);
+	}
+}
+
+static
+void
+run_open(int count)
+{
+	char name[32];
+	int i, fd;
+
+	bench_start();
+	for (i=0; i<count; i++) {
+		mkname(name, sizeof(name), "lookbench", i % NFILES);
+		fd = open(name, O_RDONLY);
+		if (fd < 0) {
+			err(1, "%s: open", name);
+		}
+		close(fd);
+	}
+	bench_report("open", count, "opens");
+}
+
+static
+void
+run_missing(int count)
+{
+	char name[32];
+	int i;
+
+	bench_start();
+	for (i=0; i<count; i++) {
+		mkname(name, sizeof(name), "lookbench-none", i % NFILES);
+		if (open(name, O_RDONLY) >= 0) {
+			errx(1, "%s: exists", name);
+		}
+		if (errno != ENOENT) {
+			err(1, "%s: open", name);
+		}
+	}
+	bench_report("open, missing", count, "opens");
+}
+
+static
+void
+run_exec(int count)
+{
+	char *args[3] = { (char *)"lookbench", (char *)"-x", NULL };
+	pid_t pid;
+	int i;
+
+	bench_start();
+	for (i=0; i<count; i++) {
+		pid = vfork();
+		if (pid < 0) {
+			err(1, "vfork");
+		}
+		if (pid == 0) {
+			/* only exec or exit here; we're in our parent's memory */
+			execv(PROG, args);
+			_exit(1);
+		}
+		bench_reap(pid);
+	}
+	bench_report("vfork+execv", count, "runs");
+}
+
+int
+main(int argc, char *argv[])
+{
+	int count;
+
+	if (argc == 2 && !strcmp(argv[1], "-x")) {
+		return 0;
+	}
+
+	count = argc > 1 ? atoi(argv[1]) : DEFAULT_COUNT;
+	if (count < 20) {
+		errx(1, "Usage: lookbench [count (20 or more)]");
+	}
+
+	makefiles();
+	run_open(count);
+	run_missing(count);
+	run_exec(count / 20);
+	return 0;
+}
@@ -0,0 +1,205 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * parread - parallel file reads.
+ *
+ * Usage: parread [nprocs] [kbytes]
+ *
+ * Creates nprocs files of kbytes each (defaults 4 and 128), then for
+ * 1, 2, 4, ... up to nprocs processes times them all reading at once,
+ * first each its own file and then all the same file, and reports
+ * the aggregate KB/s. Separate files only contend on the disk and
+ * the buffer cache; one shared file also shares its vnode. With a
+ * single filesystem lock neither case gets faster with more
+ * processes.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <err.h>
+#include <sys/wait.h>
+
+#define DEFAULT_PROCS 4
+#define DEFAULT_KB 128
+#define MAXPROCS 16
+#define PASSES 4
+#define CHUNK 4096
+
+static char buf[CHUNK];
+
+static
+void
+mkname(char *name, size_t len, unsigned n)
+{
+	snprintf(name, len, "parread.%u", n);
+}
+
+static
+void
+makefile(unsigned n, size_t bytes)
+{
+	char name[32];
+	size_t done;
+	int fd;
+
+	mkname(name, sizeof(name), n);
+	fd = open(name, O_WRONLY|O_CREAT|O_TRUNC, 0664);
+	if (fd < 0) {
+		err(1, "%s: open", name);
+	}
+	for (done = 0; done < bytes; done += CHUNK) {
+		buf[0] = (char)n;
+		if (write(fd, buf, CHUNK) != CHUNK) {
+			err(1, "%s: write", name);
+		}
+	}
+	close(fd);
+}
+
+/*
+ * Read file N from start to end PASSES times.
+ */
+static
+void
+readfile(unsigned n, size_t bytes)
+{
+	char name[32];
+	unsigned pass;
+	size_t done;
+	int fd, r;
+
+	mkname(name, sizeof(name), n);
+	fd = open(name, O_RDONLY);
+	if (fd < 0) {
+		err(1, "%s: open", name);
+	}
+	for (pass = 0; pass < PASSES; pass++) {
+		if (lseek(fd, 0, SEEK_SET) != 0) {
+			err(1, "%s: lseek", name);
+		}
+		for (done = 0; done < bytes; done += r) {
+			r = read(fd, buf, CHUNK);
+			if (r < 0) {
+				err(1, "%s: read", name);
+			}
+			if (r == 0) {
+				errx(1, "%s: early EOF", name);
+			}
+		}
+	}
+	close(fd);
+}
+
+/*
+ * Run NPROCS readers at once, each on its own file or all on file 0.
+ */
+static
+void
+run(unsigned nprocs, size_t bytes, int samefile)
+{
+	pid_t pids[MAXPROCS];
+	time_t s0, s1;
+	unsigned long ns0, ns1;
+	unsigned i;
+	long us;
+	int status, failed = 0;
+
+	__time(&s0, &ns0);
+	for (i=0; i<nprocs; i++) {
+		pids[i] = fork();
+		if (pids[i] < 0) {
+			err(1, "fork");
+		}
+		if (pids[i] == 0) {
+			readfile(samefile ? 0 : i, bytes);
+			_exit(0);
+		}
+	}
+	for (i=0; i<nprocs; i++) {
+		if (waitpid(pids[i], &status, 0) < 0) {
+			err(1, "waitpid");
+		}
+		if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+			failed = 1;
+		}
+	}
+	__time(&s1, &ns1);
+	if (failed) {
+		errx(1, "a reader failed");
+	}
+
+	us = (long)(s1 - s0) * 1000000L + ((long)ns1 - (long)ns0) / 1000;
+	if (us == 0) {
+		us = 1;
+	}
+	printf("%2u procs, %s: %8ld us  %6ld KB/s\n", nprocs,
+	       samefile ? "same file" : "own files", us,
+	       (long)((bytes / 1024) * PASSES * nprocs * 1000000L / us));
+}
+
+int
+main(int argc, char *argv[])
+{
+	char name[32];
+	unsigned nprocs, n, i;
+	size_t bytes;
+
+	nprocs = argc > 1 ? atoi(argv[1]) : DEFAULT_PROCS;
+	bytes = (argc > 2 ? atoi(argv[2]) : DEFAULT_KB) * 1024;
+	if (nprocs < 1 || nprocs > MAXPROCS || bytes < CHUNK) {
+		errx(1, "Usage: parread [nprocs (1-%d)] [kbytes]", MAXPROCS);
+	}
+
+	for (i=0; i<nprocs; i++) {
+		makefile(i, bytes);
+	}
+
+	/* Read everything once, so the first run isn't the only cold one. */
+	for (i=0; i<nprocs; i++) {
+		readfile(i, bytes);
+	}
+
+	for (n = 1; n <= nprocs; n *= 2) {
+		run(n, bytes, 0);
+		run(n, bytes, 1);
+	}
+	if (n / 2 != nprocs) {
+		run(nprocs, bytes, 0);
+		run(nprocs, bytes, 1);
+	}
+
+	for (i=0; i<nprocs; i++) {
+		mkname(name, sizeof(name), i);
+		remove(name);
+	}
+	return 0;
+}
@@ -0,0 +1,276 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * pipebench - pipe latency and throughput.
+ *
+ * Usage: pipebench [nrounds [kbytes]]
+ *
+ * Ping-pong: parent and child pass a one-byte message back and forth
+ * over two pipes nrounds (default 2000) times; prints the time per
+ * round trip. Every message goes to a reader that is already waiting
+ * for it.
+ *
+ * Streaming: the child writes kbytes (default 4096) KB into a pipe
+ * and the parent reads it and checks it, for a few combinations of
+ * write size and pipe buffer size; prints the throughput of each.
+ *
+ * Also checks non-blocking mode, EOF, and EPIPE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <err.h>
+#include <test/bench.h>
+#include <sys/ioctl.h>
+
+#define DEFAULT_NROUNDS 2000
+#define DEFAULT_KBYTES 4096
+#define MAXCHUNK 16384
+
+static char buf[MAXCHUNK];
+
+static
+void
+xpipe(int fds[2])
+{
+	if (pipe(fds) < 0) {
+		err(1, "pipe");
+	}
+}
+
+static
+void
+pingpong(unsigned nrounds)
+{
+	int down[2], up[2];
+	unsigned i;
+	pid_t pid;
+	char c;
+
+	xpipe(down);
+	xpipe(up);
+
+	pid = fork();
+	if (pid < 0) {
+		err(1, "fork");
+	}
+	if (pid == 0) {
+		close(down[1]);
+		close(up[0]);
+		for (i=0; i<nrounds; i++) {
+			if (read(down[0], &c, 1) != 1) {
+				_exit(1);
+			}
+			if (write(up[1], &c, 1) != 1) {
+				_exit(1);
+			}
+		}
+		_exit(0);
+	}
+	close(down[0]);
+	close(up[1]);
+
+	bench_start();
+	for (i=0; i<nrounds; i++) {
+		c = (char)i;
+		if (write(down[1], &c, 1) != 1) {
+			err(1, "ping");
+		}
+		if (read(up[0], &c, 1) != 1 || c != (char)i) {
+			errx(1, "bad pong");
+		}
+	}
+	bench_report("ping-pong", nrounds, "round trips");
+
+	close(down[1]);
+	close(up[0]);
+	bench_reap(pid);
+}
+
+static
+void
+fill(char *p, size_t len, unsigned long pos)
+{
+	size_t i;
+
+	for (i=0; i<len; i++) {
+		p[i] = (char)((pos + i) % 251);
+	}
+}
+
+/*
+ * Stream kbytes KB through a pipe of PIPESIZE bytes (0 for the
+ * default) in writes of CHUNK bytes.
+ */
+static
+void
+stream(unsigned kbytes, size_t chunk, int pipesize)
+{
+	char what[48];
+	unsigned long total, pos;
+	int fds[2];
+	size_t i;
+	pid_t pid;
+	int r;
+
+	xpipe(fds);
+	if (pipesize > 0 && ioctl(fds[1], PIPEIOC_SETSIZE, &pipesize) < 0) {
+		err(1, "PIPEIOC_SETSIZE");
+	}
+	if (ioctl(fds[1], PIPEIOC_GETSIZE, &pipesize) < 0) {
+		err(1, "PIPEIOC_GETSIZE");
+	}
+	total = kbytes * 1024UL;
+
+	pid = fork();
+	if (pid < 0) {
+		err(1, "fork");
+	}
+	if (pid == 0) {
+		close(fds[0]);
+		for (pos = 0; pos < total; pos += chunk) {
+			fill(buf, chunk, pos);
+			if (write(fds[1], buf, chunk) != (int)chunk) {
+				_exit(1);
+			}
+		}
+		_exit(0);
+	}
+	close(fds[1]);
+
+	pos = 0;
+	bench_start();
+	while ((r = read(fds[0], buf, MAXCHUNK)) > 0) {
+		for (i=0; i<(size_t)r; i++) {
+			if (buf[i] != (char)((pos + i) % 251)) {
+				errx(1, "stream: bad data at %lu", pos + i);
+			}
+		}
+		pos += r;
+	}
+	if (r < 0) {
+		err(1, "stream: read");
+	}
+	if (pos < total) {
+		errx(1, "stream: early EOF at %lu of %lu", pos, total);
+	}
+	snprintf(what, sizeof(what), "%lu-byte writes, %d-byte pipe",
+		 (unsigned long)chunk, pipesize);
+	bench_throughput(what, total);
+
+	close(fds[0]);
+	bench_reap(pid);
+}
+
+static
+void
+checks(void)
+{
+	int fds[2];
+	int on, size, avail, n, r;
+	char c;
+
+	xpipe(fds);
+
+	on = 1;
+	if (ioctl(fds[0], FIONBIO, &on) < 0 ||
+	    ioctl(fds[1], FIONBIO, &on) < 0) {
+		err(1, "FIONBIO");
+	}
+	if (read(fds[0], &c, 1) != -1 || errno != EAGAIN) {
+		errx(1, "read of an empty non-blocking pipe didn't fail "
+		     "with EAGAIN");
+	}
+
+	if (ioctl(fds[1], PIPEIOC_GETSIZE, &size) < 0) {
+		err(1, "PIPEIOC_GETSIZE");
+	}
+	memset(buf, 'x', sizeof(buf));
+	n = 0;
+	while ((r = write(fds[1], buf, 128)) > 0) {
+		n += r;
+	}
+	if (r != -1 || errno != EAGAIN) {
+		errx(1, "write to a full non-blocking pipe didn't fail "
+		     "with EAGAIN");
+	}
+	if (n != size) {
+		errx(1, "pipe held %d bytes, not %d", n, size);
+	}
+	if (ioctl(fds[0], FIONREAD, &avail) < 0 || avail != size) {
+		errx(1, "FIONREAD didn't report a full pipe");
+	}
+	if (lseek(fds[0], 0, SEEK_SET) != -1 || errno != ESPIPE) {
+		errx(1, "lseek on a pipe didn't fail with ESPIPE");
+	}
+
+	/* buffered data is still readable after the write end closes */
+	close(fds[1]);
+	n = 0;
+	while ((r = read(fds[0], buf, sizeof(buf))) > 0) {
+		n += r;
+	}
+	if (r != 0 || n != size) {
+		errx(1, "didn't read %d bytes then EOF", size);
+	}
+	close(fds[0]);
+
+	xpipe(fds);
+	close(fds[0]);
+	if (write(fds[1], &c, 1) != -1 || errno != EPIPE) {
+		errx(1, "write with no reader didn't fail with EPIPE");
+	}
+	close(fds[1]);
+
+	printf("non-blocking, EOF, and EPIPE checks ok\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+	unsigned nrounds, kbytes;
+
+	nrounds = argc > 1 ? atoi(argv[1]) : DEFAULT_NROUNDS;
+	kbytes = argc > 2 ? atoi(argv[2]) : DEFAULT_KBYTES;
+	if (nrounds == 0 || kbytes == 0) {
+		errx(1, "Usage: pipebench [nrounds [kbytes]]");
+	}
+
+	checks();
+	pingpong(nrounds);
+	stream(kbytes, 512, 0);
+	stream(kbytes, 4096, 0);
+	stream(kbytes, MAXCHUNK, 0);
+	stream(kbytes, MAXCHUNK, 65536);
+	return 0;
+}
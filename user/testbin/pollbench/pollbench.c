@@ -0,0 +1,277 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * pollbench - poll and select.
+ *
+ * Usage: pollbench [nrounds]
+ *
+ * A child writes a byte to one of npipes pipes, picked round-robin,
+ * and waits for an acknowledgement; the parent polls the read ends
+ * of all of them, reads the byte from whichever is ready, and
+ * acknowledges. This is done nrounds (default 500) times for several
+ * values of npipes, and the time per round is printed, for poll and
+ * then for select.
+ *
+ * Also checks timeouts, POLLHUP, POLLERR, POLLNVAL, and select's
+ * EBADF.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <err.h>
+#include <test/bench.h>
+#include <poll.h>
+#include <sys/select.h>
+
+#define DEFAULT_NROUNDS 500
+#define MAXPIPES 120
+
+static int rfds[MAXPIPES], wfds[MAXPIPES];
+static struct pollfd pfds[MAXPIPES];
+
+static
+void
+xpipe(int fds[2])
+{
+	if (pipe(fds) < 0) {
+		err(1, "pipe");
+	}
+}
+
+/*
+ * Find the one ready pipe, with poll or select, and return its index.
+ */
+static
+int
+waitready(int npipes, int usepoll)
+{
+	fd_set set;
+	int i, r, which;
+
+	if (usepoll) {
+		r = poll(pfds, npipes, INFTIM);
+		if (r != 1) {
+			err(1, "poll returned %d", r);
+		}
+		for (i=0; i<npipes; i++) {
+			if (pfds[i].revents == POLLIN) {
+				return i;
+			}
+		}
+		errx(1, "poll: nothing ready");
+	}
+
+	FD_ZERO(&set);
+	for (i=0; i<npipes; i++) {
+		FD_SET(rfds[i], &set);
+	}
+	r = select(rfds[npipes-1] + 1, &set, NULL, NULL, NULL);
+	if (r != 1) {
+		err(1, "select returned %d", r);
+	}
+	which = -1;
+	for (i=0; i<npipes; i++) {
+		if (FD_ISSET(rfds[i], &set)) {
+			which = i;
+		}
+	}
+	if (which < 0) {
+		errx(1, "select: nothing ready");
+	}
+	return which;
+}
+
+static
+void
+rounds(int npipes, unsigned nrounds, int usepoll)
+{
+	int ack[2], fds[2];
+	unsigned n;
+	int i;
+	char what[32];
+	pid_t pid;
+	char c;
+
+	for (i=0; i<npipes; i++) {
+		xpipe(fds);
+		rfds[i] = fds[0];
+		wfds[i] = fds[1];
+		pfds[i].fd = fds[0];
+		pfds[i].events = POLLIN;
+	}
+	xpipe(ack);
+
+	pid = fork();
+	if (pid < 0) {
+		err(1, "fork");
+	}
+	if (pid == 0) {
+		for (n=0; n<nrounds; n++) {
+			c = (char)n;
+			if (write(wfds[n % npipes], &c, 1) != 1 ||
+			    read(ack[0], &c, 1) != 1) {
+				_exit(1);
+			}
+		}
+		_exit(0);
+	}
+
+	bench_start();
+	for (n=0; n<nrounds; n++) {
+		i = waitready(npipes, usepoll);
+		if (i != (int)(n % npipes)) {
+			errx(1, "round %u: pipe %d ready, expected %u",
+			     n, i, n % npipes);
+		}
+		if (read(rfds[i], &c, 1) != 1 || c != (char)n) {
+			errx(1, "round %u: bad read", n);
+		}
+		if (write(ack[1], &c, 1) != 1) {
+			err(1, "ack");
+		}
+	}
+	snprintf(what, sizeof(what), "%s, %d pipes",
+		 usepoll ? "poll" : "select", npipes);
+	bench_report(what, nrounds, "rounds");
+
+	bench_reap(pid);
+	for (i=0; i<npipes; i++) {
+		close(rfds[i]);
+		close(wfds[i]);
+	}
+	close(ack[0]);
+	close(ack[1]);
+}
+
+static
+void
+checks(void)
+{
+	struct pollfd p[3];
+	struct timeval tv;
+	fd_set set;
+	int fds[2], fds2[2];
+	long us;
+
+	xpipe(fds);
+	xpipe(fds2);
+
+	/* nothing ready: timeout 0 returns at once, 100ms waits */
+	p[0].fd = fds[0];
+	p[0].events = POLLIN;
+	if (poll(p, 1, 0) != 0) {
+		errx(1, "poll of an empty pipe didn't return 0");
+	}
+	bench_start();
+	if (poll(p, 1, 100) != 0) {
+		errx(1, "poll with a timeout didn't return 0");
+	}
+	us = bench_elapsed();
+	if (us < 100000) {
+		errx(1, "poll timed out after %ld us, not 100000", us);
+	}
+
+	FD_ZERO(&set);
+	FD_SET(fds[0], &set);
+	tv.tv_sec = 0;
+	tv.tv_usec = 50000;
+	bench_start();
+	if (select(fds[0] + 1, &set, NULL, NULL, &tv) != 0) {
+		errx(1, "select with a timeout didn't return 0");
+	}
+	if (bench_elapsed() < 50000) {
+		errx(1, "select timed out early");
+	}
+
+	/* the write end of an empty pipe is writable */
+	p[0].fd = fds[1];
+	p[0].events = POLLIN | POLLOUT;
+	if (poll(p, 1, 0) != 1 || p[0].revents != POLLOUT) {
+		errx(1, "empty pipe's write end not just POLLOUT");
+	}
+
+	/* hangups, errors, and bad descriptors */
+	close(fds[1]);
+	close(fds2[0]);
+	p[0].fd = fds[0];
+	p[0].events = POLLIN;
+	p[1].fd = fds2[1];
+	p[1].events = POLLOUT;
+	p[2].fd = fds[1];
+	p[2].events = POLLIN;
+	if (poll(p, 3, INFTIM) != 3) {
+		errx(1, "poll didn't report all three");
+	}
+	if (p[0].revents != POLLHUP) {
+		errx(1, "no POLLHUP with the write end closed");
+	}
+	if (p[1].revents != POLLERR) {
+		errx(1, "no POLLERR with the read end closed");
+	}
+	if (p[2].revents != POLLNVAL) {
+		errx(1, "no POLLNVAL for a closed descriptor");
+	}
+
+	FD_ZERO(&set);
+	FD_SET(fds[1], &set);
+	if (select(fds[1] + 1, &set, NULL, NULL, NULL) != -1 ||
+	    errno != EBADF) {
+		errx(1, "select of a closed descriptor didn't fail "
+		     "with EBADF");
+	}
+
+	close(fds[0]);
+	close(fds2[1]);
+	printf("timeout and error checks ok\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+	static const int npipes[] = { 1, 10, 50, MAXPIPES };
+	unsigned nrounds, i;
+
+	nrounds = argc > 1 ? atoi(argv[1]) : DEFAULT_NROUNDS;
+	if (nrounds == 0) {
+		errx(1, "Usage: pollbench [nrounds]");
+	}
+
+	checks();
+	for (i=0; i<sizeof(npipes)/sizeof(npipes[0]); i++) {
+		rounds(npipes[i], nrounds, 1);
+	}
+	for (i=0; i<sizeof(npipes)/sizeof(npipes[0]); i++) {
+		rounds(npipes[i], nrounds, 0);
+	}
+	return 0;
+}
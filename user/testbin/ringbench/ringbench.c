@@ -0,0 +1,347 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * ringbench - batched system calls through the syscall ring.
+ *
+ * Usage: ringbench [nops]
+ *
+ * Does nops (default 4096) operations three ways, each first with one
+ * system call per operation and then through the ring, BATCH at a
+ * time with one ring_enter per batch: no-ops (getpid against
+ * RING_OP_NOP), 64-byte writes to a file, and 64-byte reads of it
+ * back. Prints the time per operation for each.
+ *
+ * Also runs open/write/fsync/close through the ring, and checks error
+ * completions and what happens when the completion queue is full.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <err.h>
+#include <test/bench.h>
+
+#define FILENAME "ringbench.tmp"
+#define DEFAULT_NOPS 4096
+#define NENTRIES 64
+#define BATCH 32
+#define RECSIZE 64
+
+static char ringmem[RING_SIZE(NENTRIES)] __attribute__((aligned(8)));
+static struct ring *ring = (struct ring *)ringmem;
+static char bufs[BATCH][RECSIZE];
+
+/*
+ * Queue one request. The caller makes sure there's room.
+ */
+static
+void
+submit(int op, int fd, void *buf, size_t len, off_t off, unsigned data)
+{
+	struct ring_sqe *sqe;
+
+	if (ring->r_sqtail - ring->r_sqhead >= NENTRIES) {
+		errx(1, "submission queue overflow");
+	}
+	sqe = &RING_SQ(ring)[ring->r_sqtail % NENTRIES];
+	sqe->sqe_op = op;
+	sqe->sqe_fd = fd;
+	sqe->sqe_off = off;
+	sqe->sqe_buf = buf;
+	sqe->sqe_len = len;
+	sqe->sqe_flags = 0;
+	sqe->sqe_data = data;
+	ring->r_sqtail++;
+}
+
+/*
+ * Take the next completion, which must exist.
+ */
+static
+struct ring_cqe
+reap(void)
+{
+	struct ring_cqe cqe;
+
+	if (ring->r_cqhead == ring->r_cqtail) {
+		errx(1, "no completion");
+	}
+	cqe = RING_CQ(ring, NENTRIES)[ring->r_cqhead % NENTRIES];
+	ring->r_cqhead++;
+	return cqe;
+}
+
+static
+void
+enter(unsigned n)
+{
+	int r;
+
+	r = ring_enter(n);
+	if (r < 0) {
+		err(1, "ring_enter");
+	}
+	if ((unsigned)r != n) {
+		errx(1, "ring_enter did %d of %u", r, n);
+	}
+}
+
+/*
+ * Reap N completions, each of which should be for request
+ * FIRST + i and have result EXPECT.
+ */
+static
+void
+reapall(unsigned n, unsigned first, int expect)
+{
+	struct ring_cqe cqe;
+	unsigned i;
+
+	for (i=0; i<n; i++) {
+		cqe = reap();
+		if (cqe.cqe_data != first + i) {
+			errx(1, "completion for %u, expected %u",
+			     cqe.cqe_data, first + i);
+		}
+		if (cqe.cqe_result != expect) {
+			errx(1, "request %u: result %d, expected %d",
+			     cqe.cqe_data, cqe.cqe_result, expect);
+		}
+	}
+}
+
+static
+void
+nops(unsigned n)
+{
+	unsigned i, j;
+
+	bench_start();
+	for (i=0; i<n; i++) {
+		getpid();
+	}
+	bench_report("getpid", n, "ops");
+
+	bench_start();
+	for (i=0; i<n; i += BATCH) {
+		for (j=0; j<BATCH; j++) {
+			submit(RING_OP_NOP, -1, NULL, 0, -1, i + j);
+		}
+		enter(BATCH);
+		reapall(BATCH, i, 0);
+	}
+	bench_report("ring nop", n, "ops");
+}
+
+static
+void
+fillrec(char *p, unsigned n)
+{
+	unsigned j;
+
+	for (j=0; j<RECSIZE; j++) {
+		p[j] = (char)(n * 7 + j);
+	}
+}
+
+static
+void
+writes(unsigned n)
+{
+	unsigned i, j;
+	int fd;
+
+	fd = open(FILENAME, O_WRONLY|O_CREAT|O_TRUNC, 0664);
+	if (fd < 0) {
+		err(1, "%s", FILENAME);
+	}
+	bench_start();
+	for (i=0; i<n; i++) {
+		fillrec(bufs[0], i);
+		if (write(fd, bufs[0], RECSIZE) != RECSIZE) {
+			err(1, "write");
+		}
+	}
+	bench_report("write", n, "ops");
+	close(fd);
+
+	fd = open(FILENAME, O_WRONLY|O_CREAT|O_TRUNC, 0664);
+	if (fd < 0) {
+		err(1, "%s", FILENAME);
+	}
+	bench_start();
+	for (i=0; i<n; i += BATCH) {
+		for (j=0; j<BATCH; j++) {
+			fillrec(bufs[j], i + j);
+			submit(RING_OP_WRITE, fd, bufs[j], RECSIZE, -1, i + j);
+		}
+		enter(BATCH);
+		reapall(BATCH, i, RECSIZE);
+	}
+	bench_report("ring write", n, "ops");
+	close(fd);
+}
+
+static
+void
+checkrec(const char *p, unsigned n)
+{
+	unsigned j;
+
+	for (j=0; j<RECSIZE; j++) {
+		if (p[j] != (char)(n * 7 + j)) {
+			errx(1, "record %u: bad data", n);
+		}
+	}
+}
+
+static
+void
+reads(unsigned n)
+{
+	unsigned i, j;
+	int fd;
+
+	fd = open(FILENAME, O_RDONLY);
+	if (fd < 0) {
+		err(1, "%s", FILENAME);
+	}
+	bench_start();
+	for (i=0; i<n; i++) {
+		if (read(fd, bufs[0], RECSIZE) != RECSIZE) {
+			err(1, "read");
+		}
+		checkrec(bufs[0], i);
+	}
+	bench_report("read", n, "ops");
+
+	/* positional this time, so the seek position doesn't matter */
+	bench_start();
+	for (i=0; i<n; i += BATCH) {
+		for (j=0; j<BATCH; j++) {
+			submit(RING_OP_READ, fd, bufs[j], RECSIZE,
+			       (off_t)(i + j) * RECSIZE, i + j);
+		}
+		enter(BATCH);
+		reapall(BATCH, i, RECSIZE);
+		for (j=0; j<BATCH; j++) {
+			checkrec(bufs[j], i + j);
+		}
+	}
+	bench_report("ring pread", n, "ops");
+	close(fd);
+}
+
+static
+void
+checks(void)
+{
+	struct ring_sqe *sqe;
+	struct ring_cqe cqe;
+	char path[] = FILENAME;
+	unsigned i;
+	int fd;
+
+	/* open, write, fsync, and close, all in one batch */
+	sqe = &RING_SQ(ring)[ring->r_sqtail % NENTRIES];
+	submit(RING_OP_OPEN, -1, path, 0664, -1, 0);
+	sqe->sqe_flags = O_WRONLY|O_CREAT|O_TRUNC;
+	enter(1);
+	cqe = reap();
+	if (cqe.cqe_result < 0) {
+		errno = -cqe.cqe_result;
+		err(1, "ring open");
+	}
+	fd = cqe.cqe_result;
+	fillrec(bufs[0], 0);
+	submit(RING_OP_WRITE, fd, bufs[0], RECSIZE, -1, 1);
+	submit(RING_OP_FSYNC, fd, NULL, 0, -1, 2);
+	submit(RING_OP_CLOSE, fd, NULL, 0, -1, 3);
+	enter(3);
+	if (reap().cqe_result != RECSIZE || reap().cqe_result != 0 ||
+	    reap().cqe_result != 0) {
+		errx(1, "ring write/fsync/close failed");
+	}
+	if (close(fd) != -1 || errno != EBADF) {
+		errx(1, "ring close didn't close the file");
+	}
+
+	/* errors come back in the completion */
+	submit(RING_OP_CLOSE, -1, NULL, 0, -1, 0);
+	submit(99, -1, NULL, 0, -1, 1);
+	enter(2);
+	reapall(1, 0, -EBADF);
+	reapall(1, 1, -ENOSYS);
+
+	/* a full completion queue stops ring_enter */
+	for (i=0; i<NENTRIES; i++) {
+		submit(RING_OP_NOP, -1, NULL, 0, -1, i);
+	}
+	enter(NENTRIES);
+	submit(RING_OP_NOP, -1, NULL, 0, -1, NENTRIES);
+	if (ring_enter(1) != 0) {
+		errx(1, "ring_enter overflowed the completion queue");
+	}
+	reapall(NENTRIES, 0, 0);
+	enter(1);
+	reapall(1, NENTRIES, 0);
+
+	if (ring_setup((struct ring *)(ringmem + 4), NENTRIES) != -1 ||
+	    errno != EINVAL) {
+		errx(1, "misaligned ring_setup didn't fail with EINVAL");
+	}
+	printf("ring checks ok\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+	unsigned n;
+
+	n = argc > 1 ? atoi(argv[1]) : DEFAULT_NOPS;
+	if (n == 0 || n % BATCH != 0) {
+		errx(1, "Usage: ringbench [nops], a multiple of %d", BATCH);
+	}
+
+	if (ring_setup(ring, NENTRIES) < 0) {
+		err(1, "ring_setup");
+	}
+
+	checks();
+	nops(n);
+	writes(n);
+	reads(n);
+
+	remove(FILENAME);
+	return 0;
+}
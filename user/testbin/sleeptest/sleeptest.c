@@ -0,0 +1,116 @@
+/*
+ * Copyright (c) 2013
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * sleeptest - check nanosleep accuracy.
+ *
+ * Sleeps for a range of intervals and reports how long each sleep
+ * actually took, according to __time. A sleep must never be shorter
+ * than asked for. Also sleeps until an absolute time with
+ * clock_nanosleep.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <err.h>
+
+static const long intervals_us[] = {
+	1, 500, 5000, 10000, 25000, 100000, 500000, 1000000,
+};
+#define NINTERVALS (sizeof(intervals_us) / sizeof(intervals_us[0]))
+
+#define NREPEATS 5
+
+static
+long
+now_diff_us(time_t s1, unsigned long ns1, time_t s2, unsigned long ns2)
+{
+	return (long)(s2 - s1) * 1000000L + ((long)ns2 - (long)ns1) / 1000;
+}
+
+int
+main(void)
+{
+	struct timespec req;
+	time_t s1, s2;
+	unsigned long ns1, ns2;
+	long got, late, maxlate;
+	unsigned i, j;
+	int result, bad = 0;
+
+	printf("%10s %12s %12s\n", "asked(us)", "avg late(us)", "max late(us)");
+	for (i=0; i<NINTERVALS; i++) {
+		req.tv_sec = intervals_us[i] / 1000000;
+		req.tv_nsec = (intervals_us[i] % 1000000) * 1000;
+		late = maxlate = 0;
+		for (j=0; j<NREPEATS; j++) {
+			__time(&s1, &ns1);
+			if (nanosleep(&req, NULL)) {
+				err(1, "nanosleep");
+			}
+			__time(&s2, &ns2);
+			got = now_diff_us(s1, ns1, s2, ns2);
+			if (got < intervals_us[i]) {
+				warnx("slept %ld us, asked for %ld",
+				      got, intervals_us[i]);
+				bad = 1;
+			}
+			late += got - intervals_us[i];
+			if (got - intervals_us[i] > maxlate) {
+				maxlate = got - intervals_us[i];
+			}
+		}
+		printf("%10ld %12ld %12ld\n", intervals_us[i],
+		       late / NREPEATS, maxlate);
+	}
+
+	/* Absolute sleep: a quarter second from now. */
+	__time(&s1, &ns1);
+	req.tv_sec = s1;
+	req.tv_nsec = ns1 + 250000000;
+	if (req.tv_nsec >= 1000000000) {
+		req.tv_sec++;
+		req.tv_nsec -= 1000000000;
+	}
+	result = clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &req, NULL);
+	if (result) {
+		errx(1, "clock_nanosleep: %s", strerror(result));
+	}
+	__time(&s2, &ns2);
+	got = now_diff_us(s1, ns1, s2, ns2);
+	printf("absolute 250000 us: took %ld us\n", got);
+	if (got < 250000) {
+		warnx("absolute sleep returned early");
+		bad = 1;
+	}
+
+	printf("sleeptest %s\n", bad ? "FAILED" : "done");
+	return bad;
+}
@@ -0,0 +1,152 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * spawnbench - how fast can we start programs?
+ *
+ * Usage: spawnbench [count]
+ *
+ * Runs /bin/true count times (default 200), waiting for each, with
+ * fork+execv, vfork+execv, and posix_spawn, and reports spawns per
+ * second for each. fork copies our whole address space only for
+ * execv to throw it away; vfork lends it to the child instead, and
+ * posix_spawn never involves it at all. To make the copy show, we
+ * carry around a BALLAST-byte array that fork has to duplicate.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <spawn.h>
+#include <errno.h>
+#include <err.h>
+#include <test/bench.h>
+
+#define DEFAULT_COUNT 200
+#define BALLAST (64 * 1024)
+#define PROG "/bin/true"
+
+static char ballast[BALLAST];
+
+static
+void
+run_fork(int count)
+{
+	char *args[2] = { (char *)PROG, NULL };
+	pid_t pid;
+	int i;
+
+	bench_start();
+	for (i=0; i<count; i++) {
+		pid = fork();
+		if (pid < 0) {
+			err(1, "fork");
+		}
+		if (pid == 0) {
+			execv(PROG, args);
+			_exit(1);
+		}
+		bench_reap(pid);
+	}
+	bench_report("fork+execv", count, "runs");
+}
+
+static
+void
+run_vfork(int count)
+{
+	char *args[2] = { (char *)PROG, NULL };
+	pid_t pid;
+	int i;
+
+	bench_start();
+	for (i=0; i<count; i++) {
+		pid = vfork();
+		if (pid < 0) {
+			err(1, "vfork");
+		}
+		if (pid == 0) {
+			/* only exec or exit here; we're in our parent's memory */
+			execv(PROG, args);
+			_exit(1);
+		}
+		bench_reap(pid);
+	}
+	bench_report("vfork+execv", count, "runs");
+}
+
+static
+void
+run_spawn(int count)
+{
+	char *args[2] = { (char *)PROG, NULL };
+	pid_t pid;
+	int i, result;
+
+	bench_start();
+	for (i=0; i<count; i++) {
+		result = posix_spawn(&pid, PROG, NULL, NULL, args, NULL);
+		if (result) {
+			errno = result;
+			err(1, "posix_spawn");
+		}
+		bench_reap(pid);
+	}
+	bench_report("posix_spawn", count, "runs");
+}
+
+int
+main(int argc, char *argv[])
+{
+	char *args[2] = { (char *)"/nonexistent", NULL };
+	pid_t pid;
+	int count, i;
+
+	count = argc > 1 ? atoi(argv[1]) : DEFAULT_COUNT;
+	if (count <= 0) {
+		errx(1, "Usage: spawnbench [count]");
+	}
+
+	/* touch the ballast so it's really there for fork to copy */
+	for (i=0; i<BALLAST; i+=4096) {
+		ballast[i] = 1;
+	}
+
+	if (posix_spawn(&pid, args[0], NULL, NULL, args, NULL) != ENOENT) {
+		errx(1, "posix_spawn of a missing program didn't fail "
+		     "with ENOENT");
+	}
+
+	run_fork(count);
+	run_vfork(count);
+	run_spawn(count);
+
+	printf("spawnbench done\n");
+	return 0;
+}